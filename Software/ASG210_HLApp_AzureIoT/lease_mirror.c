@@ -0,0 +1,119 @@
+#include <string.h>
+#include <time.h>
+
+#include "lease_mirror.h"
+
+typedef struct
+{
+    intercore_lease_entry entry;
+    time_t expires; // CLOCK_MONOTONIC seconds
+} MirroredLease;
+
+static MirroredLease leases[LEASE_MIRROR_MAX];
+static size_t leaseCount = 0;
+
+static time_t Now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+static void RemoveAt(size_t i)
+{
+    leases[i] = leases[--leaseCount];
+}
+
+static void RemoveExpired(time_t now)
+{
+    for (size_t i = leaseCount; i-- > 0;)
+    {
+        if (leases[i].expires <= now)
+            RemoveAt(i);
+    }
+}
+
+void LeaseMirror_Update(const intercore_lease_entry *entries, size_t count)
+{
+    time_t now = Now();
+    RemoveExpired(now);
+
+    for (size_t e = 0; e < count; e++)
+    {
+        const intercore_lease_entry *entry = &entries[e];
+
+        // The RT app only reports the latest state of an address; a lease that
+        // moved to another client was never reported as ended.
+        for (size_t i = leaseCount; i-- > 0;)
+        {
+            if (memcmp(leases[i].entry.ip, entry->ip, sizeof(entry->ip)) == 0 ||
+                (entry->bound && memcmp(leases[i].entry.mac, entry->mac, sizeof(entry->mac)) == 0))
+                RemoveAt(i);
+        }
+
+        if (entry->bound && entry->remaining > 0 && leaseCount < LEASE_MIRROR_MAX)
+        {
+            leases[leaseCount].entry = *entry;
+            leases[leaseCount].expires = now + (time_t)entry->remaining;
+            leaseCount++;
+        }
+    }
+}
+
+size_t LeaseMirror_Count(void)
+{
+    RemoveExpired(Now());
+    return leaseCount;
+}
+
+static size_t BuildFrame(uint8_t *buf, size_t size, uint8_t flags, const void *data, size_t len)
+{
+    intercore_batch_header batch = {.magic = INTERCORE_BATCH_MAGIC,
+                                    .version = INTERCORE_BATCH_VERSION,
+                                    .count = 1,
+                                    .epoch = 0,
+                                    .tick = 0};
+    intercore_record_header rec = {.len = (uint16_t)len, .socket = 0, .flags = flags, .tick = 0};
+
+    if (size < sizeof(batch) + sizeof(rec) + len)
+        return 0;
+
+    memcpy(buf, &batch, sizeof(batch));
+    memcpy(buf + sizeof(batch), &rec, sizeof(rec));
+    memcpy(buf + sizeof(batch) + sizeof(rec), data, len);
+    return sizeof(batch) + sizeof(rec) + len;
+}
+
+size_t LeaseMirror_BuildFrame(uint8_t *buf, size_t size, size_t *cursor)
+{
+    static intercore_lease_entry entries[LEASE_MIRROR_MAX];
+    const size_t overhead = sizeof(intercore_batch_header) + sizeof(intercore_record_header);
+    time_t now = Now();
+    size_t count = 0;
+
+    if (*cursor == 0)
+        RemoveExpired(now);
+    if (size <= overhead || *cursor >= leaseCount)
+        return 0;
+
+    size_t room = (size - overhead) / sizeof(intercore_lease_entry);
+    for (; *cursor < leaseCount && count < room; (*cursor)++)
+    {
+        if (leases[*cursor].expires <= now)
+            continue;
+        entries[count] = leases[*cursor].entry;
+        entries[count].remaining = (uint32_t)(leases[*cursor].expires - now);
+        count++;
+    }
+    if (count == 0)
+        return 0;
+
+    return BuildFrame(buf, size, INTERCORE_RECORD_LEASE, entries,
+                      count * sizeof(intercore_lease_entry));
+}
+
+size_t LeaseMirror_BuildRequest(uint8_t *buf, size_t size)
+{
+    static const uint8_t version = INTERCORE_BATCH_VERSION;
+    return BuildFrame(buf, size, INTERCORE_RECORD_LEASE_REQUEST, &version, sizeof(version));
+}
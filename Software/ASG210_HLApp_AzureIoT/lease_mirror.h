@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "intercore_batch.h"
+
+/// <summary>
+/// Most leases kept; the RT DHCP server hands out at most one per host number.
+/// </summary>
+#define LEASE_MIRROR_MAX 256
+
+/// <summary>
+/// Apply lease entries reported by the RT app. A bound entry replaces any lease
+/// for the same address or MAC, an unbound one removes the lease of its address.
+/// </summary>
+void LeaseMirror_Update(const intercore_lease_entry *entries, size_t count);
+
+/// <summary>
+/// Number of leases that have not expired.
+/// </summary>
+size_t LeaseMirror_Count(void);
+
+/// <summary>
+/// Write the leases that have not expired, with their remaining time, as one
+/// batch frame for the RT app. Call repeatedly until it returns 0.
+/// </summary>
+/// <param name="cursor">Lease to start at, 0 for the first frame; updated.</param>
+/// <returns>Frame length, or 0 when all leases were written.</returns>
+size_t LeaseMirror_BuildFrame(uint8_t *buf, size_t size, size_t *cursor);
+
+/// <summary>
+/// Write a batch frame asking the RT app to report all of its leases.
+/// </summary>
+/// <returns>Frame length, or 0 if buf is too small.</returns>
+size_t LeaseMirror_BuildRequest(uint8_t *buf, size_t size);
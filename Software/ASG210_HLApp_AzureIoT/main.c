@@ -95,6 +95,10 @@ typedef enum
     ExitCode_SocketHandler_Recv = 17,
     ExitCode_TimerHandler_Consume = 18,
     ExitCode_Init_SendTimer = 19,
+    ExitCode_Init_BatchTimer = 20,
+    ExitCode_BatchTimer_Consume = 21,
+    ExitCode_Init_QueueDrainTimer = 22,
+    ExitCode_QueueDrainTimer_Consume = 23,
 } ExitCode;
 
 static int sockFd = -1;
@@ -109,6 +113,10 @@ static volatile sig_atomic_t exitCode = ExitCode_Success;
 #undef SIMUL_DATA
 
 #include "parson.h" // used to parse Device Twin messages.
+#include "intercore_batch.h" // RT app <-> HL app batch frames
+#include "telemetry_batch.h"
+#include "telemetry_queue.h"
+#include "lease_mirror.h"
 
 // Azure IoT Hub/Central defines.
 #define SCOPEID_LENGTH 20
@@ -119,6 +127,14 @@ static const char rtAppComponentId[] = "005180bc-402f-4cb3-a662-72937dbcde47";
 static void SendToRTApp(char* buf);
 static void SendTimeData(void);
 static void AppSocketEventHandler(EventLoop *el, int fd, EventLoop_IoEvents events, void *context);
+static bool HandleRTAppBatch(const uint8_t *buf, size_t len);
+static void HandleRTAppRecord(const char *data);
+static void HandleRTAppLeases(const intercore_record_header *rec, const uint8_t *data);
+static void SendLeasesToRTApp(void);
+static void HandleRTAppBufferProfile(const intercore_record_header *rec, const uint8_t *data);
+static bool SendBufferProfileToRTApp(uint8_t profile);
+static void HandleRTAppProbe(const intercore_record_header *rec, const uint8_t *data);
+static void SendProbeCommandToRTApp(uint8_t command);
 static IOTHUB_DEVICE_CLIENT_LL_HANDLE iothubClientHandle = NULL;
 static const int keepalivePeriodSeconds = 20;
 static bool iothubAuthenticated = false;
@@ -148,7 +164,14 @@ static void GetSystemTime(void);
 static void SendSimulatedTemperature(void);
 static void SendTelemetry(const unsigned char *key, const unsigned char *value);
 #endif
-static void SendJsonTelemetry(const unsigned char *value);
+static bool SendJsonTelemetry(const unsigned char *value, time_t enqueuedAt);
+static void SendBatchedTelemetry(const char *json, unsigned int records);
+static void BatchTimerEventHandler(EventLoopTimer *timer);
+static bool SendQueuedTelemetry(const char *data, size_t len, time_t enqueuedAt);
+static void QueueDrainTimerEventHandler(EventLoopTimer *timer);
+static void TwinUpdateTelemetryBatch(const JSON_Object *desiredProperties);
+static void TwinUpdateBufferProfile(const JSON_Object *desiredProperties);
+static void TwinUpdateCycleProbes(const JSON_Object *desiredProperties);
 
 // Initialization/Cleanup
 static ExitCode InitPeripheralsAndHandlers(void);
@@ -188,6 +211,12 @@ static int bleStatusLedGpioFd = -1;
 // static int deviceTwinStatusLedGpioFd = -1;
 static bool statusLedOn = false;
 
+// Buffer profile last forwarded to the RT app, -1 for none yet
+static int bufferProfileSent = -1;
+
+// $version of the desired properties last handled, -1 for none yet
+static double desiredVersionSeen = -1;
+
 // Timer / polling
 static EventLoop *eventLoop = NULL;
 static EventLoopTimer *azureTimer = NULL;
@@ -196,6 +225,18 @@ static EventLoopTimer *azureTimer = NULL;
 static EventRegistration *socketEventReg = NULL;
 static EventLoopTimer *sendTimer = NULL;
 
+// Telemetry batching, closes a batch once its window has passed
+static EventLoopTimer *batchTimer = NULL;
+
+// Store-and-forward queue for telemetry that could not be sent, spilled to
+// mutable storage (see MutableStorage in app_manifest.json) and drained at
+// TelemetryQueueDrainPerTick messages per TelemetryQueueDrainPeriodMs.
+static EventLoopTimer *queueDrainTimer = NULL;
+static int telemetryQueueFd = -1;
+static const size_t TelemetryQueueStorageBytes = 64 * 1024;
+static const unsigned int TelemetryQueueDrainPerTick = 4;
+static const long TelemetryQueueDrainPeriodMs = 1000;
+
 // Azure IoT poll periods
 // static const int AzureIoTDefaultPollPeriodSeconds = 60;
 static const int AzureIoTDefaultPollPeriodSeconds = 10;
@@ -293,6 +334,14 @@ static ExitCode InitApplicationSocket(void)
         return ExitCode_Init_RegisterIo;
     }
 
+    // The RT app may have been running without us; have it report its DHCP leases.
+    uint8_t request[INTERCORE_BATCH_MAX];
+    size_t requestLen = LeaseMirror_BuildRequest(request, sizeof(request));
+    if (send(sockFd, request, requestLen, 0) == -1)
+    {
+        Log_Debug("ERROR: Unable to send lease request: %d (%s)\n", errno, strerror(errno));
+    }
+
     return ExitCode_Success;
 }
 
@@ -387,15 +436,25 @@ static void GetSystemTime(void)
     }
 }
 
+/// <summary>
+///     Send the system time to the RT app SNTP server as "%Y-%m-%d %H:%M:%S.uuuuuu".
+///     The RT app slews its clock toward it, so the microseconds matter.
+/// </summary>
 static void SendTimeData(void)
 {
     char timeBuf[64];
-    time_t t;
-    time(&t);
-    struct tm *tm = gmtime(&t);
-    if (strftime(timeBuf, sizeof(timeBuf), "%Y-%m-%d %H:%M:%S", tm) == 0) {
+    struct timespec now;
+    if (clock_gettime(CLOCK_REALTIME, &now) == -1) {
+        Log_Debug("INFO: Time data failed\n");
+        return;
+    }
+    struct tm *tm = gmtime(&now.tv_sec);
+    size_t len = strftime(timeBuf, sizeof(timeBuf), "%Y-%m-%d %H:%M:%S", tm);
+    if (len == 0) {
         Log_Debug("INFO: Time data failed\n");
+        return;
     }
+    snprintf(timeBuf + len, sizeof(timeBuf) - len, ".%06ld", now.tv_nsec / 1000);
 
     int bytesSent = send(sockFd, timeBuf, strlen(timeBuf), 0);
     if (bytesSent == -1) {
@@ -423,15 +482,11 @@ static void SendToRTApp(char* buf)
 /// </summary>
 static void AppSocketEventHandler(EventLoop *el, int fd, EventLoop_IoEvents events, void *context)
 {
-    // Read response from real-time capable application.
-    // If the RTApp has sent more than 32 bytes, then truncate.
-    // char rxBuf[32];
-    char rxBuf[256] = {0};
-    // for (int i = 0; i < sizeof(rxBuf); i++) {
-    //     rxBuf[i] = NULL;
-    // }
+    // Read a batch frame, or a plain text message, from the real-time capable application.
+    // Keep one byte for the terminator of the plain text case.
+    static uint8_t rxBuf[INTERCORE_BATCH_MAX + 1];
 
-    int bytesReceived = recv(fd, rxBuf, sizeof(rxBuf), 0);
+    int bytesReceived = recv(fd, rxBuf, INTERCORE_BATCH_MAX, 0);
 
 #if 1 //lawrence
     if (eth1StatusLedGpioFd >= 0)
@@ -453,21 +508,291 @@ static void AppSocketEventHandler(EventLoop *el, int fd, EventLoop_IoEvents even
         return;
     }
 
-    Log_Debug("Received %d bytes: %s\r\n", bytesReceived, rxBuf);
+    if (!HandleRTAppBatch(rxBuf, (size_t)bytesReceived))
+    {
+        rxBuf[bytesReceived] = '\0';
+        Log_Debug("Received %d bytes: %s\r\n", bytesReceived, rxBuf);
+        HandleRTAppRecord((const char *)rxBuf);
+    }
+}
 
-#if 1
-    // Send received data from RT Core to IoT Hub
-    if (iothubAuthenticated)
+/// <summary>
+///     Split a batch frame from the real-time capable application into its records.
+/// </summary>
+/// <returns>false if buf is not a batch frame</returns>
+static bool HandleRTAppBatch(const uint8_t *buf, size_t len)
+{
+    static char record[INTERCORE_BATCH_MAX + 1];
+    intercore_batch_header batch;
+    intercore_record_header rec;
+    size_t offset = sizeof(batch);
+
+    if (len < sizeof(batch))
+        return false;
+
+    memcpy(&batch, buf, sizeof(batch));
+    if (batch.magic != INTERCORE_BATCH_MAGIC || batch.version != INTERCORE_BATCH_VERSION)
+        return false;
+
+    Log_Debug("Received batch of %u records (%zu bytes)\r\n", batch.count, len);
+
+    for (unsigned int i = 0; i < batch.count; i++)
     {
-        // SendTelemetry("RTdata", rxBuf);
-        SendJsonTelemetry(rxBuf);
-        IoTHubDeviceClient_LL_DoWork(iothubClientHandle);
+        if (len - offset < sizeof(rec))
+        {
+            Log_Debug("ERROR: Truncated batch, record %u of %u\n", i, batch.count);
+            break;
+        }
+        memcpy(&rec, buf + offset, sizeof(rec));
+        offset += sizeof(rec);
+
+        if (rec.len > len - offset)
+        {
+            Log_Debug("ERROR: Truncated batch, record %u of %u\n", i, batch.count);
+            break;
+        }
+        if (rec.flags & (INTERCORE_RECORD_LEASE | INTERCORE_RECORD_LEASE_REQUEST))
+        {
+            HandleRTAppLeases(&rec, buf + offset);
+            offset += rec.len;
+            continue;
+        }
+        if (rec.flags & INTERCORE_RECORD_BUFFER_PROFILE)
+        {
+            HandleRTAppBufferProfile(&rec, buf + offset);
+            offset += rec.len;
+            continue;
+        }
+        if (rec.flags & INTERCORE_RECORD_PROBE)
+        {
+            HandleRTAppProbe(&rec, buf + offset);
+            offset += rec.len;
+            continue;
+        }
+        memcpy(record, buf + offset, rec.len);
+        record[rec.len] = '\0';
+        offset += rec.len;
+
+        // rec.tick and batch.tick share the RT millisecond clock.
+        Log_Debug("Socket %u, %u bytes, %u ms before flush: %s\r\n", rec.socket, rec.len,
+                  batch.tick - rec.tick, record);
+        HandleRTAppRecord(record);
     }
-    else
+
+    return true;
+}
+
+/// <summary>
+///     Keep the DHCP server leases reported by the real-time capable application, and
+///     send them back when it asks after a restart.
+/// </summary>
+static void HandleRTAppLeases(const intercore_record_header *rec, const uint8_t *data)
+{
+    if (rec->flags & INTERCORE_RECORD_LEASE)
+    {
+        static intercore_lease_entry entries[INTERCORE_BATCH_MAX / sizeof(intercore_lease_entry)];
+        size_t count = rec->len / sizeof(intercore_lease_entry);
+
+        memcpy(entries, data, count * sizeof(intercore_lease_entry));
+        LeaseMirror_Update(entries, count);
+        Log_Debug("Lease update, %zu entries, %zu leases kept\r\n", count, LeaseMirror_Count());
+    }
+
+    if (rec->flags & INTERCORE_RECORD_LEASE_REQUEST)
     {
-        Log_Debug("Iot Hub not authenticated.\r\n");
+        Log_Debug("RT app asked for its %zu leases\r\n", LeaseMirror_Count());
+        SendLeasesToRTApp();
+    }
+}
+
+/// <summary>
+///     Restore the DHCP server leases of the real-time capable application.
+/// </summary>
+static void SendLeasesToRTApp(void)
+{
+    static uint8_t frame[INTERCORE_BATCH_MAX];
+    size_t cursor = 0;
+    size_t len;
+
+    while ((len = LeaseMirror_BuildFrame(frame, sizeof(frame), &cursor)) > 0)
+    {
+        if (send(sockFd, frame, len, 0) == -1)
+        {
+            Log_Debug("ERROR: Unable to send leases: %d (%s)\n", errno, strerror(errno));
+            return;
+        }
+    }
+}
+
+/// <summary>
+///     W5500 socket buffer profile names used in the device twin, indexed by INTERCORE_BUFFER_*.
+/// </summary>
+static const char *const bufferProfileNames[INTERCORE_BUFFER_PROFILES] = {"balanced", "bulk",
+                                                                          "small_udp"};
+
+/// <summary>
+///     Report the socket buffer sizes the real-time capable application applied.
+/// </summary>
+static void HandleRTAppBufferProfile(const intercore_record_header *rec, const uint8_t *data)
+{
+    intercore_buffer_profile answer;
+
+    if (rec->len < sizeof(answer))
+    {
+        Log_Debug("ERROR: Short buffer profile record, %u bytes\n", rec->len);
+        return;
+    }
+    memcpy(&answer, data, sizeof(answer));
+
+    const char *name =
+        answer.profile < INTERCORE_BUFFER_PROFILES ? bufferProfileNames[answer.profile] : "unknown";
+    Log_Debug("RT app buffer profile %s: %s\n", name, answer.status == 0 ? "applied" : "rejected");
+    if (answer.status != 0)
+    {
+        // Let the next twin update try again.
+        bufferProfileSent = -1;
+    }
+
+    static char reportedState[256];
+    int len = snprintf(reportedState, sizeof(reportedState),
+                       "{\"BufferProfile\":{\"profile\":\"%s\",\"applied\":%s,\"txKB\":[", name,
+                       answer.status == 0 ? "true" : "false");
+    for (int i = 0; i < INTERCORE_BUFFER_SOCKETS; i++)
+    {
+        len += snprintf(reportedState + len, sizeof(reportedState) - (size_t)len, "%s%u",
+                        i ? "," : "", answer.tx_kb[i]);
+    }
+    len += snprintf(reportedState + len, sizeof(reportedState) - (size_t)len, "],\"rxKB\":[");
+    for (int i = 0; i < INTERCORE_BUFFER_SOCKETS; i++)
+    {
+        len += snprintf(reportedState + len, sizeof(reportedState) - (size_t)len, "%s%u",
+                        i ? "," : "", answer.rx_kb[i]);
+    }
+    snprintf(reportedState + len, sizeof(reportedState) - (size_t)len, "]}}");
+    TwinReportState(reportedState);
+}
+
+/// <summary>
+///     Ask the real-time capable application to switch its socket buffer profile.
+///     This drops the connections of its W5500 sockets.
+/// </summary>
+/// <returns>true if the request was sent</returns>
+static bool SendBufferProfileToRTApp(uint8_t profile)
+{
+    uint8_t frame[sizeof(intercore_batch_header) + sizeof(intercore_record_header) +
+                  sizeof(intercore_buffer_profile)];
+    intercore_batch_header batch = {.magic = INTERCORE_BATCH_MAGIC,
+                                    .version = INTERCORE_BATCH_VERSION,
+                                    .count = 1,
+                                    .epoch = 0,
+                                    .tick = 0};
+    intercore_record_header rec = {.len = sizeof(intercore_buffer_profile),
+                                   .socket = 0,
+                                   .flags = INTERCORE_RECORD_BUFFER_PROFILE,
+                                   .tick = 0};
+    intercore_buffer_profile command = {.profile = profile};
+
+    memcpy(frame, &batch, sizeof(batch));
+    memcpy(frame + sizeof(batch), &rec, sizeof(rec));
+    memcpy(frame + sizeof(batch) + sizeof(rec), &command, sizeof(command));
+
+    if (send(sockFd, frame, sizeof(frame), 0) == -1)
+    {
+        Log_Debug("ERROR: Unable to send buffer profile: %d (%s)\n", errno, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/// <summary>
+///     Names of the cycle probes of the real-time capable application, indexed by INTERCORE_PROBE_*.
+/// </summary>
+static const char *const probeNames[INTERCORE_PROBE_COUNT] = {
+    "spim_transfer", "spim_queue_flush", "wiz_send_data", "wiz_recv_data", "mbox_enqueue",
+    "mbox_dequeue",  "dhcps_run",        "SNTPs_run",     "loopback",      "mbox_tcp_server"};
+
+/// <summary>
+///     Log one cycle probe of the real-time capable application.
+/// </summary>
+static void HandleRTAppProbe(const intercore_record_header *rec, const uint8_t *data)
+{
+    intercore_probe_entry entry;
+
+    if (rec->len < sizeof(entry))
+    {
+        Log_Debug("ERROR: Short cycle probe record, %u bytes\n", rec->len);
+        return;
+    }
+    memcpy(&entry, data, sizeof(entry));
+
+    const char *name = entry.id < INTERCORE_PROBE_COUNT ? probeNames[entry.id] : "unknown";
+    const double cyclesPerUs = INTERCORE_PROBE_CPU_HZ / 1e6;
+    Log_Debug("RT probe %-16s %8u calls, min %.2f us, mean %.2f us, max %.2f us\n", name,
+              entry.count, entry.min / cyclesPerUs, entry.mean / cyclesPerUs,
+              entry.max / cyclesPerUs);
+    if (entry.count == 0)
+    {
+        return;
+    }
+
+    // Bucket i ends at 2^(i + shift + 1) cycles; the last one is open ended.
+    static char histogram[INTERCORE_PROBE_BUCKETS * 24];
+    int len = 0;
+    for (int i = 0; i < INTERCORE_PROBE_BUCKETS; i++)
+    {
+        if (entry.hist[i] == 0)
+        {
+            continue;
+        }
+        double bound = (double)(1u << (i + INTERCORE_PROBE_BUCKET_SHIFT + 1)) / cyclesPerUs;
+        len += snprintf(histogram + len, sizeof(histogram) - (size_t)len, " %s%.1fus:%u",
+                        i + 1 < INTERCORE_PROBE_BUCKETS ? "<" : ">=",
+                        i + 1 < INTERCORE_PROBE_BUCKETS ? bound : bound / 2, entry.hist[i]);
+    }
+    Log_Debug("    %s\n", histogram);
+}
+
+/// <summary>
+///     Ask the real-time capable application for its cycle probes, INTERCORE_PROBE_CMD_* bits.
+/// </summary>
+static void SendProbeCommandToRTApp(uint8_t command)
+{
+    uint8_t frame[sizeof(intercore_batch_header) + sizeof(intercore_record_header) +
+                  sizeof(command)];
+    intercore_batch_header batch = {.magic = INTERCORE_BATCH_MAGIC,
+                                    .version = INTERCORE_BATCH_VERSION,
+                                    .count = 1,
+                                    .epoch = 0,
+                                    .tick = 0};
+    intercore_record_header rec = {
+        .len = sizeof(command), .socket = 0, .flags = INTERCORE_RECORD_PROBE, .tick = 0};
+
+    memcpy(frame, &batch, sizeof(batch));
+    memcpy(frame + sizeof(batch), &rec, sizeof(rec));
+    memcpy(frame + sizeof(batch) + sizeof(rec), &command, sizeof(command));
+
+    if (send(sockFd, frame, sizeof(frame), 0) == -1)
+    {
+        Log_Debug("ERROR: Unable to send probe command: %d (%s)\n", errno, strerror(errno));
+    }
+}
+
+/// <summary>
+///     Forward one message from the real-time capable application to IoT Hub.
+/// </summary>
+static void HandleRTAppRecord(const char *data)
+{
+    // Send received data from RT Core to IoT Hub, batched. While IoT Hub is not
+    // reachable the batches go to the store-and-forward queue.
+    TelemetryBatchConfig config;
+    TelemetryBatch_GetConfig(&config);
+
+    if (TelemetryBatch_Add(data) == 1 && config.windowMs > 0)
+    {
+        struct timespec window = {.tv_sec = config.windowMs / 1000,
+                                  .tv_nsec = (config.windowMs % 1000) * 1000000};
+        SetEventLoopTimerOneShot(batchTimer, &window);
     }
-#endif
 }
 
 /// <summary>
@@ -876,6 +1201,36 @@ static ExitCode InitPeripheralsAndHandlers(void)
         return ExitCode_Init_AzureTimer;
     }
 
+    TelemetryBatch_Init(NULL, SendBatchedTelemetry);
+    batchTimer = CreateEventLoopDisarmedTimer(eventLoop, &BatchTimerEventHandler);
+    if (batchTimer == NULL)
+    {
+        return ExitCode_Init_BatchTimer;
+    }
+
+    telemetryQueueFd = Storage_OpenMutableFile();
+    if (telemetryQueueFd < 0)
+    {
+        Log_Debug("WARNING: Could not open mutable storage: %s (%d).\n", strerror(errno), errno);
+    }
+    if (TelemetryQueue_Open(telemetryQueueFd, TelemetryQueueStorageBytes) != 0)
+    {
+        Log_Debug("WARNING: Telemetry queue is kept in RAM only.\n");
+    }
+    else
+    {
+        Log_Debug("INFO: Telemetry queue recovered %zu messages.\n", TelemetryQueue_Pending());
+    }
+
+    struct timespec queueDrainPeriod = {.tv_sec = TelemetryQueueDrainPeriodMs / 1000,
+                                        .tv_nsec = (TelemetryQueueDrainPeriodMs % 1000) * 1000000};
+    queueDrainTimer =
+        CreateEventLoopPeriodicTimer(eventLoop, &QueueDrainTimerEventHandler, &queueDrainPeriod);
+    if (queueDrainTimer == NULL)
+    {
+        return ExitCode_Init_QueueDrainTimer;
+    }
+
     InitApplicationSocket();
 
     return ExitCode_Success;
@@ -953,6 +1308,15 @@ static void ClosePeripheralsAndHandlers(void)
 {
     DisposeEventLoopTimer(azureTimer);
     DisposeEventLoopTimer(sendTimer);
+
+    // Queue the open batch rather than send it on a client that is going away,
+    // and persist everything that is still queued.
+    iothubAuthenticated = false;
+    TelemetryBatch_Flush();
+    TelemetryBatch_Cleanup();
+    TelemetryQueue_Close();
+    DisposeEventLoopTimer(batchTimer);
+    DisposeEventLoopTimer(queueDrainTimer);
     EventLoop_UnregisterIo(eventLoop, socketEventReg);
     EventLoop_Close(eventLoop);
 
@@ -989,6 +1353,7 @@ static void ClosePeripheralsAndHandlers(void)
 #endif
     CloseFdAndPrintError(bleStatusLedGpioFd, "bleStatusLed");
     CloseFdAndPrintError(sockFd, "Socket");
+    CloseFdAndPrintError(telemetryQueueFd, "TelemetryQueue");
 }
 
 /// <summary>
@@ -1114,6 +1479,13 @@ static void TwinCallback(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned ch
         desiredProperties = rootObject;
     }
 
+    // The full twin sent after every (re)connect repeats desired properties already handled;
+    // commands such as CycleProbes only run for a patch or a new desired version.
+    double desiredVersion = json_object_get_number(desiredProperties, "$version");
+    bool desiredChanged =
+        updateState == DEVICE_TWIN_UPDATE_PARTIAL || desiredVersion != desiredVersionSeen;
+    desiredVersionSeen = desiredVersion;
+
     // Handle the Device Twin Desired Properties here.
     JSON_Object *LEDState = json_object_dotget_object(desiredProperties, "StatusLED");
     if (LEDState != NULL)
@@ -1124,6 +1496,13 @@ static void TwinCallback(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned ch
         TwinReportBoolState("StatusLED", statusLedOn);
     }
 
+    TwinUpdateTelemetryBatch(desiredProperties);
+    TwinUpdateBufferProfile(desiredProperties);
+    if (desiredChanged)
+    {
+        TwinUpdateCycleProbes(desiredProperties);
+    }
+
 cleanup:
     // Release the allocated memory.
     json_value_free(rootProperties);
@@ -1238,29 +1617,41 @@ static void SendTelemetry(const unsigned char *key, const unsigned char *value)
 }
 #endif
 
-// JSON String value
-static void SendJsonTelemetry(const unsigned char *value)
+/// <summary>
+///     Send a JSON string value to IoT Hub.
+/// </summary>
+/// <param name="enqueuedAt">When a message from the store-and-forward queue was queued,
+/// sent as the 'enqueuedTime' application property; 0 for live messages.</param>
+/// <returns>true if the client accepted the message</returns>
+static bool SendJsonTelemetry(const unsigned char *value, time_t enqueuedAt)
 {
-    static char eventBuffer[256] = {0};
-    static const char *EventMsgTemplate = "%s";
+    bool accepted = false;
 
-    int len = snprintf(eventBuffer, sizeof(eventBuffer), EventMsgTemplate, value);
-    if (len < 0)
-        return;
-
-    Log_Debug("Sending IoT Hub Message: %s\n", eventBuffer);
+    // Batches can be far larger than any fixed buffer; the message copies value.
+    Log_Debug("Sending IoT Hub Message: %s\n", value);
 
-    IOTHUB_MESSAGE_HANDLE messageHandle = IoTHubMessage_CreateFromString(eventBuffer);
+    IOTHUB_MESSAGE_HANDLE messageHandle = IoTHubMessage_CreateFromString((const char *)value);
     if (messageHandle == 0)
     {
         Log_Debug("WARNING: unable to create a new IoTHubMessage\n");
-        return;
+        return false;
     }
 
     // Set system properties
     (void)IoTHubMessage_SetContentTypeSystemProperty(messageHandle, "application%2fjson");
     (void)IoTHubMessage_SetContentEncodingSystemProperty(messageHandle, "utf-8");
 
+    if (enqueuedAt != 0)
+    {
+        char timeBuf[32];
+        struct tm tm;
+        if (gmtime_r(&enqueuedAt, &tm) != NULL &&
+            strftime(timeBuf, sizeof(timeBuf), "%Y-%m-%dT%H:%M:%SZ", &tm) != 0)
+        {
+            (void)IoTHubMessage_SetProperty(messageHandle, "enqueuedTime", timeBuf);
+        }
+    }
+
     if (IoTHubDeviceClient_LL_SendEventAsync(iothubClientHandle, messageHandle, SendMessageCallback,
                                              /*&callback_param*/ 0) != IOTHUB_CLIENT_OK)
     {
@@ -1269,9 +1660,184 @@ static void SendJsonTelemetry(const unsigned char *value)
     else
     {
         Log_Debug("INFO: IoTHubClient accepted the message for delivery\n");
+        accepted = true;
     }
 
     IoTHubMessage_Destroy(messageHandle);
+    return accepted;
+}
+
+/// <summary>
+///     Send a closed telemetry batch, see <see cref="TelemetryBatch_Add" />. It goes to the
+///     store-and-forward queue if IoT Hub is not reachable, or if older messages are still
+///     queued so that they keep their order.
+/// </summary>
+static void SendBatchedTelemetry(const char *json, unsigned int records)
+{
+    DisarmEventLoopTimer(batchTimer);
+
+    if (iothubAuthenticated && TelemetryQueue_Pending() == 0)
+    {
+        Log_Debug("Sending batch of %u records\n", records);
+        if (SendJsonTelemetry((const unsigned char *)json, 0))
+        {
+            IoTHubDeviceClient_LL_DoWork(iothubClientHandle);
+            return;
+        }
+    }
+
+    if (!TelemetryQueue_Push(json, strlen(json), time(NULL)))
+    {
+        Log_Debug("ERROR: Batch of %u records too large to queue, dropped.\n", records);
+        return;
+    }
+    Log_Debug("Queued batch of %u records, %zu messages waiting.\n", records,
+              TelemetryQueue_Pending());
+}
+
+/// <summary>
+///     Send one message from the store-and-forward queue.
+/// </summary>
+static bool SendQueuedTelemetry(const char *data, size_t len, time_t enqueuedAt)
+{
+    return iothubAuthenticated && SendJsonTelemetry((const unsigned char *)data, enqueuedAt);
+}
+
+/// <summary>
+///     Queue drain timer event: forward up to TelemetryQueueDrainPerTick queued messages.
+/// </summary>
+static void QueueDrainTimerEventHandler(EventLoopTimer *timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0)
+    {
+        exitCode = ExitCode_QueueDrainTimer_Consume;
+        return;
+    }
+
+    if (!iothubAuthenticated || TelemetryQueue_Pending() == 0)
+    {
+        return;
+    }
+
+    size_t sent = TelemetryQueue_Drain(TelemetryQueueDrainPerTick, SendQueuedTelemetry);
+    if (sent > 0)
+    {
+        IoTHubDeviceClient_LL_DoWork(iothubClientHandle);
+
+        TelemetryQueueStats stats;
+        TelemetryQueue_GetStats(&stats);
+        Log_Debug("INFO: Telemetry queue sent %zu, %zu waiting, %zu dropped.\n", sent,
+                  stats.pending, stats.dropped);
+    }
+}
+
+/// <summary>
+///     Batch timer event: the oldest pending record has waited windowMs.
+/// </summary>
+static void BatchTimerEventHandler(EventLoopTimer *timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0)
+    {
+        exitCode = ExitCode_BatchTimer_Consume;
+        return;
+    }
+
+    TelemetryBatch_Flush();
+}
+
+/// <summary>
+///     Apply the 'TelemetryBatch' desired property and report the limits in effect.
+///     Members that are missing keep their current value, e.g.
+///     {"TelemetryBatch": {"maxBytes": 4096, "maxRecords": 32, "windowMs": 1000, "aggregate": false}}
+///     maxBytes is at most TELEMETRY_QUEUE_MAX_ENTRY_BYTES.
+/// </summary>
+static void TwinUpdateTelemetryBatch(const JSON_Object *desiredProperties)
+{
+    JSON_Object *batch = json_object_get_object(desiredProperties, "TelemetryBatch");
+    if (batch == NULL)
+    {
+        return;
+    }
+
+    TelemetryBatchConfig config;
+    TelemetryBatch_GetConfig(&config);
+
+    if (json_object_has_value_of_type(batch, "maxBytes", JSONNumber))
+        config.maxBytes = (size_t)json_object_get_number(batch, "maxBytes");
+    if (json_object_has_value_of_type(batch, "maxRecords", JSONNumber))
+        config.maxRecords = (unsigned int)json_object_get_number(batch, "maxRecords");
+    if (json_object_has_value_of_type(batch, "windowMs", JSONNumber))
+        config.windowMs = (unsigned int)json_object_get_number(batch, "windowMs");
+    if (json_object_has_value_of_type(batch, "aggregate", JSONBoolean))
+        config.aggregate = json_object_get_boolean(batch, "aggregate") == 1;
+
+    // A batch that cannot be sent is queued whole; keep it within a queue entry.
+    if (config.maxBytes > TELEMETRY_QUEUE_MAX_ENTRY_BYTES)
+        config.maxBytes = TELEMETRY_QUEUE_MAX_ENTRY_BYTES;
+
+    TelemetryBatch_Configure(&config);
+    TelemetryBatch_GetConfig(&config);
+
+    static char reportedState[160];
+    snprintf(reportedState, sizeof(reportedState),
+             "{\"TelemetryBatch\":{\"maxBytes\":%zu,\"maxRecords\":%u,\"windowMs\":%u,\"aggregate\":%s}}",
+             config.maxBytes, config.maxRecords, config.windowMs,
+             config.aggregate ? "true" : "false");
+    TwinReportState(reportedState);
+}
+
+/// <summary>
+///     Apply the 'BufferProfile' desired property, e.g. {"BufferProfile": "bulk"}, one of
+///     "balanced", "bulk" or "small_udp". The RT app answers with the sizes applied, which
+///     are reported back. Only a new value is forwarded: the full twin that follows every
+///     reconnect repeats it, and each switch drops the ETH1 connections.
+/// </summary>
+static void TwinUpdateBufferProfile(const JSON_Object *desiredProperties)
+{
+    const char *name = json_object_get_string(desiredProperties, "BufferProfile");
+    if (name == NULL)
+    {
+        return;
+    }
+
+    for (uint8_t profile = 0; profile < INTERCORE_BUFFER_PROFILES; profile++)
+    {
+        if (strcmp(name, bufferProfileNames[profile]) == 0)
+        {
+            if (profile != bufferProfileSent && SendBufferProfileToRTApp(profile))
+            {
+                bufferProfileSent = profile;
+            }
+            return;
+        }
+    }
+    Log_Debug("ERROR: Unknown buffer profile \"%s\"\n", name);
+}
+
+/// <summary>
+///     Apply the 'CycleProbes' desired property: every patch or new desired version asks the
+///     RT app for its cycle probes, which are logged, e.g. {"CycleProbes": {"uart": false,
+///     "reset": true}}. "uart" also prints them on the RT app's UART, "reset" clears them
+///     afterwards.
+/// </summary>
+static void TwinUpdateCycleProbes(const JSON_Object *desiredProperties)
+{
+    JSON_Object *probes = json_object_get_object(desiredProperties, "CycleProbes");
+    if (probes == NULL)
+    {
+        return;
+    }
+
+    uint8_t command = INTERCORE_PROBE_CMD_DUMP_MBOX;
+    if (json_object_get_boolean(probes, "uart") == 1)
+    {
+        command |= INTERCORE_PROBE_CMD_DUMP_UART;
+    }
+    if (json_object_get_boolean(probes, "reset") == 1)
+    {
+        command |= INTERCORE_PROBE_CMD_RESET;
+    }
+    SendProbeCommandToRTApp(command);
 }
 
 /// <summary>
@@ -0,0 +1,226 @@
+#include <string.h>
+
+#include "parson.h"
+#include "telemetry_batch.h"
+
+#define TELEMETRY_BATCH_MAX_KEYS 16
+#define TELEMETRY_BATCH_KEY_LEN 32
+
+// Budget for one key of the aggregate element: name plus four numbers.
+#define TELEMETRY_BATCH_KEY_BYTES (TELEMETRY_BATCH_KEY_LEN + 96)
+
+typedef struct
+{
+    char key[TELEMETRY_BATCH_KEY_LEN];
+    double min;
+    double max;
+    double sum;
+    unsigned int count;
+} KeyStats;
+
+static TelemetryBatchConfig batchConfig = {
+    .maxBytes = TELEMETRY_BATCH_DEFAULT_MAX_BYTES,
+    .maxRecords = TELEMETRY_BATCH_DEFAULT_MAX_RECORDS,
+    .windowMs = TELEMETRY_BATCH_DEFAULT_WINDOW_MS,
+    .aggregate = false};
+static TelemetryBatchSendHandler sendHandler = NULL;
+
+static JSON_Value *batchArray = NULL;
+static size_t batchBytes = 0;
+static unsigned int batchRecords = 0;
+
+static KeyStats keyStats[TELEMETRY_BATCH_MAX_KEYS];
+static size_t keyCount = 0;
+
+static bool IsPassThrough(void)
+{
+    return batchConfig.maxRecords <= 1 && !batchConfig.aggregate;
+}
+
+static KeyStats *FindKeyStats(const char *key)
+{
+    for (size_t i = 0; i < keyCount; i++)
+    {
+        if (strcmp(keyStats[i].key, key) == 0)
+            return &keyStats[i];
+    }
+
+    if (keyCount == TELEMETRY_BATCH_MAX_KEYS || strlen(key) >= TELEMETRY_BATCH_KEY_LEN)
+        return NULL;
+
+    KeyStats *stats = &keyStats[keyCount++];
+    strcpy(stats->key, key);
+    stats->count = 0;
+    batchBytes += TELEMETRY_BATCH_KEY_BYTES;
+    return stats;
+}
+
+/// <summary>
+///     Move the numeric members of an object record into keyStats.
+/// </summary>
+/// <returns>true if nothing is left of the record</returns>
+static bool AggregateRecord(JSON_Value *value)
+{
+    JSON_Object *object = json_value_get_object(value);
+    if (object == NULL)
+        return false;
+
+    // Walk backwards, json_object_remove moves the last member into the hole.
+    for (size_t i = json_object_get_count(object); i-- > 0;)
+    {
+        JSON_Value *member = json_object_get_value_at(object, i);
+        if (json_value_get_type(member) != JSONNumber)
+            continue;
+
+        KeyStats *stats = FindKeyStats(json_object_get_name(object, i));
+        if (stats == NULL)
+            continue;
+
+        double number = json_value_get_number(member);
+        if (stats->count == 0)
+        {
+            stats->min = stats->max = stats->sum = number;
+        }
+        else
+        {
+            if (number < stats->min)
+                stats->min = number;
+            if (number > stats->max)
+                stats->max = number;
+            stats->sum += number;
+        }
+        stats->count++;
+
+        json_object_remove(object, json_object_get_name(object, i));
+    }
+
+    return json_object_get_count(object) == 0;
+}
+
+static JSON_Value *CreateAggregateElement(void)
+{
+    JSON_Value *element = json_value_init_object();
+    JSON_Value *keys = json_value_init_object();
+
+    for (size_t i = 0; i < keyCount; i++)
+    {
+        JSON_Value *statsValue = json_value_init_object();
+        JSON_Object *stats = json_value_get_object(statsValue);
+
+        json_object_set_number(stats, "min", keyStats[i].min);
+        json_object_set_number(stats, "max", keyStats[i].max);
+        json_object_set_number(stats, "avg", keyStats[i].sum / keyStats[i].count);
+        json_object_set_number(stats, "count", keyStats[i].count);
+        json_object_set_value(json_value_get_object(keys), keyStats[i].key, statsValue);
+    }
+    json_object_set_value(json_value_get_object(element), "aggregate", keys);
+
+    return element;
+}
+
+static void ResetBatch(void)
+{
+    json_value_free(batchArray);
+    batchArray = NULL;
+    batchBytes = 0;
+    batchRecords = 0;
+    keyCount = 0;
+}
+
+void TelemetryBatch_Init(const TelemetryBatchConfig *config, TelemetryBatchSendHandler send)
+{
+    ResetBatch();
+    sendHandler = send;
+    if (config != NULL)
+        TelemetryBatch_Configure(config);
+}
+
+void TelemetryBatch_Configure(const TelemetryBatchConfig *config)
+{
+    TelemetryBatch_Flush();
+
+    batchConfig = *config;
+    if (batchConfig.maxBytes > TELEMETRY_BATCH_LIMIT_MAX_BYTES)
+        batchConfig.maxBytes = TELEMETRY_BATCH_LIMIT_MAX_BYTES;
+    if (batchConfig.maxRecords > TELEMETRY_BATCH_LIMIT_MAX_RECORDS)
+        batchConfig.maxRecords = TELEMETRY_BATCH_LIMIT_MAX_RECORDS;
+    if (batchConfig.windowMs > TELEMETRY_BATCH_LIMIT_WINDOW_MS)
+        batchConfig.windowMs = TELEMETRY_BATCH_LIMIT_WINDOW_MS;
+}
+
+void TelemetryBatch_GetConfig(TelemetryBatchConfig *config)
+{
+    *config = batchConfig;
+}
+
+unsigned int TelemetryBatch_Add(const char *record)
+{
+    if (IsPassThrough())
+    {
+        sendHandler(record, 1);
+        return 0;
+    }
+
+    // The raw length bounds what the record adds to the message, unless it
+    // ends up as an escaped string; close the batch before it would overflow.
+    if (batchRecords > 0 && batchBytes + strlen(record) + 1 > batchConfig.maxBytes)
+        TelemetryBatch_Flush();
+
+    JSON_Value *value = json_parse_string(record);
+    if (value == NULL)
+        value = json_value_init_string(record);
+    if (value == NULL)
+        return batchRecords;
+
+    if (batchConfig.aggregate && AggregateRecord(value))
+    {
+        json_value_free(value);
+        value = NULL;
+    }
+
+    if (value != NULL)
+    {
+        if (batchArray == NULL)
+        {
+            batchArray = json_value_init_array();
+            batchBytes += 2; // []
+        }
+        // json_serialization_size counts the terminator, which stands in for the comma.
+        batchBytes += json_serialization_size(value);
+        json_array_append_value(json_value_get_array(batchArray), value);
+    }
+    batchRecords++;
+
+    if (batchRecords >= batchConfig.maxRecords || batchBytes >= batchConfig.maxBytes)
+    {
+        TelemetryBatch_Flush();
+        return 0;
+    }
+
+    return batchRecords;
+}
+
+void TelemetryBatch_Flush(void)
+{
+    if (batchRecords == 0)
+        return;
+
+    if (batchArray == NULL)
+        batchArray = json_value_init_array();
+    if (keyCount > 0)
+        json_array_append_value(json_value_get_array(batchArray), CreateAggregateElement());
+
+    char *json = json_serialize_to_string(batchArray);
+    if (json != NULL)
+    {
+        sendHandler(json, batchRecords);
+        json_free_serialized_string(json);
+    }
+
+    ResetBatch();
+}
+
+void TelemetryBatch_Cleanup(void)
+{
+    ResetBatch();
+}
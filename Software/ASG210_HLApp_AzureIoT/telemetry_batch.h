@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/// <summary>
+/// Limits that close a telemetry batch. A batch is one JSON array message; it is
+/// handed to the send handler once any of the limits is reached.
+/// </summary>
+typedef struct
+{
+    /// <summary>Serialized size of the message, in bytes.</summary>
+    size_t maxBytes;
+    /// <summary>Number of records. With maxRecords 1 and no aggregation, records
+    /// are passed through unchanged instead of being wrapped in an array.</summary>
+    unsigned int maxRecords;
+    /// <summary>Age of the oldest record, in milliseconds. The caller runs the
+    /// timer; see <see cref="TelemetryBatch_Add" />. 0 disables the window.</summary>
+    unsigned int windowMs;
+    /// <summary>Reduce numeric members of object records to min/max/avg/count per
+    /// key, carried in a trailing {"aggregate":{...}} element.</summary>
+    bool aggregate;
+} TelemetryBatchConfig;
+
+#define TELEMETRY_BATCH_DEFAULT_MAX_BYTES 4096
+#define TELEMETRY_BATCH_DEFAULT_MAX_RECORDS 32
+#define TELEMETRY_BATCH_DEFAULT_WINDOW_MS 1000
+
+#define TELEMETRY_BATCH_LIMIT_MAX_BYTES (64 * 1024)
+#define TELEMETRY_BATCH_LIMIT_MAX_RECORDS 1000
+#define TELEMETRY_BATCH_LIMIT_WINDOW_MS 60000
+
+/// <summary>
+/// Applications implement a function with this signature to send a closed batch.
+/// </summary>
+/// <param name="json">The message, valid for the duration of the call.</param>
+/// <param name="records">Number of records it covers.</param>
+typedef void (*TelemetryBatchSendHandler)(const char *json, unsigned int records);
+
+/// <summary>
+/// Set up the batcher. config may be NULL for the defaults.
+/// </summary>
+void TelemetryBatch_Init(const TelemetryBatchConfig *config, TelemetryBatchSendHandler send);
+
+/// <summary>
+/// Replace the limits, clamped to the TELEMETRY_BATCH_LIMIT_* values. The open
+/// batch is flushed first.
+/// </summary>
+void TelemetryBatch_Configure(const TelemetryBatchConfig *config);
+
+/// <summary>
+/// Get the limits in effect.
+/// </summary>
+void TelemetryBatch_GetConfig(TelemetryBatchConfig *config);
+
+/// <summary>
+/// Add one record. Records that are not valid JSON are added as strings.
+/// </summary>
+/// <param name="record">NUL-terminated record.</param>
+/// <returns>Records pending after the call. 1 means a new batch was opened and
+/// the caller should arm a windowMs timer that calls <see cref="TelemetryBatch_Flush" />;
+/// 0 means the record was sent.</returns>
+unsigned int TelemetryBatch_Add(const char *record);
+
+/// <summary>
+/// Send the open batch, if any.
+/// </summary>
+void TelemetryBatch_Flush(void);
+
+/// <summary>
+/// Drop the open batch and release its memory.
+/// </summary>
+void TelemetryBatch_Cleanup(void);
@@ -0,0 +1,486 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "telemetry_queue.h"
+
+#define SEGMENT_MAGIC 0x47535154u // "TQSG"
+#define ACK_MAGIC 0x4B435154u     // "TQCK"
+#define SEGMENT_VERSION 1
+
+typedef struct __attribute__((packed))
+{
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t bytes; // payload bytes following the header
+    uint16_t count; // entries in the payload
+    uint8_t version;
+    uint8_t reserved;
+    uint32_t crc; // CRC32 of the header, with crc 0, and the payload
+} SegmentHeader;
+
+typedef struct __attribute__((packed))
+{
+    uint32_t magic;
+    uint32_t generation; // even generations go to block A, odd to block B
+    uint32_t seq;        // segment being drained
+    uint32_t entries;    // entries of that segment already sent
+    uint32_t crc;
+} AckBlock;
+
+typedef struct __attribute__((packed))
+{
+    uint32_t enqueuedAt;
+    uint16_t len;
+} EntryHeader;
+
+#define SEGMENT_PAYLOAD_BYTES (TELEMETRY_QUEUE_SLOT_BYTES - sizeof(SegmentHeader))
+#define MAX_SLOTS 64
+
+_Static_assert(TELEMETRY_QUEUE_MAX_ENTRY_BYTES == SEGMENT_PAYLOAD_BYTES - sizeof(EntryHeader),
+               "TELEMETRY_QUEUE_MAX_ENTRY_BYTES does not match the segment layout");
+
+// RAM buffer, consumed from ramHead and appended at ramTail. Same layout as a
+// segment payload so it can be spilled in one write.
+static uint8_t ramBuf[SEGMENT_PAYLOAD_BYTES];
+static size_t ramHead, ramTail, ramCount;
+
+// Storage
+static int storageFd = -1;
+static unsigned int slotCount;
+static uint16_t slotEntries[MAX_SLOTS]; // entries in the segment of each slot, 0 if none
+static uint32_t nextSeq;                // sequence number of the next spill
+static uint32_t ackSeq;                 // oldest segment not fully sent
+static uint32_t ackEntries;             // entries of ackSeq already sent
+static uint32_t ackGeneration;
+static bool ackDirty;
+
+// Segment being drained
+static uint8_t segmentBuf[TELEMETRY_QUEUE_SLOT_BYTES];
+static uint32_t segmentSeq;
+static bool segmentLoaded;
+static size_t segmentOffset; // payload offset of entry ackEntries
+
+static uint8_t entryBuf[SEGMENT_PAYLOAD_BYTES + 1];
+
+static TelemetryQueueStats stats;
+
+static uint32_t Crc32(uint32_t crc, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+
+    crc = ~crc;
+    while (len--)
+    {
+        crc ^= *p++;
+        for (int i = 0; i < 8; i++)
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+    }
+    return ~crc;
+}
+
+static int ReadAt(off_t offset, void *buf, size_t len)
+{
+    uint8_t *p = buf;
+
+    if (lseek(storageFd, offset, SEEK_SET) == -1)
+        return -1;
+    while (len > 0)
+    {
+        ssize_t n = read(storageFd, p, len);
+        if (n <= 0)
+        {
+            if (n == -1 && errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int WriteAt(off_t offset, const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+
+    if (lseek(storageFd, offset, SEEK_SET) == -1)
+        return -1;
+    while (len > 0)
+    {
+        ssize_t n = write(storageFd, p, len);
+        if (n <= 0)
+        {
+            if (n == -1 && errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static off_t SlotOffset(uint32_t seq)
+{
+    return TELEMETRY_QUEUE_ACK_AREA_BYTES + (off_t)(seq % slotCount) * TELEMETRY_QUEUE_SLOT_BYTES;
+}
+
+static uint32_t SegmentCrc(const SegmentHeader *header, const uint8_t *payload)
+{
+    SegmentHeader copy = *header;
+
+    copy.crc = 0;
+    return Crc32(Crc32(0, &copy, sizeof(copy)), payload, header->bytes);
+}
+
+/// <summary>
+///     Read the segment in seq's slot into segmentBuf and check it.
+/// </summary>
+static bool LoadSegment(uint32_t seq)
+{
+    SegmentHeader *header = (SegmentHeader *)segmentBuf;
+
+    if (ReadAt(SlotOffset(seq), segmentBuf, sizeof(*header)) == -1)
+        return false;
+    if (header->magic != SEGMENT_MAGIC || header->version != SEGMENT_VERSION ||
+        header->seq != seq || header->bytes > SEGMENT_PAYLOAD_BYTES)
+        return false;
+    if (ReadAt(SlotOffset(seq) + (off_t)sizeof(*header), segmentBuf + sizeof(*header),
+               header->bytes) == -1)
+        return false;
+
+    return SegmentCrc(header, segmentBuf + sizeof(*header)) == header->crc;
+}
+
+static size_t StoredPending(void)
+{
+    size_t pending = 0;
+
+    for (uint32_t seq = ackSeq; seq != nextSeq; seq++)
+        pending += slotEntries[seq % slotCount];
+    return pending - ackEntries;
+}
+
+static void WriteAck(void)
+{
+    AckBlock ack = {.magic = ACK_MAGIC,
+                    .generation = ++ackGeneration,
+                    .seq = ackSeq,
+                    .entries = ackEntries,
+                    .crc = 0};
+
+    ack.crc = Crc32(0, &ack, sizeof(ack));
+    if (WriteAt((ack.generation & 1) * sizeof(ack), &ack, sizeof(ack)) == 0)
+        ackDirty = false;
+}
+
+static bool ReadAck(off_t offset, AckBlock *ack)
+{
+    uint32_t crc;
+
+    if (ReadAt(offset, ack, sizeof(*ack)) == -1 || ack->magic != ACK_MAGIC)
+        return false;
+    crc = ack->crc;
+    ack->crc = 0;
+    return Crc32(0, ack, sizeof(*ack)) == crc;
+}
+
+/// <summary>
+///     Move ackSeq past segments that are fully sent or no longer on storage.
+/// </summary>
+static void AdvanceAck(void)
+{
+    if (nextSeq - ackSeq > slotCount)
+    {
+        ackSeq = nextSeq - slotCount;
+        ackEntries = 0;
+        ackDirty = true;
+    }
+    while (ackSeq != nextSeq && ackEntries >= slotEntries[ackSeq % slotCount])
+    {
+        ackSeq++;
+        ackEntries = 0;
+        ackDirty = true;
+    }
+}
+
+/// <summary>
+///     Write the RAM buffer as the next segment, dropping the oldest one if
+///     storage is full.
+/// </summary>
+static int Spill(void)
+{
+    SegmentHeader header = {.magic = SEGMENT_MAGIC,
+                            .seq = nextSeq,
+                            .bytes = (uint32_t)(ramTail - ramHead),
+                            .count = (uint16_t)ramCount,
+                            .version = SEGMENT_VERSION,
+                            .reserved = 0,
+                            .crc = 0};
+    unsigned int slot = nextSeq % slotCount;
+
+    if (ramCount == 0)
+        return 0;
+
+    if (nextSeq - ackSeq == slotCount)
+    {
+        // Overwriting the oldest segment that still has entries to send.
+        stats.dropped += slotEntries[slot] - ackEntries;
+        ackSeq++;
+        ackEntries = 0;
+        ackDirty = true;
+    }
+    if (segmentLoaded && segmentSeq % slotCount == slot)
+        segmentLoaded = false;
+
+    header.crc = SegmentCrc(&header, ramBuf + ramHead);
+    slotEntries[slot] = 0;
+    if (WriteAt(SlotOffset(nextSeq), &header, sizeof(header)) == -1 ||
+        WriteAt(SlotOffset(nextSeq) + (off_t)sizeof(header), ramBuf + ramHead, header.bytes) == -1)
+        return -1;
+
+    slotEntries[slot] = header.count;
+    nextSeq++;
+    ramHead = ramTail = ramCount = 0;
+    stats.spilled++;
+    AdvanceAck();
+    // The first spill also writes the first ack, so a restart finds one.
+    if (ackDirty || ackGeneration == 0)
+        WriteAck();
+
+    return 0;
+}
+
+/// <summary>
+///     Drop the oldest RAM entry; used when there is no storage to spill to.
+/// </summary>
+static void DropRamHead(void)
+{
+    EntryHeader entry;
+
+    memcpy(&entry, ramBuf + ramHead, sizeof(entry));
+    ramHead += sizeof(entry) + entry.len;
+    ramCount--;
+    stats.dropped++;
+}
+
+int TelemetryQueue_Open(int fd, size_t storageBytes)
+{
+    AckBlock a, b;
+    bool haveA, haveB;
+    uint32_t slotSeq[MAX_SLOTS];
+    uint32_t maxSeq = 0;
+    bool haveSegment = false;
+
+    ramHead = ramTail = ramCount = 0;
+    segmentLoaded = false;
+    memset(&stats, 0, sizeof(stats));
+    memset(slotEntries, 0, sizeof(slotEntries));
+    nextSeq = ackSeq = ackEntries = ackGeneration = 0;
+    ackDirty = false;
+
+    storageFd = fd;
+    slotCount = 0;
+    if (fd < 0 || storageBytes < TELEMETRY_QUEUE_ACK_AREA_BYTES + 2 * TELEMETRY_QUEUE_SLOT_BYTES)
+    {
+        storageFd = -1;
+        return -1;
+    }
+    slotCount = (unsigned int)((storageBytes - TELEMETRY_QUEUE_ACK_AREA_BYTES) /
+                               TELEMETRY_QUEUE_SLOT_BYTES);
+    if (slotCount > MAX_SLOTS)
+        slotCount = MAX_SLOTS;
+
+    // Find the newest segment; a slot that does not check out is empty.
+    for (unsigned int slot = 0; slot < slotCount; slot++)
+    {
+        SegmentHeader header;
+
+        if (ReadAt(SlotOffset(slot), &header, sizeof(header)) == -1 ||
+            header.magic != SEGMENT_MAGIC || header.seq % slotCount != slot ||
+            !LoadSegment(header.seq))
+            continue;
+
+        slotEntries[slot] = header.count;
+        slotSeq[slot] = header.seq;
+        if (!haveSegment || (int32_t)(header.seq - maxSeq) > 0)
+            maxSeq = header.seq;
+        haveSegment = true;
+    }
+    segmentLoaded = false;
+    if (haveSegment)
+        nextSeq = maxSeq + 1;
+
+    // A slot that was not rewritten in the last lap holds a stale segment.
+    for (unsigned int slot = 0; slot < slotCount; slot++)
+    {
+        if (slotEntries[slot] != 0 && nextSeq - 1 - slotSeq[slot] >= slotCount)
+            slotEntries[slot] = 0;
+    }
+
+    haveA = ReadAck(0, &a);
+    haveB = ReadAck(sizeof(AckBlock), &b);
+    if (haveA && (!haveB || (int32_t)(a.generation - b.generation) > 0))
+        b = a;
+    if (haveA || haveB)
+    {
+        ackGeneration = b.generation;
+        ackSeq = b.seq;
+        ackEntries = b.entries;
+    }
+    else
+    {
+        // No ack yet: drain from the oldest segment on storage.
+        ackSeq = nextSeq;
+        for (unsigned int slot = 0; slot < slotCount; slot++)
+        {
+            if (slotEntries[slot] != 0 && (int32_t)(slotSeq[slot] - ackSeq) < 0)
+                ackSeq = slotSeq[slot];
+        }
+    }
+
+    // An ack ahead of every segment means the segments were lost; start there.
+    if ((int32_t)(nextSeq - ackSeq) < 0)
+    {
+        nextSeq = ackSeq;
+        ackEntries = 0;
+    }
+    AdvanceAck();
+    if (ackDirty)
+        WriteAck();
+
+    return 0;
+}
+
+bool TelemetryQueue_Push(const char *data, size_t len, time_t enqueuedAt)
+{
+    EntryHeader entry = {.enqueuedAt = (uint32_t)enqueuedAt, .len = (uint16_t)len};
+    size_t size = sizeof(entry) + len;
+
+    if (size > sizeof(ramBuf))
+    {
+        stats.dropped++;
+        return false;
+    }
+
+    if (ramTail + size > sizeof(ramBuf) && ramHead > 0)
+    {
+        memmove(ramBuf, ramBuf + ramHead, ramTail - ramHead);
+        ramTail -= ramHead;
+        ramHead = 0;
+    }
+    while (ramTail + size > sizeof(ramBuf))
+    {
+        if (storageFd < 0 || Spill() == -1)
+        {
+            DropRamHead();
+            memmove(ramBuf, ramBuf + ramHead, ramTail - ramHead);
+            ramTail -= ramHead;
+            ramHead = 0;
+        }
+    }
+
+    memcpy(ramBuf + ramTail, &entry, sizeof(entry));
+    memcpy(ramBuf + ramTail + sizeof(entry), data, len);
+    ramTail += size;
+    ramCount++;
+
+    return true;
+}
+
+/// <summary>
+///     Copy the entry at payload[*offset] into entryBuf and send it.
+/// </summary>
+static bool SendEntry(const uint8_t *payload, size_t *offset, TelemetryQueueSendHandler send)
+{
+    EntryHeader entry;
+
+    memcpy(&entry, payload + *offset, sizeof(entry));
+    memcpy(entryBuf, payload + *offset + sizeof(entry), entry.len);
+    entryBuf[entry.len] = '\0';
+
+    if (!send((const char *)entryBuf, entry.len, (time_t)entry.enqueuedAt))
+        return false;
+
+    *offset += sizeof(entry) + entry.len;
+    stats.drained++;
+    return true;
+}
+
+size_t TelemetryQueue_Drain(unsigned int maxEntries, TelemetryQueueSendHandler send)
+{
+    size_t sent = 0;
+
+    // Storage holds the older entries.
+    while (storageFd >= 0 && sent < maxEntries && ackSeq != nextSeq)
+    {
+        if (!segmentLoaded || segmentSeq != ackSeq)
+        {
+            if (!LoadSegment(ackSeq))
+            {
+                stats.dropped += slotEntries[ackSeq % slotCount] - ackEntries;
+                ackEntries = slotEntries[ackSeq % slotCount];
+                ackDirty = true;
+                AdvanceAck();
+                continue;
+            }
+            segmentLoaded = true;
+            segmentSeq = ackSeq;
+            segmentOffset = 0;
+            for (uint32_t i = 0; i < ackEntries; i++)
+            {
+                EntryHeader entry;
+                memcpy(&entry, segmentBuf + sizeof(SegmentHeader) + segmentOffset, sizeof(entry));
+                segmentOffset += sizeof(entry) + entry.len;
+            }
+        }
+
+        if (!SendEntry(segmentBuf + sizeof(SegmentHeader), &segmentOffset, send))
+            goto done;
+        sent++;
+        ackEntries++;
+        ackDirty = true;
+        AdvanceAck();
+    }
+
+    while (sent < maxEntries && ramCount > 0)
+    {
+        if (!SendEntry(ramBuf, &ramHead, send))
+            break;
+        ramCount--;
+        sent++;
+    }
+    if (ramCount == 0)
+        ramHead = ramTail = 0;
+
+done:
+    if (ackDirty && storageFd >= 0)
+        WriteAck();
+
+    return sent;
+}
+
+size_t TelemetryQueue_Pending(void)
+{
+    return ramCount + (storageFd >= 0 ? StoredPending() : 0);
+}
+
+void TelemetryQueue_GetStats(TelemetryQueueStats *out)
+{
+    *out = stats;
+    out->pending = TelemetryQueue_Pending();
+}
+
+void TelemetryQueue_Close(void)
+{
+    if (storageFd >= 0)
+    {
+        Spill();
+        if (ackDirty)
+            WriteAck();
+    }
+    storageFd = -1;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+/// <summary>
+/// Store-and-forward queue for telemetry that could not be sent.
+///
+/// Entries collect in a RAM buffer. When it fills up, it is spilled as one
+/// segment into a file of fixed-size slots (the app's mutable storage on the
+/// device, any regular file on Linux). Each segment carries a sequence number
+/// and a CRC32. Slots are reused oldest first, so the file never grows. Drain
+/// progress is recorded in two alternating ack blocks at the start of the file,
+/// so a restart resumes where the previous run stopped.
+///
+/// File layout: [ack A][ack B][slot 0][slot 1]...[slot N-1]
+/// </summary>
+
+#define TELEMETRY_QUEUE_SLOT_BYTES 8192
+#define TELEMETRY_QUEUE_ACK_AREA_BYTES 64
+
+/// <summary>
+/// Longest entry the queue takes: a slot less the segment and entry headers.
+/// </summary>
+#define TELEMETRY_QUEUE_MAX_ENTRY_BYTES (TELEMETRY_QUEUE_SLOT_BYTES - 20 - 6)
+
+/// <summary>
+/// Applications implement a function with this signature to send one entry.
+/// </summary>
+/// <param name="data">NUL-terminated entry, valid for the duration of the call.</param>
+/// <param name="len">Entry length, without the terminator.</param>
+/// <param name="enqueuedAt">When the entry was pushed.</param>
+/// <returns>true if the entry was handed over; false stops the drain and
+/// leaves the entry at the head of the queue.</returns>
+typedef bool (*TelemetryQueueSendHandler)(const char *data, size_t len, time_t enqueuedAt);
+
+typedef struct
+{
+    /// <summary>Entries waiting, in RAM and on storage.</summary>
+    size_t pending;
+    /// <summary>Segments written to storage since open.</summary>
+    size_t spilled;
+    /// <summary>Entries lost because the queue was full or a segment was corrupt.</summary>
+    size_t dropped;
+    /// <summary>Entries handed to the send handler since open.</summary>
+    size_t drained;
+} TelemetryQueueStats;
+
+/// <summary>
+/// Open the queue and recover entries left in storage by a previous run.
+/// </summary>
+/// <param name="fd">Readable and writable file, or -1 to queue in RAM only.</param>
+/// <param name="storageBytes">Bytes the queue may use in fd.</param>
+/// <returns>0 on success, -1 if storage is unusable; the queue then runs in RAM only.</returns>
+int TelemetryQueue_Open(int fd, size_t storageBytes);
+
+/// <summary>
+/// Append an entry.
+/// </summary>
+/// <returns>false if the entry is larger than a segment and was dropped.</returns>
+bool TelemetryQueue_Push(const char *data, size_t len, time_t enqueuedAt);
+
+/// <summary>
+/// Send up to maxEntries entries, oldest first, and persist the progress.
+/// </summary>
+/// <returns>Number of entries sent.</returns>
+size_t TelemetryQueue_Drain(unsigned int maxEntries, TelemetryQueueSendHandler send);
+
+/// <summary>
+/// Number of entries waiting.
+/// </summary>
+size_t TelemetryQueue_Pending(void);
+
+void TelemetryQueue_GetStats(TelemetryQueueStats *stats);
+
+/// <summary>
+/// Spill what is left in RAM to storage. The caller still owns fd.
+/// </summary>
+void TelemetryQueue_Close(void);
@@ -0,0 +1,195 @@
+/*
+ * Buffered UART console, see console.h.
+ */
+
+#include <stdint.h>
+
+#include "printf.h"
+#include "mt3620.h"
+#include "os_hal_uart.h"
+
+#include "console.h"
+
+/* Room the report of dropped bytes needs */
+#define CONSOLE_DROP_REPORT     40
+
+static UART_PORT console_port;
+static console_overflow console_policy;
+
+static uint8_t __attribute__((section(".sysram"))) console_buf[CONSOLE_TX_SIZE];
+/* Free running. printf may be called from interrupt handlers, so the head
+ * and the tail are only moved with interrupts masked. */
+static volatile uint32_t console_head;
+static volatile uint32_t console_tail;
+/* Length of the DMA transfer in flight, which starts at the tail */
+static volatile uint32_t console_dma_len;
+static volatile uint32_t console_dropped;
+
+static inline uint32_t console_lock(void)
+{
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    return primask;
+}
+
+static inline void console_unlock(uint32_t primask)
+{
+    __set_PRIMASK(primask);
+}
+
+static inline uint32_t console_free(void)
+{
+    return CONSOLE_TX_SIZE - (console_head - console_tail);
+}
+
+/* The longest run of unsent bytes that does not wrap; *off is its start */
+static inline uint32_t console_span(uint32_t *off)
+{
+    uint32_t len = console_head - console_tail;
+
+    *off = console_tail & (CONSOLE_TX_SIZE - 1);
+    if (len > CONSOLE_TX_SIZE - *off)
+        len = CONSOLE_TX_SIZE - *off;
+    return len;
+}
+
+static void console_put(const uint8_t *data, uint32_t len)
+{
+    uint32_t head = console_head;
+    uint32_t i;
+
+    for (i = 0; i < len; i++)
+        console_buf[(head + i) & (CONSOLE_TX_SIZE - 1)] = data[i];
+    console_head = head + len;
+}
+
+static void console_report_drops(void)
+{
+    char report[CONSOLE_DROP_REPORT];
+    int len;
+
+    if (console_dropped == 0 || console_free() < sizeof(report))
+        return;
+
+    len = snprintf(report, sizeof(report), "\r\n[console: %u bytes dropped]\r\n",
+                   (unsigned int)console_dropped);
+    console_dropped = 0;
+    console_put((const uint8_t *)report, len);
+}
+
+static int console_dma_done(void *context);
+
+/* Start a DMA transfer of the unsent bytes unless one is in flight */
+static void console_kick(void)
+{
+    uint32_t off, len;
+
+    if (console_dma_len)
+        return;
+
+    len = console_span(&off);
+    if (len && mtk_os_hal_uart_dma_send_data_async(console_port, console_buf + off, len,
+                                                   false, console_dma_done, NULL) == 0)
+        console_dma_len = len;
+}
+
+/* DMA interrupt: the transfer is done, send what was appended meanwhile */
+static int console_dma_done(void *context)
+{
+    console_tail += console_dma_len;
+    console_dma_len = 0;
+    console_kick();
+    return 0;
+}
+
+void console_init(UART_PORT port, console_overflow overflow)
+{
+    console_port = port;
+    console_policy = overflow;
+}
+
+static int console_append(const uint8_t *data, uint16_t len)
+{
+    uint32_t primask = console_lock();
+
+    while (console_free() < len) {
+        /* Nothing would free the ring while we wait here */
+        if (console_policy == CONSOLE_OVERFLOW_DROP || primask || __get_IPSR() ||
+            len > CONSOLE_TX_SIZE) {
+            console_dropped += len;
+            console_unlock(primask);
+            return 0;
+        }
+        console_unlock(primask);
+        console_poll();
+        primask = console_lock();
+    }
+
+    console_put(data, len);
+    console_unlock(primask);
+    return len;
+}
+
+void console_putc(char c)
+{
+    uint8_t b = (uint8_t)c;
+
+    console_append(&b, 1);
+}
+
+int console_write(const uint8_t *data, uint16_t len)
+{
+    return console_append(data, len);
+}
+
+uint16_t console_room(void)
+{
+    return (uint16_t)console_free();
+}
+
+void console_poll(void)
+{
+    uint32_t primask = console_lock();
+    uint32_t off, len;
+    int sent;
+
+    console_report_drops();
+
+    if (console_port == OS_HAL_UART_PORT0) {
+        len = console_span(&off);
+        if (len) {
+            sent = mtk_os_hal_uart_put_data_nowait(console_port, console_buf + off, len);
+            if (sent > 0)
+                console_tail += sent;
+        }
+    } else {
+        console_kick();
+    }
+
+    console_unlock(primask);
+}
+
+void console_flush(void)
+{
+    uint32_t primask = console_lock();
+    int sent;
+
+    if (console_dma_len) {
+        sent = mtk_os_hal_uart_dma_stop_send(console_port);
+        if (sent > 0)
+            console_tail += sent;
+        console_dma_len = 0;
+    }
+
+    do {
+        while (console_tail != console_head) {
+            mtk_os_hal_uart_put_char(console_port,
+                                     console_buf[console_tail & (CONSOLE_TX_SIZE - 1)]);
+            console_tail++;
+        }
+        console_report_drops();
+    } while (console_tail != console_head);
+
+    console_unlock(primask);
+}
@@ -0,0 +1,52 @@
+/*
+ * Buffered UART console.
+ *
+ * printf() appends to a TX ring through _putchar() and returns at once; the
+ * ring is sent in the background. On an ISU port the ring is sent by DMA,
+ * and the completion of one transfer starts the next. The M4 UART
+ * (OS_HAL_UART_PORT0) has no DMA channel; there console_poll() fills the TX
+ * FIFO from the ring whenever it is empty. Call console_poll() from the main
+ * loop on either port: it also starts DMA for what was appended since.
+ *
+ * When the ring is full, CONSOLE_OVERFLOW_DROP drops what does not fit and
+ * reports the count once there is room again; CONSOLE_OVERFLOW_BLOCK waits
+ * for room, except in an interrupt handler or with interrupts masked, where
+ * it drops as well.
+ */
+
+#ifndef __CONSOLE_H__
+#define __CONSOLE_H__
+
+#include <stdint.h>
+
+#include "os_hal_uart.h"
+
+/* Ring size, a power of 2; in .sysram, where the UART DMA reads it */
+#define CONSOLE_TX_SIZE             2048
+
+typedef enum {
+    CONSOLE_OVERFLOW_DROP,
+    CONSOLE_OVERFLOW_BLOCK,
+} console_overflow;
+
+/* The UART must be initialized. */
+void console_init(UART_PORT port, console_overflow overflow);
+
+void console_putc(char c);
+
+/* Append all of data or, if the ring has not the room, nothing; for output
+ * that must not be cut, e.g. binary frames. Returns len or 0. */
+int console_write(const uint8_t *data, uint16_t len);
+
+/* Free bytes in the ring */
+uint16_t console_room(void);
+
+/* Keep the ring moving; call from the main loop. */
+void console_poll(void);
+
+/* Send all of the ring with the CPU before returning, for crash paths and
+ * before a reset; safe in fault handlers. A DMA transfer in flight is
+ * stopped and the CPU sends the rest. */
+void console_flush(void);
+
+#endif /* __CONSOLE_H__ */
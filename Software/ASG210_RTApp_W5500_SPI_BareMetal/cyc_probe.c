@@ -0,0 +1,112 @@
+/*
+ * Cycle probes on the RT app's hot paths.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "printf.h"
+#include "mt3620.h"
+
+#include "intercore_batch.h"
+#include "mbox_batch.h"
+#include "cyc_probe.h"
+
+cyc_probe_stat cyc_probes[INTERCORE_PROBE_COUNT];
+
+static const char *const cyc_probe_names[INTERCORE_PROBE_COUNT] = {
+    [INTERCORE_PROBE_SPIM_TRANSFER] = "spim_transfer",
+    [INTERCORE_PROBE_SPIM_FLUSH] = "spim_queue_flush",
+    [INTERCORE_PROBE_WIZ_SEND_DATA] = "wiz_send_data",
+    [INTERCORE_PROBE_WIZ_RECV_DATA] = "wiz_recv_data",
+    [INTERCORE_PROBE_MBOX_ENQUEUE] = "mbox_enqueue",
+    [INTERCORE_PROBE_MBOX_DEQUEUE] = "mbox_dequeue",
+    [INTERCORE_PROBE_DHCPS_RUN] = "dhcps_run",
+    [INTERCORE_PROBE_SNTPS_RUN] = "SNTPs_run",
+    [INTERCORE_PROBE_LOOPBACK] = "loopback",
+    [INTERCORE_PROBE_MBOX_TCP] = "mbox_tcp_server",
+};
+
+/* Cycles to microseconds, without 64-bit division */
+#define CYC_PROBE_US(cycles)    ((cycles) / (INTERCORE_PROBE_CPU_HZ / 1000000))
+
+void cyc_probe_init(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    cyc_probe_reset();
+}
+
+void cyc_probe_reset(void)
+{
+    memset(cyc_probes, 0, sizeof(cyc_probes));
+}
+
+static void cyc_probe_entry(uint8_t id, intercore_probe_entry *e)
+{
+    const cyc_probe_stat *p = &cyc_probes[id];
+    uint8_t b;
+
+    memset(e, 0, sizeof(*e));
+    e->id = id;
+    e->count = p->count;
+    e->min = p->min;
+    e->max = p->max;
+    e->mean = p->count ? (uint32_t)(p->total / p->count) : 0;
+    for (b = 0; b < INTERCORE_PROBE_BUCKETS; b++)
+        e->hist[b] = p->hist[b] > 0xFFFF ? 0xFFFF : (uint16_t)p->hist[b];
+}
+
+void cyc_probe_dump_uart(void)
+{
+    intercore_probe_entry e;
+    uint8_t id, b;
+
+#ifndef CYC_PROBE
+    printf("Cycle probes not built in (CYC_PROBE)\r\n");
+    return;
+#endif
+
+    printf("Cycle probes, cycles at %d MHz:\r\n", INTERCORE_PROBE_CPU_HZ / 1000000);
+    for (id = 0; id < INTERCORE_PROBE_COUNT; id++) {
+        cyc_probe_entry(id, &e);
+        printf("  %-16s %8u calls, min %u, mean %u, max %u (%u us)\r\n", cyc_probe_names[id],
+            e.count, e.min, e.mean, e.max, CYC_PROBE_US(e.max));
+        if (e.count == 0)
+            continue;
+        /* bucket b ends at 2^(b + SHIFT + 1) cycles */
+        printf("   ");
+        for (b = 0; b < INTERCORE_PROBE_BUCKETS; b++)
+            if (e.hist[b])
+                printf(" %s2^%d:%u", b + 1 < INTERCORE_PROBE_BUCKETS ? "<" : ">=",
+                    b + 1 < INTERCORE_PROBE_BUCKETS ? b + INTERCORE_PROBE_BUCKET_SHIFT + 1 :
+                    b + INTERCORE_PROBE_BUCKET_SHIFT, e.hist[b]);
+        printf("\r\n");
+    }
+}
+
+int cyc_probe_dump_mbox(void)
+{
+    intercore_probe_entry e;
+    uint8_t id;
+
+    for (id = 0; id < INTERCORE_PROBE_COUNT; id++) {
+        cyc_probe_entry(id, &e);
+        if (mbox_batch_add(0, INTERCORE_RECORD_PROBE, (const uint8_t *)&e, sizeof(e)) <= 0)
+            break;
+    }
+    mbox_batch_flush();
+    return id;
+}
+
+void cyc_probe_command(uint8_t cmd)
+{
+    if (cmd & INTERCORE_PROBE_CMD_DUMP_UART)
+        cyc_probe_dump_uart();
+    if (cmd & INTERCORE_PROBE_CMD_DUMP_MBOX)
+        cyc_probe_dump_mbox();
+    if (cmd & INTERCORE_PROBE_CMD_RESET)
+        cyc_probe_reset();
+}
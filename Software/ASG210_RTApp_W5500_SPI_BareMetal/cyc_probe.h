@@ -0,0 +1,79 @@
+/*
+ * Cycle probes on the RT app's hot paths, timed with the DWT cycle counter.
+ *
+ * A probe is a CYC_PROBE_BEGIN()/CYC_PROBE_END() pair in one block, named by
+ * an INTERCORE_PROBE_* id. Each probe keeps the number of calls, the
+ * minimum, maximum and total cycles and a log2 histogram in a fixed table;
+ * nothing is printed on the hot path. On request the table is printed on the
+ * UART or sent to the HL app, see cyc_probe_command().
+ *
+ * The probes are built in with CYC_PROBE (see CMakeLists.txt) and are empty
+ * otherwise. They time the main loop only; a probe in an interrupt handler
+ * would race the one it interrupted. A time includes the interrupts taken and
+ * the nested probes.
+ */
+
+#ifndef __CYC_PROBE_H__
+#define __CYC_PROBE_H__
+
+#include <stdint.h>
+
+#include "intercore_batch.h"
+
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+    uint32_t hist[INTERCORE_PROBE_BUCKETS];
+} cyc_probe_stat;
+
+#ifdef CYC_PROBE
+/* DWT->CYCCNT; the address is the same on every Cortex-M, which spares the
+ * driver sources that include this header the whole BSP. */
+#define CYC_PROBE_CYCCNT        (*(volatile uint32_t *)0xE0001004UL)
+
+extern cyc_probe_stat cyc_probes[INTERCORE_PROBE_COUNT];
+
+static inline void cyc_probe_record(uint8_t id, uint32_t cycles)
+{
+    cyc_probe_stat *p = &cyc_probes[id];
+    int bucket = 31 - __builtin_clz(cycles | 1) - INTERCORE_PROBE_BUCKET_SHIFT;
+
+    if (bucket < 0)
+        bucket = 0;
+    else if (bucket >= INTERCORE_PROBE_BUCKETS)
+        bucket = INTERCORE_PROBE_BUCKETS - 1;
+
+    if (p->count == 0 || cycles < p->min)
+        p->min = cycles;
+    if (cycles > p->max)
+        p->max = cycles;
+    p->count++;
+    p->total += cycles;
+    p->hist[bucket]++;
+}
+
+#define CYC_PROBE_BEGIN(id)     uint32_t cyc_probe_start_##id = CYC_PROBE_CYCCNT
+#define CYC_PROBE_END(id)       cyc_probe_record((id), CYC_PROBE_CYCCNT - cyc_probe_start_##id)
+#else
+#define CYC_PROBE_BEGIN(id)
+#define CYC_PROBE_END(id)
+#endif
+
+/* Start the cycle counter and clear the table. */
+void cyc_probe_init(void);
+
+void cyc_probe_reset(void);
+
+/* Print the table on the UART. */
+void cyc_probe_dump_uart(void);
+
+/* Queue one INTERCORE_RECORD_PROBE record per probe in the mailbox batch.
+ * Returns the number of records queued. */
+int cyc_probe_dump_mbox(void);
+
+/* Carry out the INTERCORE_PROBE_CMD_* bits of cmd. */
+void cyc_probe_command(uint8_t cmd);
+
+#endif /* __CYC_PROBE_H__ */
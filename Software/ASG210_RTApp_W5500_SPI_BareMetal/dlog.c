@@ -0,0 +1,135 @@
+/*
+ * Deferred binary log, see dlog.h.
+ */
+
+#include <stdint.h>
+
+#include "printf.h"
+
+#include "dlog.h"
+
+#ifdef DLOG_DEFERRED
+
+#include "console.h"
+
+#define DLOG_SLOTS          64      /* power of 2 */
+
+typedef struct {
+    uint16_t id;
+    uint8_t nargs;
+    uint32_t tick;
+    uint32_t args[DLOG_MAX_ARGS];
+} dlog_slot;
+
+extern volatile uint32_t sys_tick_in_ms;
+
+static dlog_slot dlog_ring[DLOG_SLOTS];
+/* Free running; dlog_put() only moves the head, dlog_drain() only the tail */
+static volatile uint32_t dlog_head;
+static volatile uint32_t dlog_tail;
+static volatile uint32_t dlog_lost;
+
+/* Frames of one drain, written to the console in one go so text does not
+ * split them */
+static uint8_t dlog_tx[DLOG_DRAIN_MAX > DLOG_FRAME_MAX ? DLOG_DRAIN_MAX : DLOG_FRAME_MAX];
+
+void dlog_put(uint16_t id, uint8_t nargs, const uint32_t *args)
+{
+    uint32_t head = dlog_head;
+    dlog_slot *s;
+    uint8_t i;
+
+    if (head - dlog_tail >= DLOG_SLOTS) {
+        dlog_lost++;
+        return;
+    }
+
+    s = &dlog_ring[head & (DLOG_SLOTS - 1)];
+    s->id = id;
+    s->nargs = nargs;
+    s->tick = sys_tick_in_ms;
+    for (i = 0; i < nargs; i++)
+        s->args[i] = args[i];
+
+    /* The slot is written before it is published. */
+    __asm volatile ("" ::: "memory");
+    dlog_head = head + 1;
+}
+
+static void dlog_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint16_t dlog_frame(uint8_t *p, uint16_t id, uint8_t nargs, uint32_t tick,
+                           const uint32_t *args)
+{
+    uint8_t i;
+
+    p[0] = DLOG_SYNC;
+    p[1] = nargs;
+    p[2] = (uint8_t)id;
+    p[3] = (uint8_t)(id >> 8);
+    dlog_le32(p + 4, tick);
+    for (i = 0; i < nargs; i++)
+        dlog_le32(p + DLOG_FRAME_HEAD + 4 * i, args[i]);
+
+    return DLOG_FRAME_HEAD + 4 * nargs;
+}
+
+int dlog_drain(void)
+{
+    uint32_t tail = dlog_tail;
+    uint32_t lost = dlog_lost;
+    uint16_t room = console_room();
+    uint16_t len = 0;
+    const dlog_slot *s;
+
+    if (room > sizeof(dlog_tx))
+        room = sizeof(dlog_tx);
+
+    if (lost && room >= DLOG_FRAME_HEAD + 4) {
+        len = dlog_frame(dlog_tx, DLOG_DROPPED, 1, sys_tick_in_ms, &lost);
+        dlog_lost -= lost;
+    }
+
+    while (tail != dlog_head) {
+        s = &dlog_ring[tail & (DLOG_SLOTS - 1)];
+        if (room - len < DLOG_FRAME_HEAD + 4 * s->nargs)
+            break;
+        len += dlog_frame(dlog_tx + len, s->id, s->nargs, s->tick, s->args);
+        tail++;
+    }
+    dlog_tail = tail;
+
+    if (len)
+        console_write(dlog_tx, len);
+
+    return len;
+}
+
+#else
+
+static const char *const dlog_formats[DLOG_COUNT] = {
+#define DLOG_FMT(id, fmt)   [id] = fmt,
+#include "dlog_fmt.h"
+#undef DLOG_FMT
+};
+
+void dlog_put(uint16_t id, uint8_t nargs, const uint32_t *args)
+{
+    uint32_t a[DLOG_MAX_ARGS] = { 0 };
+    uint8_t i;
+
+    if (id >= DLOG_COUNT)
+        return;
+    for (i = 0; i < nargs && i < DLOG_MAX_ARGS; i++)
+        a[i] = args[i];
+
+    printf(dlog_formats[id], a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+}
+
+#endif
@@ -0,0 +1,57 @@
+/*
+ * Deferred binary log for the RT app's hot paths.
+ *
+ * DLOG(id, args...) logs the format dlog_fmt.h gives id. With DLOG_DEFERRED
+ * (see CMakeLists.txt) the call only copies the id, the millisecond tick and
+ * the arguments into a ring; dlog_drain() moves them from the main loop to
+ * the console as binary frames, which Software/DLog_Decoder renders as text.
+ * Without DLOG_DEFERRED the call prints the text at once with printf.
+ *
+ * The ring has one producer and one consumer and takes no lock: log from the
+ * main loop only, not from interrupt handlers. A record that finds the ring
+ * full is dropped and counted; the count is sent as DLOG_DROPPED.
+ *
+ * Frame on the console, little endian:
+ *   DLOG_SYNC, number of arguments, id (16 bits), tick in ms (32 bits),
+ *   the arguments (32 bits each)
+ * The text printf sends is ASCII, so DLOG_SYNC never starts a line of text.
+ */
+
+#ifndef __DLOG_H__
+#define __DLOG_H__
+
+#include <stdint.h>
+
+enum {
+#define DLOG_FMT(id, fmt)   id,
+#include "dlog_fmt.h"
+#undef DLOG_FMT
+    DLOG_COUNT
+};
+
+#define DLOG_MAX_ARGS       8
+#define DLOG_SYNC           0xA5
+#define DLOG_FRAME_HEAD     8
+#define DLOG_FRAME_MAX      (DLOG_FRAME_HEAD + 4 * DLOG_MAX_ARGS)
+
+/* The leading 0 keeps the array valid for a format without arguments. */
+#define DLOG(id, ...)   do { \
+        const uint32_t dlog_args_[] = { 0, ##__VA_ARGS__ }; \
+        _Static_assert(sizeof(dlog_args_) <= 4 * (DLOG_MAX_ARGS + 1), "too many dlog arguments"); \
+        dlog_put((id), sizeof(dlog_args_) / 4 - 1, dlog_args_ + 1); \
+    } while (0)
+
+void dlog_put(uint16_t id, uint8_t nargs, const uint32_t *args);
+
+#ifdef DLOG_DEFERRED
+/* Most bytes one dlog_drain() moves to the console */
+#ifndef DLOG_DRAIN_MAX
+#define DLOG_DRAIN_MAX      256
+#endif
+
+/* Move the oldest frames of the ring to the console, as many as it has room
+ * for. Returns the number of bytes moved. */
+int dlog_drain(void);
+#endif
+
+#endif /* __DLOG_H__ */
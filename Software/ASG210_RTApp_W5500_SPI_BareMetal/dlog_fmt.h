@@ -0,0 +1,36 @@
+/*
+ * Format strings of the deferred log, see dlog.h.
+ *
+ * DLOG_FMT(id, format) gives every log site an id; the RT app only stores the
+ * id and the arguments, the decoder (Software/DLog_Decoder) holds the text.
+ * A format takes at most DLOG_MAX_ARGS arguments, all of them 32-bit integers:
+ * %d, %u, %x and %c, no %s, %p or length modifiers.
+ *
+ * Ids are positions in this list. Add new formats at the end, so the decoder
+ * of a newer build still reads the logs of an older one.
+ */
+
+DLOG_FMT(DLOG_DROPPED,              "dlog: %u records dropped\r\n")
+
+/* main.c */
+DLOG_FMT(DLOG_MBOX_TCP_RECV,        "Received data from socket %d : (%d)\r\n")
+DLOG_FMT(DLOG_MBOX_TCP_CLOSED,      "%d : Socket Closed\r\n")
+DLOG_FMT(DLOG_MBOX_TCP_LISTEN,      "%d : Listen, TCP server, port [%d]\r\n")
+DLOG_FMT(DLOG_MBOX_TCP_OPENED,      "%d : Socket Opened\r\n")
+/* not logged any more; kept so the ids after it keep their values */
+DLOG_FMT(DLOG_MBOX_ENQUEUE_FAILED,  "Mailbox enqueue failed!\n")
+DLOG_FMT(DLOG_MBOX_DEQUEUE_FAILED,  "Mailbox dequeue failed!\n")
+
+/* dhcps.c */
+DLOG_FMT(DLOG_DHCPS_NO_IP,          "\r\n No useable ip!!!!\r\n")
+DLOG_FMT(DLOG_DHCPS_MSG,            "DHCP message : %d.%d.%d.%d(%d) %d received. \r\n")
+DLOG_FMT(DLOG_DHCPS_OFFER,          "DHCP_SERVER_STATE_OFFER\r\n")
+DLOG_FMT(DLOG_DHCPS_ACK,            "DHCP_SERVER_STATE_ACK\r\n")
+DLOG_FMT(DLOG_DHCPS_NAK,            "DHCP_SERVER_STATE_NAK\r\n")
+
+/* loopback.c */
+DLOG_FMT(DLOG_LOOPBACK_CONNECTED,   "%d:Connected - %d.%d.%d.%d : %d\r\n")
+DLOG_FMT(DLOG_LOOPBACK_CLOSE_WAIT,  "%d : SOCK_CLOSE_WAIT \r\n")
+DLOG_FMT(DLOG_LOOPBACK_CLOSED,      "%d : Socket Closed\r\n")
+DLOG_FMT(DLOG_LOOPBACK_RECVFROM_ERR, "%d: recvfrom error. %d\r\n")
+DLOG_FMT(DLOG_LOOPBACK_SENDTO_ERR,  "%d: sock_sendto error. %d\r\n")
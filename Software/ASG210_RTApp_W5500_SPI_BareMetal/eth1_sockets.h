@@ -0,0 +1,59 @@
+/*
+ * Sockets of ETH1 and the buffer profiles that weigh them.
+ *
+ * Included by main.c where L2_BRIDGE is decided, and by the host benchmarks
+ * in W5500_HostSim, which run the RT app's servers with the same buffers.
+ */
+
+#ifndef __ETH1_SOCKETS_H__
+#define __ETH1_SOCKETS_H__
+
+#include "intercore_batch.h"
+#include "l2_bridge.h"
+#include "sock_profile.h"
+
+#ifdef L2_BRIDGE
+#define MBOX_TCP_SOCKET     4
+#else
+#define MBOX_TCP_SOCKET     0
+#endif
+#define LOOPBACK_SOCKET     1
+#define DHCP_SERVER_SOCKET  2
+#define SNTP_SERVER_SOCKET  3
+
+#ifdef L2_BRIDGE
+#define L2_BRIDGE_WEIGHT(w)     [L2_BRIDGE_SOCKET] = (w),
+#else
+#define L2_BRIDGE_WEIGHT(w)
+#endif
+
+/* ETH1 socket buffer profiles, indexed by INTERCORE_BUFFER_* */
+static const sock_profile sock_profiles[INTERCORE_BUFFER_PROFILES] = {
+    [INTERCORE_BUFFER_BALANCED] = {
+        .name = "balanced",
+        .tx_weight = { 1, 1, 1, 1, 1, 1, 1, 1 },
+        .rx_weight = { 1, 1, 1, 1, 1, 1, 1, 1 },
+    },
+    /* the mailbox data socket (and bridge) first: 8 KB each way */
+    [INTERCORE_BUFFER_BULK] = {
+        .name = "bulk stream",
+        .tx_weight = { [MBOX_TCP_SOCKET] = 8, [LOOPBACK_SOCKET] = 2,
+                       [DHCP_SERVER_SOCKET] = 1, [SNTP_SERVER_SOCKET] = 1,
+                       L2_BRIDGE_WEIGHT(8) },
+        .rx_weight = { [MBOX_TCP_SOCKET] = 8, [LOOPBACK_SOCKET] = 2,
+                       [DHCP_SERVER_SOCKET] = 1, [SNTP_SERVER_SOCKET] = 1,
+                       L2_BRIDGE_WEIGHT(8) },
+    },
+    /* request bursts queue up in RX; the replies are small */
+    [INTERCORE_BUFFER_SMALL_UDP] = {
+        .name = "many small UDP",
+        .tx_weight = { [MBOX_TCP_SOCKET] = 2, [LOOPBACK_SOCKET] = 1,
+                       [DHCP_SERVER_SOCKET] = 2, [SNTP_SERVER_SOCKET] = 2,
+                       L2_BRIDGE_WEIGHT(2) },
+        .rx_weight = { [MBOX_TCP_SOCKET] = 1, [LOOPBACK_SOCKET] = 1,
+                       [DHCP_SERVER_SOCKET] = 4, [SNTP_SERVER_SOCKET] = 4,
+                       L2_BRIDGE_WEIGHT(1) },
+    },
+};
+
+#endif /* __ETH1_SOCKETS_H__ */
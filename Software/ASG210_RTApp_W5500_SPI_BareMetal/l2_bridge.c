@@ -0,0 +1,372 @@
+/*
+ * Transparent layer-2 bridge between two W5500 chips.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "ioLibrary_Driver/Ethernet/socket.h"
+#include "ioLibrary_Driver/Ethernet/W5500/w5500.h"
+
+#include "l2_bridge.h"
+
+#define L2_BRIDGE_NONE      0xFF
+#define L2_BRIDGE_MAC_LEN   6
+
+typedef struct {
+    uint8_t mac[L2_BRIDGE_MAC_LEN];
+    uint8_t port;
+    uint8_t next;                   /* hash chain or free list */
+    uint32_t seen;                  /* bridge_tick_1s of the last frame from mac */
+} l2_bridge_entry;
+
+static l2_bridge_entry mac_table[L2_BRIDGE_MAC_ENTRIES];
+static uint8_t mac_hash[L2_BRIDGE_HASH_SIZE];   /* first entry of each chain */
+static uint8_t mac_free;
+
+static wizchip_ctx *bridge_port[L2_BRIDGE_PORTS];
+static uint8_t bridge_own[L2_BRIDGE_PORTS][L2_BRIDGE_MAC_LEN];  /* SHAR of each chip */
+static uint8_t bridge_sending[L2_BRIDGE_PORTS];    /* SEND issued, SENDOK not seen yet */
+static uint8_t bridge_cr_posted[L2_BRIDGE_PORTS];  /* SEND issued, Sn_CR not seen clear yet */
+
+static uint32_t (*bridge_clock_us)(void);
+static volatile uint8_t bridge_stamped[L2_BRIDGE_PORTS];
+static volatile uint32_t bridge_stamp[L2_BRIDGE_PORTS];
+
+static volatile uint32_t bridge_tick_1s;
+static uint32_t bridge_swept;       /* bridge_tick_1s at the last sweep */
+static uint32_t bridge_forwarded;   /* frames sent up to the last sweep */
+
+static l2_bridge_counter bridge_counter;
+
+/* Frames are read into the two buffers in turn. A frame goes out with a
+ * queued write and a posted SEND, so the next frame is read into the other
+ * buffer while the egress chip's SPI master still sends the last one; a
+ * buffer is reused only once the port it went out on was flushed. */
+static uint8_t bridge_frame[2][L2_BRIDGE_FRAME_MAX];
+static uint8_t bridge_slot;                 /* buffer the next frame is read into */
+static uint8_t bridge_slot_port[2];         /* port still sending from a buffer, or L2_BRIDGE_NONE */
+
+static uint8_t l2_bridge_hash(const uint8_t *mac)
+{
+    uint32_t h = 0;
+    uint8_t i;
+
+    for (i = 0; i < L2_BRIDGE_MAC_LEN; i++)
+        h = h * 31 + mac[i];
+    return (uint8_t)(h % L2_BRIDGE_HASH_SIZE);
+}
+
+static uint8_t l2_bridge_lookup(const uint8_t *mac)
+{
+    uint8_t idx = mac_hash[l2_bridge_hash(mac)];
+
+    while (idx != L2_BRIDGE_NONE &&
+           memcmp(mac_table[idx].mac, mac, L2_BRIDGE_MAC_LEN) != 0)
+        idx = mac_table[idx].next;
+    return idx;
+}
+
+static void l2_bridge_learn(const uint8_t *mac, uint8_t port)
+{
+    l2_bridge_entry *e;
+    uint8_t h, idx;
+
+    /* group addresses are never a source */
+    if (mac[0] & 0x01)
+        return;
+
+    idx = l2_bridge_lookup(mac);
+    if (idx == L2_BRIDGE_NONE)
+    {
+        if (mac_free == L2_BRIDGE_NONE)
+        {
+            bridge_counter.table_full++;
+            return;
+        }
+        idx = mac_free;
+        e = &mac_table[idx];
+        mac_free = e->next;
+
+        h = l2_bridge_hash(mac);
+        memcpy(e->mac, mac, L2_BRIDGE_MAC_LEN);
+        e->next = mac_hash[h];
+        mac_hash[h] = idx;
+        bridge_counter.learned++;
+    }
+
+    /* a station that moved is simply relearned on its new port */
+    e = &mac_table[idx];
+    e->port = port;
+    e->seen = bridge_tick_1s;
+}
+
+static uint8_t l2_bridge_port_of(const wizchip_ctx *ctx)
+{
+    uint8_t port;
+
+    for (port = 0; port < L2_BRIDGE_PORTS; port++)
+        if (bridge_port[port] == ctx)
+            return port;
+    return L2_BRIDGE_NONE;
+}
+
+/* Queue the frame on the selected chip and return with it in flight. A SEND
+ * is only issued once the previous one completed, which it normally has by
+ * the time the next frame was read from the other chip. Returns 0, or -1 if
+ * the frame is dropped. */
+static int l2_bridge_send(uint8_t port, uint8_t *frame, uint16_t len)
+{
+    const uint8_t sn = L2_BRIDGE_SOCKET;
+
+    if (bridge_sending[port])
+    {
+        while (!(getSn_IR(sn) & Sn_IR_SENDOK))
+            if (getSn_SR(sn) != SOCK_MACRAW)
+                break;
+        setSn_IR(sn, Sn_IR_SENDOK);
+        bridge_sending[port] = 0;
+        bridge_cr_posted[port] = 0;
+    }
+
+    if (getSn_SR(sn) != SOCK_MACRAW || getSn_TX_FSR(sn) < len)
+        return -1;
+
+    wiz_send_data_queued(sn, frame, len);
+    setSn_CR(sn, Sn_CR_SEND);
+    bridge_sending[port] = 1;
+    bridge_cr_posted[port] = 1;
+    return 0;
+}
+
+/* Wait until the buffer the next frame is read into is no longer sent from. */
+static void l2_bridge_slot_free(void)
+{
+    uint8_t port = bridge_slot_port[bridge_slot];
+    wizchip_ctx *prev;
+
+    if (port == L2_BRIDGE_NONE)
+        return;
+
+    prev = wizchip_setctx(bridge_port[port]);
+    WIZCHIP_FLUSH();
+    wizchip_setctx(prev);
+    bridge_slot_port[bridge_slot] = L2_BRIDGE_NONE;
+}
+
+static void l2_bridge_latency(uint8_t port)
+{
+    uint32_t sample;
+
+    if (!bridge_stamped[port])
+        return;
+
+    sample = bridge_clock_us() - bridge_stamp[port];
+    bridge_stamped[port] = 0;
+
+    bridge_counter.latency_us = sample;
+    if (sample > bridge_counter.latency_max_us)
+        bridge_counter.latency_max_us = sample;
+    /* smoothed over the last 8 or so samples */
+    bridge_counter.latency_avg_us += ((int32_t)(sample - bridge_counter.latency_avg_us)) / 8;
+}
+
+static void l2_bridge_forward(uint8_t in, uint16_t len)
+{
+    uint8_t *frame = bridge_frame[bridge_slot];
+    const uint8_t *dst = frame;
+    const uint8_t *src = frame + L2_BRIDGE_MAC_LEN;
+    uint8_t out = in ^ 1;
+    uint8_t idx;
+    wizchip_ctx *prev;
+    int ret;
+
+    l2_bridge_learn(src, in);
+
+    if (dst[0] & 0x01)
+    {
+        bridge_counter.flooded++;
+    }
+    else
+    {
+        if (memcmp(dst, bridge_own[in], L2_BRIDGE_MAC_LEN) == 0)
+        {
+            bridge_counter.filtered++;
+            return;
+        }
+        idx = l2_bridge_lookup(dst);
+        if (idx == L2_BRIDGE_NONE)
+            bridge_counter.flooded++;
+        else if (mac_table[idx].port == in)
+        {
+            bridge_counter.filtered++;
+            return;
+        }
+    }
+
+    prev = wizchip_setctx(bridge_port[out]);
+    ret = l2_bridge_send(out, frame, len);
+    wizchip_setctx(prev);
+
+    if (ret)
+    {
+        bridge_counter.dropped++;
+        return;
+    }
+    bridge_slot_port[bridge_slot] = out;
+    bridge_slot ^= 1;
+    bridge_counter.tx[out]++;
+    if (bridge_clock_us)
+        l2_bridge_latency(in);
+}
+
+int l2_bridge_init(wizchip_ctx *port0, wizchip_ctx *port1, uint32_t (*clock_us)(void))
+{
+    wizchip_ctx *prev;
+    uint8_t i;
+
+    if (port0 == NULL || port1 == NULL)
+        return -1;
+
+    bridge_port[0] = port0;
+    bridge_port[1] = port1;
+    bridge_clock_us = clock_us;
+
+    prev = WIZCHIP_CTX;
+    for (i = 0; i < L2_BRIDGE_PORTS; i++)
+    {
+        wizchip_setctx(bridge_port[i]);
+        getSHAR(bridge_own[i]);
+        bridge_sending[i] = 0;
+        bridge_cr_posted[i] = 0;
+        bridge_stamped[i] = 0;
+    }
+    wizchip_setctx(prev);
+    bridge_slot = 0;
+    bridge_slot_port[0] = bridge_slot_port[1] = L2_BRIDGE_NONE;
+
+    for (i = 0; i < L2_BRIDGE_HASH_SIZE; i++)
+        mac_hash[i] = L2_BRIDGE_NONE;
+    for (i = 0; i < L2_BRIDGE_MAC_ENTRIES; i++)
+        mac_table[i].next = (i + 1 < L2_BRIDGE_MAC_ENTRIES) ? i + 1 : L2_BRIDGE_NONE;
+    mac_free = 0;
+
+    memset(&bridge_counter, 0, sizeof(bridge_counter));
+    bridge_swept = bridge_tick_1s;
+    bridge_forwarded = 0;
+    return 0;
+}
+
+void l2_bridge_evt(uint8_t sn, uint8_t ir)
+{
+    uint8_t in = l2_bridge_port_of(WIZCHIP_CTX);
+    uint8_t head[2];
+    uint16_t len;
+    uint8_t n;
+
+    if (in == L2_BRIDGE_NONE || sn != L2_BRIDGE_SOCKET)
+        return;
+
+    switch (getSn_SR(sn))
+    {
+    case SOCK_MACRAW:
+        break;
+    case SOCK_CLOSED:
+        /* no MAC filter: the bridge has to see every frame on the wire */
+        wiz_socket(sn, Sn_MR_MACRAW, 0, 0);
+        bridge_sending[in] = 0;
+        bridge_cr_posted[in] = 0;
+        return;
+    default:
+        close_socket(sn);
+        return;
+    }
+
+    for (n = 0; n < L2_BRIDGE_MAX_BURST; n++)
+    {
+        if (getSn_RX_RSR(sn) < sizeof(head))
+            break;
+
+        /* each frame is preceded by its length, the 2 length bytes included */
+        wiz_recv_data(sn, head, sizeof(head));
+        len = ((uint16_t)head[0] << 8) | head[1];
+        if (len < sizeof(head) + L2_BRIDGE_FRAME_MIN ||
+            len > sizeof(head) + L2_BRIDGE_FRAME_MAX)
+        {
+            /* out of step with the RX ring, start over */
+            bridge_counter.dropped++;
+            close_socket(sn);
+            return;
+        }
+        len -= sizeof(head);
+
+        l2_bridge_slot_free();
+        wiz_recv_data(sn, bridge_frame[bridge_slot], len);
+        if (bridge_cr_posted[in])
+        {
+            /* the chip takes a command only once it accepted the SEND */
+            while (getSn_CR(sn))
+                ;
+            bridge_cr_posted[in] = 0;
+        }
+        setSn_CR(sn, Sn_CR_RECV);
+        while (getSn_CR(sn))
+            ;
+
+        bridge_counter.rx[in]++;
+        l2_bridge_forward(in, len);
+    }
+}
+
+void l2_bridge_stamp(uint8_t port)
+{
+    if (port >= L2_BRIDGE_PORTS || bridge_clock_us == NULL || bridge_stamped[port])
+        return;
+
+    bridge_stamp[port] = bridge_clock_us();
+    bridge_stamped[port] = 1;
+}
+
+void l2_bridge_time_handler(void)
+{
+    bridge_tick_1s++;
+}
+
+void l2_bridge_sweep(void)
+{
+    uint32_t now = bridge_tick_1s;
+    uint32_t forwarded;
+    uint8_t *link;
+    uint8_t h, idx;
+
+    if (now == bridge_swept)
+        return;
+
+    forwarded = bridge_counter.tx[0] + bridge_counter.tx[1];
+    bridge_counter.fps = (forwarded - bridge_forwarded) / (now - bridge_swept);
+    bridge_forwarded = forwarded;
+    bridge_swept = now;
+
+    for (h = 0; h < L2_BRIDGE_HASH_SIZE; h++)
+    {
+        link = &mac_hash[h];
+        while (*link != L2_BRIDGE_NONE)
+        {
+            idx = *link;
+            if (now - mac_table[idx].seen < L2_BRIDGE_AGE_TIME)
+            {
+                link = &mac_table[idx].next;
+                continue;
+            }
+            *link = mac_table[idx].next;
+            mac_table[idx].next = mac_free;
+            mac_free = idx;
+            bridge_counter.aged++;
+        }
+    }
+}
+
+void l2_bridge_get_counters(l2_bridge_counter *counters)
+{
+    *counters = bridge_counter;
+}
@@ -0,0 +1,73 @@
+/*
+ * Transparent layer-2 bridge between two W5500 chips.
+ *
+ * Socket 0 of each chip is opened in MACRAW mode without the MAC filter, so
+ * it sees every frame on its wire. Each received frame teaches the bridge
+ * which port its source MAC lives on; it is then sent out of the other port
+ * unless its destination is known to be on the port it came from, or is the
+ * receiving chip itself. Learned entries age out after L2_BRIDGE_AGE_TIME
+ * seconds without traffic.
+ *
+ * The bridge is driven by the W5500 event dispatcher: register l2_bridge_evt
+ * for socket 0 of both chips. Like the dispatcher it only touches the chips
+ * through the ioLibrary, selecting each chip's driver context as needed.
+ */
+
+#ifndef __L2_BRIDGE_H__
+#define __L2_BRIDGE_H__
+
+#include <stdint.h>
+
+#include "ioLibrary_Driver/Ethernet/wizchip_conf.h"
+
+#define L2_BRIDGE_PORTS         2
+#define L2_BRIDGE_SOCKET        0       /* MACRAW is only available on socket 0 */
+
+#define L2_BRIDGE_MAC_ENTRIES   128
+#define L2_BRIDGE_HASH_SIZE     64
+#define L2_BRIDGE_AGE_TIME      300     /* seconds, the 802.1D default */
+
+/* Frames forwarded per port in one handler call, so one busy port cannot
+ * starve the other or the rest of the main loop. */
+#define L2_BRIDGE_MAX_BURST     8
+
+/* Largest frame without FCS; MACRAW hands frames over without it. */
+#define L2_BRIDGE_FRAME_MAX     1514
+#define L2_BRIDGE_FRAME_MIN     14
+
+typedef struct {
+    uint32_t rx[L2_BRIDGE_PORTS];       /* frames received per port */
+    uint32_t tx[L2_BRIDGE_PORTS];       /* frames sent per port */
+    uint32_t flooded;                   /* group or unknown destination */
+    uint32_t filtered;                  /* destination on the ingress port, or the chip itself */
+    uint32_t dropped;                   /* no TX room on the egress port, or a bad frame */
+    uint32_t learned;                   /* MAC table entries created */
+    uint32_t aged;                      /* MAC table entries expired */
+    uint32_t table_full;                /* source MACs not learned for lack of room */
+    uint32_t fps;                       /* frames forwarded during the last second */
+    uint32_t latency_us;                /* INTn to SEND of the first frame it announced, last sample */
+    uint32_t latency_max_us;
+    uint32_t latency_avg_us;
+} l2_bridge_counter;
+
+/* Bridge the chips with driver contexts port0 and port1. clock_us returns a
+ * free-running microsecond count, it is called from the INTn handlers too; it
+ * may be NULL, in which case no latency is measured.
+ * Returns 0, or -1 on a missing context. */
+int l2_bridge_init(wizchip_ctx *port0, wizchip_ctx *port1, uint32_t (*clock_us)(void));
+
+/* W5500 event handler for socket L2_BRIDGE_SOCKET of either chip. */
+void l2_bridge_evt(uint8_t sn, uint8_t ir);
+
+/* Called from the INTn EINT handler of port's chip. */
+void l2_bridge_stamp(uint8_t port);
+
+/* Called once per second, may be from an interrupt handler. */
+void l2_bridge_time_handler(void);
+
+/* Age out the MAC table and update the frame rate; call from the main loop. */
+void l2_bridge_sweep(void);
+
+void l2_bridge_get_counters(l2_bridge_counter *counters);
+
+#endif /* __L2_BRIDGE_H__ */
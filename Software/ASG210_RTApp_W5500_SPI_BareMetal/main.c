@@ -43,6 +43,7 @@
 #include "os_hal_uart.h"
 #include "os_hal_gpt.h"
 #include "os_hal_gpio.h"
+#include "os_hal_eint.h"
 #include "os_hal_spim.h"
 #include "os_hal_mbox.h"
 #include "os_hal_mbox_shared_mem.h"
@@ -54,6 +55,16 @@
 #include "ioLibrary_Driver/Internet/DHCP/dhcps.h"
 #include "ioLibrary_Driver/Internet/SNTP/sntps.h"
 
+#include "w5500_event.h"
+#include "mbox_batch.h"
+#include "ntp_clock.h"
+#include "l2_bridge.h"
+#include "sock_profile.h"
+#include "cyc_probe.h"
+#include "dlog.h"
+#include "console.h"
+#include "intercore_batch.h"
+
 
 /* Additional Note:
  *     A7 <--> M4 communication is handled by shared memory.
@@ -68,10 +79,46 @@
 /* UART */
 static const uint8_t uart_port_num = OS_HAL_UART_PORT0;
 
-uint8_t spi_master_port_num = OS_HAL_SPIM_ISU1;
-uint32_t spi_master_speed = 2*10*1000; /* KHz */
+/* SPI clock of both W5500s */
+#define W5500_SPI_SPEED     (2*10*1000) /* KHz */
+
+/* W5500 chips. ETH1 on ISU1 is the private network chip every service runs on.
+ * On the stock ASG200, ISU0 (ETH0) carries an ENC28J60 owned by the HL app;
+ * define W5500_ETH0 on a board with a second W5500 there, and add "ISU0" and
+ * GPIO 5 to app_manifest.json. Sockets of both chips are served by the same
+ * event loop, see W5500_EVT_SID(). */
+// #define W5500_ETH0
+
+#define W5500_CHIP_ETH1     0
+#ifdef W5500_ETH0
+#define W5500_CHIP_ETH0     1
+#define W5500_CHIP_COUNT    2
+#else
+#define W5500_CHIP_COUNT    1
+#endif
+
+/* Bridge ETH0 and ETH1 at layer 2 through socket 0 of both chips, see
+ * l2_bridge.h. The mailbox TCP server moves from socket 0 to 4 of ETH1. */
+// #define L2_BRIDGE
+#if defined(L2_BRIDGE) && !defined(W5500_ETH0)
+#error "L2_BRIDGE needs W5500_ETH0"
+#endif
+
+/* ETH1 sockets and their buffer profiles */
+#include "eth1_sockets.h"
+
+/* Socket buffer profile of ETH1 at boot; the HL app can switch it at run time
+ * with an INTERCORE_RECORD_BUFFER_PROFILE record. */
+#define SOCK_PROFILE_DEFAULT        INTERCORE_BUFFER_BALANCED
+
+/* Print the per-socket throughput of ETH1 every SOCK_PROFILE_BENCHMARK_MS, to
+ * compare the profiles under a given load. */
+// #define SOCK_PROFILE_BENCHMARK
+#define SOCK_PROFILE_BENCHMARK_MS   10000
 
 extern uint32_t timestamp;
+extern volatile u32 sys_tick_in_ms;
+extern uint8_t DHCPs_SOCKET;
 
 #define SPIM_CLOCK_POLARITY SPI_CPOL_0
 #define SPIM_CLOCK_PHASE SPI_CPHA_0
@@ -120,7 +167,7 @@ static const uint32_t mbox_irq_status = 0x3;
 /****************************************************************************/
 /* Global Variables */
 /****************************************************************************/
-struct mtk_spi_config spi_default_config = {
+static struct mtk_spi_config spi_eth1_config = {
     .cpol = SPIM_CLOCK_POLARITY,
     .cpha = SPIM_CLOCK_PHASE,
     .rx_mlsb = SPIM_RX_MLSB,
@@ -134,6 +181,16 @@ struct mtk_spi_config spi_default_config = {
     .slave_sel = SPI_SELECT_DEVICE_0,
 #endif
 };
+#ifdef W5500_ETH0
+/* wired like ETH1, NCS on CSB */
+static struct mtk_spi_config spi_eth0_config = {
+    .cpol = SPIM_CLOCK_POLARITY,
+    .cpha = SPIM_CLOCK_PHASE,
+    .rx_mlsb = SPIM_RX_MLSB,
+    .tx_mlsb = SPIM_TX_MSLB,
+    .slave_sel = SPI_SELECT_DEVICE_1,
+};
+#endif
 #if 0
 uint8_t spim_tx_buf[SPIM_FULL_DUPLEX_MAX_LEN];
 uint8_t spim_rx_buf[SPIM_FULL_DUPLEX_MAX_LEN];
@@ -172,6 +229,18 @@ wiz_NetInfo gWIZNETINFO = {
     };
 #endif
 
+#ifdef W5500_ETH0
+/* ETH0 serves its own subnet */
+static wiz_NetInfo eth0_netinfo = {
+        {0x00, 0x08, 0xdc, 0xff, 0xfa, 0xfc},
+        {192, 168, 60, 1},
+        {255, 255, 255, 0},
+        {192, 168, 60, 1},
+        {8, 8, 8, 8},
+        NETINFO_STATIC
+    };
+#endif
+
 #define USE_READ_SYSRAM
 #ifdef USE_READ_SYSRAM
 uint8_t __attribute__((unused, section(".sysram"))) s0_Buf[2 * 1024];
@@ -190,24 +259,97 @@ BufferHeader *outbound, *inbound;
 static uint32_t mbox_shared_buf_size;
 volatile u8  blockDeqSema;
 volatile u8  blockFifoSema;
+volatile u8  blockReadSema;
 static const u32 pay_load_start_offset = 20; /* UUID 16B, Reserved 4B */
 
-/* GPIO */
-static const uint8_t gpio_w5500_reset = OS_HAL_GPIO_12;
-static const uint8_t gpio_w5500_ready = OS_HAL_GPIO_15;
+/* W5500 chips, indexed by W5500_CHIP_xxx */
+#define W5500_NO_GPIO       0xFF
+
+typedef struct {
+    const char *name;
+    wizchip_ctx ctx;            /* SPI bus, chip select and socket state */
+    wiz_NetInfo *netinfo;
+    uint8_t gpio_reset;         /* W5500_NO_GPIO: software reset only */
+    uint8_t gpio_ready;         /* W5500_NO_GPIO: not wired */
+    uint8_t gpio_int;           /* INTn, active low */
+    eint_number eint_int;
+    void (*int_handler)(void);
+} w5500_chip;
+
+static void w5500_eth1_int_handler(void);
+#ifdef W5500_ETH0
+static void w5500_eth0_int_handler(void);
+#endif
+
+static w5500_chip w5500_chips[W5500_CHIP_COUNT] = {
+    [W5500_CHIP_ETH1] = {
+        .name = "ETH1",
+        .ctx = {
+            .spi_port = OS_HAL_SPIM_ISU1,
+            .spi_config = &spi_eth1_config,
+            .spi_speed_khz = W5500_SPI_SPEED,
+        },
+        .netinfo = &gWIZNETINFO,
+        .gpio_reset = OS_HAL_GPIO_12,
+        .gpio_ready = OS_HAL_GPIO_15,
+        .gpio_int = OS_HAL_GPIO_2,              /* WIZNET_ASG200_ETH1_INT */
+        .eint_int = HAL_EINT_NUMBER_2,
+        .int_handler = w5500_eth1_int_handler,
+    },
+#ifdef W5500_ETH0
+    [W5500_CHIP_ETH0] = {
+        .name = "ETH0",
+        .ctx = {
+            .spi_port = OS_HAL_SPIM_ISU0,
+            .spi_config = &spi_eth0_config,
+            .spi_speed_khz = W5500_SPI_SPEED,
+        },
+        .netinfo = &eth0_netinfo,
+        .gpio_reset = W5500_NO_GPIO,
+        .gpio_ready = W5500_NO_GPIO,
+        .gpio_int = OS_HAL_GPIO_5,              /* WIZNET_ASG200_ETH0_INT */
+        .eint_int = HAL_EINT_NUMBER_5,
+        .int_handler = w5500_eth0_int_handler,
+    },
+#endif
+};
+
+static uint8_t sock_profile_active = INTERCORE_BUFFER_BALANCED;
+static uint8_t sock_profile_tx[_WIZCHIP_SOCK_NUM_];
+static uint8_t sock_profile_rx[_WIZCHIP_SOCK_NUM_];
+
+/* GPT0 runs from the 1KHz clock and gives the DHCP server and the bridge
+ * their 1 Hz tick in every build. With SNTP it also refreshes the seconds
+ * counter from the NTP clock, which keeps the GPT2 counter extension current. */
+#define SECOND_GPT		OS_HAL_GPT0
+#define SECOND_GPT_COUNT	1000
 
 
 /******************************************************************************/
 /* Applicaiton Hooks */
 /******************************************************************************/
-/* Hook for "printf". */
+/* Hook for "printf", buffered by the console. */
 void _putchar(char character)
 {
-	mtk_os_hal_uart_put_char(uart_port_num, character);
+	console_putc(character);
 	if (character == '\n')
-		mtk_os_hal_uart_put_char(uart_port_num, '\r');
+		console_putc('\r');
+}
+
+/* Faults print what the console still holds before the core stops. */
+static _Noreturn void fault_halt(const char *name)
+{
+	printf("\r\n*** %s fault, CFSR %08x HFSR %08x\r\n", name, SCB->CFSR, SCB->HFSR);
+	console_flush();
+	while (1)
+		;
 }
 
+void Hard_Fault_Handler(void) { fault_halt("Hard"); }
+void MPU_Fault_Handler(void) { fault_halt("MPU"); }
+void Bus_Fault_Handler(void) { fault_halt("Bus"); }
+void Usage_Fault_Handler(void) { fault_halt("Usage"); }
+
 /******************************************************************************/
 /* Functions */
 /******************************************************************************/
@@ -250,42 +392,45 @@ static int gpio_input(u8 gpio_no, os_hal_gpio_data *pvalue)
 	return 0;
 }
 
-// check w5500 network setting
-void InitPrivateNetInfo(void)
+// check w5500 network setting, on the selected chip
+void InitPrivateNetInfo(w5500_chip *chip)
 {
+	wiz_NetInfo *netinfo = chip->netinfo;
 	uint8_t tmpstr[6];
 	uint8_t i = 0;
 	ctlwizchip(CW_GET_ID, (void *)tmpstr);
 
 #ifdef NETINFO_USE_MANUAL
-	if (ctlnetwork(CN_SET_NETINFO, (void *)&gWIZNETINFO) < 0) {
+	if (ctlnetwork(CN_SET_NETINFO, (void *)netinfo) < 0) {
 		printf("ERROR: ctlnetwork SET\r\n");
 		while(1);
 	}
 
 	wiz_NetInfo netinfo_temp;
 
+	/* read the chip back, not the driver's copy of what was just written */
 	memset((void *)&netinfo_temp, 0, sizeof(netinfo_temp));
+	wizchip_shadow_invalidate();
 	ctlnetwork(CN_GET_NETINFO, (void *)&netinfo_temp);
 
-	if(memcmp((void *)&netinfo_temp, (void *)&gWIZNETINFO, sizeof(netinfo_temp)))
+	if(memcmp((void *)&netinfo_temp, (void *)netinfo, sizeof(netinfo_temp)))
 	{
 		printf("ERROR: NETINFO not matched\r\n");
 		while(1);
 	}
 
 #else
-	ctlnetwork(CN_GET_NETINFO, (void *)&gWIZNETINFO);
+	ctlnetwork(CN_GET_NETINFO, (void *)netinfo);
 #endif
 
-	printf("\r\n=== %s NET CONF ===\r\n", (char *)tmpstr);
-	printf("MAC: %02x:%02x:%02x:%02x:%02x:%02x\r\n", gWIZNETINFO.mac[0], gWIZNETINFO.mac[1], gWIZNETINFO.mac[2],
-		gWIZNETINFO.mac[3], gWIZNETINFO.mac[4], gWIZNETINFO.mac[5]);
+	printf("\r\n=== %s %s NET CONF ===\r\n", chip->name, (char *)tmpstr);
+	printf("MAC: %02x:%02x:%02x:%02x:%02x:%02x\r\n", netinfo->mac[0], netinfo->mac[1], netinfo->mac[2],
+		netinfo->mac[3], netinfo->mac[4], netinfo->mac[5]);
 
-	printf("SIP: %d.%d.%d.%d\r\n", gWIZNETINFO.ip[0], gWIZNETINFO.ip[1], gWIZNETINFO.ip[2], gWIZNETINFO.ip[3]);
-	printf("GAR: %d.%d.%d.%d\r\n", gWIZNETINFO.gw[0], gWIZNETINFO.gw[1], gWIZNETINFO.gw[2], gWIZNETINFO.gw[3]);
-	printf("SUB: %d.%d.%d.%d\r\n", gWIZNETINFO.sn[0], gWIZNETINFO.sn[1], gWIZNETINFO.sn[2], gWIZNETINFO.sn[3]);
-	printf("DNS: %d.%d.%d.%d\r\n", gWIZNETINFO.dns[0], gWIZNETINFO.dns[1], gWIZNETINFO.dns[2], gWIZNETINFO.dns[3]);
+	printf("SIP: %d.%d.%d.%d\r\n", netinfo->ip[0], netinfo->ip[1], netinfo->ip[2], netinfo->ip[3]);
+	printf("GAR: %d.%d.%d.%d\r\n", netinfo->gw[0], netinfo->gw[1], netinfo->gw[2], netinfo->gw[3]);
+	printf("SUB: %d.%d.%d.%d\r\n", netinfo->sn[0], netinfo->sn[1], netinfo->sn[2], netinfo->sn[3]);
+	printf("DNS: %d.%d.%d.%d\r\n", netinfo->dns[0], netinfo->dns[1], netinfo->dns[2], netinfo->dns[3]);
 	printf("======================\r\n");
 
 	// socket 0-7 closed
@@ -330,15 +475,147 @@ void mbox_fifo_cb(struct mtk_os_hal_mbox_cb_data *data)
 void mbox_swint_cb(struct mtk_os_hal_mbox_cb_data *data)
 {
 	if (data->swint.channel == OS_HAL_MBOX_CH0) {
+		/* A7 made room in the outbound ring for a parked mailbox socket */
+		if (data->swint.swint_sts & (1 << 0)) {
+			blockReadSema++;
+		}
 		if (data->swint.swint_sts & (1 << 1)) {
 			blockDeqSema++;
 		}
 	}
 }
 
+/* Lease records per mailbox record: 64 bytes, never cut short by mbox_batch_add. */
+#define LEASE_RECORD_ENTRIES    (MBOX_BATCH_MIN_RECORD / sizeof(intercore_lease_entry))
+
+/* Forward changed DHCP server leases to the HL app, which keeps them while the
+ * RT app restarts. A lease is only taken off the changed list once its record
+ * is in the ring; when the ring is full the rest waits for the next pass. */
+static void mbox_lease_sync(void)
+{
+    intercore_lease_entry entries[LEASE_RECORD_ENTRIES];
+    dhcps_lease_info info[LEASE_RECORD_ENTRIES];
+    uint8_t n, i;
+
+    do {
+        n = dhcps_lease_changed_peek(info, LEASE_RECORD_ENTRIES);
+        if (n == 0)
+            break;
+        for (i = 0; i < n; i++) {
+            memcpy(entries[i].mac, info[i].chaddr, sizeof(entries[i].mac));
+            memcpy(entries[i].ip, info[i].ip, sizeof(entries[i].ip));
+            entries[i].bound = info[i].bound;
+            entries[i].reserved = 0;
+            entries[i].remaining = info[i].remaining;
+        }
+        if (mbox_batch_add(DHCPs_SOCKET, INTERCORE_RECORD_LEASE,
+                (uint8_t *)entries, n * sizeof(entries[0])) <= 0)
+            break;
+        dhcps_lease_changed_take(n);
+    } while (n == LEASE_RECORD_ENTRIES);
+}
+
+/* Ask the HL app for the leases it kept from a previous run. */
+static void mbox_lease_request(void)
+{
+    static const uint8_t version = INTERCORE_BATCH_VERSION;
+
+    mbox_batch_add(DHCPs_SOCKET, INTERCORE_RECORD_LEASE_REQUEST, &version, sizeof(version));
+    mbox_batch_flush();
+}
+
+/* Switch the ETH1 socket buffers to a profile, which drops its connections,
+ * and tell the HL app the sizes now in effect. The profile already in effect
+ * is not applied again, so its connections stay up. */
+static void sock_profile_select(uint8_t profile)
+{
+    intercore_buffer_profile answer;
+    wizchip_ctx *prev;
+    uint8_t sn;
+
+    memset(&answer, 0, sizeof(answer));
+    answer.profile = profile;
+
+    if (profile >= INTERCORE_BUFFER_PROFILES) {
+        answer.status = 1;
+    } else if (profile != sock_profile_active) {
+        prev = wizchip_setctx(&w5500_chips[W5500_CHIP_ETH1].ctx);
+        if (sock_profile_apply(&sock_profiles[profile], sock_profile_tx, sock_profile_rx) == 0)
+            sock_profile_active = profile;
+        else
+            answer.status = 2;
+        wizchip_setctx(prev);
+        /* the handlers reopen their sockets */
+        w5500_evt_kick(W5500_CHIP_ETH1);
+    }
+
+    printf("Buffer profile %d \"%s\"%s\r\n", profile,
+        profile < INTERCORE_BUFFER_PROFILES ? sock_profiles[profile].name : "?",
+        answer.status ? " rejected" : "");
+    for (sn = 0; sn < _WIZCHIP_SOCK_NUM_; sn++) {
+        answer.tx_kb[sn] = sock_profile_tx[sn];
+        answer.rx_kb[sn] = sock_profile_rx[sn];
+    }
+    mbox_batch_add(MBOX_TCP_SOCKET, INTERCORE_RECORD_BUFFER_PROFILE,
+        (const uint8_t *)&answer, sizeof(answer));
+}
+
+/* Handle a batch frame from the HL app. Returns 0 if buf is not one. */
+static int mbox_handle_batch(const uint8_t *buf, u32 len)
+{
+    intercore_batch_header batch;
+    intercore_record_header rec;
+    intercore_lease_entry entry;
+    dhcps_lease_info info;
+    u32 off = sizeof(batch);
+    u32 i, e;
+
+    if (len < sizeof(batch))
+        return 0;
+    memcpy(&batch, buf, sizeof(batch));
+    if (batch.magic != INTERCORE_BATCH_MAGIC || batch.version != INTERCORE_BATCH_VERSION)
+        return 0;
+
+    for (i = 0; i < batch.count && len - off >= sizeof(rec); i++) {
+        memcpy(&rec, buf + off, sizeof(rec));
+        off += sizeof(rec);
+        if (rec.len > len - off)
+            break;
+
+        if (rec.flags & INTERCORE_RECORD_LEASE_REQUEST)
+            dhcps_lease_changed_all();
+
+        if (rec.flags & INTERCORE_RECORD_LEASE) {
+            for (e = 0; e + sizeof(entry) <= rec.len; e += sizeof(entry)) {
+                memcpy(&entry, buf + off + e, sizeof(entry));
+                memcpy(info.chaddr, entry.mac, sizeof(info.chaddr));
+                memcpy(info.ip, entry.ip, sizeof(info.ip));
+                info.bound = entry.bound;
+                info.remaining = entry.remaining;
+                dhcps_lease_restore(&info);
+            }
+        }
+
+        /* only the profile number of the command is used */
+        if ((rec.flags & INTERCORE_RECORD_BUFFER_PROFILE) && rec.len >= 1)
+            sock_profile_select(buf[off]);
+        if ((rec.flags & INTERCORE_RECORD_PROBE) && rec.len >= 1)
+            cyc_probe_command(buf[off]);
+        off += rec.len;
+    }
+
+    return 1;
+}
+
 void mbox_get_payload(u8 *mbox_buf, u32 mbox_data_len)
 {
     uint8_t* timebuf;
+
+    if (mbox_data_len < pay_load_start_offset)
+        return;
+    if (mbox_handle_batch(&mbox_buf[pay_load_start_offset],
+            mbox_data_len - pay_load_start_offset))
+        return;
 #if 0
 	u32 payload_len;
     payload_len = mbox_data_len - pay_load_start_offset;
@@ -367,6 +644,7 @@ void mbox_init(void)
 
 	blockDeqSema = 0;
 	blockFifoSema = 0;
+	blockReadSema = 0;
 
 	/* Register interrupt callback */
 	mask.channel = OS_HAL_MBOX_CH0;
@@ -386,21 +664,9 @@ void mbox_init(void)
 	// printf("Mbox local buf size = %d\n", MBOX_BUFFER_LEN_MAX);
 
 	memcpy((void*)&mbox_send_buf, (void*)&hlAppId, sizeof(hlAppId));
-}
 
-void mbox_send_data_a7(uint8_t* sock_data, uint32_t datasize)
-{
-    uint32_t size;
-	int result;
-
-    memcpy((void*)&mbox_send_buf[pay_load_start_offset], sock_data, datasize);
-    size = pay_load_start_offset + datasize;
-
-    /* Write to A7, enqueue to mailbox */
-	result = EnqueueData(inbound, outbound, mbox_shared_buf_size, mbox_send_buf, size);
-	if (result == -1) {
-		printf("Mailbox enqueue failed!\n");
-	}
+	mbox_batch_init(inbound, outbound, mbox_shared_buf_size,
+			mbox_send_buf, pay_load_start_offset);
 }
 
 void mbox_receive_data(void)
@@ -411,114 +677,389 @@ void mbox_receive_data(void)
     memset(mbox_recv_buf, 0, MBOX_BUFFER_LEN_MAX);
 
     /* Read from A7, dequeue from mailbox */
+    CYC_PROBE_BEGIN(INTERCORE_PROBE_MBOX_DEQUEUE);
     result = DequeueData(outbound, inbound, mbox_shared_buf_size, mbox_recv_buf, &buf_len);
+    CYC_PROBE_END(INTERCORE_PROBE_MBOX_DEQUEUE);
     if (result == -1 || buf_len < pay_load_start_offset) {
-        printf("Mailbox dequeue failed!\n");
+        DLOG(DLOG_MBOX_DEQUEUE_FAILED);
     }
     mbox_get_payload(mbox_recv_buf, buf_len);
 }
 
-void mbox_tcp_server(uint8_t sn, uint8_t* sock_buf, uint16_t port)
+/* Receive up to size bytes from a TCP socket straight into the open mailbox
+ * batch as one record. Data that does not fit stays in the W5500 and is picked
+ * up on the next call. Returns the record length, 0 if the ring is full.
+ */
+static int32_t mbox_sock_recv_batch(uint8_t sn, uint16_t size)
+{
+    mbox_span span;
+    wiz_iovec iov[2];
+    int32_t len;
+
+    len = mbox_batch_record(sn, size, &span);
+    if (len <= 0)
+        return 0;
+
+    iov[0].buf = span.first;
+    iov[0].len = span.firstSize;
+    iov[1].buf = span.second;
+    iov[1].len = span.secondSize;
+    wiz_recv_datav(sn, iov, 2, (uint16_t)len);
+
+    setSn_CR(sn, Sn_CR_RECV);
+    while (getSn_CR(sn));
+
+    return len;
+}
+
+void mbox_tcp_server(uint8_t sn, uint16_t port)
 {
     int32_t ret;
     uint16_t size = 0;
+    wiz_SnSnapshot snap;
 
-	for (int i = 0; i < DATA_BUF_SIZE; i++) {
-        sock_buf[i] = NULL;
-    }
+    getSn_SNAPSHOT(sn, &snap);
 
-    switch (getSn_SR(sn))
+    switch (snap.sr)
     {
     case SOCK_ESTABLISHED:
-        if (getSn_IR(sn) & Sn_IR_CON)
+        if (snap.ir & Sn_IR_CON)
         {
             setSn_IR(sn, Sn_IR_CON);
         }
-        if ((size = getSn_RX_RSR(sn)) > 0) // Don't need to check SOCKERR_BUSY because it doesn't not occur.
+        if ((size = snap.rx_rsr) > 0) // Don't need to check SOCKERR_BUSY because it doesn't not occur.
         {
-            if (size > DATA_BUF_SIZE)
-                size = DATA_BUF_SIZE;
-
-            ret = sock_recv(sn, sock_buf, size);
-
-            if (ret <= 0)
-                return ret; // check SOCKERR_BUSY & SOCKERR_XXX. For showing the occurrence of SOCKERR_BUSY.
-
-            printf("Received data from socket %d : (%d) %s\r\n", sn, size, sock_buf);
-
-            // Send data to a7 core
-			mbox_send_data_a7(sock_buf, size);
+            // Send data to a7 core, batched in place in the mailbox ring
+            ret = mbox_sock_recv_batch(sn, size);
+            if (ret > 0)
+                DLOG(DLOG_MBOX_TCP_RECV, sn, ret);
+            else
+                w5500_evt_park(sn);     /* ring full, see mbox_swint_cb() */
         }
         break;
     case SOCK_CLOSE_WAIT:
         if ((ret = sock_disconnect(sn)) != SOCK_OK)
-            return ret;
-        printf("%d : Socket Closed\r\n", sn);
+            return;
+        DLOG(DLOG_MBOX_TCP_CLOSED, sn);
         break;
     case SOCK_INIT:
-        printf("%d : Listen, TCP server, port [%d]\r\n", sn, port);
+        DLOG(DLOG_MBOX_TCP_LISTEN, sn, port);
         if ((ret = sock_listen(sn)) != SOCK_OK)
-            return ret;
+            return;
         break;
     case SOCK_CLOSED:
         if ((ret = wiz_socket(sn, Sn_MR_TCP, port, 0x00)) != sn)
-            return ret;
-        printf("%d : Socket Opened\r\n", sn);
+            return;
+        DLOG(DLOG_MBOX_TCP_OPENED, sn);
         break;
     default:
         break;
     }
 }
 
-void w5500_init() {
+/* Reset the selected chip */
+void w5500_init(w5500_chip *chip) {
     
-    // W5500 reset
-    gpio_output(gpio_w5500_reset, OS_HAL_GPIO_DATA_LOW);
-    osai_delay_ms(1);
-    
-    gpio_output(gpio_w5500_reset, OS_HAL_GPIO_DATA_HIGH);
-    osai_delay_ms(1);
+    if (chip->gpio_reset == W5500_NO_GPIO) {
+        wizchip_sw_reset();
+    } else {
+        // W5500 reset
+        gpio_output(chip->gpio_reset, OS_HAL_GPIO_DATA_LOW);
+        osai_delay_ms(1);
+
+        gpio_output(chip->gpio_reset, OS_HAL_GPIO_DATA_HIGH);
+        osai_delay_ms(1);
+        wizchip_shadow_invalidate();
+    }
 
     // W5500 ready check
-    os_hal_gpio_data w5500_ready;
-    gpio_input(gpio_w5500_ready, &w5500_ready);
+    if (chip->gpio_ready != W5500_NO_GPIO) {
+        os_hal_gpio_data w5500_ready;
+        gpio_input(chip->gpio_ready, &w5500_ready);
 
-    while (1) {
-        if (w5500_ready) break;
+        while (1) {
+            if (w5500_ready) break;
+        }
     }
 
     osai_delay_ms(100);
 
-    wizchip_setnetinfo_partial(&gWIZNETINFO);
+    wizchip_setnetinfo_partial(chip->netinfo);
     printf("Network Configuration from TinyMCU\r\n");
 }
 
+// #define SPI_BENCHMARK
+#ifdef SPI_BENCHMARK
+#define SPI_BENCHMARK_LEN	2048
+#define SPI_BENCHMARK_LOOP	64
+#define SPI_BENCHMARK_CHUNK	32	/* SPIM half-duplex limit */
+
+/* Read the socket 7 RX buffer over and over, once with a blocking transfer per
+ * chunk and once through the SPIM transaction queue, and print the throughput.
+ */
+static void spi_benchmark(void)
+{
+    const wizchip_ctx *ctx = &w5500_chips[W5500_CHIP_ETH1].ctx;
+    struct mtk_spi_transfer xfer;
+    uint32_t addrsel = (WIZCHIP_RXBUF_BLOCK(7) << 3) | _W5500_SPI_READ_;
+    uint32_t start, elapsed;
+    uint16_t off;
+    int loop, mode;
+
+    memset(&xfer, 0, sizeof(xfer));
+    xfer.speed_khz = ctx->spi_speed_khz;
+    xfer.opcode_len = 3;
+    xfer.len = SPI_BENCHMARK_CHUNK;
+
+    for (mode = 0; mode < 2; mode++) {
+        start = sys_tick_in_ms;
+        for (loop = 0; loop < SPI_BENCHMARK_LOOP; loop++) {
+            for (off = 0; off < SPI_BENCHMARK_LEN; off += SPI_BENCHMARK_CHUNK) {
+                xfer.opcode = (((u32)off << 8) | addrsel) & 0xffffff;
+                xfer.rx_buf = &s0_Buf[off];
+                if (mode == 0)
+                    mtk_os_hal_spim_transfer((spim_num)ctx->spi_port,
+                        ctx->spi_config, &xfer);
+                else
+                    while (mtk_os_hal_spim_queue_submit((spim_num)ctx->spi_port,
+                            ctx->spi_config, &xfer, NULL, NULL) == -2)
+                        ;
+            }
+            if (mode == 1)
+                mtk_os_hal_spim_queue_flush((spim_num)ctx->spi_port, 1000);
+        }
+        elapsed = sys_tick_in_ms - start;
+        if (elapsed == 0)
+            elapsed = 1;
+
+        printf("SPI benchmark %s: %d bytes in %d ms, %d KB/s\r\n",
+            mode ? "queued" : "blocking",
+            SPI_BENCHMARK_LEN * SPI_BENCHMARK_LOOP, elapsed,
+            (SPI_BENCHMARK_LEN * SPI_BENCHMARK_LOOP) / elapsed);
+    }
+}
+#endif
+
+#ifdef SOCK_PROFILE_BENCHMARK
+/* Throughput of every ETH1 socket over the last period, with its buffers.
+ * Bytes per millisecond are kB/s. */
+static void sock_profile_benchmark(void)
+{
+    static uint32_t last_ms;
+    static w5500_evt_traffic last[_WIZCHIP_SOCK_NUM_];
+    w5500_evt_traffic now;
+    uint32_t elapsed = sys_tick_in_ms - last_ms;
+    uint8_t sn;
+
+    if (elapsed < SOCK_PROFILE_BENCHMARK_MS)
+        return;
+
+    printf("Buffer profile \"%s\", last %d ms:\r\n",
+        sock_profiles[sock_profile_active].name, elapsed);
+    for (sn = 0; sn < _WIZCHIP_SOCK_NUM_; sn++) {
+        w5500_evt_get_traffic(W5500_EVT_SID(W5500_CHIP_ETH1, sn), &now);
+        printf("  socket %d: RX %d kB/s (%d KB buffer), TX %d kB/s (%d KB buffer)\r\n", sn,
+            (now.rx_bytes - last[sn].rx_bytes) / elapsed, sock_profile_rx[sn],
+            (now.tx_bytes - last[sn].tx_bytes) / elapsed, sock_profile_tx[sn]);
+        last[sn] = now;
+    }
+    last_ms = sys_tick_in_ms;
+}
+#endif
+
+/* W5500 INTn EINT handlers, flag the event for the main loop. ETH1 also stamps
+ * the time for the SNTP receive timestamp, and both stamp it for the bridge
+ * latency counter. */
+static void w5500_eth1_int_handler(void)
+{
+    ntp_clock_capture();
+#ifdef L2_BRIDGE
+    l2_bridge_stamp(W5500_CHIP_ETH1);
+#endif
+    w5500_evt_signal(W5500_CHIP_ETH1);
+}
+
+#ifdef W5500_ETH0
+static void w5500_eth0_int_handler(void)
+{
+#ifdef L2_BRIDGE
+    l2_bridge_stamp(W5500_CHIP_ETH0);
+#endif
+    w5500_evt_signal(W5500_CHIP_ETH0);
+}
+#endif
+
+static void w5500_int_init(w5500_chip *chip)
+{
+    int ret;
+
+    ret = mtk_os_hal_gpio_request(chip->gpio_int);
+    if (ret != 0) {
+        printf("request gpio[%d] fail\n", chip->gpio_int);
+        return;
+    }
+    mtk_os_hal_gpio_set_direction(chip->gpio_int, OS_HAL_GPIO_DIR_INPUT);
+
+    ret = mtk_os_hal_eint_register(chip->eint_int, HAL_EINT_EDGE_FALLING, chip->int_handler);
+    if (ret < 0)
+        printf("%s INTn eint register failed (%d)\n", chip->name, ret);
+}
+
+/* Socket event handlers. The wrapped state machines still read Sn_SR themselves,
+ * they are just no longer polled when nothing happened. */
+static void dhcps_evt(uint8_t sn, uint8_t ir)
+{
+    CYC_PROBE_BEGIN(INTERCORE_PROBE_DHCPS_RUN);
+    dhcps_run();
+    CYC_PROBE_END(INTERCORE_PROBE_DHCPS_RUN);
+}
+
+#ifndef TEST_AX1
+static void sntps_evt(uint8_t sn, uint8_t ir)
+{
+    CYC_PROBE_BEGIN(INTERCORE_PROBE_SNTPS_RUN);
+    SNTPs_run();
+    CYC_PROBE_END(INTERCORE_PROBE_SNTPS_RUN);
+}
+#endif
+
+/* TCP echo on the non-blocking send path. Only as much is read as the TX
+ * buffer can take, so nothing has to be kept aside: the rest stays in RX,
+ * closing the peer's window, until SENDOK makes room. The other states are
+ * left to the loopback example. */
+static void loopback_echo(uint8_t sn)
+{
+    wiz_SnSnapshot snap;
+    uint16_t room, size;
+    int32_t ret;
+
+    getSn_SNAPSHOT(sn, &snap);
+    if (snap.sr != SOCK_ESTABLISHED) {
+        loopback_tcps(sn, s1_Buf, 50001);
+        return;
+    }
+    if (snap.rx_rsr == 0)
+        return;
+
+    room = getSn_TxMAX(sn) - (uint16_t)(snap.tx_wr - snap.tx_rd);
+    if (room == 0) {
+        w5500_evt_wait_sent(sn);
+        return;
+    }
+
+    size = snap.rx_rsr;
+    if (size > room)
+        size = room;
+    if (size > sizeof(s1_Buf))
+        size = sizeof(s1_Buf);
+
+    ret = sock_recv(sn, s1_Buf, size);
+    if (ret > 0)
+        sock_send_async(sn, s1_Buf, (uint16_t)ret);
+}
+
+static void loopback_evt(uint8_t sn, uint8_t ir)
+{
+    CYC_PROBE_BEGIN(INTERCORE_PROBE_LOOPBACK);
+    loopback_echo(sn);
+    CYC_PROBE_END(INTERCORE_PROBE_LOOPBACK);
+}
+
+static void mbox_tcp_evt(uint8_t sn, uint8_t ir)
+{
+    CYC_PROBE_BEGIN(INTERCORE_PROBE_MBOX_TCP);
+    mbox_tcp_server(sn, 5000);
+    CYC_PROBE_END(INTERCORE_PROBE_MBOX_TCP);
+}
+
+#if defined(L2_BRIDGE) && !defined(TEST_AX1)
+/* Microseconds from the NTP clock, for the bridge latency counter */
+static uint32_t l2_bridge_clock_us(void)
+{
+    ntp_timestamp now;
+
+    ntp_clock_get(&now);
+    return now.second * 1000000 + ntp_clock_frac_to_us(now.fraction);
+}
+#endif
+
+static void second_gpt_cb(void *unused)
+{
+#ifndef TEST_AX1
+    ntp_timestamp now;
+
+    ntp_clock_get(&now);
+    timestamp = now.second;
+#endif
+
+    dhcps_time_handler();
+#ifdef L2_BRIDGE
+    l2_bridge_time_handler();
+#endif
+}
+
+static struct os_gpt_int second_gpt_int = {
+    .gpt_cb_hdl = second_gpt_cb,
+    .gpt_cb_data = NULL,
+};
+
+#ifndef TEST_AX1
+static void timestamp_clock_init(void)
+{
+    ntp_clock_init(timestamp, 0);
+    reg_sntps_clock_cbfunc(ntp_clock_get, ntp_clock_take_capture, ntp_clock_sync,
+                           NTP_CLOCK_PRECISION);
+}
+#endif
+
+static void second_tick_init(void)
+{
+    mtk_os_hal_gpt_init();
+    mtk_os_hal_gpt_config(SECOND_GPT, 0, &second_gpt_int);
+    mtk_os_hal_gpt_reset_timer(SECOND_GPT, SECOND_GPT_COUNT, true);
+    mtk_os_hal_gpt_start(SECOND_GPT);
+}
+
 _Noreturn void RTCoreMain(void)
 {
-    u32 i = 0;
+    uint8_t chip;
     
     /* Init Vector Table */
     NVIC_SetupVectorTable();
 
+    /* Cycle counter of the probes */
+    cyc_probe_init();
+
     /* Init UART */
     mtk_os_hal_uart_ctlr_init(uart_port_num);
+    console_init(uart_port_num, CONSOLE_OVERFLOW_DROP);
     //printf("\nUART Inited (port_num=%d)\n", uart_port_num);
 
     /* Init SPIM */
-    mtk_os_hal_spim_ctlr_init(spi_master_port_num);
+    for (chip = 0; chip < W5500_CHIP_COUNT; chip++)
+        mtk_os_hal_spim_ctlr_init(w5500_chips[chip].ctx.spi_port);
 
     printf("--------------------------------\r\n");
     printf("W5500_RTApp_MT3620_BareMetal\r\n");
     printf("App built on: " __DATE__ " " __TIME__ "\r\n");
 
-    /* Init W5500 */
-    w5500_init();
+    /* Init W5500s, socket events are driven by their INTn lines */
+    w5500_evt_init();
+    for (chip = 0; chip < W5500_CHIP_COUNT; chip++) {
+        wizchip_setctx(&w5500_chips[chip].ctx);
+        w5500_init(&w5500_chips[chip]);
+        InitPrivateNetInfo(&w5500_chips[chip]);
+        w5500_evt_attach(chip, &w5500_chips[chip].ctx);
+    }
 
-    InitPrivateNetInfo();
+    /* The services below run on ETH1 */
+    wizchip_setctx(&w5500_chips[W5500_CHIP_ETH1].ctx);
 // #define TEST_AX1
-    dhcps_init(2, gDATABUF);
+    sock_profile_apply(&sock_profiles[SOCK_PROFILE_DEFAULT], sock_profile_tx, sock_profile_rx);
+    sock_profile_active = SOCK_PROFILE_DEFAULT;
+    dhcps_init(DHCP_SERVER_SOCKET, gDATABUF);
 #ifndef TEST_AX1
-    SNTPs_init(3, gsntpDATABUF);
+    SNTPs_init(SNTP_SERVER_SOCKET, gsntpDATABUF);
 #endif
 
 #if 1
@@ -529,37 +1070,75 @@ _Noreturn void RTCoreMain(void)
 #endif
 
 	mbox_init();
+    mbox_lease_request();
 
-#if 0
-	for (;;) 
-		__asm__("wfi");
+#ifdef SPI_BENCHMARK
+    spi_benchmark();
+#endif
+
+    w5500_evt_register(W5500_EVT_SID(W5500_CHIP_ETH1, MBOX_TCP_SOCKET), mbox_tcp_evt);
+    w5500_evt_register(W5500_EVT_SID(W5500_CHIP_ETH1, LOOPBACK_SOCKET), loopback_evt);
+    w5500_evt_register_sent(W5500_EVT_SID(W5500_CHIP_ETH1, LOOPBACK_SOCKET), NULL);
+    w5500_evt_register(W5500_EVT_SID(W5500_CHIP_ETH1, DHCP_SERVER_SOCKET), dhcps_evt);
+#ifndef TEST_AX1
+    w5500_evt_register(W5500_EVT_SID(W5500_CHIP_ETH1, SNTP_SERVER_SOCKET), sntps_evt);
+    timestamp_clock_init();
+#endif
+#ifdef W5500_ETH0
+    w5500_evt_register(W5500_EVT_SID(W5500_CHIP_ETH0, 1), loopback_evt);
+    w5500_evt_register_sent(W5500_EVT_SID(W5500_CHIP_ETH0, 1), NULL);
+#endif
+#ifdef L2_BRIDGE
+#ifndef TEST_AX1
+    l2_bridge_init(&w5500_chips[0].ctx, &w5500_chips[1].ctx, l2_bridge_clock_us);
 #else
+    l2_bridge_init(&w5500_chips[0].ctx, &w5500_chips[1].ctx, NULL);
+#endif
+    w5500_evt_register(W5500_EVT_SID(W5500_CHIP_ETH1, L2_BRIDGE_SOCKET), l2_bridge_evt);
+    w5500_evt_register(W5500_EVT_SID(W5500_CHIP_ETH0, L2_BRIDGE_SOCKET), l2_bridge_evt);
+#endif
+    second_tick_init();
+    for (chip = 0; chip < W5500_CHIP_COUNT; chip++)
+        w5500_int_init(&w5500_chips[chip]);
+
     while (1)
     {
-        dhcps_run();
-        
-#ifndef TEST_AX1
-        SNTPs_run();
-#endif
-        // loopback_tcps(0, s0_Buf, 50000);
-        loopback_tcps(1, s1_Buf, 50001);
+        if (w5500_evt_pending())
+            w5500_evt_dispatch();
 
-		mbox_tcp_server(0, s0_Buf, 5000);
         if (blockDeqSema != 0) {
             mbox_receive_data();
             blockDeqSema--;
         }
 
-#ifndef TEST_AX1
-        i++;
-        if(i > 10000)
-        {
-          timestamp++;
-          i = 0;
+        if (blockReadSema != 0) {
+            blockReadSema = 0;
+            w5500_evt_unpark(W5500_EVT_SID(W5500_CHIP_ETH1, MBOX_TCP_SOCKET));
         }
+
+        dhcps_lease_sweep();
+#ifdef L2_BRIDGE
+        l2_bridge_sweep();
 #endif
-    }
+        mbox_lease_sync();
+        mbox_batch_poll();
+#ifdef DLOG_DEFERRED
+        if (!w5500_evt_pending())
+            dlog_drain();
+#endif
+        console_poll();
+#ifdef SOCK_PROFILE_BENCHMARK
+        sock_profile_benchmark();
 #endif
 
+        /* Sleep until INTn, the mailbox or the next tick; the 1 ms SysTick
+         * bounds the batch flush latency. WFI still wakes on an interrupt
+         * that became pending while they were masked. */
+        __disable_irq();
+        if (!w5500_evt_pending() && blockDeqSema == 0 && blockReadSema == 0)
+            __WFI();
+        __enable_irq();
+    }
+
 }
 
@@ -0,0 +1,172 @@
+/*
+ * RT -> HL record batching over the shared-memory mailbox.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "printf.h"
+
+#include "intercore_batch.h"
+#include "mbox_batch.h"
+#include "cyc_probe.h"
+
+extern volatile u32 sys_tick_in_ms;
+extern uint32_t timestamp;
+
+static BufferHeader *batch_inbound, *batch_outbound;
+static u32 batch_buf_size;
+static const void *batch_prefix;
+static u32 batch_prefix_size;
+
+static RingReservation batch_res;
+static uint8_t batch_open;
+static uint8_t batch_count;
+static uint16_t batch_used;         /* payload bytes, batch header included */
+static uint32_t batch_start_ms;     /* tick of the first record */
+
+/* Describe [off, off + len) of the reserved payload area. */
+static void batch_span(uint16_t off, uint16_t len, mbox_span *span)
+{
+    if (off >= batch_res.firstSize) {
+        span->first = batch_res.second + (off - batch_res.firstSize);
+        span->firstSize = len;
+        span->second = NULL;
+        span->secondSize = 0;
+        return;
+    }
+
+    span->first = batch_res.first + off;
+    span->firstSize = len;
+    span->second = NULL;
+    span->secondSize = 0;
+    if (off + len > batch_res.firstSize) {
+        span->firstSize = batch_res.firstSize - off;
+        span->second = batch_res.second;
+        span->secondSize = len - span->firstSize;
+    }
+}
+
+static void batch_write(uint16_t off, const void *src, uint16_t len)
+{
+    mbox_span span;
+
+    batch_span(off, len, &span);
+    memcpy(span.first, src, span.firstSize);
+    memcpy(span.second, (const uint8_t *)src + span.firstSize, span.secondSize);
+}
+
+static int batch_begin(void)
+{
+    if (ReserveData(batch_inbound, batch_outbound, batch_buf_size,
+            batch_prefix, batch_prefix_size, INTERCORE_BATCH_MAX, &batch_res) == -1)
+        return -1;
+
+    batch_open = 1;
+    batch_count = 0;
+    batch_used = sizeof(intercore_batch_header);
+    return 0;
+}
+
+void mbox_batch_init(BufferHeader *inbound, BufferHeader *outbound, u32 bufSize,
+                     const void *header, u32 headerSize)
+{
+    batch_inbound = inbound;
+    batch_outbound = outbound;
+    batch_buf_size = bufSize;
+    batch_prefix = header;
+    batch_prefix_size = headerSize;
+    batch_open = 0;
+}
+
+static int32_t batch_record(uint8_t sn, uint8_t flags, uint16_t len, mbox_span *span)
+{
+    intercore_record_header rec;
+    uint16_t room, want;
+
+    if (len == 0)
+        return 0;
+
+    if (batch_open) {
+        room = INTERCORE_BATCH_MAX - batch_used;
+        want = len < MBOX_BATCH_MIN_RECORD ? len : MBOX_BATCH_MIN_RECORD;
+        if (room < sizeof(rec) + want || batch_count == 0xFF)
+            mbox_batch_flush();
+    }
+
+    if (!batch_open && batch_begin() == -1)
+        return -1;
+
+    room = INTERCORE_BATCH_MAX - batch_used - sizeof(rec);
+    if (len > room)
+        len = room;
+
+    if (batch_count == 0)
+        batch_start_ms = sys_tick_in_ms;
+
+    rec.len = len;
+    rec.socket = sn;
+    rec.flags = flags;
+    rec.tick = sys_tick_in_ms;
+    batch_write(batch_used, &rec, sizeof(rec));
+    batch_span(batch_used + sizeof(rec), len, span);
+
+    batch_used += sizeof(rec) + len;
+    batch_count++;
+
+    return len;
+}
+
+int32_t mbox_batch_record(uint8_t sn, uint16_t len, mbox_span *span)
+{
+    return batch_record(sn, 0, len, span);
+}
+
+int32_t mbox_batch_add(uint8_t sn, uint8_t flags, const uint8_t *data, uint16_t len)
+{
+    mbox_span span;
+    int32_t granted;
+
+    granted = batch_record(sn, flags, len, &span);
+    if (granted <= 0)
+        return granted;
+
+    memcpy(span.first, data, span.firstSize);
+    memcpy(span.second, data + span.firstSize, span.secondSize);
+    return granted;
+}
+
+int mbox_batch_flush(void)
+{
+    intercore_batch_header hdr;
+    int ret;
+
+    if (!batch_open || batch_count == 0)
+        return 0;
+
+    hdr.magic = INTERCORE_BATCH_MAGIC;
+    hdr.version = INTERCORE_BATCH_VERSION;
+    hdr.count = batch_count;
+    hdr.epoch = timestamp;
+    hdr.tick = sys_tick_in_ms;
+    batch_write(0, &hdr, sizeof(hdr));
+
+    batch_open = 0;
+    CYC_PROBE_BEGIN(INTERCORE_PROBE_MBOX_ENQUEUE);
+    ret = CommitData(batch_outbound, batch_buf_size, &batch_res, batch_used);
+    CYC_PROBE_END(INTERCORE_PROBE_MBOX_ENQUEUE);
+    if (ret == -1)
+        printf("Mailbox batch commit failed!\n");
+
+    return ret;
+}
+
+void mbox_batch_poll(void)
+{
+    if (!batch_open || batch_count == 0)
+        return;
+
+    if (batch_used >= MBOX_BATCH_FLUSH_BYTES ||
+        sys_tick_in_ms - batch_start_ms >= MBOX_BATCH_FLUSH_MS)
+        mbox_batch_flush();
+}
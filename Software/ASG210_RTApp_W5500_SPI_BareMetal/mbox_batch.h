@@ -0,0 +1,55 @@
+/*
+ * RT -> HL record batching over the shared-memory mailbox.
+ *
+ * A batch is a ring reservation (see ReserveData) that records are written
+ * into in place; it is committed as one mailbox block when it is full, when
+ * the oldest record is MBOX_BATCH_FLUSH_MS old, or on mbox_batch_flush().
+ * The frame format is described in intercore_batch.h.
+ * While a batch is open it owns the outbound ring: do not call EnqueueData.
+ */
+
+#ifndef __MBOX_BATCH_H__
+#define __MBOX_BATCH_H__
+
+#include <stdint.h>
+
+#include "os_hal_mbox.h"
+#include "os_hal_mbox_shared_mem.h"
+
+/* Flush once this many bytes are batched ... */
+#define MBOX_BATCH_FLUSH_BYTES      768
+/* ... or once the oldest record is this old. */
+#define MBOX_BATCH_FLUSH_MS         20
+
+/* Don't start a record in a batch with less room than this; flush instead. */
+#define MBOX_BATCH_MIN_RECORD       64
+
+/* Where the payload of one record goes, possibly split by the ring wrap. */
+typedef struct {
+    uint8_t *first;
+    uint16_t firstSize;
+    uint8_t *second;
+    uint16_t secondSize;
+} mbox_span;
+
+/* header/headerSize: the component ID prefix written in front of every block. */
+void mbox_batch_init(BufferHeader *inbound, BufferHeader *outbound, u32 bufSize,
+                     const void *header, u32 headerSize);
+
+/* Start a record of up to len bytes from socket sn. Returns the number of
+ * bytes granted (the caller must fill exactly that many through span), or
+ * -1 if the mailbox ring has no room for a batch. */
+int32_t mbox_batch_record(uint8_t sn, uint16_t len, mbox_span *span);
+
+/* Copying variant of mbox_batch_record for data already in memory; flags are
+ * the INTERCORE_RECORD_* bits of the record. A record of up to
+ * MBOX_BATCH_MIN_RECORD bytes is never cut short. */
+int32_t mbox_batch_add(uint8_t sn, uint8_t flags, const uint8_t *data, uint16_t len);
+
+/* Commit the open batch, if it has records. */
+int mbox_batch_flush(void);
+
+/* Apply the size and age thresholds; call from the main loop. */
+void mbox_batch_poll(void);
+
+#endif /* __MBOX_BATCH_H__ */
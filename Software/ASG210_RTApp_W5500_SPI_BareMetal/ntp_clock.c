@@ -0,0 +1,124 @@
+/*
+ * High-resolution NTP clock for the SNTP server.
+ */
+
+#include <stddef.h>
+
+#include "nvic.h"
+#include "os_hal_gpt.h"
+
+#include "ntp_clock.h"
+
+/* GPT2 is the free-running counter of the 32 kHz domain. */
+#define NTP_CLOCK_GPT               OS_HAL_GPT2
+
+#define NTP_CLOCK_STEP_LIMIT        (((int64_t)NTP_CLOCK_STEP_LIMIT_MS << 32) / 1000)
+
+static uint64_t clk_base;           /* NTP time at clk_last_raw */
+static uint32_t clk_last_raw;       /* counter value clk_base was taken at */
+static int64_t clk_slew;            /* offset still to be slewed in */
+static uint8_t clk_synced;
+
+static ntp_timestamp clk_capture;
+static volatile uint8_t clk_capture_valid;
+
+/* Move clk_base forward to the counter value raw, applying as much of the
+ * pending slew as NTP_CLOCK_SLEW_PPM allows over the elapsed time. */
+static uint64_t ntp_clock_advance(uint32_t raw)
+{
+    uint64_t delta = ntp_clock_ticks_to_ntp((uint32_t)(raw - clk_last_raw));
+    uint64_t adj = delta * NTP_CLOCK_SLEW_PPM / 1000000;
+
+    if (clk_slew > 0) {
+        if (adj > (uint64_t)clk_slew)
+            adj = clk_slew;
+        delta += adj;
+        clk_slew -= adj;
+    } else if (clk_slew < 0) {
+        if (adj > (uint64_t)-clk_slew)
+            adj = -clk_slew;
+        delta -= adj;
+        clk_slew += adj;
+    }
+
+    clk_base += delta;
+    clk_last_raw = raw;
+
+    return clk_base;
+}
+
+static uint64_t ntp_clock_now(void)
+{
+    return ntp_clock_advance(mtk_os_hal_gpt_get_cur_count(NTP_CLOCK_GPT));
+}
+
+void ntp_clock_init(uint32_t sec, uint32_t frac)
+{
+    uint32_t flag;
+
+    mtk_os_hal_gpt_init();
+    mtk_os_hal_gpt_config(NTP_CLOCK_GPT, 1, NULL);
+    mtk_os_hal_gpt_start(NTP_CLOCK_GPT);
+
+    local_irq_save(flag);
+    clk_last_raw = mtk_os_hal_gpt_get_cur_count(NTP_CLOCK_GPT);
+    clk_base = ((uint64_t)sec << 32) | frac;
+    clk_slew = 0;
+    clk_synced = 0;
+    clk_capture_valid = 0;
+    local_irq_restore(flag);
+}
+
+void ntp_clock_get(ntp_timestamp *ts)
+{
+    uint32_t flag;
+    uint64_t now;
+
+    local_irq_save(flag);
+    now = ntp_clock_now();
+    local_irq_restore(flag);
+
+    ts->second = now >> 32;
+    ts->fraction = (uint32_t)now;
+}
+
+void ntp_clock_sync(uint32_t sec, uint32_t frac)
+{
+    uint32_t flag;
+    uint64_t target = ((uint64_t)sec << 32) | frac;
+    int64_t offset;
+
+    local_irq_save(flag);
+    offset = (int64_t)(target - ntp_clock_now());
+    if (!clk_synced || offset > NTP_CLOCK_STEP_LIMIT || offset < -NTP_CLOCK_STEP_LIMIT) {
+        clk_base = target;
+        clk_slew = 0;
+        clk_synced = 1;
+    } else {
+        /* Measured against the corrected time, so it replaces what is left. */
+        clk_slew = offset;
+    }
+    local_irq_restore(flag);
+}
+
+void ntp_clock_capture(void)
+{
+    ntp_clock_get(&clk_capture);
+    clk_capture_valid = 1;
+}
+
+int ntp_clock_take_capture(ntp_timestamp *ts)
+{
+    uint32_t flag;
+    int ret = -1;
+
+    local_irq_save(flag);
+    if (clk_capture_valid) {
+        *ts = clk_capture;
+        clk_capture_valid = 0;
+        ret = 0;
+    }
+    local_irq_restore(flag);
+
+    return ret;
+}
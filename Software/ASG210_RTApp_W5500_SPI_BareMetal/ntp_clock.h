@@ -0,0 +1,65 @@
+/*
+ * High-resolution NTP clock for the SNTP server.
+ *
+ * Time is kept as a 64-bit NTP timestamp (seconds since 1900 in the upper 32
+ * bits, binary fraction in the lower 32) advanced by a free-running 32.768 kHz
+ * GPT counter. One counter tick is exactly 2^17 fraction units, so no division
+ * is needed on the read path.
+ *
+ * ntp_clock_sync() slews the clock toward a reference time by at most
+ * NTP_CLOCK_SLEW_PPM, so the served time never jumps; only the first sync, or
+ * an offset beyond NTP_CLOCK_STEP_LIMIT_MS, steps it.
+ *
+ * ntp_clock_get() must run at least once per counter wrap (36 hours); the
+ * 1 Hz timestamp tick takes care of that.
+ */
+
+#ifndef __NTP_CLOCK_H__
+#define __NTP_CLOCK_H__
+
+#include <stdint.h>
+
+#include "ioLibrary_Driver/Internet/SNTP/sntps.h"
+
+#define NTP_CLOCK_HZ                32768
+#define NTP_CLOCK_TICK_SHIFT        17      /* 2^32 / NTP_CLOCK_HZ */
+#define NTP_CLOCK_PRECISION         (-15)   /* log2 of one tick, in seconds */
+
+#define NTP_CLOCK_SLEW_PPM          5000
+#define NTP_CLOCK_STEP_LIMIT_MS     2000
+
+/* Start the counter and set the clock to sec:frac. */
+void ntp_clock_init(uint32_t sec, uint32_t frac);
+
+/* Current time. Safe to call from interrupt handlers. */
+void ntp_clock_get(ntp_timestamp *ts);
+
+/* Steer toward the reference time sec:frac, taken now. */
+void ntp_clock_sync(uint32_t sec, uint32_t frac);
+
+/* Latch the current time as a receive timestamp, from the W5500 INTn handler.
+ * INTn only falls when no other socket interrupt is pending, so a datagram that
+ * arrives behind another event is stamped at that event's edge instead; the
+ * error is bounded by how quickly the main loop services INTn. */
+void ntp_clock_capture(void);
+
+/* Take the latched receive timestamp. Returns 0, or -1 if there is none. */
+int ntp_clock_take_capture(ntp_timestamp *ts);
+
+/* Fixed-point helpers, exposed for the SNTP code. */
+static inline uint64_t ntp_clock_ticks_to_ntp(uint64_t ticks)
+{
+    return ticks << NTP_CLOCK_TICK_SHIFT;
+}
+
+static inline uint32_t ntp_clock_us_to_frac(uint32_t us)
+{
+    return (uint32_t)(((uint64_t)us << 32) / 1000000);
+}
+
+static inline uint32_t ntp_clock_frac_to_us(uint32_t frac)
+{
+    return (uint32_t)(((uint64_t)frac * 1000000 + (1u << 31)) >> 32);
+}
+
+#endif /* __NTP_CLOCK_H__ */
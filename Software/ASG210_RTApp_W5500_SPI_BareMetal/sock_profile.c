@@ -0,0 +1,65 @@
+/*
+ * W5500 socket buffer profiles.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "ioLibrary_Driver/Ethernet/socket.h"
+#include "ioLibrary_Driver/Ethernet/W5500/w5500.h"
+
+#include "sock_profile.h"
+
+void sock_profile_compute(const uint8_t *weight, uint8_t *size_kb)
+{
+    uint8_t left = SOCK_PROFILE_MEMORY_KB;
+    uint8_t sn, best;
+
+    for (sn = 0; sn < _WIZCHIP_SOCK_NUM_; sn++)
+    {
+        size_kb[sn] = (weight[sn] && left) ? 1 : 0;
+        left -= size_kb[sn];
+    }
+
+    while (1)
+    {
+        /* weight[sn] / size_kb[sn] largest, compared without dividing */
+        best = _WIZCHIP_SOCK_NUM_;
+        for (sn = 0; sn < _WIZCHIP_SOCK_NUM_; sn++)
+        {
+            if (size_kb[sn] == 0 || size_kb[sn] > left || size_kb[sn] >= SOCK_PROFILE_MAX_KB)
+                continue;
+            if (best == _WIZCHIP_SOCK_NUM_ ||
+                (uint16_t)weight[sn] * size_kb[best] > (uint16_t)weight[best] * size_kb[sn])
+                best = sn;
+        }
+        if (best == _WIZCHIP_SOCK_NUM_)
+            break;
+
+        left -= size_kb[best];
+        size_kb[best] *= 2;
+    }
+}
+
+int sock_profile_apply(const sock_profile *profile, uint8_t *txsize, uint8_t *rxsize)
+{
+    uint8_t tx[_WIZCHIP_SOCK_NUM_];
+    uint8_t rx[_WIZCHIP_SOCK_NUM_];
+    uint8_t sn;
+
+    sock_profile_compute(profile->tx_weight, tx);
+    sock_profile_compute(profile->rx_weight, rx);
+
+    for (sn = 0; sn < _WIZCHIP_SOCK_NUM_; sn++)
+        if (getSn_SR(sn) != SOCK_CLOSED)
+            close_socket(sn);
+
+    if (wizchip_setbufsize(tx, rx) != 0)
+        return -1;
+
+    if (txsize)
+        memcpy(txsize, tx, sizeof(tx));
+    if (rxsize)
+        memcpy(rxsize, rx, sizeof(rx));
+    return 0;
+}
@@ -0,0 +1,41 @@
+/*
+ * W5500 socket buffer profiles.
+ *
+ * The W5500 shares 16 KB of TX and 16 KB of RX memory between its 8 sockets,
+ * 2 KB each after reset. A profile weighs the sockets of one chip for a
+ * workload; sock_profile_apply() turns the weights into power-of-two buffer
+ * sizes that fill the memory and programs Sn_TXBUF_SIZE/Sn_RXBUF_SIZE.
+ * The buffers can only move while the sockets are closed, so applying a profile
+ * closes every socket of the chip; their handlers open them again.
+ */
+
+#ifndef __SOCK_PROFILE_H__
+#define __SOCK_PROFILE_H__
+
+#include <stdint.h>
+
+#include "ioLibrary_Driver/Ethernet/wizchip_conf.h"
+
+/* Buffer memory per direction, in KB */
+#define SOCK_PROFILE_MEMORY_KB      16
+#define SOCK_PROFILE_MAX_KB         16
+
+typedef struct {
+    const char *name;
+    /* Relative share of each socket; 0 leaves the socket without a buffer,
+     * so it cannot be opened. */
+    uint8_t tx_weight[_WIZCHIP_SOCK_NUM_];
+    uint8_t rx_weight[_WIZCHIP_SOCK_NUM_];
+} sock_profile;
+
+/* Buffer sizes in KB for weight: every weighted socket gets 1 KB, then the
+ * socket with the most weight per KB is doubled for as long as the memory
+ * allows. Ties go to the lower socket number. */
+void sock_profile_compute(const uint8_t *weight, uint8_t *size_kb);
+
+/* Close every socket of the selected chip and give them the buffers of
+ * profile. The sizes applied are returned through txsize/rxsize, which may be
+ * NULL. Returns 0, or -1 if the chip refused the sizes. */
+int sock_profile_apply(const sock_profile *profile, uint8_t *txsize, uint8_t *rxsize);
+
+#endif /* __SOCK_PROFILE_H__ */
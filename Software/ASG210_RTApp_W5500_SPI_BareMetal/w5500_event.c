@@ -0,0 +1,346 @@
+/*
+ * W5500 interrupt event dispatcher.
+ */
+
+#include <stddef.h>
+
+#include "ioLibrary_Driver/Ethernet/wizchip_conf.h"
+#include "ioLibrary_Driver/Ethernet/socket.h"
+#include "ioLibrary_Driver/Ethernet/W5500/w5500.h"
+
+#include "w5500_event.h"
+
+/* SENDOK is left masked unless the socket uses sock_send_async(): blocking
+ * sock_send() polls and clears it itself. */
+#define W5500_EVT_SN_IMR    (Sn_IR_CON | Sn_IR_DISCON | Sn_IR_RECV | Sn_IR_TIMEOUT)
+
+typedef struct {
+    wizchip_ctx *ctx;               /* NULL while the chip is not attached */
+    w5500_evt_handler handler[_WIZCHIP_SOCK_NUM_];
+    w5500_evt_sent_handler sent[_WIZCHIP_SOCK_NUM_];
+    w5500_evt_traffic traffic[_WIZCHIP_SOCK_NUM_];
+    uint16_t rx_rd[_WIZCHIP_SOCK_NUM_];     /* Sn_RX_RD / Sn_TX_WR at the last run */
+    uint16_t tx_wr[_WIZCHIP_SOCK_NUM_];
+    uint8_t counting;               /* sockets whose rx_rd/tx_wr are valid */
+    uint8_t mask;                   /* sockets with a handler (SIMR) */
+    uint8_t rerun;                  /* sockets to run without a hardware event */
+    uint8_t async;                  /* sockets with SENDOK unmasked */
+    uint8_t waiting;                /* sockets waiting for SENDOK to go on with RX */
+    uint8_t parked;                 /* sockets waiting for w5500_evt_unpark() */
+    volatile uint8_t irq;           /* set by INTn */
+} w5500_evt_chip;
+
+static w5500_evt_chip evt_chip[W5500_EVT_MAX_CHIPS];
+
+/* Sn_IR bits of socket sn the dispatcher serves, the ones unmasked in Sn_IMR */
+static inline uint8_t w5500_evt_sn_imr(const w5500_evt_chip *c, uint8_t sn)
+{
+    return W5500_EVT_SN_IMR | ((c->async & (1 << sn)) ? Sn_IR_SENDOK : 0);
+}
+
+/* Account the data the socket moved since its last run: the RX read and TX
+ * write pointers only advance as the application consumes and queues data.
+ * They are meaningless until the socket is open, and restart when it is
+ * reopened. */
+static void w5500_evt_count(w5500_evt_chip *c, uint8_t sn, const wiz_SnSnapshot *snap)
+{
+    switch (snap->sr)
+    {
+    case SOCK_ESTABLISHED:
+    case SOCK_CLOSE_WAIT:
+    case SOCK_UDP:
+    case SOCK_MACRAW:
+        if (c->counting & (1 << sn))
+        {
+            c->traffic[sn].rx_bytes += (uint16_t)(snap->rx_rd - c->rx_rd[sn]);
+            c->traffic[sn].tx_bytes += (uint16_t)(snap->tx_wr - c->tx_wr[sn]);
+        }
+        c->rx_rd[sn] = snap->rx_rd;
+        c->tx_wr[sn] = snap->tx_wr;
+        c->counting |= (1 << sn);
+        break;
+    default:
+        c->counting &= ~(1 << sn);
+        break;
+    }
+}
+
+/* A socket needs the driver to move on from CLOSED, INIT or CLOSE_WAIT, and
+ * still has work while RX data is left over. Every other state is advanced by
+ * the chip, which raises an interrupt when it is done. */
+static uint8_t w5500_evt_needs_rerun(w5500_evt_chip *c, uint8_t sn)
+{
+    wiz_SnSnapshot snap;
+
+    getSn_SNAPSHOT(sn, &snap);
+    w5500_evt_count(c, sn, &snap);
+
+    switch (snap.sr)
+    {
+    case SOCK_CLOSED:
+    case SOCK_INIT:
+    case SOCK_CLOSE_WAIT:
+        return 1;
+    case SOCK_ESTABLISHED:
+    case SOCK_UDP:
+    case SOCK_MACRAW:
+        if ((c->waiting | c->parked) & (1 << sn))
+            return 0;
+        return snap.rx_rsr != 0;
+    default:
+        return 0;
+    }
+}
+
+void w5500_evt_init(void)
+{
+    uint8_t chip, sn;
+
+    for (chip = 0; chip < W5500_EVT_MAX_CHIPS; chip++)
+    {
+        evt_chip[chip].ctx = NULL;
+        for (sn = 0; sn < _WIZCHIP_SOCK_NUM_; sn++)
+        {
+            evt_chip[chip].handler[sn] = NULL;
+            evt_chip[chip].sent[sn] = NULL;
+            evt_chip[chip].traffic[sn].rx_bytes = 0;
+            evt_chip[chip].traffic[sn].tx_bytes = 0;
+        }
+        evt_chip[chip].counting = 0;
+        evt_chip[chip].mask = 0;
+        evt_chip[chip].rerun = 0;
+        evt_chip[chip].async = 0;
+        evt_chip[chip].waiting = 0;
+        evt_chip[chip].parked = 0;
+        evt_chip[chip].irq = 0;
+    }
+}
+
+int w5500_evt_attach(uint8_t chip, wizchip_ctx *ctx)
+{
+    wizchip_ctx *prev;
+
+    if (chip >= W5500_EVT_MAX_CHIPS || ctx == NULL)
+        return -1;
+
+    evt_chip[chip].ctx = ctx;
+
+    prev = wizchip_setctx(ctx);
+    setSIMR(0);
+    wizchip_setctx(prev);
+    return 0;
+}
+
+int w5500_evt_register(uint8_t sid, w5500_evt_handler handler)
+{
+    w5500_evt_chip *c;
+    wizchip_ctx *prev;
+    uint8_t sn = sid % _WIZCHIP_SOCK_NUM_;
+
+    if (sid >= W5500_EVT_SOCKETS || handler == NULL)
+        return -1;
+
+    c = &evt_chip[sid / _WIZCHIP_SOCK_NUM_];
+    if (c->ctx == NULL)
+        return -1;
+
+    c->handler[sn] = handler;
+    c->sent[sn] = NULL;
+    c->async &= ~(1 << sn);
+    c->waiting &= ~(1 << sn);
+    c->parked &= ~(1 << sn);
+    c->mask |= (1 << sn);
+    c->rerun |= (1 << sn);
+
+    prev = wizchip_setctx(c->ctx);
+    setSn_IMR(sn, W5500_EVT_SN_IMR);
+    setSIMR(c->mask);
+    wizchip_setctx(prev);
+    return 0;
+}
+
+int w5500_evt_register_sent(uint8_t sid, w5500_evt_sent_handler sent)
+{
+    w5500_evt_chip *c;
+    wizchip_ctx *prev;
+    uint8_t sn = sid % _WIZCHIP_SOCK_NUM_;
+
+    if (sid >= W5500_EVT_SOCKETS)
+        return -1;
+
+    c = &evt_chip[sid / _WIZCHIP_SOCK_NUM_];
+    if (c->ctx == NULL || !(c->mask & (1 << sn)))
+        return -1;
+
+    c->sent[sn] = sent;
+    c->async |= (1 << sn);
+
+    prev = wizchip_setctx(c->ctx);
+    setSn_IMR(sn, (W5500_EVT_SN_IMR | Sn_IR_SENDOK));
+    wizchip_setctx(prev);
+    return 0;
+}
+
+void w5500_evt_wait_sent(uint8_t sn)
+{
+    uint8_t chip;
+
+    for (chip = 0; chip < W5500_EVT_MAX_CHIPS; chip++)
+    {
+        if (evt_chip[chip].ctx == WIZCHIP_CTX && sn < _WIZCHIP_SOCK_NUM_)
+        {
+            evt_chip[chip].waiting |= (1 << sn);
+            return;
+        }
+    }
+}
+
+void w5500_evt_park(uint8_t sn)
+{
+    uint8_t chip;
+
+    for (chip = 0; chip < W5500_EVT_MAX_CHIPS; chip++)
+    {
+        if (evt_chip[chip].ctx == WIZCHIP_CTX && sn < _WIZCHIP_SOCK_NUM_)
+        {
+            evt_chip[chip].parked |= (1 << sn);
+            return;
+        }
+    }
+}
+
+void w5500_evt_unpark(uint8_t sid)
+{
+    w5500_evt_chip *c;
+    uint8_t sn = sid % _WIZCHIP_SOCK_NUM_;
+
+    if (sid >= W5500_EVT_SOCKETS)
+        return;
+
+    c = &evt_chip[sid / _WIZCHIP_SOCK_NUM_];
+    if (c->parked & (1 << sn))
+    {
+        c->parked &= ~(1 << sn);
+        c->rerun |= (1 << sn);
+    }
+}
+
+void w5500_evt_kick(uint8_t chip)
+{
+    if (chip < W5500_EVT_MAX_CHIPS)
+        evt_chip[chip].rerun |= evt_chip[chip].mask;
+}
+
+void w5500_evt_get_traffic(uint8_t sid, w5500_evt_traffic *traffic)
+{
+    w5500_evt_chip *c;
+    uint8_t sn = sid % _WIZCHIP_SOCK_NUM_;
+
+    if (sid >= W5500_EVT_SOCKETS)
+    {
+        traffic->rx_bytes = 0;
+        traffic->tx_bytes = 0;
+        return;
+    }
+
+    c = &evt_chip[sid / _WIZCHIP_SOCK_NUM_];
+    *traffic = c->traffic[sn];
+}
+
+void w5500_evt_signal(uint8_t chip)
+{
+    if (chip < W5500_EVT_MAX_CHIPS)
+        evt_chip[chip].irq = 1;
+}
+
+uint8_t w5500_evt_pending(void)
+{
+    uint8_t chip;
+
+    for (chip = 0; chip < W5500_EVT_MAX_CHIPS; chip++)
+        if (evt_chip[chip].irq || evt_chip[chip].rerun)
+            return 1;
+    return 0;
+}
+
+static void w5500_evt_dispatch_chip(w5500_evt_chip *c)
+{
+    uint8_t sir, ir, sn, rerun;
+    int32_t room;
+
+    sir = rerun = c->rerun;
+    c->rerun = 0;
+    if (c->irq)
+    {
+        c->irq = 0;
+        sir |= getSIR() & c->mask;
+    }
+
+    for (sn = 0; sn < _WIZCHIP_SOCK_NUM_; sn++)
+    {
+        if (!(sir & (1 << sn)))
+            continue;
+
+        ir = getSn_IR(sn) & w5500_evt_sn_imr(c, sn);
+        if (ir)
+            setSn_IR(sn, ir);
+        else if (!(rerun & (1 << sn)))
+            continue;   /* SIR only flagged a masked bit, see below */
+
+        if (ir & Sn_IR_SENDOK)
+        {
+            room = sock_send_complete(sn);
+            if (c->sent[sn])
+                c->sent[sn](sn, room);
+
+            /* a lone SENDOK only concerns a handler that waits for TX room */
+            ir &= ~Sn_IR_SENDOK;
+            if (!ir && !(c->waiting & (1 << sn)) && !(rerun & (1 << sn)))
+                continue;
+        }
+
+        /* the handler calls w5500_evt_wait_sent() or w5500_evt_park()
+         * again if still stuck */
+        c->waiting &= ~(1 << sn);
+        c->parked &= ~(1 << sn);
+        c->handler[sn](sn, ir);
+
+        if (w5500_evt_needs_rerun(c, sn))
+            c->rerun |= (1 << sn);
+    }
+
+    /* INTn is edge-triggered: a socket that raised a new event while we were
+     * clearing the previous one keeps the line low without another edge.
+     * SIR also flags Sn_IR bits left masked, like the SENDOK a blocking
+     * sock_send() leaves set until its next call; only an unmasked one counts,
+     * or the dispatcher would be re-armed for good. */
+    sir = getSIR() & c->mask;
+    for (sn = 0; sir; sn++, sir >>= 1)
+    {
+        if ((sir & 1) && (getSn_IR(sn) & w5500_evt_sn_imr(c, sn)))
+        {
+            c->irq = 1;
+            break;
+        }
+    }
+}
+
+void w5500_evt_dispatch(void)
+{
+    wizchip_ctx *prev = WIZCHIP_CTX;
+    w5500_evt_chip *c;
+    uint8_t chip;
+
+    /* Chips take turns, one pass each, so a busy chip cannot starve the other */
+    for (chip = 0; chip < W5500_EVT_MAX_CHIPS; chip++)
+    {
+        c = &evt_chip[chip];
+        if (c->ctx == NULL || !(c->irq || c->rerun))
+            continue;
+
+        wizchip_setctx(c->ctx);
+        w5500_evt_dispatch_chip(c);
+    }
+
+    wizchip_setctx(prev);
+}
@@ -0,0 +1,94 @@
+/*
+ * W5500 interrupt event dispatcher.
+ *
+ * The W5500 INTn line is only used as a wake-up: the EINT handler calls
+ * w5500_evt_signal(), and the main loop calls w5500_evt_dispatch() which reads
+ * SIR once, reads/clears Sn_IR of the flagged sockets and runs their handlers.
+ * The core only touches W5500 registers through the ioLibrary accessors, so it
+ * does not depend on the MT3620 HAL.
+ *
+ * Several chips can share the dispatcher, each with its own INTn line and
+ * driver context. Sockets are then numbered across the chips: socket sn of chip
+ * c is W5500_EVT_SID(c, sn), giving up to W5500_EVT_SOCKETS sockets in total.
+ */
+
+#ifndef __W5500_EVENT_H__
+#define __W5500_EVENT_H__
+
+#include <stdint.h>
+
+#include "ioLibrary_Driver/Ethernet/wizchip_conf.h"
+
+#define W5500_EVT_MAX_CHIPS     2
+#define W5500_EVT_SOCKETS       (W5500_EVT_MAX_CHIPS * _WIZCHIP_SOCK_NUM_)
+#define W5500_EVT_SID(chip, sn) ((chip) * _WIZCHIP_SOCK_NUM_ + (sn))
+
+/* Socket handler. sn is the socket number on its own chip, whose context is
+ * selected while the handler runs. ir holds the Sn_IR bits that were pending
+ * (already cleared), or 0 when the handler is re-run to drive the socket state
+ * machine. SENDOK is never passed on, see w5500_evt_register_sent(). */
+typedef void (*w5500_evt_handler)(uint8_t sn, uint8_t ir);
+
+/* Detach every chip and drop every registered handler. */
+void w5500_evt_init(void);
+
+/* Serve chip with the driver context ctx and mask all of its socket
+ * interrupts. Returns 0 on success, -1 on a bad chip number. */
+int w5500_evt_attach(uint8_t chip, wizchip_ctx *ctx);
+
+/* Route events of socket sid (see W5500_EVT_SID) to handler and unmask them in
+ * SIMR/Sn_IMR of its chip, which must be attached. The handler is run once on
+ * the next dispatch to open the socket.
+ * Returns 0 on success, -1 on a bad socket number. */
+int w5500_evt_register(uint8_t sid, w5500_evt_handler handler);
+
+/* TX completion handler, see w5500_evt_register_sent(). room is the free room
+ * in the TX buffer as returned by sock_send_complete(), or a negative
+ * SOCKERR_* once the connection is gone. */
+typedef void (*w5500_evt_sent_handler)(uint8_t sn, int32_t room);
+
+/* Switch TCP socket sid, already registered, to the sock_send_async() path:
+ * its SENDOK interrupt is unmasked and sock_send_complete() is called for it,
+ * then sent if not NULL. The socket must not use the blocking sock_send().
+ * Returns 0 on success, -1 on a bad or unregistered socket. */
+int w5500_evt_register_sent(uint8_t sid, w5500_evt_sent_handler sent);
+
+/* Called by the handler of socket sn of the current chip when it leaves RX
+ * data unread for lack of TX room. The socket is then not re-run for that data
+ * until its next SENDOK, which runs the handler again. */
+void w5500_evt_wait_sent(uint8_t sn);
+
+/* Called by the handler of socket sn of the current chip when it leaves RX
+ * data unread for lack of room elsewhere, e.g. in the mailbox ring. The
+ * socket is then not re-run for that data until its next Sn_IR event or
+ * w5500_evt_unpark(). */
+void w5500_evt_park(uint8_t sn);
+
+/* Run socket sid on the next dispatch if it is parked, e.g. once the room it
+ * waits for was made. */
+void w5500_evt_unpark(uint8_t sid);
+
+/* Run every registered socket of chip on the next dispatch, e.g. after its
+ * sockets were closed behind the handlers' backs. */
+void w5500_evt_kick(uint8_t chip);
+
+/* Bytes a socket's handlers consumed from RX and queued for TX, counted from
+ * the socket's read and write pointers after every run. */
+typedef struct {
+    uint32_t rx_bytes;
+    uint32_t tx_bytes;
+} w5500_evt_traffic;
+
+void w5500_evt_get_traffic(uint8_t sid, w5500_evt_traffic *traffic);
+
+/* Called from the INTn EINT handler of chip. */
+void w5500_evt_signal(uint8_t chip);
+
+/* Non-zero when w5500_evt_dispatch() has work to do. */
+uint8_t w5500_evt_pending(void);
+
+/* Service pending socket events of every chip once. The driver context that
+ * was selected on entry is selected again on return. */
+void w5500_evt_dispatch(void);
+
+#endif /* __W5500_EVENT_H__ */
@@ -0,0 +1,117 @@
+/* Intercore batch frame format, shared by the RT and HL applications.
+ *
+ * The RT app packs several records into one mailbox block, so the HL app gets
+ * one message (and the A7 one interrupt) per batch instead of per receive.
+ * Both cores are little-endian; fields are stored unaligned and must be read
+ * with memcpy.
+ *
+ *   intercore_batch_header
+ *   intercore_record_header + data
+ *   intercore_record_header + data
+ *   ...
+ *
+ * The HL app uses the same frame towards the RT app for lease records, buffer
+ * profile commands and cycle probe requests.
+ */
+
+#ifndef __INTERCORE_BATCH_H__
+#define __INTERCORE_BATCH_H__
+
+#include <stdint.h>
+
+#define INTERCORE_BATCH_MAGIC       0x4249      /* "IB" */
+#define INTERCORE_BATCH_VERSION     1
+
+/* Largest mailbox message the HL app can receive. */
+#define INTERCORE_BATCH_MAX         1024
+
+typedef struct __attribute__((packed)) {
+    uint16_t magic;         /* INTERCORE_BATCH_MAGIC */
+    uint8_t  version;       /* INTERCORE_BATCH_VERSION */
+    uint8_t  count;         /* number of records */
+    uint32_t epoch;         /* RT wall clock when flushed, seconds since 1900 */
+    uint32_t tick;          /* RT millisecond tick when flushed */
+} intercore_batch_header;
+
+typedef struct __attribute__((packed)) {
+    uint16_t len;           /* data bytes following this header */
+    uint8_t  socket;        /* W5500 socket the data came from */
+    uint8_t  flags;         /* INTERCORE_RECORD_*, 0 for socket data */
+    uint32_t tick;          /* RT millisecond tick when received */
+} intercore_record_header;
+
+/* intercore_record_header.flags */
+#define INTERCORE_RECORD_LEASE          0x01    /* data: intercore_lease_entry[] */
+#define INTERCORE_RECORD_LEASE_REQUEST  0x02    /* data: one byte, ignored; asks
+                                                   the other side for all leases */
+#define INTERCORE_RECORD_BUFFER_PROFILE 0x04    /* data: intercore_buffer_profile */
+#define INTERCORE_RECORD_PROBE          0x08    /* HL -> RT data: one INTERCORE_PROBE_CMD_*
+                                                   byte; RT -> HL: intercore_probe_entry */
+
+/* A DHCP server lease. The RT app sends one whenever a binding changes; the HL
+ * app keeps them and sends them back when the RT app restarts. */
+typedef struct __attribute__((packed)) {
+    uint8_t  mac[6];
+    uint8_t  ip[4];
+    uint8_t  bound;         /* 0: the lease of ip ended */
+    uint8_t  reserved;
+    uint32_t remaining;     /* seconds left on the lease */
+} intercore_lease_entry;
+
+/* W5500 socket buffer profile. The HL app sends one to select a profile
+ * (only profile is used); the RT app answers with the sizes it applied. */
+#define INTERCORE_BUFFER_BALANCED       0       /* 2 KB per socket, the reset default */
+#define INTERCORE_BUFFER_BULK           1       /* most memory to the data socket */
+#define INTERCORE_BUFFER_SMALL_UDP      2       /* RX memory to the DHCP and SNTP servers */
+#define INTERCORE_BUFFER_PROFILES       3
+
+#define INTERCORE_BUFFER_SOCKETS        8
+
+typedef struct __attribute__((packed)) {
+    uint8_t  profile;       /* INTERCORE_BUFFER_* */
+    uint8_t  status;        /* answer: 0 applied, 1 unknown profile, 2 refused by the chip */
+    uint8_t  reserved[2];
+    uint8_t  tx_kb[INTERCORE_BUFFER_SOCKETS];   /* answer: Sn_TXBUF_SIZE per socket */
+    uint8_t  rx_kb[INTERCORE_BUFFER_SOCKETS];   /* answer: Sn_RXBUF_SIZE per socket */
+} intercore_buffer_profile;
+
+/* Cycle probes of the RT app, timed with the M4's DWT cycle counter, see
+ * cyc_probe.h there. The HL app asks for them with a command byte; the RT app
+ * answers with one intercore_probe_entry record per probe. */
+#define INTERCORE_PROBE_SPIM_TRANSFER   0       /* one blocking SPIM transaction */
+#define INTERCORE_PROBE_SPIM_FLUSH      1       /* wait for the queued SPIM transactions */
+#define INTERCORE_PROBE_WIZ_SEND_DATA   2       /* copy to a W5500 TX buffer */
+#define INTERCORE_PROBE_WIZ_RECV_DATA   3       /* copy from a W5500 RX buffer */
+#define INTERCORE_PROBE_MBOX_ENQUEUE    4       /* the commit of a batch */
+#define INTERCORE_PROBE_MBOX_DEQUEUE    5       /* DequeueData */
+#define INTERCORE_PROBE_DHCPS_RUN       6
+#define INTERCORE_PROBE_SNTPS_RUN       7
+#define INTERCORE_PROBE_LOOPBACK        8       /* TCP echo socket event */
+#define INTERCORE_PROBE_MBOX_TCP        9       /* mailbox TCP server socket event */
+#define INTERCORE_PROBE_COUNT           10
+
+#define INTERCORE_PROBE_CMD_DUMP_MBOX   0x01    /* answer with the probe records */
+#define INTERCORE_PROBE_CMD_DUMP_UART   0x02    /* print them on the RT app's UART */
+#define INTERCORE_PROBE_CMD_RESET       0x04    /* clear them, after the dumps */
+
+/* M4 core clock, for turning cycles into time */
+#define INTERCORE_PROBE_CPU_HZ          197600000
+
+/* Histogram of a probe: bucket 0 counts calls of less than
+ * 2^(INTERCORE_PROBE_BUCKET_SHIFT + 1) cycles, bucket i those of
+ * [2^(i + SHIFT), 2^(i + SHIFT + 1)) cycles, and the last bucket also
+ * every longer one. */
+#define INTERCORE_PROBE_BUCKETS         16
+#define INTERCORE_PROBE_BUCKET_SHIFT    6
+
+typedef struct __attribute__((packed)) {
+    uint8_t  id;            /* INTERCORE_PROBE_* */
+    uint8_t  reserved[3];
+    uint32_t count;         /* calls timed */
+    uint32_t min;           /* cycles; 0 when count is 0 */
+    uint32_t max;
+    uint32_t mean;
+    uint16_t hist[INTERCORE_PROBE_BUCKETS];     /* saturate at 0xFFFF */
+} intercore_probe_entry;
+
+#endif /* __INTERCORE_BATCH_H__ */
@@ -0,0 +1,132 @@
+/*
+ * Decoder of the RT app's deferred log, see dlog.h in the RT app.
+ *
+ * Reads a capture of the RT app's UART (a file, or stdin) and writes it as
+ * text: the text printf sent is passed through, every dlog frame is rendered
+ * with its format from dlog_fmt.h by the BSP printf engine the RT app prints
+ * with, so a line reads the same deferred or not. A byte that does not start
+ * a valid frame is passed through as text.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "printf.h"
+
+#include "dlog.h"
+
+static const char *const dlog_formats[DLOG_COUNT] = {
+#define DLOG_FMT(id, fmt)   [id] = fmt,
+#include "dlog_fmt.h"
+#undef DLOG_FMT
+};
+
+static int show_tick;
+
+/* printf() of the BSP engine is not used; the frames are rendered with fctprintf(). */
+void _putchar(char character)
+{
+    (void)character;
+}
+
+static void decode_out(char character, void *arg)
+{
+    if (character != '\r')
+        fputc(character, (FILE *)arg);
+}
+
+static uint32_t decode_le32(const uint8_t *p)
+{
+    return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Render the frame at p; returns its length, 0 if p does not hold a valid frame */
+static size_t decode_frame(const uint8_t *p, size_t avail, FILE *out)
+{
+    uint32_t a[DLOG_MAX_ARGS] = { 0 };
+    uint16_t id;
+    uint8_t nargs, i;
+    size_t len;
+
+    if (avail < DLOG_FRAME_HEAD)
+        return 0;
+    nargs = p[1];
+    id = p[2] | (uint16_t)(p[3] << 8);
+    len = DLOG_FRAME_HEAD + 4 * (size_t)nargs;
+    if (nargs > DLOG_MAX_ARGS || id >= DLOG_COUNT || avail < len)
+        return 0;
+
+    for (i = 0; i < nargs; i++)
+        a[i] = decode_le32(p + DLOG_FRAME_HEAD + 4 * i);
+
+    if (show_tick) {
+        uint32_t tick = decode_le32(p + 4);
+        fctprintf(decode_out, out, "[%6u.%03u] ", tick / 1000, tick % 1000);
+    }
+    fctprintf(decode_out, out, dlog_formats[id], a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+
+    return len;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-t] [capture]\n"
+                    "  -t  prefix the rendered frames with their tick, s.ms\n", name);
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    static uint8_t buf[64 * 1024];
+    FILE *in = stdin;
+    size_t have = 0, off, used, n;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t")) != -1) {
+        if (opt == 't')
+            show_tick = 1;
+        else
+            usage(argv[0]);
+    }
+    if (optind < argc) {
+        in = fopen(argv[optind], "rb");
+        if (in == NULL) {
+            perror(argv[optind]);
+            return 1;
+        }
+    }
+
+    for (;;) {
+        n = fread(buf + have, 1, sizeof(buf) - have, in);
+        have += n;
+        if (have == 0)
+            break;
+
+        for (off = 0; off < have; off += used) {
+            used = 1;
+            if (buf[off] != DLOG_SYNC) {
+                decode_out((char)buf[off], stdout);
+                continue;
+            }
+            /* A frame cut by the end of the buffer is completed by the next read */
+            if (n != 0 && have - off < DLOG_FRAME_MAX)
+                break;
+            used = decode_frame(buf + off, have - off, stdout);
+            if (used == 0) {
+                decode_out((char)buf[off], stdout);
+                used = 1;
+            }
+        }
+
+        memmove(buf, buf + off, have - off);
+        have -= off;
+        if (n == 0 && have == 0)
+            break;
+    }
+
+    if (in != stdin)
+        fclose(in);
+    return 0;
+}
@@ -0,0 +1,287 @@
+/*
+ * Round trip of the RT app's deferred log: dlog.c built with DLOG_DEFERRED
+ * writes its frames to a stand-in of the console, the capture is decoded by
+ * dlog_decode, and the text must be what the C library's snprintf makes of
+ * each format and its arguments.
+ *
+ * Every format of dlog_fmt.h is logged with many argument sets (0, 1, the
+ * limits of 8, 16 and 32 bits, negative numbers as the RT app passes them,
+ * random values), with the tick running up to and across its wrap. Text lines
+ * go to the console between drains like printf does, the console has varying
+ * room, so drains move some of the frames or none, and the ring overflows
+ * now and then, which the next drain reports. The capture is far larger than
+ * the decoder's read buffer, so frames are split across reads. It is decoded
+ * twice, with and without -t.
+ *
+ * Usage: dlog_roundtrip_test path/to/dlog_decode
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "console.h"
+#include "dlog.h"
+#include "host_test.h"
+
+#define TEST_RECORDS        40000
+#define TEST_SLOTS          64          /* DLOG_SLOTS of dlog.c */
+#define TEST_CAPTURE_MAX    (4 * 1024 * 1024)
+#define TEST_TEXT_MAX       (8 * 1024 * 1024)
+#define TEST_SEED           0xD106F00Du
+
+static const char *const test_formats[DLOG_COUNT] = {
+#define DLOG_FMT(id, fmt)   [id] = fmt,
+#include "dlog_fmt.h"
+#undef DLOG_FMT
+};
+
+static const uint32_t test_values[] = {
+    0, 1, 7, 9, 10, 99, 127, 128, 255, 256, 32767, 32768, 65535, 65536,
+    0x7FFFFFFF, 0x80000000, 0xFFFFFFFF, (uint32_t)-1000, 192, 168, 1000000,
+};
+
+/* A record the ring holds, with the text it has to decode to */
+typedef struct {
+    uint8_t nargs;
+    uint32_t tick;
+    char text[160];
+} test_record;
+
+volatile uint32_t sys_tick_in_ms;
+
+static uint8_t capture[TEST_CAPTURE_MAX];
+static size_t capture_len;
+static uint16_t console_free;
+
+/* The decoder's output expected without and with -t */
+static char expect[2][TEST_TEXT_MAX];
+static size_t expect_len[2];
+
+static test_record ring[TEST_SLOTS];
+static unsigned int ring_head, ring_tail;
+static uint32_t lost;
+static unsigned int reports;        /* drains that reported lost records */
+
+static uint32_t rng = TEST_SEED;
+
+static uint32_t rnd(uint32_t n)
+{
+    rng = rng * 1103515245 + 12345;
+    return (rng >> 8) % n;
+}
+
+/* Stand-in of the console: everything written lands in the capture */
+int console_write(const uint8_t *data, uint16_t len)
+{
+    int fits = len <= console_free && capture_len + len <= sizeof(capture);
+
+    CHECKF(fits, "console_write of %u bytes with %u free", len, console_free);
+    if (!fits)
+        return 0;
+    memcpy(capture + capture_len, data, len);
+    capture_len += len;
+    console_free -= len;
+    return len;
+}
+
+uint16_t console_room(void)
+{
+    return console_free;
+}
+
+/* The decoder drops the CR of CRLF */
+static void expect_add(int ticked, const char *text)
+{
+    for (; *text; text++)
+        if (*text != '\r' && expect_len[ticked] < TEST_TEXT_MAX)
+            expect[ticked][expect_len[ticked]++] = *text;
+}
+
+static void expect_frame(uint32_t tick, const char *text)
+{
+    char prefix[32];
+
+    snprintf(prefix, sizeof(prefix), "[%6u.%03u] ", tick / 1000, tick % 1000);
+    expect_add(0, text);
+    expect_add(1, prefix);
+    expect_add(1, text);
+}
+
+static uint8_t format_args(const char *fmt)
+{
+    uint8_t n = 0;
+
+    for (; *fmt; fmt++) {
+        if (*fmt != '%')
+            continue;
+        if (fmt[1] == '%')
+            fmt++;
+        else
+            n++;
+    }
+    return n;
+}
+
+/* What printf puts on the console between drains */
+static void text_line(unsigned int i)
+{
+    char line[64];
+    int len;
+
+    len = snprintf(line, sizeof(line), "text %u, plain printf\r\n", i);
+    if (capture_len + len <= sizeof(capture)) {
+        memcpy(capture + capture_len, line, len);
+        capture_len += len;
+    }
+    expect_add(0, line);
+    expect_add(1, line);
+}
+
+static void log_record(void)
+{
+    uint32_t a[DLOG_MAX_ARGS] = { 0 };
+    uint16_t id = (uint16_t)rnd(DLOG_COUNT);
+    test_record *r;
+    uint8_t nargs = format_args(test_formats[id]), i;
+
+    for (i = 0; i < nargs; i++)
+        a[i] = rnd(3) ? test_values[rnd(sizeof(test_values) / sizeof(test_values[0]))]
+                      : (rnd(0x10000) << 16) ^ rnd(0x10000);
+
+    if (ring_head - ring_tail >= TEST_SLOTS) {
+        lost++;
+    } else {
+        r = &ring[ring_head++ % TEST_SLOTS];
+        r->nargs = nargs;
+        r->tick = sys_tick_in_ms;
+        snprintf(r->text, sizeof(r->text), test_formats[id], a[0], a[1], a[2], a[3], a[4], a[5],
+                 a[6], a[7]);
+    }
+    dlog_put(id, nargs, a);
+}
+
+/* A drain with room bytes free on the console: a report of the records lost
+ * if it fits, then whole frames, oldest first, as many as fit */
+static void drain(uint16_t room)
+{
+    const uint16_t most = DLOG_DRAIN_MAX > DLOG_FRAME_MAX ? DLOG_DRAIN_MAX : DLOG_FRAME_MAX;
+    char text[64];
+    uint16_t budget, size;
+    test_record *r;
+
+    console_free = room;
+    budget = room < most ? room : most;
+
+    if (lost && budget >= DLOG_FRAME_HEAD + 4) {
+        snprintf(text, sizeof(text), test_formats[DLOG_DROPPED], lost);
+        expect_frame(sys_tick_in_ms, text);
+        budget -= DLOG_FRAME_HEAD + 4;
+        lost = 0;
+        reports++;
+    }
+    while (ring_tail != ring_head) {
+        r = &ring[ring_tail % TEST_SLOTS];
+        size = DLOG_FRAME_HEAD + 4 * r->nargs;
+        if (budget < size)
+            break;
+        expect_frame(r->tick, r->text);
+        budget -= size;
+        ring_tail++;
+    }
+
+    dlog_drain();
+}
+
+/* Decode the capture at path and compare the text with the expected one */
+static void decode(const char *decoder, const char *path, int ticked)
+{
+    static char out[TEST_TEXT_MAX];
+    char command[1024];
+    size_t len = 0, n, i;
+    int status, match;
+    FILE *p;
+
+    snprintf(command, sizeof(command), "'%s' %s '%s'", decoder, ticked ? "-t" : "", path);
+    p = popen(command, "r");
+    CHECKF(p != NULL, "%s: %s", command, strerror(errno));
+    if (p == NULL)
+        return;
+    while ((n = fread(out + len, 1, sizeof(out) - len, p)) > 0)
+        len += n;
+    status = pclose(p);
+    CHECKF(status == 0, "%s failed", command);
+
+    for (i = 0; i < len && i < expect_len[ticked] && out[i] == expect[ticked][i]; i++)
+        ;
+    match = i == len && len == expect_len[ticked];
+    while (!match && i > 0 && out[i - 1] != '\n')
+        i--;
+    CHECKF(match,
+           "%s: %zu bytes decoded, %zu expected, first difference in the line at %zu:\n"
+           "  got:      %.80s\n  expected: %.80s",
+           command, len, expect_len[ticked], i, out + i, expect[ticked] + i);
+}
+
+int main(int argc, char *argv[])
+{
+    static const uint16_t rooms[] = { 0, 7, 8, 12, 20, 40, 48, 100, 255, 256, 2048 };
+    char path[] = "/tmp/dlog_roundtrip_XXXXXX";
+    unsigned int i, lines = 0;
+    FILE *f;
+    int fd;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s path/to/dlog_decode\n", argv[0]);
+        return 2;
+    }
+
+    sys_tick_in_ms = 0;
+    for (i = 0; i < TEST_RECORDS; i++) {
+        /* the tick runs up to its wrap and across it */
+        if (i == TEST_RECORDS / 2)
+            sys_tick_in_ms = 0xFFFFFFFF - 20000;
+        sys_tick_in_ms += rnd(50);
+
+        log_record();
+        switch (rnd(16)) {
+        case 0:
+            text_line(lines++);
+            break;
+        case 1:
+        case 2:
+        case 3:
+            drain(rooms[rnd(sizeof(rooms) / sizeof(rooms[0]))]);
+            break;
+        default:
+            break;
+        }
+        /* a stretch without drains overflows the ring */
+        if (rnd(2000) == 0)
+            while (rnd(200))
+                log_record();
+    }
+    while (ring_tail != ring_head || lost)
+        drain(2048);
+
+    fd = mkstemp(path);
+    f = fd < 0 ? NULL : fdopen(fd, "wb");
+    if (f == NULL || fwrite(capture, 1, capture_len, f) != capture_len || fclose(f) != 0) {
+        perror(path);
+        return 1;
+    }
+
+    /* the run must have gone through the cases it is meant to */
+    CHECKF(reports > 0 && capture_len > 64 * 1024,
+           "%u overflows reported, %zu bytes of capture", reports, capture_len);
+
+    decode(argv[1], path, 0);
+    decode(argv[1], path, 1);
+    unlink(path);
+
+    printf("%u records, %u overflows, %zu bytes of capture\n", TEST_RECORDS, reports, capture_len);
+    HOST_TEST_EXIT();
+}
@@ -0,0 +1,20 @@
+/*
+ * Host stand-in for OS_HAL's os_hal_uart.h, giving the UART_PORT that the RT
+ * app's console.h uses. The round trip test links dlog.c, which includes it,
+ * and stands in for the console itself.
+ */
+
+#ifndef __OS_HAL_UART_H__
+#define __OS_HAL_UART_H__
+
+typedef enum {
+    OS_HAL_UART_PORT0 = 0,
+    OS_HAL_UART_ISU0,
+    OS_HAL_UART_ISU1,
+    OS_HAL_UART_ISU2,
+    OS_HAL_UART_ISU3,
+    OS_HAL_UART_ISU4,
+    OS_HAL_UART_MAX_PORT
+} UART_PORT;
+
+#endif /* __OS_HAL_UART_H__ */
@@ -0,0 +1,332 @@
+/// <summary>
+/// Test of telemetry_batch.c against a stub of the IoT Hub device client.
+///
+/// The send handler is the one of main.c: a closed batch goes to IoT Hub while it is
+/// reachable and nothing is queued, else to the store-and-forward queue, which is
+/// drained once IoT Hub is back. The stub keeps every message it accepts. Checked are
+/// the limits that close a batch, the pass-through mode, the aggregation, records that
+/// are not JSON, the clamping of the configuration, and that no record is lost,
+/// duplicated or reordered on the way, also when every batch goes through the queue.
+/// </summary>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "parson.h"
+#include "telemetry_batch.h"
+#include "telemetry_queue.h"
+
+#include "host_test.h"
+
+#define HUB_MESSAGES_MAX 4096
+
+/// <summary>Stub of the IoT Hub device client: the messages it accepted.</summary>
+static char *hubMessages[HUB_MESSAGES_MAX];
+static unsigned int hubRecords[HUB_MESSAGES_MAX];
+static size_t hubCount;
+static bool hubOnline = true;
+
+static unsigned int pushFailures;
+
+static bool StubHub_SendEvent(const char *json, unsigned int records)
+{
+    if (!hubOnline || hubCount == HUB_MESSAGES_MAX)
+    {
+        return false;
+    }
+    hubMessages[hubCount] = strdup(json);
+    hubRecords[hubCount] = records;
+    hubCount++;
+    return true;
+}
+
+static void StubHub_Reset(void)
+{
+    for (size_t i = 0; i < hubCount; i++)
+    {
+        free(hubMessages[i]);
+    }
+    hubCount = 0;
+}
+
+/// <summary>SendBatchedTelemetry of main.c.</summary>
+static void SendBatchedTelemetry(const char *json, unsigned int records)
+{
+    if (TelemetryQueue_Pending() == 0 && StubHub_SendEvent(json, records))
+    {
+        return;
+    }
+    if (!TelemetryQueue_Push(json, strlen(json), time(NULL)))
+    {
+        pushFailures++;
+    }
+}
+
+/// <summary>SendQueuedTelemetry of main.c; the record count is not queued.</summary>
+static bool SendQueuedTelemetry(const char *data, size_t len, time_t enqueuedAt)
+{
+    (void)len;
+    (void)enqueuedAt;
+    return StubHub_SendEvent(data, 0);
+}
+
+static void Configure(size_t maxBytes, unsigned int maxRecords, bool aggregate)
+{
+    TelemetryBatchConfig config = {
+        .maxBytes = maxBytes, .maxRecords = maxRecords, .windowMs = 0, .aggregate = aggregate};
+
+    TelemetryBatch_Configure(&config);
+}
+
+static void AddSeq(unsigned int seq, unsigned int pad)
+{
+    char record[256];
+
+    snprintf(record, sizeof(record), "{\"seq\":%u,\"pad\":\"%.*s\"}", seq, (int)pad,
+             "................................................................"
+             "................................................................");
+    TelemetryBatch_Add(record);
+}
+
+/// <summary>
+///     Walk the records of every message the hub got, in order: they must carry the
+///     seq numbers 0 to count - 1. Messages must not be longer than maxBytes.
+/// </summary>
+static void CheckSequence(unsigned int count, size_t maxBytes)
+{
+    unsigned int next = 0;
+
+    for (size_t m = 0; m < hubCount; m++)
+    {
+        CHECKF(strlen(hubMessages[m]) <= maxBytes, "message %zu: %zu bytes, limit %zu", m,
+               strlen(hubMessages[m]), maxBytes);
+
+        JSON_Value *value = json_parse_string(hubMessages[m]);
+        JSON_Array *array = json_value_get_array(value);
+        CHECKF(array != NULL, "message %zu is not an array", m);
+        if (array == NULL)
+        {
+            json_value_free(value);
+            continue;
+        }
+        CHECK(hubRecords[m] == 0 || hubRecords[m] == json_array_get_count(array));
+
+        for (size_t i = 0; i < json_array_get_count(array); i++)
+        {
+            JSON_Object *record = json_array_get_object(array, i);
+            unsigned int seq = (unsigned int)json_object_get_number(record, "seq");
+            CHECKF(seq == next, "message %zu record %zu: seq %u, expected %u", m, i, seq, next);
+            next = seq + 1;
+        }
+        json_value_free(value);
+    }
+    CHECKF(next == count, "%u records arrived, %u expected", next, count);
+}
+
+static void TestDefaults(void)
+{
+    TelemetryBatchConfig config;
+
+    StubHub_Reset();
+    TelemetryBatch_Init(NULL, SendBatchedTelemetry);
+    TelemetryBatch_GetConfig(&config);
+    CHECK(config.maxBytes == TELEMETRY_BATCH_DEFAULT_MAX_BYTES);
+    CHECK(config.maxRecords == TELEMETRY_BATCH_DEFAULT_MAX_RECORDS);
+    CHECK(config.windowMs == TELEMETRY_BATCH_DEFAULT_WINDOW_MS);
+    CHECK(!config.aggregate);
+
+    // The first record opens a batch, the caller arms the window timer.
+    CHECK(TelemetryBatch_Add("{\"seq\":0}") == 1);
+    for (unsigned int i = 1; i < TELEMETRY_BATCH_DEFAULT_MAX_RECORDS - 1; i++)
+    {
+        char record[32];
+        snprintf(record, sizeof(record), "{\"seq\":%u}", i);
+        CHECK(TelemetryBatch_Add(record) == i + 1);
+    }
+    CHECK(hubCount == 0);
+    CHECK(TelemetryBatch_Add("{\"seq\":31}") == 0);
+    CHECK(hubCount == 1);
+    CHECK(hubRecords[0] == TELEMETRY_BATCH_DEFAULT_MAX_RECORDS);
+    CheckSequence(TELEMETRY_BATCH_DEFAULT_MAX_RECORDS, TELEMETRY_BATCH_DEFAULT_MAX_BYTES);
+
+    // Nothing open: a flush sends nothing.
+    TelemetryBatch_Flush();
+    CHECK(hubCount == 1);
+}
+
+static void TestMaxBytes(void)
+{
+    static const size_t limits[] = {200, 1000, 4096};
+
+    for (size_t l = 0; l < sizeof(limits) / sizeof(limits[0]); l++)
+    {
+        StubHub_Reset();
+        Configure(limits[l], 1000, false);
+        for (unsigned int i = 0; i < 300; i++)
+        {
+            AddSeq(i, i % 97);
+        }
+        TelemetryBatch_Flush();
+        CHECK(hubCount > 1);
+        CheckSequence(300, limits[l]);
+    }
+}
+
+static void TestPassThrough(void)
+{
+    static const char *records[] = {"{\"a\":1}", "not json", "[1,2]", "{ \"spaced\" : true }"};
+
+    StubHub_Reset();
+    Configure(4096, 1, false);
+    for (size_t i = 0; i < sizeof(records) / sizeof(records[0]); i++)
+    {
+        CHECK(TelemetryBatch_Add(records[i]) == 0);
+        CHECK(hubCount == i + 1);
+        CHECK(hubRecords[i] == 1);
+        CHECK(strcmp(hubMessages[i], records[i]) == 0);
+    }
+}
+
+static void TestAggregate(void)
+{
+    StubHub_Reset();
+    Configure(4096, 4, true);
+    TelemetryBatch_Add("{\"temp\":1,\"hum\":10}");
+    TelemetryBatch_Add("{\"temp\":3,\"hum\":20}");
+    TelemetryBatch_Add("{\"temp\":2,\"id\":\"x\"}");
+    CHECK(hubCount == 0);
+    TelemetryBatch_Add("{\"temp\":6}");
+    CHECK(hubCount == 1);
+    CHECK(hubRecords[0] == 4);
+
+    // What is left of the records, then the aggregate element.
+    JSON_Value *value = json_parse_string(hubMessages[0]);
+    JSON_Array *array = json_value_get_array(value);
+    CHECK(array != NULL && json_array_get_count(array) == 2);
+    if (array != NULL && json_array_get_count(array) == 2)
+    {
+        JSON_Object *rest = json_array_get_object(array, 0);
+        CHECK(json_object_get_count(rest) == 1);
+        CHECK(strcmp(json_object_get_string(rest, "id"), "x") == 0);
+
+        JSON_Object *aggregate =
+            json_object_get_object(json_array_get_object(array, 1), "aggregate");
+        JSON_Object *temp = json_object_get_object(aggregate, "temp");
+        JSON_Object *hum = json_object_get_object(aggregate, "hum");
+        CHECK(json_object_get_number(temp, "min") == 1);
+        CHECK(json_object_get_number(temp, "max") == 6);
+        CHECK(json_object_get_number(temp, "avg") == 3);
+        CHECK(json_object_get_number(temp, "count") == 4);
+        CHECK(json_object_get_number(hum, "min") == 10);
+        CHECK(json_object_get_number(hum, "max") == 20);
+        CHECK(json_object_get_number(hum, "avg") == 15);
+        CHECK(json_object_get_number(hum, "count") == 2);
+    }
+    json_value_free(value);
+}
+
+static void TestNotJson(void)
+{
+    StubHub_Reset();
+    Configure(4096, 2, false);
+    TelemetryBatch_Add("not json");
+    TelemetryBatch_Add("{\"ok\":true}");
+    CHECK(hubCount == 1);
+    CHECK(hubCount == 1 && strcmp(hubMessages[0], "[\"not json\",{\"ok\":true}]") == 0);
+}
+
+static void TestConfigure(void)
+{
+    TelemetryBatchConfig config;
+
+    // Configure sends the open batch first.
+    StubHub_Reset();
+    Configure(4096, 10, false);
+    TelemetryBatch_Add("{\"seq\":0}");
+    TelemetryBatch_Add("{\"seq\":1}");
+    CHECK(hubCount == 0);
+
+    config = (TelemetryBatchConfig){.maxBytes = 1000000, .maxRecords = 100000,
+                                    .windowMs = 10000000, .aggregate = false};
+    TelemetryBatch_Configure(&config);
+    CHECK(hubCount == 1 && hubRecords[0] == 2);
+
+    TelemetryBatch_GetConfig(&config);
+    CHECK(config.maxBytes == TELEMETRY_BATCH_LIMIT_MAX_BYTES);
+    CHECK(config.maxRecords == TELEMETRY_BATCH_LIMIT_MAX_RECORDS);
+    CHECK(config.windowMs == TELEMETRY_BATCH_LIMIT_WINDOW_MS);
+}
+
+/// <summary>
+///     IoT Hub is away: every batch is queued. Batches of up to
+///     TELEMETRY_QUEUE_MAX_ENTRY_BYTES, the largest the twin handler allows, must all
+///     fit the queue, and arrive in order once IoT Hub is back.
+/// </summary>
+static void TestOffline(void)
+{
+    FILE *storage = tmpfile();
+    TelemetryQueueStats stats;
+    unsigned int records = 0;
+
+    CHECK(storage != NULL);
+    if (storage == NULL)
+    {
+        return;
+    }
+    CHECK(TelemetryQueue_Open(fileno(storage), 64 * 1024) == 0);
+
+    StubHub_Reset();
+    pushFailures = 0;
+    Configure(TELEMETRY_QUEUE_MAX_ENTRY_BYTES, TELEMETRY_BATCH_LIMIT_MAX_RECORDS, false);
+
+    hubOnline = false;
+    while (records < 600)
+    {
+        AddSeq(records, 40 + records % 60);
+        records++;
+    }
+    TelemetryBatch_Flush();
+    CHECK(hubCount == 0);
+    CHECK(pushFailures == 0);
+    CHECK(TelemetryQueue_Pending() > 1);
+
+    // Back online: the new batch waits behind the queued ones.
+    hubOnline = true;
+    AddSeq(records++, 10);
+    TelemetryBatch_Flush();
+    CHECK(hubCount == 0);
+
+    while (TelemetryQueue_Pending() > 0)
+    {
+        if (TelemetryQueue_Drain(4, SendQueuedTelemetry) == 0)
+        {
+            break;
+        }
+    }
+    CHECK(TelemetryQueue_Pending() == 0);
+    TelemetryQueue_GetStats(&stats);
+    CHECK(stats.dropped == 0);
+    CheckSequence(records, TELEMETRY_QUEUE_MAX_ENTRY_BYTES);
+
+    TelemetryQueue_Close();
+    fclose(storage);
+}
+
+int main(void)
+{
+    TestDefaults();
+    TestMaxBytes();
+    TestPassThrough();
+    TestAggregate();
+    TestNotJson();
+    TestConfigure();
+    TestOffline();
+
+    TelemetryBatch_Cleanup();
+    StubHub_Reset();
+
+    HOST_TEST_EXIT();
+}
@@ -0,0 +1,320 @@
+/// <summary>
+/// Test of telemetry_queue.c on a temporary file.
+///
+/// Every entry carries its number. The queue is closed or dropped like on a crash,
+/// reopened on the same file, and drained; the entries must come back oldest first,
+/// none twice, and the pending and dropped counts must add up. Checked are a reopen
+/// with no ack block on storage, the first ack being written with the first spill,
+/// a drain resumed after a restart, slots reused once storage is full, and a
+/// corrupt segment.
+/// </summary>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "telemetry_queue.h"
+
+#include "host_test.h"
+
+#define ACK_MAGIC 0x4B435154u // "TQCK", of telemetry_queue.c
+
+// Entries of ENTRY_BYTES: two fit the RAM buffer, the third spills it as a segment.
+#define ENTRY_BYTES 3000
+#define ENTRIES_PER_SEGMENT 2
+#define STORAGE_BYTES(slots) (TELEMETRY_QUEUE_ACK_AREA_BYTES + (slots)*TELEMETRY_QUEUE_SLOT_BYTES)
+
+static unsigned int drainedSeq[1024];
+static size_t drainedCount;
+static bool drainOnline = true;
+
+static void PushSeq(unsigned int seq)
+{
+    char entry[ENTRY_BYTES + 1];
+    int n = snprintf(entry, sizeof(entry), "seq=%u;", seq);
+
+    memset(entry + n, 'x', ENTRY_BYTES - (size_t)n);
+    entry[ENTRY_BYTES] = '\0';
+    CHECK(TelemetryQueue_Push(entry, ENTRY_BYTES, (time_t)seq));
+}
+
+static bool RecordEntry(const char *data, size_t len, time_t enqueuedAt)
+{
+    unsigned int seq;
+
+    if (!drainOnline || drainedCount == sizeof(drainedSeq) / sizeof(drainedSeq[0]))
+    {
+        return false;
+    }
+    CHECK(len == ENTRY_BYTES && strlen(data) == len);
+    CHECK(sscanf(data, "seq=%u;", &seq) == 1);
+    CHECK((time_t)seq == enqueuedAt);
+    drainedSeq[drainedCount++] = seq;
+    return true;
+}
+
+static void DrainAll(void)
+{
+    drainedCount = 0;
+    while (TelemetryQueue_Drain(3, RecordEntry) != 0)
+    {
+    }
+    CHECK(TelemetryQueue_Pending() == 0);
+}
+
+/// <summary>The drained entries must be first to first + count - 1, in order.</summary>
+static void CheckDrained(unsigned int first, unsigned int count)
+{
+    CHECKF(drainedCount == count, "%zu entries drained, %u expected", drainedCount, count);
+    for (size_t i = 0; i < drainedCount && i < count; i++)
+    {
+        CHECKF(drainedSeq[i] == first + i, "entry %zu: seq %u, expected %zu", i, drainedSeq[i],
+               first + i);
+    }
+}
+
+static FILE *NewStorage(void)
+{
+    FILE *storage = tmpfile();
+
+    if (storage == NULL)
+    {
+        perror("tmpfile");
+        exit(1);
+    }
+    return storage;
+}
+
+static bool HaveAck(int fd)
+{
+    uint32_t magic[2] = {0, 0};
+
+    // Ack blocks A and B; short reads leave the magic 0.
+    (void)pread(fd, &magic[0], sizeof(magic[0]), 0);
+    (void)pread(fd, &magic[1], sizeof(magic[1]), 20);
+    return magic[0] == ACK_MAGIC || magic[1] == ACK_MAGIC;
+}
+
+/// <summary>
+///     Entries of a run that never got to write an ack block, like one that stopped
+///     before its first ack or whose ack area was lost, are all recovered, also when
+///     fewer segments than slots were written. Seven slots, so that sequence numbers
+///     counted back past 0 would not map to their slots.
+/// </summary>
+static void TestReopenWithoutAck(unsigned int entries)
+{
+    FILE *storage = NewStorage();
+    int fd = fileno(storage);
+    static const uint8_t zero[TELEMETRY_QUEUE_ACK_AREA_BYTES];
+    TelemetryQueueStats stats;
+
+    CHECK(TelemetryQueue_Open(fd, STORAGE_BYTES(7)) == 0);
+    for (unsigned int i = 0; i < entries; i++)
+    {
+        PushSeq(i);
+    }
+    TelemetryQueue_Close();
+    CHECK(pwrite(fd, zero, sizeof(zero), 0) == sizeof(zero));
+
+    CHECK(TelemetryQueue_Open(fd, STORAGE_BYTES(7)) == 0);
+    TelemetryQueue_GetStats(&stats);
+    CHECKF(stats.pending == entries, "%u entries: %zu pending", entries, stats.pending);
+    CHECKF(stats.dropped == 0, "%u entries: %zu dropped", entries, stats.dropped);
+    DrainAll();
+    CheckDrained(0, entries);
+    TelemetryQueue_GetStats(&stats);
+    CHECK(stats.dropped == 0);
+
+    TelemetryQueue_Close();
+    fclose(storage);
+}
+
+/// <summary>
+///     The first spill writes an ack block. A crash right after it loses what was in
+///     RAM only.
+/// </summary>
+static void TestFirstSpillAck(void)
+{
+    FILE *storage = NewStorage();
+    int fd = fileno(storage);
+    TelemetryQueueStats stats;
+
+    CHECK(TelemetryQueue_Open(fd, STORAGE_BYTES(8)) == 0);
+    CHECK(!HaveAck(fd));
+    for (unsigned int i = 0; i <= ENTRIES_PER_SEGMENT; i++)
+    {
+        PushSeq(i);
+    }
+    TelemetryQueue_GetStats(&stats);
+    CHECK(stats.spilled == 1);
+    CHECK(HaveAck(fd));
+
+    // Crash: open again without closing.
+    CHECK(TelemetryQueue_Open(fd, STORAGE_BYTES(8)) == 0);
+    CHECK(TelemetryQueue_Pending() == ENTRIES_PER_SEGMENT);
+    DrainAll();
+    CheckDrained(0, ENTRIES_PER_SEGMENT);
+
+    TelemetryQueue_Close();
+    fclose(storage);
+}
+
+/// <summary>
+///     A drain that stopped halfway, inside a segment, resumes after a restart with the
+///     first entry that was not sent.
+/// </summary>
+static void TestResume(void)
+{
+    FILE *storage = NewStorage();
+    int fd = fileno(storage);
+    const unsigned int entries = 11;
+
+    CHECK(TelemetryQueue_Open(fd, STORAGE_BYTES(8)) == 0);
+    for (unsigned int i = 0; i < entries; i++)
+    {
+        PushSeq(i);
+    }
+    drainedCount = 0;
+    CHECK(TelemetryQueue_Drain(5, RecordEntry) == 5);
+    CheckDrained(0, 5);
+    drainOnline = false;
+    CHECK(TelemetryQueue_Drain(5, RecordEntry) == 0);
+    drainOnline = true;
+    CHECK(TelemetryQueue_Pending() == entries - 5);
+    TelemetryQueue_Close();
+
+    CHECK(TelemetryQueue_Open(fd, STORAGE_BYTES(8)) == 0);
+    CHECK(TelemetryQueue_Pending() == entries - 5);
+    DrainAll();
+    CheckDrained(5, entries - 5);
+    TelemetryQueue_Close();
+
+    // Nothing left for the next run.
+    CHECK(TelemetryQueue_Open(fd, STORAGE_BYTES(8)) == 0);
+    CHECK(TelemetryQueue_Pending() == 0);
+    TelemetryQueue_Close();
+    fclose(storage);
+}
+
+/// <summary>
+///     With storage full the oldest segment makes room and its entries count as
+///     dropped. This goes on for several laps of the slots, across restarts; what
+///     is left are the newest entries.
+/// </summary>
+static void TestWrap(void)
+{
+    FILE *storage = NewStorage();
+    int fd = fileno(storage);
+    const unsigned int slots = 3;
+    const unsigned int entries = 7 * slots * ENTRIES_PER_SEGMENT + 1;
+    TelemetryQueueStats stats;
+    size_t carried = 0;
+    unsigned int seq = 0;
+
+    CHECK(TelemetryQueue_Open(fd, STORAGE_BYTES(slots)) == 0);
+    for (unsigned int lap = 0; lap < 3; lap++)
+    {
+        for (unsigned int i = 0; i < entries; i++)
+        {
+            PushSeq(seq++);
+        }
+        TelemetryQueue_GetStats(&stats);
+        CHECKF(stats.pending + stats.dropped == carried + entries,
+               "lap %u: %zu pending, %zu dropped, %zu carried", lap, stats.pending,
+               stats.dropped, carried);
+        CHECK(stats.pending <= slots * ENTRIES_PER_SEGMENT + ENTRIES_PER_SEGMENT);
+        TelemetryQueue_Close();
+
+        CHECK(TelemetryQueue_Open(fd, STORAGE_BYTES(slots)) == 0);
+        carried = TelemetryQueue_Pending();
+        CHECK(carried > 0 && carried <= stats.pending);
+    }
+
+    DrainAll();
+    CheckDrained(seq - (unsigned int)carried, (unsigned int)carried);
+
+    TelemetryQueue_Close();
+    fclose(storage);
+}
+
+/// <summary>
+///     A segment whose CRC does not check out is skipped, on reopen and when found
+///     while draining; its entries count as dropped, the others arrive.
+/// </summary>
+static void TestCorruptSegment(void)
+{
+    FILE *storage = NewStorage();
+    int fd = fileno(storage);
+    const unsigned int entries = 4 * ENTRIES_PER_SEGMENT;
+    off_t slot1 = TELEMETRY_QUEUE_ACK_AREA_BYTES + 1 * TELEMETRY_QUEUE_SLOT_BYTES;
+    off_t slot5 = TELEMETRY_QUEUE_ACK_AREA_BYTES + 5 * TELEMETRY_QUEUE_SLOT_BYTES;
+    TelemetryQueueStats stats;
+    uint8_t byte;
+
+    CHECK(TelemetryQueue_Open(fd, STORAGE_BYTES(8)) == 0);
+    for (unsigned int i = 0; i < entries; i++)
+    {
+        PushSeq(i);
+    }
+    TelemetryQueue_Close();
+
+    // Flip a payload byte of the segment in slot 1.
+    CHECK(pread(fd, &byte, 1, slot1 + 100) == 1);
+    byte ^= 0x01;
+    CHECK(pwrite(fd, &byte, 1, slot1 + 100) == 1);
+
+    CHECK(TelemetryQueue_Open(fd, STORAGE_BYTES(8)) == 0);
+    CHECK(TelemetryQueue_Pending() == entries - ENTRIES_PER_SEGMENT);
+    DrainAll();
+    CHECK(drainedCount == entries - ENTRIES_PER_SEGMENT);
+    for (size_t i = 0; i < drainedCount; i++)
+    {
+        unsigned int expect = (unsigned int)i + (i < ENTRIES_PER_SEGMENT ? 0 : ENTRIES_PER_SEGMENT);
+        CHECKF(drainedSeq[i] == expect, "entry %zu: seq %u, expected %u", i, drainedSeq[i], expect);
+    }
+    TelemetryQueue_Close();
+
+    // Corrupted after the open: found by the drain. These segments go to slots 4 to 7.
+    CHECK(TelemetryQueue_Open(fd, STORAGE_BYTES(8)) == 0);
+    for (unsigned int i = 0; i < entries; i++)
+    {
+        PushSeq(100 + i);
+    }
+    TelemetryQueue_Close();
+    CHECK(TelemetryQueue_Open(fd, STORAGE_BYTES(8)) == 0);
+    CHECK(TelemetryQueue_Pending() == entries);
+    CHECK(pread(fd, &byte, 1, slot5 + 100) == 1);
+    byte ^= 0x01;
+    CHECK(pwrite(fd, &byte, 1, slot5 + 100) == 1);
+    DrainAll();
+    TelemetryQueue_GetStats(&stats);
+    CHECK(stats.dropped == ENTRIES_PER_SEGMENT);
+    CHECK(drainedCount == entries - ENTRIES_PER_SEGMENT);
+    for (size_t i = 0; i < drainedCount; i++)
+    {
+        unsigned int expect = 100 + (unsigned int)i + (i < ENTRIES_PER_SEGMENT ? 0 : ENTRIES_PER_SEGMENT);
+        CHECKF(drainedSeq[i] == expect, "entry %zu: seq %u, expected %u", i, drainedSeq[i], expect);
+    }
+
+    TelemetryQueue_Close();
+    fclose(storage);
+}
+
+int main(void)
+{
+    static const unsigned int entries[] = {1, 2, 3, 5, 8, 13, 14};
+
+    for (size_t i = 0; i < sizeof(entries) / sizeof(entries[0]); i++)
+    {
+        TestReopenWithoutAck(entries[i]);
+    }
+    TestFirstSpillAck();
+    TestResume();
+    TestWrap();
+    TestCorruptSegment();
+
+    HOST_TEST_EXIT();
+}
@@ -0,0 +1,40 @@
+/*
+ * Checks of the host tests of HLApp_HostTest, W5500_HostSim and DLog_Decoder:
+ * a failed CHECK prints where and what, counts the failure and lets the test
+ * go on; HOST_TEST_EXIT() ends main() with the status ctest looks at.
+ */
+
+#ifndef __HOST_TEST_H__
+#define __HOST_TEST_H__
+
+#include <stdio.h>
+
+static unsigned int host_test_failures;
+
+#define CHECK(cond)     do { \
+        if (!(cond)) { \
+            host_test_failures++; \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        } \
+    } while (0)
+
+/* Like CHECK, with a printf-style note of the values involved */
+#define CHECKF(cond, ...)   do { \
+        if (!(cond)) { \
+            host_test_failures++; \
+            fprintf(stderr, "%s:%d: check failed: %s: ", __FILE__, __LINE__, #cond); \
+            fprintf(stderr, __VA_ARGS__); \
+            fputc('\n', stderr); \
+        } \
+    } while (0)
+
+#define HOST_TEST_EXIT()    do { \
+        if (host_test_failures) { \
+            fprintf(stderr, "%u checks failed\n", host_test_failures); \
+            return 1; \
+        } \
+        printf("ok\n"); \
+        return 0; \
+    } while (0)
+
+#endif /* __HOST_TEST_H__ */
@@ -34,6 +34,31 @@ typedef struct {
 /* <summary>Blocks inside the shared buffer have this alignment.</summary> */
 #define RINGBUFFER_ALIGNMENT 16
 
+/* <summary>
+ * Space reserved in the outbound buffer by <see cref="ReserveData" />.
+ * The payload area may wrap around the end of the shared buffer, in which
+ * case it is described by two contiguous regions.
+ * </summary>
+ */
+typedef struct {
+	/* <summary>Payload area up to the end of the buffer.</summary> */
+	uint8_t *first;
+	/* <summary>Length of <c>first</c> in bytes.</summary> */
+	u32 firstSize;
+	/* <summary>Wrapped part of the payload area, or NULL.</summary> */
+	uint8_t *second;
+	/* <summary>Length of <c>second</c> in bytes.</summary> */
+	u32 secondSize;
+	/* <summary>Write position of the block, used by
+	 * <see cref="CommitData" />.</summary>
+	 */
+	u32 blockPosition;
+	/* <summary>Header bytes already written in front of the payload.
+	 * </summary>
+	 */
+	u32 headerSize;
+} RingReservation;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -77,6 +102,52 @@ int GetIntercoreBuffers(BufferHeader **outbound,
 int EnqueueData(BufferHeader *inbound, BufferHeader *outbound,
 		u32 bufSize, const void *src, u32 dataSize);
 
+/* <summary>
+ * <para>Reserve a block in the shared buffer so the payload can be written in
+ * place, e.g. by the network driver, instead of being staged in a local
+ * buffer and copied by <see cref="EnqueueData" />.</para>
+ * <para>The header is copied into the block right away. Nothing is visible to
+ * the high-level application until <see cref="CommitData" /> is called, and
+ * only one reservation may be outstanding at a time.</para>
+ * </summary>
+ * <param name="outbound">The outbound buffer, as obtained from
+ * <see cref="GetIntercoreBuffers" />.
+ * </param>
+ * <param name="inbound">The inbound buffer, as obtained from
+ * <see cref="GetIntercoreBuffers" />.
+ * </param>
+ * <param name="bufSize">
+ * The total buffer size, as obtained from <see cref="GetIntercoreBuffers" />.
+ * </param>
+ * <param name="header">Header to place in front of the payload, e.g. the
+ * component ID, or NULL.</param>
+ * <param name="headerSize">Length of the header in bytes.</param>
+ * <param name="payloadSize">Maximum payload length in bytes.</param>
+ * <param name="reservation">On success, describes the payload area.</param>
+ * <returns>0 if the space is available, -1 otherwise.</returns>
+ */
+int ReserveData(BufferHeader *inbound, BufferHeader *outbound,
+		u32 bufSize, const void *header, u32 headerSize,
+		u32 payloadSize, RingReservation *reservation);
+
+/* <summary>
+ * Publish a block reserved by <see cref="ReserveData" /> and notify the
+ * high-level application.
+ * </summary>
+ * <param name="outbound">The outbound buffer, as obtained from
+ * <see cref="GetIntercoreBuffers" />.
+ * </param>
+ * <param name="bufSize">
+ * The total buffer size, as obtained from <see cref="GetIntercoreBuffers" />.
+ * </param>
+ * <param name="reservation">The reservation to commit.</param>
+ * <param name="payloadSize">Number of payload bytes actually written. It must
+ * not exceed the reserved size; 0 drops the reservation.</param>
+ * <returns>0 on success, -1 otherwise.</returns>
+ */
+int CommitData(BufferHeader *outbound, u32 bufSize,
+		const RingReservation *reservation, u32 payloadSize);
+
 /* <summary>
  * Remove data from the shared buffer, which has been written by the high-level
  * application.
@@ -152,6 +152,14 @@ typedef int (*spi_usr_complete_callback) (void *context);
   * @}
   */
 
+/** @brief Number of descriptors in the per-port transaction queue used by
+ * mtk_os_hal_spim_queue_submit(). One slot is kept free, so up to
+ * MTK_OS_HAL_SPIM_QUEUE_DEPTH - 1 transactions can be outstanding.
+ */
+#ifndef MTK_OS_HAL_SPIM_QUEUE_DEPTH
+#define MTK_OS_HAL_SPIM_QUEUE_DEPTH	8
+#endif
+
 /** @defgroup os_hal_spim_function Function
   * @{
    * This section provides high level APIs to upper layer.
@@ -255,6 +263,81 @@ int mtk_os_hal_spim_async_transfer(spim_num bus_num,
 				   spi_usr_complete_callback complete,
 				   void *context);
 
+/**
+ * @brief  Queue one SPI transfer behind the ones already submitted.
+ *
+ *  The transfer descriptor is copied, so xfer may be reused right away,
+ *  but tx_buf/rx_buf must stay valid until complete() is called.
+ *  When a transfer finishes, the next queued one is started from the
+ *  interrupt before complete() runs, so the bus stays busy while the
+ *  caller prepares more work.
+ *  Do not mix with mtk_os_hal_spim_transfer() on the same port unless
+ *  the queue has been flushed.
+ *
+ *  @param [in] bus_num : SPIM ISU Port number,
+ *  it can be OS_HAL_SPIM_ISU0~OS_HAL_SPIM_ISU4
+ *  @param [in] config : the HW setting, must stay valid until completion
+ *  @param [in] xfer : the data should be read/writen.
+ *  @param [in] complete : called in interrupt context when xfer is done,
+ *  or NULL
+ *  @param [in] context : the argument to complete() when it's called
+ *
+ *  @return -2 means the queue is full.
+ *  @return other negative value means fail.
+ *  @return 0 means success.
+ */
+int mtk_os_hal_spim_queue_submit(spim_num bus_num,
+				 struct mtk_spi_config *config,
+				 struct mtk_spi_transfer *xfer,
+				 spi_usr_complete_callback complete,
+				 void *context);
+
+/**
+ * @brief  Get the number of queued transfers not completed yet.
+ *
+ *  @param [in] bus_num : SPIM ISU Port number,
+ *  it can be OS_HAL_SPIM_ISU0~OS_HAL_SPIM_ISU4
+ *
+ *  @return negative value means fail.
+ *  @return otherwise the number of outstanding transfers.
+ */
+int mtk_os_hal_spim_queue_pending(spim_num bus_num);
+
+/**
+ * @brief  Wait until at most pending queued transfers are outstanding.
+ *
+ *  For a submitter that found the queue full: waiting for
+ *  MTK_OS_HAL_SPIM_QUEUE_DEPTH - 2 returns as soon as the oldest transfer
+ *  has completed and a descriptor is free again.
+ *  Every completed transfer signals the waiter, which blocks on a semaphore
+ *  with FreeRTOS and sleeps in WFI on bare metal. time_ms bounds the whole
+ *  wait, not each completion.
+ *
+ *  @param [in] bus_num : SPIM ISU Port number,
+ *  it can be OS_HAL_SPIM_ISU0~OS_HAL_SPIM_ISU4
+ *  @param [in] pending : the number of transfers that may remain queued
+ *  @param [in] time_ms : timeout in ms
+ *
+ *  @return negative value means fail or timeout.
+ *  @return 0 means success.
+ */
+int mtk_os_hal_spim_queue_wait(spim_num bus_num, int pending, int time_ms);
+
+/**
+ * @brief  Wait until every queued transfer is completed.
+ *
+ *  Waits like mtk_os_hal_spim_queue_wait() with pending 0.
+ *
+ *  @param [in] bus_num : SPIM ISU Port number,
+ *  it can be OS_HAL_SPIM_ISU0~OS_HAL_SPIM_ISU4
+ *  @param [in] time_ms : timeout in ms
+ *
+ *  @return negative value means timeout, or the error of a queued
+ *  transfer that could not be started since the last flush.
+ *  @return 0 means success.
+ */
+int mtk_os_hal_spim_queue_flush(spim_num bus_num, int time_ms);
+
 #ifdef __cplusplus
 }
 #endif
@@ -117,6 +117,13 @@
  *        - Call mtk_os_hal_uart_dma_send_data(UART_PORT port_num,
  *          u8 *data, u32 len, bool vff_mode, u32 timeout)
  *
+ *      - Send UART data in DMA mode without waiting
+ *        - Call mtk_os_hal_uart_dma_send_data_async(UART_PORT port_num,
+ *          u8 *data, u32 len, bool vff_mode,
+ *          uart_dma_done_callback complete, void *context)
+ *        - Call mtk_os_hal_uart_dma_stop_send(UART_PORT port_num)
+ *          to stop it
+ *
  *      - Get UART data in DMA mode
  *        - Call mtk_os_hal_uart_dma_get_data(UART_PORT port_num,
  *          u8 *data, u32 len, bool vff_mode, u32 timeout)
@@ -264,6 +271,21 @@ u8 mtk_os_hal_uart_get_char_nowait(UART_PORT port_num);
  */
 void mtk_os_hal_uart_put_char(UART_PORT port_num, u8 data);
 
+/**
+ * @brief  Send UART data in PIO mode without waiting: fill the TX FIFO
+ *  if it is empty.
+ *
+ *  @param [in] bus_num : UART Port number,
+ *  it can be OS_HAL_UART_PORT0~OS_HAL_UART_ISU4
+ *  @param [in] data : Pointer to the data.
+ *  @param [in] len : Data length.
+ *
+ *  @return Number of bytes written to the TX FIFO, at most
+ *  UART_TX_FIFO_SIZE, 0 while it is not empty.
+ */
+int mtk_os_hal_uart_put_data_nowait(UART_PORT port_num,
+	const u8 *data, u32 len);
+
 /**
  * @brief  Set UART hardware flow control.
  *
@@ -340,6 +362,40 @@ void mtk_os_hal_uart_set_irq(UART_PORT port_num, u8 irq_flag);
 int mtk_os_hal_uart_dma_send_data(UART_PORT port_num,
 	u8 *data, u32 len, bool vff_mode, u32 timeout);
 
+/**
+ * @brief  Start sending UART data in DMA mode and return at once.
+ *  complete is called from the DMA interrupt once the transfer is
+ *  done; it may start the next transfer.
+ *
+ *  @param [in] bus_num : UART Port number,
+ *  it can be OS_HAL_UART_ISU0~OS_HAL_UART_ISU4, CM4-UART has no DMA.
+ *  @param [in] data : Pointer to the data, in DMA-able memory; it must
+ *  stay valid until complete is called.
+ *  @param [in] len : Data length.
+ *  @param [in] vff_mode : true: VFF Mode; false: Half-Size Mode.
+ *  @param [in] complete : Called when the transfer is done.
+ *  @param [in] context : Argument of complete.
+ *
+ *  @return 0 means the transfer was started.
+ *  @return -UART_ENXIO means a DMA transfer is ongoing.
+ *  @return -UART_EINVAL or -UART_EPTR means invalid arguments.
+ */
+int mtk_os_hal_uart_dma_send_data_async(UART_PORT port_num,
+	u8 *data, u32 len, bool vff_mode,
+	uart_dma_done_callback complete, void *context);
+
+/**
+ * @brief  Stop the DMA transfer started by
+ *  mtk_os_hal_uart_dma_send_data_async(); its completion callback is not
+ *  called.
+ *
+ *  @param [in] bus_num : UART Port number,
+ *  it can be OS_HAL_UART_ISU0~OS_HAL_UART_ISU4.
+ *
+ *  @return Number of bytes have been send, 0 if no transfer is ongoing.
+ */
+int mtk_os_hal_uart_dma_stop_send(UART_PORT port_num);
+
 /**
  * @brief  Get UART data in DMA mode. This function will return when :
  *    "Error detected" or "timeout" or "RX DMA completed".
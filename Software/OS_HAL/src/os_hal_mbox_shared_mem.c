@@ -199,6 +199,116 @@ int EnqueueData(BufferHeader *inbound, BufferHeader *outbound,
 	return 0;
 }
 
+int ReserveData(BufferHeader *inbound, BufferHeader *outbound,
+			u32 bufSize, const void *header, u32 headerSize,
+			u32 payloadSize, RingReservation *reservation)
+{
+	u32 remoteReadPosition = inbound->readPosition;
+	u32 localWritePosition = outbound->writePosition;
+	u32 dataSize = headerSize + payloadSize;
+
+	if (remoteReadPosition >= bufSize) {
+		printf("ReserveData: remoteReadPosition invalid\r\n");
+		return -1;
+	}
+
+	/* Same space rules as EnqueueData. */
+	u32 availSpace;
+
+	if (remoteReadPosition <= localWritePosition)
+		availSpace = remoteReadPosition - localWritePosition + bufSize;
+	else
+		availSpace = remoteReadPosition - localWritePosition;
+
+	if (availSpace < sizeof(u32) + dataSize + RINGBUFFER_ALIGNMENT)
+		return -1;
+
+	u32 dataToEnd = bufSize - localWritePosition;
+
+	if (dataToEnd < sizeof(u32)) {
+		printf("ReserveData: not enough space for block size\r\n");
+		return -1;
+	}
+
+	/* Offset of the first byte after the block size word, in the data area
+	 * and as a count of bytes left before the end of the buffer.
+	 */
+	u32 dataStart = localWritePosition + sizeof(u32);
+	u32 leftToEnd = dataToEnd - sizeof(u32);
+
+	/* Header, split if it crosses the end of the buffer. */
+	u32 headerToEnd = headerSize < leftToEnd ? headerSize : leftToEnd;
+	const uint8_t *header8 = header;
+
+	if (headerSize) {
+		__builtin_memcpy(DataAreaOffset8(outbound, dataStart),
+				header8, headerToEnd);
+		__builtin_memcpy(DataAreaOffset8(outbound, 0),
+				header8 + headerToEnd, headerSize - headerToEnd);
+	}
+
+	/* Payload area, starting right after the header. */
+	if (headerToEnd < headerSize) {
+		reservation->first = DataAreaOffset8(outbound,
+					headerSize - headerToEnd);
+		reservation->firstSize = payloadSize;
+		reservation->second = NULL;
+		reservation->secondSize = 0;
+	} else {
+		u32 payloadToEnd = leftToEnd - headerSize;
+
+		if (payloadToEnd > payloadSize)
+			payloadToEnd = payloadSize;
+
+		reservation->first = DataAreaOffset8(outbound,
+					dataStart + headerSize);
+		reservation->firstSize = payloadToEnd;
+		reservation->second = payloadToEnd < payloadSize ?
+					DataAreaOffset8(outbound, 0) : NULL;
+		reservation->secondSize = payloadSize - payloadToEnd;
+	}
+
+	reservation->blockPosition = localWritePosition;
+	reservation->headerSize = headerSize;
+
+	return 0;
+}
+
+int CommitData(BufferHeader *outbound, u32 bufSize,
+			const RingReservation *reservation, u32 payloadSize)
+{
+	u32 localWritePosition = reservation->blockPosition;
+	u32 dataSize = reservation->headerSize + payloadSize;
+
+	if (localWritePosition != outbound->writePosition ||
+	    payloadSize > reservation->firstSize + reservation->secondSize) {
+		printf("CommitData: invalid reservation\r\n");
+		return -1;
+	}
+
+	if (payloadSize == 0)
+		return 0;
+
+	/* Write block size to first word in block. */
+	*DataAreaOffset32(outbound, localWritePosition) = dataSize;
+
+	/* Advance write position. */
+	localWritePosition =
+		RoundUp(localWritePosition + sizeof(u32) +
+			dataSize, RINGBUFFER_ALIGNMENT);
+	if (localWritePosition >= bufSize)
+		localWritePosition -= bufSize;
+
+	outbound->writePosition = localWritePosition;
+
+	/* SW_TX_INT_PORT[0] = 1 -> indicate message received. */
+	u32 sw_trig_int = 0;
+
+	mtk_os_hal_mbox_ioctl(OS_HAL_MBOX_CH0,
+				MBOX_IOSET_SWINT_TRIG, &sw_trig_int);
+	return 0;
+}
+
 int DequeueData(BufferHeader *outbound, BufferHeader *inbound,
 			u32 bufSize, void *dest, u32 *dataSize)
 {
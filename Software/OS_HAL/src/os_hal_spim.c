@@ -84,6 +84,16 @@ static unsigned long cg_base_addr[OS_HAL_SPIM_ISU_MAX] = {
 	ISU4_CG_BASE,
 };
 
+/**
+ * one queued transaction, owned by the queue until its callback returns
+ */
+struct mtk_spi_queue_desc {
+	struct mtk_spi_transfer xfer;
+	struct mtk_spi_config *config;
+	spi_usr_complete_callback complete;
+	void *context;
+};
+
 /**
  * this os special spi structure, need mapping it to mtk_spi_controller
  */
@@ -93,6 +103,8 @@ struct mtk_spi_controller_rtos {
 	/* the type based on OS */
 #ifdef OSAI_FREERTOS
 	QueueHandle_t xfer_completion;
+	/* counts completed queue descriptors, given once per descriptor */
+	QueueHandle_t queue_done;
 #else
 	volatile u8 xfer_completion;
 #endif
@@ -100,6 +112,13 @@ struct mtk_spi_controller_rtos {
 	/* used for async API */
 	spi_usr_complete_callback complete;
 	void *context;
+
+	/* used for queue API: head is written by submit, tail by irq */
+	struct mtk_spi_queue_desc queue[MTK_OS_HAL_SPIM_QUEUE_DEPTH];
+	volatile u8 queue_head;
+	volatile u8 queue_tail;
+	volatile u8 queue_busy;
+	volatile int queue_err;
 };
 
 static struct mtk_spi_controller_rtos g_spim_ctlr_rtos[OS_HAL_SPIM_ISU_MAX];
@@ -134,6 +153,19 @@ int mtk_os_hal_spim_dump_reg(spim_num bus_num)
 	return 0;
 }
 
+/* The callback may start the next async transfer, which installs a new
+ * complete/context pair, so clear ours before calling it.
+ */
+static void _mtk_os_hal_spim_async_done(struct mtk_spi_controller_rtos *ctlr_rtos)
+{
+	spi_usr_complete_callback complete = ctlr_rtos->complete;
+	void *context = ctlr_rtos->context;
+
+	ctlr_rtos->complete = NULL;
+	ctlr_rtos->context = NULL;
+	complete(context);
+}
+
 static int _mtk_os_hal_spim_irq_handler(spim_num bus_num)
 {
 	struct mtk_spi_controller_rtos *ctlr_rtos;
@@ -162,9 +194,7 @@ static int _mtk_os_hal_spim_irq_handler(spim_num bus_num)
 	    ((curr_xfer->opcode_len != 0) && !curr_xfer->rx_buf)) {
 		if (ctlr_rtos->complete) {
 			/* async xfer */
-			ctlr_rtos->complete(ctlr_rtos->context);
-			ctlr_rtos->complete = NULL;
-			ctlr_rtos->context = NULL;
+			_mtk_os_hal_spim_async_done(ctlr_rtos);
 		} else {
 			/* sync xfer */
 #ifdef OSAI_FREERTOS
@@ -264,9 +294,7 @@ static int _mtk_os_hal_spim_dma_done_callback(void *data)
 	struct mtk_spi_controller_rtos *ctlr_rtos = data;
 
 	if (ctlr_rtos->complete) {
-		ctlr_rtos->complete(ctlr_rtos->context);
-		ctlr_rtos->complete = NULL;
-		ctlr_rtos->context = NULL;
+		_mtk_os_hal_spim_async_done(ctlr_rtos);
 	} else {
 		/* while using DMA mode to do sync xfer,
 		 * release semaphore in this callback
@@ -319,6 +347,7 @@ int mtk_os_hal_spim_ctlr_init(spim_num bus_num)
 
 #ifdef OSAI_FREERTOS
 	ctlr_rtos->xfer_completion = xSemaphoreCreateBinary();
+	ctlr_rtos->queue_done = xSemaphoreCreateCounting(MTK_OS_HAL_SPIM_QUEUE_DEPTH, 0);
 #else
 	ctlr_rtos->xfer_completion = 0;
 #endif
@@ -347,6 +376,7 @@ int mtk_os_hal_spim_ctlr_deinit(spim_num bus_num)
 
 #ifdef OSAI_FREERTOS
 	vSemaphoreDelete(ctlr_rtos->xfer_completion);
+	vSemaphoreDelete(ctlr_rtos->queue_done);
 #else
 	ctlr_rtos->xfer_completion = 0;
 #endif
@@ -469,3 +499,185 @@ int mtk_os_hal_spim_async_transfer(spim_num bus_num,
 	return ret;
 }
 
+/* Start the descriptor at queue_tail. Called with queue_busy set, from
+ * submit (irq masked) or from the completion of the previous descriptor.
+ */
+static int _mtk_os_hal_spim_queue_kick(spim_num bus_num,
+				       struct mtk_spi_controller_rtos *ctlr_rtos);
+
+static int _mtk_os_hal_spim_queue_done(void *context)
+{
+	struct mtk_spi_controller_rtos *ctlr_rtos = context;
+	struct mtk_spi_queue_desc *desc = &ctlr_rtos->queue[ctlr_rtos->queue_tail];
+	spi_usr_complete_callback complete = desc->complete;
+	void *user_context = desc->context;
+	spim_num bus_num = (spim_num)(ctlr_rtos - g_spim_ctlr_rtos);
+#ifdef OSAI_FREERTOS
+	BaseType_t x_higher_priority_task_woken = pdFALSE;
+#endif
+
+	/* get the next transaction on the wire before running the user callback */
+	ctlr_rtos->queue_tail = (ctlr_rtos->queue_tail + 1) %
+				MTK_OS_HAL_SPIM_QUEUE_DEPTH;
+	if (ctlr_rtos->queue_tail != ctlr_rtos->queue_head)
+		_mtk_os_hal_spim_queue_kick(bus_num, ctlr_rtos);
+	else
+		ctlr_rtos->queue_busy = 0;
+
+	if (complete)
+		complete(user_context);
+
+#ifdef OSAI_FREERTOS
+	/* a waiter checks its own condition, so every descriptor signals */
+	xSemaphoreGiveFromISR(ctlr_rtos->queue_done, &x_higher_priority_task_woken);
+	portYIELD_FROM_ISR(x_higher_priority_task_woken);
+#endif
+
+	return 0;
+}
+
+static int _mtk_os_hal_spim_queue_kick(spim_num bus_num,
+				       struct mtk_spi_controller_rtos *ctlr_rtos)
+{
+	struct mtk_spi_queue_desc *desc;
+	int ret;
+
+	while (ctlr_rtos->queue_tail != ctlr_rtos->queue_head) {
+		desc = &ctlr_rtos->queue[ctlr_rtos->queue_tail];
+		ret = mtk_os_hal_spim_async_transfer(bus_num, desc->config,
+						     &desc->xfer,
+						     _mtk_os_hal_spim_queue_done,
+						     ctlr_rtos);
+		if (!ret)
+			return 0;
+
+		/* drop the failed descriptor and report it, keep the rest going */
+		ctlr_rtos->queue_err = ret;
+		ctlr_rtos->queue_tail = (ctlr_rtos->queue_tail + 1) %
+					MTK_OS_HAL_SPIM_QUEUE_DEPTH;
+	}
+
+	ctlr_rtos->queue_busy = 0;
+	return -1;
+}
+
+int mtk_os_hal_spim_queue_submit(spim_num bus_num,
+				 struct mtk_spi_config *config,
+				 struct mtk_spi_transfer *xfer,
+				 spi_usr_complete_callback complete,
+				 void *context)
+{
+	struct mtk_spi_controller_rtos *ctlr_rtos;
+	struct mtk_spi_queue_desc *desc;
+	u8 next;
+	u32 flag;
+
+	ctlr_rtos = _mtk_os_hal_spim_get_ctlr(bus_num);
+	if (!ctlr_rtos || !ctlr_rtos->ctlr)
+		return -1;
+
+	next = (ctlr_rtos->queue_head + 1) % MTK_OS_HAL_SPIM_QUEUE_DEPTH;
+	if (next == ctlr_rtos->queue_tail)
+		return -2;	/* full, caller should retry after a completion */
+
+	desc = &ctlr_rtos->queue[ctlr_rtos->queue_head];
+	desc->xfer = *xfer;
+	desc->config = config;
+	desc->complete = complete;
+	desc->context = context;
+
+	local_irq_save(flag);
+	ctlr_rtos->queue_head = next;
+	if (!ctlr_rtos->queue_busy) {
+		ctlr_rtos->queue_busy = 1;
+		_mtk_os_hal_spim_queue_kick(bus_num, ctlr_rtos);
+	}
+	local_irq_restore(flag);
+
+	return 0;
+}
+
+static int _mtk_os_hal_spim_queue_pending(struct mtk_spi_controller_rtos *ctlr_rtos)
+{
+	return (ctlr_rtos->queue_head + MTK_OS_HAL_SPIM_QUEUE_DEPTH -
+		ctlr_rtos->queue_tail) % MTK_OS_HAL_SPIM_QUEUE_DEPTH;
+}
+
+int mtk_os_hal_spim_queue_pending(spim_num bus_num)
+{
+	struct mtk_spi_controller_rtos *ctlr_rtos;
+
+	ctlr_rtos = _mtk_os_hal_spim_get_ctlr(bus_num);
+	if (!ctlr_rtos)
+		return -1;
+
+	return _mtk_os_hal_spim_queue_pending(ctlr_rtos);
+}
+
+/* Wait until at most pending descriptors are outstanding, at most time_ms
+ * from the call. FreeRTOS blocks on the per-descriptor semaphore; bare metal
+ * sleeps in WFI until the next interrupt, the completion or the 1 ms SysTick.
+ * Interrupts are masked between the check and the WFI, so a completion in
+ * between still wakes it.
+ */
+static int _mtk_os_hal_spim_queue_sleep(struct mtk_spi_controller_rtos *ctlr_rtos,
+					int pending, int time_ms)
+{
+#ifdef OSAI_FREERTOS
+	TickType_t start = xTaskGetTickCount();
+	TickType_t limit = time_ms / portTICK_RATE_MS;
+	TickType_t elapsed;
+
+	while (_mtk_os_hal_spim_queue_pending(ctlr_rtos) > pending) {
+		elapsed = xTaskGetTickCount() - start;
+		if (elapsed >= limit ||
+		    pdTRUE != xSemaphoreTake(ctlr_rtos->queue_done, limit - elapsed))
+			return _mtk_os_hal_spim_queue_pending(ctlr_rtos) > pending ? -1 : 0;
+	}
+#else
+	extern volatile u32 sys_tick_in_ms;
+	uint32_t start_tick = sys_tick_in_ms;
+	u32 flag;
+
+	while (_mtk_os_hal_spim_queue_pending(ctlr_rtos) > pending) {
+		if (sys_tick_in_ms - start_tick > (u32)time_ms)
+			return -1;
+		local_irq_save(flag);
+		if (_mtk_os_hal_spim_queue_pending(ctlr_rtos) > pending)
+			__WFI();
+		local_irq_restore(flag);
+	}
+#endif
+
+	return 0;
+}
+
+int mtk_os_hal_spim_queue_wait(spim_num bus_num, int pending, int time_ms)
+{
+	struct mtk_spi_controller_rtos *ctlr_rtos;
+
+	ctlr_rtos = _mtk_os_hal_spim_get_ctlr(bus_num);
+	if (!ctlr_rtos || pending < 0)
+		return -1;
+
+	return _mtk_os_hal_spim_queue_sleep(ctlr_rtos, pending, time_ms);
+}
+
+int mtk_os_hal_spim_queue_flush(spim_num bus_num, int time_ms)
+{
+	struct mtk_spi_controller_rtos *ctlr_rtos;
+	int ret;
+
+	ctlr_rtos = _mtk_os_hal_spim_get_ctlr(bus_num);
+	if (!ctlr_rtos)
+		return -1;
+
+	/* no descriptor left means the queue is idle, see _queue_done() */
+	if (_mtk_os_hal_spim_queue_sleep(ctlr_rtos, 0, time_ms))
+		return -1;
+
+	ret = ctlr_rtos->queue_err;
+	ctlr_rtos->queue_err = 0;
+
+	return ret;
+}
@@ -110,6 +110,10 @@ struct mtk_uart_controller_rtos {
 	/* flag for DMA TX/RX */
 	bool bTX_Running;
 	bool bRX_Running;
+
+	/* completion of mtk_os_hal_uart_dma_send_data_async() */
+	uart_dma_done_callback tx_complete;
+	void *tx_context;
 };
 
 static struct mtk_uart_private
@@ -250,6 +254,18 @@ void mtk_os_hal_uart_put_char(UART_PORT port_num, u8 data)
 	mtk_mhal_uart_putc(ctlr_rtos->ctlr, data);
 }
 
+int mtk_os_hal_uart_put_data_nowait(UART_PORT port_num,
+	const u8 *data, u32 len)
+{
+	struct mtk_uart_controller_rtos *ctlr_rtos =
+		_mtk_os_hal_uart_get_ctlr(port_num);
+
+	if (!ctlr_rtos)
+		return -UART_EPTR;
+
+	return mtk_mhal_uart_putc_nowait(ctlr_rtos->ctlr, data, len);
+}
+
 int mtk_os_hal_uart_clear_irq_status(UART_PORT port_num)
 {
 	struct mtk_uart_controller_rtos *ctlr_rtos =
@@ -307,13 +323,36 @@ void mtk_os_hal_uart_set_sw_fc(UART_PORT port_num,
 		xon2, xoff2, escape_data);
 }
 
+static int _mtk_os_hal_uart_dma_tx_finish(
+				struct mtk_uart_controller_rtos *ctlr_rtos)
+{
+	struct mtk_uart_controller *ctlr = ctlr_rtos->ctlr;
+
+	mtk_mhal_uart_update_dma_tx_info(ctlr);
+	mtk_mhal_uart_release_dma_tx_ch(ctlr);
+
+	mtk_mhal_uart_set_dma(ctlr, false);
+	ctlr_rtos->bTX_Running = false;
+
+	return ctlr->mdata->tx_size;
+}
+
 static int _mtk_os_hal_uart_dma_tx_callback(void *data)
 {
 	struct mtk_uart_controller_rtos *ctlr_rtos = data;
+	uart_dma_done_callback complete = ctlr_rtos->tx_complete;
 #ifdef OSAI_FREERTOS
 	BaseType_t x_higher_priority_task_woken = pdFALSE;
 #endif
 
+	/* async xfer: finish it here, the user may start the next one */
+	if (complete) {
+		ctlr_rtos->tx_complete = NULL;
+		_mtk_os_hal_uart_dma_tx_finish(ctlr_rtos);
+		complete(ctlr_rtos->tx_context);
+		return 0;
+	}
+
 	/* while using DMA mode, release semaphore in this callback */
 #ifdef OSAI_FREERTOS
 	xSemaphoreGiveFromISR(ctlr_rtos->xTX_Queue,
@@ -385,13 +424,12 @@ static int _mtk_os_hal_uart_wait_for_rx_done(
 	return 0;
 }
 
-int mtk_os_hal_uart_dma_send_data(UART_PORT port_num,
-	u8 *data, u32 len, bool vff_mode, u32 timeout)
+static int _mtk_os_hal_uart_dma_tx_start(UART_PORT port_num,
+	u8 *data, u32 len, bool vff_mode)
 {
 	struct mtk_uart_controller_rtos *ctlr_rtos =
 		_mtk_os_hal_uart_get_ctlr(port_num);
 	struct mtk_uart_controller *ctlr;
-	int ret;
 
 	if (!ctlr_rtos)
 		return -UART_EPTR;
@@ -400,13 +438,12 @@ int mtk_os_hal_uart_dma_send_data(UART_PORT port_num,
 	if (!ctlr)
 		return -UART_EPTR;
 
-	if (len >= 0x4000) {
-		printf("DMA max transfter size is 0x4000!\r\n");
+	/* CM4-UART has no DMA channel */
+	if (port_num == OS_HAL_UART_PORT0)
 		return -UART_EINVAL;
-	}
 
-	if (timeout == 0) {
-		printf("timeout parameter fail!\r\n");
+	if (len >= 0x4000) {
+		printf("DMA max transfter size is 0x4000!\r\n");
 		return -UART_EINVAL;
 	}
 
@@ -415,12 +452,8 @@ int mtk_os_hal_uart_dma_send_data(UART_PORT port_num,
 		return -UART_ENXIO;
 	}
 
-#ifdef OSAI_FREERTOS
-	if (!ctlr_rtos->xTX_Queue)
-		ctlr_rtos->xTX_Queue = xSemaphoreCreateBinary();
-#else
-	ctlr_rtos->xTX_Queue = 0;
-#endif
+	if (ctlr_rtos->bTX_Running == true)
+		return -UART_ENXIO;
 
 	ctlr_rtos->bTX_Running = true;
 
@@ -444,10 +477,44 @@ int mtk_os_hal_uart_dma_send_data(UART_PORT port_num,
 	mtk_mhal_uart_dma_tx_config(ctlr);
 	mtk_mhal_uart_start_dma_tx(ctlr);
 
+	return 0;
+}
+
+int mtk_os_hal_uart_dma_send_data(UART_PORT port_num,
+	u8 *data, u32 len, bool vff_mode, u32 timeout)
+{
+	struct mtk_uart_controller_rtos *ctlr_rtos =
+		_mtk_os_hal_uart_get_ctlr(port_num);
+	int ret;
+
+	if (!ctlr_rtos)
+		return -UART_EPTR;
+
+	if (timeout == 0) {
+		printf("timeout parameter fail!\r\n");
+		return -UART_EINVAL;
+	}
+
+#ifdef OSAI_FREERTOS
+	if (!ctlr_rtos->xTX_Queue)
+		ctlr_rtos->xTX_Queue = xSemaphoreCreateBinary();
+#else
+	ctlr_rtos->xTX_Queue = 0;
+#endif
+
+	ret = _mtk_os_hal_uart_dma_tx_start(port_num, data, len, vff_mode);
+	if (ret) {
+#ifdef OSAI_FREERTOS
+		vSemaphoreDelete(ctlr_rtos->xTX_Queue);
+		ctlr_rtos->xTX_Queue = NULL;
+#endif
+		return ret;
+	}
+
 	ret = _mtk_os_hal_uart_wait_for_tx_done(ctlr_rtos, timeout);
 	if (ret) {
 		/* printf("Take UART TX Semaphore timeout!\n"); */
-		mtk_mhal_uart_stop_dma_tx(ctlr);
+		mtk_mhal_uart_stop_dma_tx(ctlr_rtos->ctlr);
 	}
 
 #ifdef OSAI_FREERTOS
@@ -457,13 +524,48 @@ int mtk_os_hal_uart_dma_send_data(UART_PORT port_num,
 	ctlr_rtos->xTX_Queue = 0;
 #endif
 
-	mtk_mhal_uart_update_dma_tx_info(ctlr);
-	mtk_mhal_uart_release_dma_tx_ch(ctlr);
+	return _mtk_os_hal_uart_dma_tx_finish(ctlr_rtos);
+}
 
-	mtk_mhal_uart_set_dma(ctlr, false);
-	ctlr_rtos->bTX_Running = false;
+int mtk_os_hal_uart_dma_send_data_async(UART_PORT port_num,
+	u8 *data, u32 len, bool vff_mode,
+	uart_dma_done_callback complete, void *context)
+{
+	struct mtk_uart_controller_rtos *ctlr_rtos =
+		_mtk_os_hal_uart_get_ctlr(port_num);
+	int ret;
 
-	return ctlr->mdata->tx_size;
+	if (!ctlr_rtos || !complete)
+		return -UART_EPTR;
+
+	if (ctlr_rtos->bTX_Running == true)
+		return -UART_ENXIO;
+
+	ctlr_rtos->tx_complete = complete;
+	ctlr_rtos->tx_context = context;
+
+	ret = _mtk_os_hal_uart_dma_tx_start(port_num, data, len, vff_mode);
+	if (ret)
+		ctlr_rtos->tx_complete = NULL;
+
+	return ret;
+}
+
+int mtk_os_hal_uart_dma_stop_send(UART_PORT port_num)
+{
+	struct mtk_uart_controller_rtos *ctlr_rtos =
+		_mtk_os_hal_uart_get_ctlr(port_num);
+
+	if (!ctlr_rtos || !ctlr_rtos->ctlr)
+		return -UART_EPTR;
+
+	if (ctlr_rtos->bTX_Running == false)
+		return 0;
+
+	mtk_mhal_uart_stop_dma_tx(ctlr_rtos->ctlr);
+	ctlr_rtos->tx_complete = NULL;
+
+	return _mtk_os_hal_uart_dma_tx_finish(ctlr_rtos);
 }
 
 int mtk_os_hal_uart_dma_get_data(UART_PORT port_num,
@@ -0,0 +1,604 @@
+/*
+ * Stress test of the DHCP server's lease table, dhcps.c, on the model.
+ *
+ * Chip A plays TEST_CLIENTS clients, chip B runs the server on a pool of
+ * fewer addresses than there are clients. A seeded sequence of operations
+ * drives them: DISCOVER/REQUEST exchanges, abandoned offers, renewals,
+ * releases, declines, requests for any address or for another server, and
+ * jumps of the clock past the offer, decline and lease times.
+ *
+ * A model of the lease table next to the test predicts every reply: the
+ * address a client gets is the one it has or had if the server still
+ * remembers it, the one it asks for if that is free, or any free one; no
+ * reply at all only when nothing is free. After each operation the bindings
+ * reported through dhcps_lease_changed_peek() and _take() must match the
+ * model, so no address is bound to two clients and no client holds two. Finally the server is
+ * restarted, its bound leases are restored with dhcps_lease_restore() and
+ * the run goes on.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ioLibrary_Driver/Ethernet/socket.h"
+#include "ioLibrary_Driver/Internet/DHCP/dhcps.h"
+
+#include "w5500_sim.h"
+#include "host_test.h"
+
+#define TEST_SOCK           3
+#define TEST_CLIENTS        48
+#define TEST_OPS            20000
+#define TEST_OPS_RESTART    4000
+#define TEST_POOL_START     10
+#define TEST_POOL_END       41      /* the server, .20, is in the range */
+#define TEST_SEED           0x5EED1EA5u
+
+enum {
+    MODEL_FREE,
+    MODEL_OFFERED,
+    MODEL_BOUND,
+    MODEL_RESERVED,
+};
+
+typedef struct {
+    uint8_t state;
+    int owner;              /* client the server remembers for the address, -1 if none */
+    uint32_t expires;       /* second, 0 = never */
+} model_lease;
+
+static w5500_sim_net test_net;
+static w5500_sim chip_a, chip_b;
+static wizchip_ctx ctx_a, ctx_b;
+
+static wiz_NetInfo netinfo_a = {
+    .mac = { 0x00, 0x08, 0xDC, 0x00, 0x00, 0x0A },
+    .ip = { 192, 168, 50, 10 },
+    .sn = { 255, 255, 255, 0 },
+    .gw = { 192, 168, 50, 1 },
+    .dhcp = NETINFO_STATIC,
+};
+static wiz_NetInfo netinfo_b = {
+    .mac = { 0x00, 0x08, 0xDC, 0x00, 0x00, 0x0B },
+    .ip = { 192, 168, 50, 20 },
+    .sn = { 255, 255, 255, 0 },
+    .gw = { 192, 168, 50, 1 },
+    .dhcp = NETINFO_STATIC,
+};
+static const uint8_t other_server[4] = { 192, 168, 50, 2 };
+
+static dhcps_msg server_buf;
+static dhcps_msg msg;
+
+static model_lease model[DHCPS_LEASE_HOSTS];
+static uint32_t model_next;         /* earliest expiry, 0 = none */
+static uint32_t now_s;              /* dhcps_time_handler() calls */
+static int mirror[DHCPS_LEASE_HOSTS];   /* bound client per host, from the changed leases */
+
+static uint32_t sent, replies;
+static uint32_t rng = TEST_SEED;
+
+/* The printf of the BSP used by dhcps.c and the log */
+void _putchar(char character)
+{
+    (void)character;
+}
+
+static uint32_t rnd(uint32_t n)
+{
+    rng = rng * 1103515245 + 12345;
+    return (rng >> 8) % n;
+}
+
+/*
+ * The model
+ */
+
+static void model_init(void)
+{
+    unsigned int host;
+
+    for (host = 0; host < DHCPS_LEASE_HOSTS; host++)
+    {
+        model[host].owner = -1;
+        model[host].expires = 0;
+        model[host].state = MODEL_RESERVED;
+        if (host >= TEST_POOL_START && host <= TEST_POOL_END && host != netinfo_b.ip[3])
+            model[host].state = MODEL_FREE;
+    }
+    model_next = 0;
+}
+
+static unsigned int model_by_client(int c)
+{
+    unsigned int host;
+
+    for (host = 1; host < DHCPS_LEASE_HOSTS; host++)
+        if (model[host].owner == c)
+            return host;
+    return 0;
+}
+
+static void model_set(unsigned int host, uint8_t state, uint32_t seconds)
+{
+    model[host].state = state;
+    model[host].expires = seconds ? now_s + seconds : 0;
+    if (seconds && (model_next == 0 || model[host].expires < model_next))
+        model_next = model[host].expires;
+}
+
+static void model_claim(unsigned int host, int c, uint8_t state, uint32_t seconds)
+{
+    unsigned int old;
+
+    if (model[host].owner != c)
+    {
+        old = model_by_client(c);
+        if (old)
+            model[old].owner = -1;
+        model[host].owner = c;
+    }
+    model_set(host, state, seconds);
+}
+
+static void model_sweep(void)
+{
+    unsigned int host;
+
+    if (model_next == 0 || now_s < model_next)
+        return;
+    model_next = 0;
+    for (host = 1; host < DHCPS_LEASE_HOSTS; host++)
+    {
+        if (model[host].expires == 0)
+            continue;
+        if (now_s >= model[host].expires)
+            model_set(host, MODEL_FREE, 0);
+        else if (model_next == 0 || model[host].expires < model_next)
+            model_next = model[host].expires;
+    }
+}
+
+static int model_any_free(void)
+{
+    unsigned int host;
+
+    for (host = 1; host < DHCPS_LEASE_HOSTS; host++)
+        if (model[host].state == MODEL_FREE)
+            return 1;
+    return 0;
+}
+
+/* Host of an address on the server's subnet, 0 for anything else */
+static unsigned int host_of(const uint8_t *ip)
+{
+    return memcmp(ip, netinfo_b.ip, 3) == 0 ? ip[3] : 0;
+}
+
+/*
+ * The wire
+ */
+
+static void tick(uint32_t seconds)
+{
+    wizchip_setctx(&ctx_b);
+    while (seconds--)
+    {
+        dhcps_time_handler();
+        now_s++;
+        dhcps_lease_sweep();
+        model_sweep();
+    }
+}
+
+static uint16_t client_msg(int c, uint8_t type, const uint8_t *ciaddr, const uint8_t *req,
+                           const uint8_t *server)
+{
+    uint8_t *opt = msg.options;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.op = DHCP_MESSAGE_OP_REQUEST;
+    msg.htype = DHCP_MESSAGE_HTYPE;
+    msg.hlen = DHCP_MESSAGE_HLEN;
+    msg.xid[0] = (uint8_t)rnd(256);
+    msg.xid[3] = (uint8_t)c;
+    msg.chaddr[0] = 0x02;
+    msg.chaddr[5] = (uint8_t)(c + 1);
+    if (ciaddr)
+        memcpy(msg.ciaddr, ciaddr, 4);
+    /* the reply is built over the request: none of this may show in it */
+    if (rnd(2))
+    {
+        memset(msg.sname, 'S', sizeof(msg.sname) - 1);
+        memset(msg.file, 'F', sizeof(msg.file) - 1);
+        memset(msg.options, 0xEE, sizeof(msg.options));
+    }
+
+    memcpy(opt, dhcp_magic_cookie, sizeof(dhcp_magic_cookie));
+    opt += sizeof(dhcp_magic_cookie);
+    *opt++ = DHCP_OPTION_CODE_MSG_TYPE;
+    *opt++ = 1;
+    *opt++ = type;
+    if (req)
+    {
+        *opt++ = DHCP_OPTION_CODE_REQUEST_IP_ADDRESS;
+        *opt++ = 4;
+        memcpy(opt, req, 4);
+        opt += 4;
+    }
+    if (server)
+    {
+        *opt++ = DHCP_OPTION_CODE_SERVER_ID;
+        *opt++ = 4;
+        memcpy(opt, server, 4);
+        opt += 4;
+    }
+    *opt++ = DHCP_OPTION_CODE_END;
+
+    if (opt - (uint8_t *)&msg < DHCPS_MIN_REPLY_LEN)
+        return DHCPS_MIN_REPLY_LEN;
+    return (uint16_t)(opt - (uint8_t *)&msg);
+}
+
+/* Send the message of client c and return the type of the reply, 0 if none.
+ * The reply is left in msg. */
+static uint8_t exchange(int c, uint16_t len)
+{
+    static const uint8_t zero[sizeof(msg.file)];
+    uint8_t bcast[4] = { 255, 255, 255, 255 };
+    uint8_t addr[4], *opt, *end;
+    uint16_t port;
+    int32_t ret;
+
+    wizchip_setctx(&ctx_a);
+    CHECK(sock_sendto(TEST_SOCK, (uint8_t *)&msg, len, bcast, DHCP_SERVER_PORT) == len);
+    sent++;
+
+    wizchip_setctx(&ctx_b);
+    CHECK(dhcps_run() == 1);
+
+    wizchip_setctx(&ctx_a);
+    if (getSn_RX_RSR(TEST_SOCK) == 0)
+        return 0;
+    ret = sock_recvfrom(TEST_SOCK, (uint8_t *)&msg, sizeof(msg), addr, &port);
+    CHECK(getSn_RX_RSR(TEST_SOCK) == 0);
+    replies++;
+
+    CHECK(ret >= DHCPS_MIN_REPLY_LEN && port == DHCP_SERVER_PORT);
+    CHECK(memcmp(msg.sname, zero, sizeof(msg.sname)) == 0 && memcmp(msg.file, zero, sizeof(msg.file)) == 0);
+    /* the padding after the end option is zero */
+    end = (uint8_t *)&msg + ret;
+    for (opt = &msg.options[4]; opt < end && *opt != DHCP_OPTION_CODE_END; opt += 2 + opt[1])
+        ;
+    CHECK(opt < end);
+    while (++opt < end && *opt == 0)
+        ;
+    CHECK(opt >= end);
+    CHECK(msg.op == DHCP_MESSAGE_OP_REPLY);
+    CHECK(msg.chaddr[0] == 0x02 && msg.chaddr[5] == c + 1);
+    CHECK(memcmp(msg.options, dhcp_magic_cookie, 4) == 0);
+    CHECK(msg.options[4] == DHCP_OPTION_CODE_MSG_TYPE && msg.options[5] == 1);
+    return msg.options[6];
+}
+
+/* An address the server hands out must be one of the pool's */
+static unsigned int check_yiaddr(void)
+{
+    unsigned int host = host_of(msg.yiaddr);
+
+    CHECKF(host >= TEST_POOL_START && host <= TEST_POOL_END && host != netinfo_b.ip[3],
+           "%u.%u.%u.%u handed out", msg.yiaddr[0], msg.yiaddr[1], msg.yiaddr[2], msg.yiaddr[3]);
+    return host;
+}
+
+static void addr_of(unsigned int host, uint8_t *ip)
+{
+    memcpy(ip, netinfo_b.ip, 3);
+    ip[3] = (uint8_t)host;
+}
+
+/*
+ * Operations of client c; each returns the host it was offered or bound, 0 if none
+ */
+
+static unsigned int op_discover(int c, const uint8_t *req)
+{
+    unsigned int l = model_by_client(c), r = req ? host_of(req) : 0, host;
+    uint8_t type;
+
+    if (l == 0 && r != 0 && model[r].state == MODEL_FREE)
+        l = r;
+    type = exchange(c, client_msg(c, DHCP_MESSAGE_TYPE_DISCOVER, NULL, req, NULL));
+
+    if (l == 0 && !model_any_free())
+    {
+        CHECKF(type == 0, "client %d: OFFER from an empty pool", c);
+        return 0;
+    }
+    CHECKF(type == DHCP_MESSAGE_TYPE_OFFER, "client %d: reply %u to DISCOVER", c, type);
+    if (type != DHCP_MESSAGE_TYPE_OFFER)
+        return 0;
+
+    host = check_yiaddr();
+    if (l != 0)
+        CHECKF(host == l, "client %d: offered .%u, expected .%u", c, host, l);
+    else
+        CHECKF(model[host].state == MODEL_FREE, "client %d: offered .%u, which is not free", c, host);
+    if (model[host].state != MODEL_BOUND)
+        model_claim(host, c, MODEL_OFFERED, DHCPS_OFFER_TIME);
+    return host;
+}
+
+static unsigned int op_request(int c, const uint8_t *ciaddr, const uint8_t *req, const uint8_t *server)
+{
+    unsigned int l = model_by_client(c), r = host_of(req ? req : ciaddr);
+    uint8_t expect = DHCP_MESSAGE_TYPE_ACK, type;
+
+    type = exchange(c, client_msg(c, DHCP_MESSAGE_TYPE_REQUEST, ciaddr, req, server));
+
+    if (server && memcmp(server, netinfo_b.ip, 4) != 0)
+    {
+        CHECKF(type == 0, "client %d: reply to a REQUEST for another server", c);
+        if (l && model[l].state == MODEL_OFFERED)
+            model_set(l, MODEL_FREE, 0);
+        return 0;
+    }
+
+    if (r == 0 || (l && model[l].state != MODEL_FREE && l != r) ||
+        (r != l && model[r].state != MODEL_FREE))
+        expect = DHCP_MESSAGE_TYPE_NAK;
+    CHECKF(type == expect, "client %d: reply %u to REQUEST of .%u, expected %u", c, type, r, expect);
+    if (type != DHCP_MESSAGE_TYPE_ACK || expect != DHCP_MESSAGE_TYPE_ACK)
+        return 0;
+
+    CHECK(check_yiaddr() == r);
+    model_claim(r, c, MODEL_BOUND, DHCPS_LEASE_TIME);
+    return r;
+}
+
+static void op_release(int c)
+{
+    unsigned int l = model_by_client(c);
+    uint8_t ip[4] = { 0, 0, 0, 0 };
+
+    if (l)
+        addr_of(l, ip);
+    CHECK(exchange(c, client_msg(c, DHCP_MESSAGE_TYPE_RELEASE, ip, NULL, netinfo_b.ip)) == 0);
+    if (l && model[l].state != MODEL_FREE)
+        model_set(l, MODEL_FREE, 0);
+}
+
+static void op_decline(int c, const uint8_t *req)
+{
+    unsigned int l = model_by_client(c);
+
+    CHECK(exchange(c, client_msg(c, DHCP_MESSAGE_TYPE_DECLINE, NULL, req, netinfo_b.ip)) == 0);
+    if (l && model[l].state != MODEL_FREE && host_of(req) == l)
+    {
+        model[l].owner = -1;
+        model_set(l, MODEL_RESERVED, DHCPS_DECLINE_TIME);
+    }
+}
+
+/*
+ * The checks
+ */
+
+/* Takes the changes the way the RT app forwards them: a peek of a few, then
+ * the take once they were delivered. Some deliveries fail, and the same
+ * leases must then come again. */
+static void take_changes(void)
+{
+    dhcps_lease_info info[4], again[4];
+    unsigned int host;
+    uint8_t n, i;
+
+    wizchip_setctx(&ctx_b);
+    memset(info, 0, sizeof(info));          /* memcmp() sees the padding */
+    memset(again, 0, sizeof(again));
+    while ((n = dhcps_lease_changed_peek(info, 1 + rnd(4))) > 0)
+    {
+        if (rnd(4) == 0)
+        {
+            CHECK(dhcps_lease_changed_peek(again, n) == n);
+            CHECK(memcmp(again, info, n * sizeof(info[0])) == 0);
+            continue;
+        }
+        dhcps_lease_changed_take(n);
+        for (i = 0; i < n; i++)
+        {
+            host = host_of(info[i].ip);
+            CHECK(host != 0);
+            if (!info[i].bound)
+            {
+                mirror[host] = -1;
+                continue;
+            }
+            CHECK(info[i].chaddr[0] == 0x02 && info[i].chaddr[5] >= 1 &&
+                  info[i].chaddr[5] <= TEST_CLIENTS);
+            mirror[host] = info[i].chaddr[5] - 1;
+            CHECKF(info[i].remaining == model[host].expires - now_s, ".%u: %u s left, model %u s",
+                   host, info[i].remaining, model[host].expires - now_s);
+        }
+    }
+}
+
+static void check_table(uint32_t op)
+{
+    unsigned int host, holds[TEST_CLIENTS] = { 0 };
+    int bound;
+
+    take_changes();
+    for (host = 1; host < DHCPS_LEASE_HOSTS; host++)
+    {
+        bound = model[host].state == MODEL_BOUND ? model[host].owner : -1;
+        CHECKF(mirror[host] == bound, "op %u: .%u reported bound to %d, model %d", op, host,
+               mirror[host], bound);
+        if (mirror[host] >= 0)
+            holds[mirror[host]]++;
+    }
+    for (host = 0; host < TEST_CLIENTS; host++)
+        CHECKF(holds[host] <= 1, "op %u: client %u holds %u addresses", op, host, holds[host]);
+}
+
+static void run_ops(uint32_t ops)
+{
+    uint8_t ip[4], req[4];
+    unsigned int host, l, op;
+    uint32_t i, r;
+    int c;
+
+    for (i = 0; i < ops; i++)
+    {
+        tick(1);       /* one rate window per operation */
+        c = (int)rnd(TEST_CLIENTS);
+        l = model_by_client(c);
+        /* mostly pool addresses, some on the subnet, some off it */
+        addr_of(TEST_POOL_START - 4 + rnd(TEST_POOL_END - TEST_POOL_START + 9), req);
+        if (rnd(16) == 0)
+            req[2] = 51;
+
+        r = rnd(100);
+        op = 0;
+        if (r < 35)
+        {
+            host = op_discover(c, rnd(4) == 0 ? req : NULL);
+            if (host)
+            {
+                addr_of(host, ip);
+                op_request(c, NULL, ip, netinfo_b.ip);
+            }
+        }
+        else if (r < 48)
+            op_discover(c, rnd(2) ? req : NULL);
+        else if (r < 58)
+        {
+            /* renewal names the address in ciaddr */
+            if (l)
+                addr_of(l, ip);
+            op_request(c, l ? ip : req, NULL, NULL);
+        }
+        else if (r < 72)
+            op_release(c);
+        else if (r < 82)
+            op_request(c, NULL, req, netinfo_b.ip);
+        else if (r < 87)
+            op_request(c, NULL, req, other_server);
+        else if (r < 92)
+        {
+            if (l && rnd(4))
+                addr_of(l, req);
+            op_decline(c, req);
+        }
+        else if (r < 98)
+            tick(1 + rnd(DHCPS_DECLINE_TIME + 100));
+        else if (r < 99)
+            tick(DHCPS_LEASE_TIME / 2 + rnd(DHCPS_LEASE_TIME));
+        else
+        {
+            /* everybody comes back at once */
+            for (c = 0; c < TEST_CLIENTS; c++)
+            {
+                host = op_discover(c, NULL);
+                if (host)
+                {
+                    addr_of(host, ip);
+                    op_request(c, NULL, ip, netinfo_b.ip);
+                }
+                check_table(op++);
+                tick(1);
+            }
+        }
+        check_table(i);
+    }
+}
+
+/*
+ * The server restarts; the bound leases saved from dhcps_lease_changed() are
+ * restored, the rest of the table starts over.
+ */
+static void restart(void)
+{
+    dhcps_lease_info saved[DHCPS_LEASE_HOSTS], info;
+    unsigned int host, n = 0, i;
+    int c;
+
+    wizchip_setctx(&ctx_b);
+    dhcps_lease_changed_all();
+    while (dhcps_lease_changed(&info))
+        if (info.bound)
+            saved[n++] = info;
+    for (host = 1; host < DHCPS_LEASE_HOSTS; host++)
+        CHECK(mirror[host] < 0 || model[host].state == MODEL_BOUND);
+
+    dhcps_init(TEST_SOCK, (uint8_t *)&server_buf);
+    model_init();
+    for (host = 0; host < DHCPS_LEASE_HOSTS; host++)
+        mirror[host] = -1;
+
+    for (i = 0; i < n; i++)
+    {
+        host = host_of(saved[i].ip);
+        c = saved[i].chaddr[5] - 1;
+        CHECK(dhcps_lease_restore(&saved[i]) == 1);
+        model_claim(host, c, MODEL_BOUND, saved[i].remaining);
+    }
+    /* a lease that conflicts with the table is refused */
+    if (n >= 2)
+    {
+        info = saved[0];
+        memcpy(info.ip, saved[1].ip, 4);
+        CHECK(dhcps_lease_restore(&info) == 0);
+        info = saved[0];
+        host = TEST_POOL_START;
+        while (model[host].state != MODEL_FREE && host < TEST_POOL_END)
+            host++;
+        addr_of(host, info.ip);
+        CHECK(dhcps_lease_restore(&info) == 0);
+    }
+    check_table(0);
+    printf("restart: %u leases restored\n", n);
+}
+
+int main(void)
+{
+    uint8_t size[_WIZCHIP_SOCK_NUM_] = { 2, 2, 2, 2, 2, 2, 2, 2 };
+    ip_addr pool_start, pool_end;
+    dhcps_counter counters;
+    unsigned int host;
+
+    w5500_sim_init(&chip_a, &test_net);
+    w5500_sim_init(&chip_b, &test_net);
+    w5500_sim_attach(&chip_a, &ctx_a);
+    w5500_sim_attach(&chip_b, &ctx_b);
+    wizchip_setctx(&ctx_a);
+    wizchip_init(size, size);
+    wizchip_setnetinfo(&netinfo_a);
+    wiz_socket(TEST_SOCK, Sn_MR_UDP, DHCP_CLIENT_PORT, 0);
+    wizchip_setctx(&ctx_b);
+    wizchip_init(size, size);
+    wizchip_setnetinfo(&netinfo_b);
+
+    addr_of(TEST_POOL_START, (uint8_t *)&pool_start.addr);
+    addr_of(TEST_POOL_END, (uint8_t *)&pool_end.addr);
+    dhcps_set_addr_pool(1, &pool_start, &pool_end);
+    dhcps_init(TEST_SOCK, (uint8_t *)&server_buf);
+    dhcps_run();        /* opens the socket */
+
+    model_init();
+    for (host = 0; host < DHCPS_LEASE_HOSTS; host++)
+        mirror[host] = -1;
+
+    run_ops(TEST_OPS);
+    restart();
+    run_ops(TEST_OPS_RESTART);
+
+    wizchip_setctx(&ctx_b);
+    dhcps_get_counters(&counters);
+    CHECKF(counters.received == sent, "%u received, %u sent", counters.received, sent);
+    CHECKF(counters.replied == replies, "%u replied, %u replies", counters.replied, replies);
+    CHECK(counters.rate_limited == 0 && counters.dropped == 0);
+    printf("%u messages, %u replies, %u s\n", sent, replies, now_s);
+
+    HOST_TEST_EXIT();
+}
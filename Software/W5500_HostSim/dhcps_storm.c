@@ -0,0 +1,346 @@
+/*
+ * DISCOVER storm against the DHCP server, dhcps.c, on the W5500 model.
+ *
+ * A rack of devices powers up together: chip A plays the clients, chip B runs
+ * the server like the RT app, one dhcps_run() per main loop pass. The clients
+ * send their DISCOVERs, each retransmitted a number of times, and burst of
+ * them arrive between two passes; what does not fit the server socket's RX
+ * buffer is lost in the model like on the wire. B's socket buffers are those
+ * of one of the RT app's ETH1 profiles, see eth1_sockets.h. The clients then
+ * send a REQUEST for every OFFER they got. All of it happens within one
+ * second, so the per-MAC rate limit sees the retransmits.
+ *
+ * For each phase the report gives the datagrams sent, lost in the RX buffer,
+ * rate limited and answered, the passes the server needed, the most datagrams
+ * handled in one pass, the reply length, and the SPI transactions, SPI bytes
+ * and bus time of B per datagram handled.
+ *
+ * By default the bursts fit the buffer and every client must get bound; the
+ * exit status is 1 if one does not. Bursts larger than the buffer holds, or
+ * retransmits past the rate limit, are reported as such and lose clients.
+ *
+ * Usage: dhcps_storm [-c clients] [-r sends per client] [-b burst] [-p profile] [-m max_len]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ioLibrary_Driver/Ethernet/socket.h"
+#include "ioLibrary_Driver/Internet/DHCP/dhcps.h"
+
+#include "eth1_sockets.h"
+#include "w5500_sim.h"
+
+#define STORM_SOCK          DHCP_SERVER_SOCKET
+#define STORM_CLIENTS       128
+#define STORM_SENDS         1
+#define STORM_BURST         DHCPS_MAX_BURST     /* what one dhcps_run() takes */
+#define STORM_PROFILE       INTERCORE_BUFFER_SMALL_UDP
+#define STORM_CLIENT_RX_KB  16      /* all replies of a pass fit */
+#define STORM_UDP_HEAD      8       /* per datagram in the RX buffer */
+#define STORM_PASSES_MAX    100000
+
+static w5500_sim_net storm_net;
+static w5500_sim chip_a, chip_b;
+static wizchip_ctx ctx_a, ctx_b;
+
+static wiz_NetInfo netinfo_a = {
+    .mac = { 0x00, 0x08, 0xDC, 0x00, 0x00, 0x0A },
+    .ip = { 192, 168, 50, 10 },
+    .sn = { 255, 255, 255, 0 },
+    .gw = { 192, 168, 50, 1 },
+    .dhcp = NETINFO_STATIC,
+};
+static wiz_NetInfo netinfo_b = {
+    .mac = { 0x00, 0x08, 0xDC, 0x00, 0x00, 0x0B },
+    .ip = { 192, 168, 50, 20 },
+    .sn = { 255, 255, 255, 0 },
+    .gw = { 192, 168, 50, 1 },
+    .dhcp = NETINFO_STATIC,
+};
+
+static dhcps_msg server_buf;
+static dhcps_msg msg;
+
+static unsigned int clients = STORM_CLIENTS;
+static unsigned int sends = STORM_SENDS;
+static unsigned int burst = STORM_BURST;
+
+/* -p names of the profiles, indexed by INTERCORE_BUFFER_* */
+static const char *const storm_profile_opt[INTERCORE_BUFFER_PROFILES] = {
+    [INTERCORE_BUFFER_BALANCED] = "balanced",
+    [INTERCORE_BUFFER_BULK] = "bulk",
+    [INTERCORE_BUFFER_SMALL_UDP] = "small_udp",
+};
+
+/* per client: the address offered, then 1 once acked */
+static uint8_t offered[256][4];
+static uint8_t acked[256];
+
+typedef struct {
+    uint32_t sent;
+    uint32_t passes;
+    uint32_t max_pass;      /* most datagrams handled in one pass */
+    uint32_t replies[DHCP_MESSAGE_TYPE_RELEASE + 1];    /* by message type */
+    uint64_t reply_bytes;
+} storm_phase;
+
+/* The printf of the BSP used by dhcps.c and the log */
+void _putchar(char character)
+{
+    (void)character;
+}
+
+static uint16_t storm_msg(unsigned int client, uint8_t type, const uint8_t *req)
+{
+    uint8_t *opt = msg.options;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.op = DHCP_MESSAGE_OP_REQUEST;
+    msg.htype = DHCP_MESSAGE_HTYPE;
+    msg.hlen = DHCP_MESSAGE_HLEN;
+    msg.xid[2] = (uint8_t)(client >> 8);
+    msg.xid[3] = (uint8_t)client;
+    msg.chaddr[0] = 0x02;
+    msg.chaddr[4] = (uint8_t)(client >> 8);
+    msg.chaddr[5] = (uint8_t)client;
+
+    memcpy(opt, dhcp_magic_cookie, sizeof(dhcp_magic_cookie));
+    opt += sizeof(dhcp_magic_cookie);
+    *opt++ = DHCP_OPTION_CODE_MSG_TYPE;
+    *opt++ = 1;
+    *opt++ = type;
+    if (req)
+    {
+        *opt++ = DHCP_OPTION_CODE_REQUEST_IP_ADDRESS;
+        *opt++ = 4;
+        memcpy(opt, req, 4);
+        opt += 4;
+        *opt++ = DHCP_OPTION_CODE_SERVER_ID;
+        *opt++ = 4;
+        memcpy(opt, netinfo_b.ip, 4);
+        opt += 4;
+    }
+    *opt++ = DHCP_OPTION_CODE_END;
+
+    if (opt - (uint8_t *)&msg < DHCPS_MIN_REPLY_LEN)
+        return DHCPS_MIN_REPLY_LEN;
+    return (uint16_t)(opt - (uint8_t *)&msg);
+}
+
+static void storm_send(storm_phase *p, unsigned int client, uint8_t type, const uint8_t *req)
+{
+    uint8_t bcast[4] = { 255, 255, 255, 255 };
+    uint16_t len = storm_msg(client, type, req);
+
+    wizchip_setctx(&ctx_a);
+    sock_sendto(STORM_SOCK, (uint8_t *)&msg, len, bcast, DHCP_SERVER_PORT);
+    p->sent++;
+}
+
+/* One main loop pass of the server, then the clients read their replies */
+static void storm_pass(storm_phase *p)
+{
+    uint8_t addr[4];
+    uint16_t port;
+    dhcps_counter c0, c1;
+    unsigned int client;
+    int32_t len;
+
+    wizchip_setctx(&ctx_b);
+    dhcps_get_counters(&c0);
+    dhcps_run();
+    dhcps_get_counters(&c1);
+    p->passes++;
+    if (c1.received - c0.received + c1.dropped - c0.dropped > p->max_pass)
+        p->max_pass = c1.received - c0.received + c1.dropped - c0.dropped;
+
+    wizchip_setctx(&ctx_a);
+    while (getSn_RX_RSR(STORM_SOCK) > 0)
+    {
+        len = sock_recvfrom(STORM_SOCK, (uint8_t *)&msg, sizeof(msg), addr, &port);
+        if (len <= 0)
+            break;
+        p->reply_bytes += len;
+        if (msg.options[6] > DHCP_MESSAGE_TYPE_RELEASE)
+            continue;
+        p->replies[msg.options[6]]++;
+
+        client = ((unsigned int)msg.chaddr[4] << 8) | msg.chaddr[5];
+        if (client >= clients)
+            continue;
+        if (msg.options[6] == DHCP_MESSAGE_TYPE_OFFER)
+            memcpy(offered[client], msg.yiaddr, 4);
+        else if (msg.options[6] == DHCP_MESSAGE_TYPE_ACK)
+            acked[client] = 1;
+    }
+}
+
+/* Passes until the server has nothing left */
+static void storm_settle(storm_phase *p)
+{
+    wizchip_setctx(&ctx_b);
+    while (getSn_RX_RSR(STORM_SOCK) > 0 && p->passes < STORM_PASSES_MAX)
+    {
+        storm_pass(p);
+        wizchip_setctx(&ctx_b);
+    }
+}
+
+static void storm_report(const char *name, const storm_phase *p, const w5500_sim_stats *from,
+                         const dhcps_counter *c0, const dhcps_counter *c1)
+{
+    uint32_t handled = (c1->received - c0->received) + (c1->dropped - c0->dropped);
+    uint32_t frames = chip_b.stats.frames - from->frames;
+    uint64_t wire = (uint64_t)frames * 3 + (chip_b.stats.data_bytes - from->data_bytes);
+    uint32_t replied = c1->replied - c0->replied;
+
+    printf("%s\n", name);
+    printf("    sent %u, lost in B's RX buffer %u, rate limited %u, not for the server %u\n",
+           p->sent, chip_b.stats.rx_dropped - from->rx_dropped, c1->rate_limited - c0->rate_limited,
+           c1->dropped - c0->dropped);
+    printf("    replied %u (OFFER %u, ACK %u, NAK %u), %.0f B per reply, %u B untrimmed\n",
+           replied, p->replies[DHCP_MESSAGE_TYPE_OFFER], p->replies[DHCP_MESSAGE_TYPE_ACK],
+           p->replies[DHCP_MESSAGE_TYPE_NAK], replied ? (double)p->reply_bytes / replied : 0.0,
+           (unsigned)sizeof(dhcps_msg));
+    printf("    %u passes, at most %u datagrams in one\n", p->passes, p->max_pass);
+    if (handled)
+        printf("    B %7.1f SPI transactions %7.0f SPI bytes %7.1f us bus per datagram handled\n",
+               (double)frames / handled, (double)wire / handled,
+               (double)(chip_b.stats.bus_ns - from->bus_ns) / 1000 / handled);
+}
+
+static void storm_chip(w5500_sim *sim, wizchip_ctx *ctx, wiz_NetInfo *netinfo, uint8_t *txsize,
+                       uint8_t *rxsize)
+{
+    w5500_sim_init(sim, &storm_net);
+    w5500_sim_attach(sim, ctx);
+    wizchip_setctx(ctx);
+    if (wizchip_init(txsize, rxsize) != 0)
+    {
+        fprintf(stderr, "buffer sizes refused\n");
+        exit(2);
+    }
+    wizchip_setnetinfo(netinfo);
+}
+
+int main(int argc, char *argv[])
+{
+    uint8_t txsize[_WIZCHIP_SOCK_NUM_] = { 0 }, rxsize[_WIZCHIP_SOCK_NUM_] = { 0 };
+    unsigned int profile = STORM_PROFILE, client, i, n, fits;
+    w5500_sim_stats from;
+    dhcps_counter c0, c1;
+    storm_phase p;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:r:b:p:m:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            clients = (unsigned int)strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            sends = (unsigned int)strtoul(optarg, NULL, 0);
+            break;
+        case 'b':
+            burst = (unsigned int)strtoul(optarg, NULL, 0);
+            break;
+        case 'p':
+            for (profile = 0; profile < INTERCORE_BUFFER_PROFILES; profile++)
+                if (strcmp(optarg, storm_profile_opt[profile]) == 0)
+                    break;
+            break;
+        case 'm':
+            w5500_sim_spi.max_len = (uint16_t)strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-c clients] [-r sends per client] [-b burst] [-p profile] [-m max_len]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    if (clients == 0 || clients > 256 || sends == 0 || burst == 0 || profile == INTERCORE_BUFFER_PROFILES)
+    {
+        fprintf(stderr, "%s: 1 to 256 clients, sends and burst not 0, profile balanced, bulk or small_udp\n",
+                argv[0]);
+        return 2;
+    }
+
+    /* A's client socket takes all RX memory, B runs the RT app's profile */
+    for (i = 0; i < _WIZCHIP_SOCK_NUM_; i++)
+        txsize[i] = 2;
+    rxsize[STORM_SOCK] = STORM_CLIENT_RX_KB;
+    storm_chip(&chip_a, &ctx_a, &netinfo_a, txsize, rxsize);
+    sock_profile_compute(sock_profiles[profile].tx_weight, txsize);
+    sock_profile_compute(sock_profiles[profile].rx_weight, rxsize);
+    storm_chip(&chip_b, &ctx_b, &netinfo_b, txsize, rxsize);
+    fits = rxsize[STORM_SOCK] * 1024 / (STORM_UDP_HEAD + DHCPS_MIN_REPLY_LEN);
+    wizchip_setctx(&ctx_a);
+    wiz_socket(STORM_SOCK, Sn_MR_UDP, DHCP_CLIENT_PORT, 0);
+    wizchip_setctx(&ctx_b);
+    dhcps_init(STORM_SOCK, (uint8_t *)&server_buf);
+    dhcps_run();        /* opens the socket */
+    dhcps_time_handler();
+
+    printf("DISCOVER storm: %u clients, %u sends each, bursts of %u, profile %s: B's DHCP socket %u KB RX, ",
+           clients, sends, burst, sock_profiles[profile].name, rxsize[STORM_SOCK]);
+    if (w5500_sim_spi.max_len)
+        printf("SPI frames of at most %u data bytes\n", w5500_sim_spi.max_len);
+    else
+        printf("SPI frames of any length\n");
+    printf("at most %u datagrams per dhcps_run(), %u per MAC and second\n", DHCPS_MAX_BURST, DHCPS_RATE_LIMIT);
+    if (burst > fits || burst > DHCPS_MAX_BURST)
+        printf("overflow: B's RX buffer holds %u DISCOVERs and one pass takes %u, bursts of %u are lost in part\n",
+               fits, DHCPS_MAX_BURST, burst);
+    if (sends > DHCPS_RATE_LIMIT)
+        printf("rate limit: %u sends per client are more than %u\n", sends, DHCPS_RATE_LIMIT);
+    printf("\n");
+
+    /* Every client's DISCOVER, retransmits following the first round */
+    memset(&p, 0, sizeof(p));
+    from = chip_b.stats;
+    dhcps_get_counters(&c0);
+    for (i = 0, n = 0; i < sends; i++)
+    {
+        for (client = 0; client < clients; client++)
+        {
+            storm_send(&p, client, DHCP_MESSAGE_TYPE_DISCOVER, NULL);
+            if (++n % burst == 0)
+                storm_pass(&p);
+        }
+    }
+    storm_settle(&p);
+    wizchip_setctx(&ctx_b);
+    dhcps_get_counters(&c1);
+    storm_report("discover", &p, &from, &c0, &c1);
+
+    /* A second later, a REQUEST for every OFFER */
+    dhcps_time_handler();
+    memset(&p, 0, sizeof(p));
+    from = chip_b.stats;
+    c0 = c1;
+    for (client = 0, n = 0; client < clients; client++)
+    {
+        if (offered[client][0] == 0)
+            continue;
+        storm_send(&p, client, DHCP_MESSAGE_TYPE_REQUEST, offered[client]);
+        if (++n % burst == 0)
+            storm_pass(&p);
+    }
+    storm_settle(&p);
+    wizchip_setctx(&ctx_b);
+    dhcps_get_counters(&c1);
+    storm_report("request", &p, &from, &c0, &c1);
+
+    for (client = 0, n = 0; client < clients; client++)
+        n += acked[client];
+    printf("\n%u of %u clients bound\n", n, clients);
+
+    /* a storm the server is sized for loses no one */
+    if (burst <= fits && burst <= DHCPS_MAX_BURST && sends <= DHCPS_RATE_LIMIT && n != clients)
+        return 1;
+    return 0;
+}
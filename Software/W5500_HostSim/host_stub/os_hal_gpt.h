@@ -0,0 +1,39 @@
+/*
+ * Host stand-in for OS_HAL's os_hal_gpt.h, declaring the calls the RT app's
+ * host-tested modules make. A test that links such a module defines them and
+ * so drives the counters itself.
+ */
+
+#ifndef __OS_HAL_GPT_H__
+#define __OS_HAL_GPT_H__
+
+enum gpt_num {
+    GPT0 = 0,
+    GPT1 = 1,
+    GPT2 = 2,
+    GPT3 = 3,
+    GPT4 = 4,
+    GPT_MAX_NUM
+};
+
+typedef enum {
+    OS_HAL_GPT0 = GPT0,
+    OS_HAL_GPT1 = GPT1,
+    OS_HAL_GPT2 = GPT2,
+    OS_HAL_GPT3 = GPT3,
+    OS_HAL_GPT4 = GPT4,
+    OS_HAL_GPT_MAX_NUM
+} GPT_ID;
+
+struct os_gpt_int {
+    void (*gpt_cb_hdl)(void *);
+    void *gpt_cb_data;
+};
+
+void mtk_os_hal_gpt_init(void);
+int mtk_os_hal_gpt_config(enum gpt_num timer_id, unsigned char speed_32us,
+                          struct os_gpt_int *gpt_int);
+int mtk_os_hal_gpt_start(enum gpt_num timer_id);
+unsigned int mtk_os_hal_gpt_get_cur_count(enum gpt_num timer_id);
+
+#endif /* __OS_HAL_GPT_H__ */
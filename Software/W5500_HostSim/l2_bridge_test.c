@@ -0,0 +1,757 @@
+/*
+ * Replay of pcap captures through the RT app's layer-2 bridge, l2_bridge.c,
+ * on the model.
+ *
+ * Each bridge port is a chip with socket 0 in MACRAW mode on a wire of its
+ * own, a w5500_sim_net; a second chip on each wire, the tap, plays the
+ * stations: it sends the captured frames of its wire and receives whatever
+ * the bridge sends out there. The frames of both captures are replayed in
+ * timestamp order, those within the same second in groups like a busy wire
+ * delivers them, and the capture's seconds drive the bridge's 1 Hz tick, so
+ * MAC entries age and the frame rate is computed like on the board.
+ *
+ * A model of a learning bridge next to the test decides for every frame the
+ * bridge reads whether it is forwarded; each frame a tap receives must be
+ * the next one the model forwarded to that wire, byte for byte, and nothing
+ * may come back on the wire a frame came from. The frame rate must match the
+ * model's after every sweep, the other counters at the end.
+ *
+ * The bridge chips sit on a queued SPI that sends what the driver queues
+ * only when the driver flushes or the taps look at the wires, so the frames
+ * the bridge posts and leaves in flight must be intact when they go out.
+ *
+ * Without arguments the test writes a seeded pair of captures first and
+ * replays those: stations on both wires, some of which move, broadcast,
+ * multicast and unicast to known, unknown and local stations and to the
+ * bridge chips, frames of 14 to 1514 bytes, more stations than the MAC table
+ * holds, and gaps past the aging time.
+ *
+ * Usage: l2_bridge_test [wire0.pcap [wire1.pcap]]
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ioLibrary_Driver/Ethernet/socket.h"
+#include "ioLibrary_Driver/Ethernet/W5500/w5500.h"
+
+#include "l2_bridge.h"
+#include "w5500_sim.h"
+#include "host_test.h"
+
+#define TEST_SOCK           L2_BRIDGE_SOCKET
+#define TEST_GROUP          10      /* frames per group, they fit the 16 KB RX buffer */
+#define TEST_FRAMES         6000
+#define TEST_STATIONS       72      /* per wire; 144 is more than the MAC table holds */
+#define TEST_BUSY           40      /* per wire, the stations that send most */
+#define TEST_SEED           0xB71D6E5Au
+
+#define PCAP_MAGIC          0xA1B2C3D4u
+#define PCAP_MAGIC_NS       0xA1B23C4Du
+#define PCAP_LINKTYPE_ETH   1
+#define PCAP_SNAPLEN        65535
+
+#define MAC_LEN             6
+
+typedef struct {
+    uint8_t data[L2_BRIDGE_FRAME_MAX];
+    uint16_t len;
+} test_frame;
+
+typedef struct {
+    test_frame frame[L2_BRIDGE_MAX_BURST * 2];
+    unsigned int head, count;
+} test_queue;
+
+static w5500_sim_net test_wire[L2_BRIDGE_PORTS];
+static w5500_sim chip_port[L2_BRIDGE_PORTS], chip_tap[L2_BRIDGE_PORTS];
+static wizchip_ctx ctx_port[L2_BRIDGE_PORTS], ctx_tap[L2_BRIDGE_PORTS];
+
+static wiz_NetInfo netinfo_port[L2_BRIDGE_PORTS] = {
+    {
+        .mac = { 0x00, 0x08, 0xDC, 0x00, 0x00, 0x0A },
+        .ip = { 192, 168, 50, 10 },
+        .sn = { 255, 255, 255, 0 },
+        .gw = { 192, 168, 50, 1 },
+        .dhcp = NETINFO_STATIC,
+    },
+    {
+        .mac = { 0x00, 0x08, 0xDC, 0x00, 0x00, 0x0B },
+        .ip = { 192, 168, 50, 11 },
+        .sn = { 255, 255, 255, 0 },
+        .gw = { 192, 168, 50, 1 },
+        .dhcp = NETINFO_STATIC,
+    },
+};
+
+/* Frames on a wire the bridge has not read yet, and frames the model
+ * expects on a wire */
+static test_queue pending[L2_BRIDGE_PORTS];
+static test_queue expected[L2_BRIDGE_PORTS];
+
+static uint32_t rng = TEST_SEED;
+
+static uint32_t rnd(uint32_t n)
+{
+    rng = rng * 1103515245 + 12345;
+    return (rng >> 8) % n;
+}
+
+static test_frame *queue_push(test_queue *q)
+{
+    test_frame *f;
+
+    CHECK(q->count < sizeof(q->frame) / sizeof(q->frame[0]));
+    f = &q->frame[(q->head + q->count) % (sizeof(q->frame) / sizeof(q->frame[0]))];
+    q->count++;
+    return f;
+}
+
+static test_frame *queue_pop(test_queue *q)
+{
+    test_frame *f = &q->frame[q->head];
+
+    q->head = (q->head + 1) % (sizeof(q->frame) / sizeof(q->frame[0]));
+    q->count--;
+    return f;
+}
+
+/*
+ * The model: a learning bridge with the MAC table size and aging time of
+ * l2_bridge.h
+ */
+
+typedef struct {
+    uint8_t mac[MAC_LEN];
+    uint8_t port;
+    uint8_t used;
+    uint32_t seen;
+} model_entry;
+
+static model_entry model_table[L2_BRIDGE_MAC_ENTRIES];
+static uint32_t model_tick, model_swept;
+static uint32_t model_forwarded;    /* frames forwarded up to the last sweep */
+static uint32_t model_fps_max;
+static l2_bridge_counter model;
+
+static model_entry *model_lookup(const uint8_t *mac)
+{
+    unsigned int i;
+
+    for (i = 0; i < L2_BRIDGE_MAC_ENTRIES; i++)
+        if (model_table[i].used && memcmp(model_table[i].mac, mac, MAC_LEN) == 0)
+            return &model_table[i];
+    return NULL;
+}
+
+static void model_learn(const uint8_t *mac, uint8_t port)
+{
+    model_entry *e = model_lookup(mac);
+    unsigned int i;
+
+    if (mac[0] & 0x01)
+        return;
+    if (e == NULL)
+    {
+        for (i = 0; i < L2_BRIDGE_MAC_ENTRIES && model_table[i].used; i++)
+            ;
+        if (i == L2_BRIDGE_MAC_ENTRIES)
+        {
+            model.table_full++;
+            return;
+        }
+        e = &model_table[i];
+        memcpy(e->mac, mac, MAC_LEN);
+        e->used = 1;
+        model.learned++;
+    }
+    e->port = port;
+    e->seen = model_tick;
+}
+
+/* The frame in came in on port in: expect it on the other wire, or not */
+static void model_frame(const test_frame *in, uint8_t port)
+{
+    const uint8_t *dst = in->data;
+    model_entry *e;
+    test_frame *out;
+
+    model.rx[port]++;
+    model_learn(in->data + MAC_LEN, port);
+
+    if (!(dst[0] & 0x01))
+    {
+        if (memcmp(dst, netinfo_port[port].mac, MAC_LEN) == 0)
+        {
+            model.filtered++;
+            return;
+        }
+        e = model_lookup(dst);
+        if (e && e->port == port)
+        {
+            model.filtered++;
+            return;
+        }
+        if (e == NULL)
+            model.flooded++;
+    }
+    else
+    {
+        model.flooded++;
+    }
+
+    model.tx[port ^ 1]++;
+    out = queue_push(&expected[port ^ 1]);
+    *out = *in;
+}
+
+static void model_sweep(void)
+{
+    unsigned int i;
+
+    if (model_tick == model_swept)
+        return;
+    model.fps = (model.tx[0] + model.tx[1] - model_forwarded) / (model_tick - model_swept);
+    if (model.fps > model_fps_max)
+        model_fps_max = model.fps;
+    model_forwarded = model.tx[0] + model.tx[1];
+    model_swept = model_tick;
+    for (i = 0; i < L2_BRIDGE_MAC_ENTRIES; i++)
+    {
+        if (model_table[i].used && model_tick - model_table[i].seen >= L2_BRIDGE_AGE_TIME)
+        {
+            model_table[i].used = 0;
+            model.aged++;
+        }
+    }
+}
+
+/*
+ * pcap files, classic format, Ethernet link type
+ */
+
+typedef struct {
+    FILE *f;
+    int swap;
+    int nsec;
+    int have;                       /* a frame is read and waits */
+    uint32_t sec, usec;
+    test_frame frame;
+    unsigned int frames, skipped;
+} pcap_in;
+
+static uint32_t pcap_u32(const uint8_t *p, int swap)
+{
+    if (swap)
+        return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void pcap_put32(FILE *f, uint32_t v)
+{
+    /* written in host order, as pcap files are */
+    fwrite(&v, sizeof(v), 1, f);
+}
+
+static void pcap_write_header(FILE *f)
+{
+    uint16_t version[2] = { 2, 4 };
+
+    pcap_put32(f, PCAP_MAGIC);
+    fwrite(version, sizeof(version), 1, f);
+    pcap_put32(f, 0);               /* thiszone */
+    pcap_put32(f, 0);               /* sigfigs */
+    pcap_put32(f, PCAP_SNAPLEN);
+    pcap_put32(f, PCAP_LINKTYPE_ETH);
+}
+
+static void pcap_write(FILE *f, uint32_t sec, uint32_t usec, const test_frame *frame)
+{
+    pcap_put32(f, sec);
+    pcap_put32(f, usec);
+    pcap_put32(f, frame->len);
+    pcap_put32(f, frame->len);
+    fwrite(frame->data, 1, frame->len, f);
+}
+
+/* Read the next frame the bridge can carry; frames of other sizes are skipped */
+static void pcap_next(pcap_in *in)
+{
+    uint8_t rec[16];
+    uint32_t incl, orig;
+
+    in->have = 0;
+    while (in->f && fread(rec, sizeof(rec), 1, in->f) == 1)
+    {
+        in->sec = pcap_u32(rec, in->swap);
+        in->usec = pcap_u32(rec + 4, in->swap);
+        if (in->nsec)
+            in->usec /= 1000;
+        incl = pcap_u32(rec + 8, in->swap);
+        orig = pcap_u32(rec + 12, in->swap);
+
+        if (incl != orig || incl < L2_BRIDGE_FRAME_MIN || incl > L2_BRIDGE_FRAME_MAX)
+        {
+            in->skipped++;
+            if (incl > PCAP_SNAPLEN || fseek(in->f, incl, SEEK_CUR) != 0)
+                break;
+            continue;
+        }
+        if (fread(in->frame.data, 1, incl, in->f) != incl)
+            break;
+        in->frame.len = (uint16_t)incl;
+        in->frames++;
+        in->have = 1;
+        return;
+    }
+}
+
+static int pcap_open(pcap_in *in, FILE *f)
+{
+    uint8_t head[24];
+    uint32_t magic;
+
+    memset(in, 0, sizeof(*in));
+    in->f = f;
+    if (f == NULL || fread(head, sizeof(head), 1, f) != 1)
+        return -1;
+
+    magic = pcap_u32(head, 0);
+    if (magic == PCAP_MAGIC || magic == PCAP_MAGIC_NS)
+        in->swap = 0;
+    else if (pcap_u32(head, 1) == PCAP_MAGIC || pcap_u32(head, 1) == PCAP_MAGIC_NS)
+        in->swap = 1;
+    else
+        return -1;
+    in->nsec = pcap_u32(head, in->swap) == PCAP_MAGIC_NS;
+    if (pcap_u32(head + 20, in->swap) != PCAP_LINKTYPE_ETH)
+        return -1;
+
+    pcap_next(in);
+    return 0;
+}
+
+/*
+ * A seeded pair of captures
+ */
+
+static void gen_mac(uint8_t *mac, unsigned int station)
+{
+    mac[0] = 0x02;
+    mac[1] = 0x00;
+    mac[2] = 0x00;
+    mac[3] = 0x00;
+    mac[4] = (uint8_t)(station >> 8);
+    mac[5] = (uint8_t)station;
+}
+
+static void gen_captures(FILE *wire[L2_BRIDGE_PORTS])
+{
+    uint8_t at[2 * TEST_STATIONS];  /* the wire of each station */
+    uint64_t t = (uint64_t)1700000000 * 1000000;
+    test_frame frame;
+    unsigned int i, j, src, dst, r;
+
+    for (i = 0; i < 2 * TEST_STATIONS; i++)
+        at[i] = i >= TEST_STATIONS;
+    for (i = 0; i < L2_BRIDGE_PORTS; i++)
+        pcap_write_header(wire[i]);
+
+    for (i = 0; i < TEST_FRAMES; i++)
+    {
+        /* mostly busy, now and then quiet for about the aging time or more */
+        if (rnd(800) == 0)
+            t += (uint64_t)(L2_BRIDGE_AGE_TIME - 20 + rnd(60)) * 1000000;
+        else if (rnd(4) == 0)
+            t += rnd(2000000);
+        else
+            t += rnd(20000);
+
+        /* the busy stations of a wire talk most */
+        src = rnd(3) ? rnd(TEST_BUSY) + (rnd(2) ? TEST_STATIONS : 0) : rnd(2 * TEST_STATIONS);
+        if (rnd(300) == 0)
+            at[src] ^= 1;               /* the station moved */
+
+        r = rnd(100);
+        if (r < 10)
+            memset(frame.data, 0xFF, MAC_LEN);
+        else if (r < 15)
+        {
+            frame.data[0] = 0x01;
+            frame.data[1] = 0x00;
+            frame.data[2] = 0x5E;
+            frame.data[3] = (uint8_t)rnd(0x80);
+            frame.data[4] = (uint8_t)rnd(256);
+            frame.data[5] = (uint8_t)rnd(256);
+        }
+        else if (r < 19)
+            memcpy(frame.data, netinfo_port[rnd(L2_BRIDGE_PORTS)].mac, MAC_LEN);
+        else
+        {
+            dst = rnd(6) ? rnd(TEST_BUSY) + (rnd(2) ? TEST_STATIONS : 0) : rnd(2 * TEST_STATIONS);
+            gen_mac(frame.data, dst);
+        }
+        gen_mac(frame.data + MAC_LEN, src);
+
+        r = rnd(20);
+        if (r == 0)
+            frame.len = L2_BRIDGE_FRAME_MIN + rnd(60 - L2_BRIDGE_FRAME_MIN);
+        else if (r < 3)
+            frame.len = 60;
+        else if (r < 5)
+            frame.len = L2_BRIDGE_FRAME_MAX;
+        else
+            frame.len = 60 + rnd(L2_BRIDGE_FRAME_MAX - 60 + 1);
+        for (j = 2 * MAC_LEN; j < frame.len; j++)
+            frame.data[j] = (uint8_t)rnd(256);
+
+        pcap_write(wire[at[src]], (uint32_t)(t / 1000000), (uint32_t)(t % 1000000), &frame);
+    }
+    for (i = 0; i < L2_BRIDGE_PORTS; i++)
+    {
+        fflush(wire[i]);
+        rewind(wire[i]);
+    }
+}
+
+/*
+ * Queued SPI of the bridge chips: frames the driver queues are applied only
+ * on its flush or when the bus is done with them, from the buffers the
+ * driver passed, so a buffer it reuses too early sends the wrong bytes
+ */
+
+#define BUS_FRAMES          256
+
+typedef struct {
+    uint32_t addr_sel;
+    uint8_t *rx, *tx;
+    uint16_t len;
+} bus_frame;
+
+static bus_frame bus[L2_BRIDGE_PORTS][BUS_FRAMES];
+static unsigned int bus_count[L2_BRIDGE_PORTS];
+static uint32_t bus_overlapped;     /* reads that left frames on the bus */
+
+static uint8_t bus_port(void)
+{
+    return WIZCHIP_CTX->spi_config == &chip_port[0] ? 0 : 1;
+}
+
+/* The bus finished the frames queued on a port */
+static void bus_done(uint8_t port)
+{
+    bus_frame *f;
+    unsigned int i;
+
+    for (i = 0; i < bus_count[port]; i++)
+    {
+        f = &bus[port][i];
+        w5500_sim_frame(&chip_port[port], f->addr_sel, f->rx, f->tx, f->len);
+    }
+    bus_count[port] = 0;
+}
+
+static int bus_transfer(uint32_t AddrSel, uint8_t *rxBuf, uint8_t *txBuf, uint16_t len, uint8_t use_dma)
+{
+    uint8_t port = bus_port();
+
+    (void)use_dma;
+    CHECKF(bus_count[port] == 0, "port %u: unqueued frame with %u queued ones outstanding", port,
+           bus_count[port]);
+    bus_done(port);
+    w5500_sim_frame(&chip_port[port], AddrSel, rxBuf, txBuf, len);
+    return 0;
+}
+
+static int bus_queue(uint32_t AddrSel, uint8_t *rxBuf, uint8_t *txBuf, uint16_t len, uint8_t use_dma)
+{
+    uint8_t port = bus_port();
+    bus_frame *f;
+
+    (void)use_dma;
+    /* a full queue has had time to send its oldest frames */
+    if (bus_count[port] == BUS_FRAMES)
+        bus_done(port);
+    f = &bus[port][bus_count[port]++];
+    f->addr_sel = AddrSel;
+    f->rx = rxBuf;
+    f->tx = txBuf;
+    f->len = len;
+    return 0;
+}
+
+static int bus_flush(void)
+{
+    uint8_t port = bus_port();
+
+    bus_done(port);
+    return 0;
+}
+
+static const wizchip_spi_backend bus_spi = {
+    W5500_SIM_SPI_MAX_LEN,
+    bus_transfer,
+    bus_queue,
+    bus_flush,
+};
+
+/*
+ * Replay
+ */
+
+static void tap_send(uint8_t port, const test_frame *frame)
+{
+    uint32_t dropped = chip_port[port].stats.rx_dropped;
+
+    wizchip_setctx(&ctx_tap[port]);
+    CHECK(getSn_TX_FSR(TEST_SOCK) >= frame->len);
+    wiz_send_data(TEST_SOCK, (uint8_t *)frame->data, frame->len);
+    setSn_CR(TEST_SOCK, Sn_CR_SEND);
+    while (getSn_CR(TEST_SOCK))
+        ;
+    setSn_IR(TEST_SOCK, Sn_IR_SENDOK);
+    CHECKF(chip_port[port].stats.rx_dropped == dropped, "port %u: frame lost in the RX buffer", port);
+}
+
+/* Every frame on the wire must be the next one the model expects there */
+static void tap_check(uint8_t port)
+{
+    static test_frame got;
+    uint8_t head[2];
+    test_frame *want;
+    uint16_t len;
+
+    wizchip_setctx(&ctx_tap[port]);
+    while (getSn_RX_RSR(TEST_SOCK) >= sizeof(head))
+    {
+        wiz_recv_data(TEST_SOCK, head, sizeof(head));
+        len = (((uint16_t)head[0] << 8) | head[1]) - sizeof(head);
+        CHECK(len <= L2_BRIDGE_FRAME_MAX);
+        if (len > L2_BRIDGE_FRAME_MAX)
+            len = L2_BRIDGE_FRAME_MAX;
+        wiz_recv_data(TEST_SOCK, got.data, len);
+        setSn_CR(TEST_SOCK, Sn_CR_RECV);
+        while (getSn_CR(TEST_SOCK))
+            ;
+
+        CHECKF(expected[port].count > 0, "port %u: unexpected frame of %u bytes", port, len);
+        if (expected[port].count == 0)
+            continue;
+        want = queue_pop(&expected[port]);
+        CHECKF(len == want->len && memcmp(got.data, want->data, len) == 0,
+               "port %u: got a frame of %u bytes, expected one of %u bytes", port, len, want->len);
+    }
+}
+
+/* The bridge serves both ports until it has read every frame of the group */
+static void bridge_run(void)
+{
+    l2_bridge_counter c;
+    uint32_t rx;
+    uint8_t port;
+    unsigned int n;
+
+    while (pending[0].count || pending[1].count)
+    {
+        for (port = 0; port < L2_BRIDGE_PORTS; port++)
+        {
+            if (pending[port].count == 0)
+                continue;
+
+            l2_bridge_get_counters(&c);
+            rx = c.rx[port];
+            wizchip_setctx(&ctx_port[port]);
+            l2_bridge_evt(TEST_SOCK, Sn_IR_RECV);
+            l2_bridge_get_counters(&c);
+
+            n = c.rx[port] - rx;
+            CHECKF(n > 0 && n <= L2_BRIDGE_MAX_BURST && n <= pending[port].count,
+                   "port %u: %u frames read of %u", port, n, pending[port].count);
+            if (n == 0 || n > pending[port].count)
+            {
+                pending[port].count = 0;
+                continue;
+            }
+            while (n--)
+                model_frame(queue_pop(&pending[port]), port);
+
+            /* the taps see what the bus has sent by now */
+            if (bus_count[0] || bus_count[1])
+                bus_overlapped++;
+            bus_done(0);
+            bus_done(1);
+            tap_check(0);
+            tap_check(1);
+        }
+    }
+}
+
+static void replay(pcap_in in[L2_BRIDGE_PORTS])
+{
+    l2_bridge_counter c;
+    uint32_t base = 0, sec;
+    uint8_t port, group;
+    pcap_in *next;
+
+    if (in[0].have || in[1].have)
+        base = in[0].have && (!in[1].have || in[0].sec <= in[1].sec) ? in[0].sec : in[1].sec;
+
+    for (;;)
+    {
+        /* frames of one second, up to TEST_GROUP of them, arrive together */
+        for (group = 0; group < TEST_GROUP; group++)
+        {
+            if (!in[0].have && !in[1].have)
+                break;
+            if (in[0].have && (!in[1].have || in[0].sec < in[1].sec ||
+                               (in[0].sec == in[1].sec && in[0].usec <= in[1].usec)))
+                port = 0;
+            else
+                port = 1;
+            next = &in[port];
+
+            /* a capture going back in time does not move the clock */
+            sec = next->sec - base;
+            if ((int32_t)sec < 0)
+                sec = model_tick;
+            if (group > 0 && sec != model_tick)
+                break;
+            if (sec != model_tick)
+            {
+                while (model_tick != sec)
+                {
+                    l2_bridge_time_handler();
+                    model_tick++;
+                }
+                l2_bridge_sweep();
+                model_sweep();
+                l2_bridge_get_counters(&c);
+                CHECKF(c.fps == model.fps, "second %u: %u frames/s, %u expected", model_tick,
+                       c.fps, model.fps);
+            }
+
+            tap_send(port, &next->frame);
+            *queue_push(&pending[port]) = next->frame;
+            pcap_next(next);
+        }
+        if (group == 0)
+            break;
+        bridge_run();
+    }
+}
+
+static void setup_chip(w5500_sim *sim, wizchip_ctx *ctx, w5500_sim_net *wire, wiz_NetInfo *netinfo)
+{
+    uint8_t size[_WIZCHIP_SOCK_NUM_] = { 16 };
+
+    w5500_sim_init(sim, wire);
+    w5500_sim_attach(sim, ctx);
+    wizchip_setctx(ctx);
+    CHECK(wizchip_init(size, size) == 0);
+    wizchip_setnetinfo(netinfo);
+}
+
+int main(int argc, char *argv[])
+{
+    wiz_NetInfo netinfo_tap;
+    FILE *wire[L2_BRIDGE_PORTS] = { NULL, NULL };
+    pcap_in in[L2_BRIDGE_PORTS];
+    l2_bridge_counter c;
+    uint8_t port;
+
+    if (argc > 3)
+    {
+        fprintf(stderr, "usage: %s [wire0.pcap [wire1.pcap]]\n", argv[0]);
+        return 2;
+    }
+
+    for (port = 0; port < L2_BRIDGE_PORTS; port++)
+    {
+        netinfo_tap = netinfo_port[port];
+        netinfo_tap.mac[4] = 0xFF;
+        netinfo_tap.ip[3] += 100;
+        setup_chip(&chip_port[port], &ctx_port[port], &test_wire[port], &netinfo_port[port]);
+        setup_chip(&chip_tap[port], &ctx_tap[port], &test_wire[port], &netinfo_tap);
+        CHECK(wiz_socket(TEST_SOCK, Sn_MR_MACRAW, 0, 0) == TEST_SOCK);
+        ctx_port[port].spi = &bus_spi;
+    }
+
+    CHECK(l2_bridge_init(&ctx_port[0], &ctx_port[1], NULL) == 0);
+    for (port = 0; port < L2_BRIDGE_PORTS; port++)
+    {
+        /* the first event opens the MACRAW socket */
+        wizchip_setctx(&ctx_port[port]);
+        l2_bridge_evt(TEST_SOCK, 0);
+        CHECK(getSn_SR(TEST_SOCK) == SOCK_MACRAW);
+    }
+
+    if (argc == 1)
+    {
+        wire[0] = tmpfile();
+        wire[1] = tmpfile();
+        CHECK(wire[0] != NULL && wire[1] != NULL);
+        if (wire[0] == NULL || wire[1] == NULL)
+            HOST_TEST_EXIT();
+        gen_captures(wire);
+    }
+    else
+    {
+        for (port = 0; port + 1 < (uint8_t)argc; port++)
+        {
+            wire[port] = fopen(argv[port + 1], "rb");
+            if (wire[port] == NULL)
+            {
+                perror(argv[port + 1]);
+                return 2;
+            }
+        }
+    }
+    for (port = 0; port < L2_BRIDGE_PORTS; port++)
+    {
+        if (wire[port] && pcap_open(&in[port], wire[port]) != 0)
+        {
+            fprintf(stderr, "wire %u: not a pcap capture of Ethernet frames\n", port);
+            return 2;
+        }
+        if (wire[port] == NULL)
+            memset(&in[port], 0, sizeof(in[port]));
+    }
+
+    replay(in);
+
+    CHECK(expected[0].count == 0 && expected[1].count == 0);
+    l2_bridge_get_counters(&c);
+    for (port = 0; port < L2_BRIDGE_PORTS; port++)
+    {
+        CHECKF(c.rx[port] == model.rx[port], "port %u: %u frames read, %u sent", port, c.rx[port],
+               model.rx[port]);
+        CHECKF(c.tx[port] == model.tx[port], "port %u: %u frames forwarded, %u expected", port,
+               c.tx[port], model.tx[port]);
+    }
+    CHECKF(c.flooded == model.flooded, "%u flooded, %u expected", c.flooded, model.flooded);
+    CHECKF(c.filtered == model.filtered, "%u filtered, %u expected", c.filtered, model.filtered);
+    CHECKF(c.learned == model.learned, "%u learned, %u expected", c.learned, model.learned);
+    CHECKF(c.aged == model.aged, "%u aged, %u expected", c.aged, model.aged);
+    CHECKF(c.table_full == model.table_full, "%u not learned, %u expected", c.table_full,
+           model.table_full);
+    CHECK(c.dropped == 0);
+
+    printf("replayed %u + %u frames (%u + %u skipped) over %u s: forwarded %u + %u, "
+           "flooded %u, filtered %u, learned %u, aged %u, not learned %u, peak %u frames/s\n",
+           in[0].frames, in[1].frames, in[0].skipped, in[1].skipped, model_tick, c.tx[1], c.tx[0],
+           c.flooded, c.filtered, c.learned, c.aged, c.table_full, model_fps_max);
+    if (argc == 1)
+    {
+        /* the captures must have gone through every case */
+        CHECK(c.tx[0] > 0 && c.tx[1] > 0);
+        CHECK(c.flooded > 0 && c.filtered > 0);
+        CHECK(c.aged > 0 && c.table_full > 0);
+        CHECK(model_fps_max > 0);
+        CHECK(bus_overlapped > 0);
+    }
+    for (port = 0; port < L2_BRIDGE_PORTS; port++)
+        if (wire[port])
+            fclose(wire[port]);
+
+    HOST_TEST_EXIT();
+}
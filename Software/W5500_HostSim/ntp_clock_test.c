@@ -0,0 +1,272 @@
+/*
+ * Test of the RT app's NTP clock, ntp_clock.c, on a counter the test drives
+ * in place of GPT2 (see host_stub/os_hal_gpt.h).
+ *
+ * A 32.768 kHz tick must advance the clock by exactly 2^17 fraction units,
+ * also across a counter wrap. The first sync and any offset beyond
+ * NTP_CLOCK_STEP_LIMIT_MS step the clock; a smaller offset is slewed in at
+ * NTP_CLOCK_SLEW_PPM with the clock never going back nor skipping ahead, and
+ * once it is in, the clock runs at the counter's rate again and matches the
+ * reference exactly. A new sync replaces what is left of the slew.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "os_hal_gpt.h"
+
+#include "ntp_clock.h"
+#include "host_test.h"
+
+#define NTP_SEC             ((uint64_t)1 << 32)
+#define NTP_MS(ms)          (((int64_t)(ms) << 32) / 1000)
+#define T0                  ((uint64_t)3900000000u << 32)
+
+/* Seconds it takes to slew in ms at NTP_CLOCK_SLEW_PPM, with a margin */
+#define SLEW_SECONDS(ms)    ((ms) * 1000 / NTP_CLOCK_SLEW_PPM + 2)
+
+static uint32_t gpt_count;
+
+void mtk_os_hal_gpt_init(void)
+{
+}
+
+int mtk_os_hal_gpt_config(enum gpt_num timer_id, unsigned char speed_32us, struct os_gpt_int *gpt_int)
+{
+    CHECK(timer_id == GPT2 && speed_32us == 1 && gpt_int == NULL);
+    return 0;
+}
+
+int mtk_os_hal_gpt_start(enum gpt_num timer_id)
+{
+    (void)timer_id;
+    return 0;
+}
+
+unsigned int mtk_os_hal_gpt_get_cur_count(enum gpt_num timer_id)
+{
+    CHECK(timer_id == GPT2);
+    return gpt_count;
+}
+
+static uint64_t now(void)
+{
+    ntp_timestamp ts;
+
+    ntp_clock_get(&ts);
+    return ((uint64_t)ts.second << 32) | ts.fraction;
+}
+
+static void init_at(uint64_t t)
+{
+    ntp_clock_init((uint32_t)(t >> 32), (uint32_t)t);
+}
+
+static void sync_to(uint64_t t)
+{
+    ntp_clock_sync((uint32_t)(t >> 32), (uint32_t)t);
+}
+
+/*
+ * Run the counter for seconds, reading the clock every step ticks. Each step
+ * must move the clock forward by the ticks' worth, give or take the slew rate.
+ * The slew's rounding costs at most one fraction unit per reading.
+ */
+static void run(unsigned int seconds, uint32_t step)
+{
+    uint64_t ticks = (uint64_t)seconds * NTP_CLOCK_HZ;
+    uint64_t last = now(), t, nominal, slew;
+
+    while (ticks)
+    {
+        if (step > ticks)
+            step = (uint32_t)ticks;
+        gpt_count += step;
+        ticks -= step;
+
+        t = now();
+        nominal = ntp_clock_ticks_to_ntp(step);
+        slew = nominal * NTP_CLOCK_SLEW_PPM / 1000000 + 1;
+        CHECKF(t - last >= nominal - slew && t - last <= nominal + slew,
+               "step of %u ticks moved the clock by %lld units, nominal %llu",
+               step, (long long)(t - last), (unsigned long long)nominal);
+        last = t;
+    }
+}
+
+static void test_ticks(void)
+{
+    static const uint32_t us[] = { 0, 1, 30, 31, 999, 500000, 999999 };
+    unsigned int i;
+
+    gpt_count = 0x12345678;
+    init_at(T0);
+    CHECK(now() == T0);
+
+    gpt_count += 1;
+    CHECK(now() == T0 + (1u << NTP_CLOCK_TICK_SHIFT));
+    gpt_count += NTP_CLOCK_HZ - 1;
+    CHECK(now() == T0 + NTP_SEC);
+    gpt_count += 3 * NTP_CLOCK_HZ + NTP_CLOCK_HZ / 4;
+    CHECK(now() == T0 + 4 * NTP_SEC + NTP_SEC / 4);
+
+    /* The counter wraps every 36 hours */
+    gpt_count = 0xFFFFFFF0;
+    init_at(T0);
+    gpt_count += 0x20;
+    CHECK(now() == T0 + ((uint64_t)0x20 << NTP_CLOCK_TICK_SHIFT));
+
+    CHECK(ntp_clock_ticks_to_ntp(NTP_CLOCK_HZ) == NTP_SEC);
+    CHECK(ntp_clock_us_to_frac(500000) == 0x80000000u);
+    CHECK(ntp_clock_frac_to_us(1u << NTP_CLOCK_TICK_SHIFT) == 31);
+    for (i = 0; i < sizeof(us) / sizeof(us[0]); i++)
+        CHECKF(ntp_clock_frac_to_us(ntp_clock_us_to_frac(us[i])) == us[i], "%u us", us[i]);
+}
+
+/* The first sync steps, however small the offset */
+static void test_first_sync(void)
+{
+    gpt_count = 1000;
+    init_at(T0);
+    sync_to(T0 + NTP_MS(1));
+    CHECK(now() == T0 + NTP_MS(1));
+
+    init_at(T0);
+    sync_to(T0 - NTP_MS(1));
+    CHECK(now() == T0 - NTP_MS(1));
+}
+
+/* An offset of ms is slewed in, read at the 1 Hz tick or at every tick */
+static void test_slew(int ms, uint32_t step)
+{
+    uint64_t start, adj, expect;
+    int64_t left, off;
+    unsigned int i, seconds = SLEW_SECONDS(ms < 0 ? -ms : ms);
+
+    gpt_count = 0;
+    init_at(T0);
+    sync_to(T0);
+    start = gpt_count;
+
+    sync_to(T0 + NTP_MS(ms));
+    CHECKF(now() == T0, "%d ms: the clock jumped", ms);
+
+    /* One second, at the full slew rate while there is enough left */
+    run(1, step);
+    adj = NTP_SEC * NTP_CLOCK_SLEW_PPM / 1000000;
+    if (adj > (uint64_t)NTP_MS(ms < 0 ? -ms : ms))
+        adj = NTP_MS(ms < 0 ? -ms : ms);
+    expect = ms < 0 ? T0 + NTP_SEC - adj : T0 + NTP_SEC + adj;
+    CHECKF(now() + NTP_CLOCK_HZ >= expect && now() <= expect + NTP_CLOCK_HZ,
+           "%d ms: %lld units off after 1 s", ms, (long long)(now() - expect));
+
+    /* What is left shrinks and keeps its sign: the clock never overshoots */
+    left = NTP_MS(ms);
+    for (i = 0; i < seconds; i++)
+    {
+        run(1, NTP_CLOCK_HZ);
+        off = (int64_t)(T0 + NTP_MS(ms) + ntp_clock_ticks_to_ntp(gpt_count - start) - now());
+        CHECKF(ms > 0 ? off >= 0 && off <= left : off <= 0 && off >= left,
+               "%d ms: %lld units left after %u s, %lld before", ms, (long long)off, i + 2,
+               (long long)left);
+        left = off;
+    }
+    CHECKF(now() == T0 + NTP_MS(ms) + ntp_clock_ticks_to_ntp(gpt_count - start),
+           "%d ms: %lld units off after %u s", ms,
+           (long long)(now() - (T0 + NTP_MS(ms) + ntp_clock_ticks_to_ntp(gpt_count - start))),
+           seconds + 1);
+
+    /* Slewed in: back to the counter's rate */
+    start = now();
+    gpt_count += 10 * NTP_CLOCK_HZ;
+    CHECK(now() == start + 10 * NTP_SEC);
+}
+
+/* At the step limit the clock still slews; beyond it, it steps */
+static void test_step_limit(void)
+{
+    static const int slewed[] = { NTP_CLOCK_STEP_LIMIT_MS, -NTP_CLOCK_STEP_LIMIT_MS };
+    static const int stepped[] = { NTP_CLOCK_STEP_LIMIT_MS + 1, -NTP_CLOCK_STEP_LIMIT_MS - 1, 100000, -100000 };
+    unsigned int i;
+
+    for (i = 0; i < sizeof(slewed) / sizeof(slewed[0]); i++)
+    {
+        gpt_count = 5;
+        init_at(T0);
+        sync_to(T0);
+        sync_to(T0 + NTP_MS(slewed[i]));
+        CHECKF(now() == T0, "%d ms stepped", slewed[i]);
+    }
+    for (i = 0; i < sizeof(stepped) / sizeof(stepped[0]); i++)
+    {
+        gpt_count = 5;
+        init_at(T0);
+        sync_to(T0);
+        sync_to(T0 + NTP_MS(stepped[i]));
+        CHECKF(now() == T0 + NTP_MS(stepped[i]), "%d ms not stepped", stepped[i]);
+        /* and nothing is left to slew */
+        gpt_count += 10 * NTP_CLOCK_HZ;
+        CHECK(now() == T0 + NTP_MS(stepped[i]) + 10 * NTP_SEC);
+    }
+}
+
+/* A sync measures against the slewed clock and replaces the slew left */
+static void test_resync(void)
+{
+    uint64_t start, t;
+
+    gpt_count = 0;
+    init_at(T0);
+    sync_to(T0);
+    sync_to(T0 + NTP_MS(1000));
+    run(100, NTP_CLOCK_HZ);
+
+    /* Half of it is in; the reference still says 1 s ahead of the counter */
+    sync_to(T0 + NTP_MS(1000) + 100 * NTP_SEC);
+    run(SLEW_SECONDS(500), NTP_CLOCK_HZ);
+    CHECK(now() == T0 + NTP_MS(1000) + ntp_clock_ticks_to_ntp(gpt_count));
+
+    /* A sync to the clock's own time cancels the slew */
+    sync_to(T0);
+    sync_to(T0 + NTP_MS(1500));
+    run(10, NTP_CLOCK_HZ);
+    t = now();
+    sync_to(t);
+    start = gpt_count;
+    gpt_count += 10 * NTP_CLOCK_HZ;
+    CHECK(now() == t + ntp_clock_ticks_to_ntp(gpt_count - start));
+}
+
+static void test_capture(void)
+{
+    ntp_timestamp ts;
+    uint64_t t;
+
+    gpt_count = 77;
+    init_at(T0);
+    CHECK(ntp_clock_take_capture(&ts) == -1);
+
+    gpt_count += 1234;
+    t = now();
+    ntp_clock_capture();
+    gpt_count += NTP_CLOCK_HZ;
+    CHECK(ntp_clock_take_capture(&ts) == 0);
+    CHECK((((uint64_t)ts.second << 32) | ts.fraction) == t);
+    CHECK(ntp_clock_take_capture(&ts) == -1);
+}
+
+int main(void)
+{
+    test_ticks();
+    test_first_sync();
+    test_slew(1000, NTP_CLOCK_HZ);
+    test_slew(-1000, NTP_CLOCK_HZ);
+    test_slew(3, 1);
+    test_slew(-3, 1);
+    test_slew(NTP_CLOCK_STEP_LIMIT_MS, 1000);
+    test_step_limit();
+    test_resync();
+    test_capture();
+
+    HOST_TEST_EXIT();
+}
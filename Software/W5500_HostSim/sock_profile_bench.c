@@ -0,0 +1,418 @@
+/*
+ * Throughput of every ETH1 socket under each of the RT app's buffer profiles,
+ * on the W5500 model.
+ *
+ * Chip B runs the RT app's ETH1 servers with the socket buffers of a profile
+ * of eth1_sockets.h, applied with sock_profile_apply(): the mailbox data
+ * socket, read whole like mbox_tcp_server() does, the TCP echo of loopback.c,
+ * and the DHCP and SNTP servers. Chip A is the network. The run is a sequence
+ * of main loop passes: each socket of B that has data is served once per
+ * pass, and a pass lasts the SPI bus time B spent in it plus a fixed loop
+ * time for everything else the M4 does. Between two passes A offers
+ *
+ *  - mailbox: a saturating TCP stream, as much as B's receive window takes;
+ *  - echo: a block of BENCH_ECHO_BLOCK bytes, if B's window takes it;
+ *  - DHCP: a burst of DISCOVERs from a rack of clients every few passes;
+ *  - SNTP: a burst of requests every few passes.
+ *
+ * The model has no TCP window, so A sends no more than B's RX buffer has room
+ * for; UDP datagrams that do not fit are lost like on the wire. The 1 Hz tick
+ * of the DHCP server follows the simulated time.
+ *
+ * For each profile and socket the report gives the buffer sizes, the bytes B
+ * received and sent per second of simulated time (bytes per ms are kB/s), and
+ * for the UDP servers the datagrams sent, lost in B's RX buffer and answered.
+ *
+ * Usage: sock_profile_bench [-p profile] [-n passes] [-l loop_us] [-m max_len]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ioLibrary_Driver/Ethernet/socket.h"
+#include "ioLibrary_Driver/Application/loopback/loopback.h"
+#include "ioLibrary_Driver/Internet/SNTP/sntps.h"
+#include "ioLibrary_Driver/Internet/DHCP/dhcps.h"
+
+#include "eth1_sockets.h"
+#include "w5500_sim.h"
+
+#define BENCH_PASSES        4000
+#define BENCH_LOOP_US       500
+#define BENCH_MBOX_PORT     5000    /* the RT app's ports */
+#define BENCH_ECHO_PORT     50001
+#define BENCH_SNTP_PORT     5123    /* client side */
+#define BENCH_ECHO_BLOCK    1024
+#define BENCH_DHCP_CLIENTS  64      /* each sends below the rate limit */
+#define BENCH_DHCP_BURST    16
+#define BENCH_DHCP_EVERY    64      /* passes */
+#define BENCH_SNTP_BURST    48
+#define BENCH_SNTP_EVERY    16
+#define BENCH_SNTP_LEN      48
+
+#define BENCH_SOCKS         4
+#define BENCH_SREG_RX_RSR   0x26    /* Sn_RX_RSR in the model's socket registers */
+
+enum {
+    BENCH_MBOX,
+    BENCH_ECHO,
+    BENCH_DHCP,
+    BENCH_SNTP,
+};
+
+static const uint8_t bench_sock[BENCH_SOCKS] = {
+    MBOX_TCP_SOCKET, LOOPBACK_SOCKET, DHCP_SERVER_SOCKET, SNTP_SERVER_SOCKET,
+};
+
+static const char *const bench_role[BENCH_SOCKS] = { "mailbox", "echo", "DHCP", "SNTP" };
+
+/* -p names of the profiles, indexed by INTERCORE_BUFFER_* */
+static const char *const bench_profile_opt[INTERCORE_BUFFER_PROFILES] = {
+    [INTERCORE_BUFFER_BALANCED] = "balanced",
+    [INTERCORE_BUFFER_BULK] = "bulk",
+    [INTERCORE_BUFFER_SMALL_UDP] = "small_udp",
+};
+
+typedef struct {
+    uint64_t rx_bytes;      /* into B */
+    uint64_t tx_bytes;      /* out of B */
+    uint32_t sent;          /* datagrams A sent */
+    uint32_t lost;          /* datagrams lost in B's RX buffer */
+    uint32_t answered;
+} bench_sock_stats;
+
+static w5500_sim_net bench_net;
+static w5500_sim chip_a, chip_b;
+static wizchip_ctx ctx_a, ctx_b;
+
+static wiz_NetInfo netinfo_a = {
+    .mac = { 0x00, 0x08, 0xDC, 0x00, 0x00, 0x0A },
+    .ip = { 192, 168, 50, 10 },
+    .sn = { 255, 255, 255, 0 },
+    .gw = { 192, 168, 50, 1 },
+    .dhcp = NETINFO_STATIC,
+};
+static wiz_NetInfo netinfo_b = {
+    .mac = { 0x00, 0x08, 0xDC, 0x00, 0x00, 0x0B },
+    .ip = { 192, 168, 50, 20 },
+    .sn = { 255, 255, 255, 0 },
+    .gw = { 192, 168, 50, 1 },
+    .dhcp = NETINFO_STATIC,
+};
+
+static uint8_t stream[W5500_SIM_BUF_MAX];
+static uint8_t mbox_buf[W5500_SIM_BUF_MAX];
+static uint8_t echo_buf[DATA_BUF_SIZE + 1];     /* loopback_tcps() terminates the data */
+static uint8_t sntp_buf[SNTPS_BUF_SIZE];
+static uint8_t rx_buf[W5500_SIM_BUF_MAX];
+static dhcps_msg dhcp_buf;
+static dhcps_msg msg;
+
+static uint8_t tx_kb[_WIZCHIP_SOCK_NUM_], rx_kb[_WIZCHIP_SOCK_NUM_];
+static bench_sock_stats stats[BENCH_SOCKS];
+static unsigned int dhcp_client;
+
+/* The printf of the BSP used by loopback.c, sntps.c, dhcps.c and the log */
+void _putchar(char character)
+{
+    (void)character;
+}
+
+/* Room in the RX buffer of B's socket sn, read from the model, not over SPI */
+static uint16_t bench_window(uint8_t sn)
+{
+    const uint8_t *reg = chip_b.sock[sn].reg;
+
+    return (uint16_t)(rx_kb[sn] * 1024 - ((reg[BENCH_SREG_RX_RSR] << 8) | reg[BENCH_SREG_RX_RSR + 1]));
+}
+
+static uint16_t bench_rsr(uint8_t sn)
+{
+    const uint8_t *reg = chip_b.sock[sn].reg;
+
+    return (uint16_t)((reg[BENCH_SREG_RX_RSR] << 8) | reg[BENCH_SREG_RX_RSR + 1]);
+}
+
+/* A datagram from A; returns 1 if it reached B's RX buffer */
+static int bench_sendto(uint8_t sn, const uint8_t *buf, uint16_t len, uint16_t port)
+{
+    uint8_t bcast[4] = { 255, 255, 255, 255 };
+    uint32_t dropped = chip_b.stats.rx_dropped;
+
+    wizchip_setctx(&ctx_a);
+    sock_sendto(sn, (uint8_t *)buf, len, sn == DHCP_SERVER_SOCKET ? bcast : netinfo_b.ip, port);
+    return chip_b.stats.rx_dropped == dropped;
+}
+
+static uint16_t bench_dhcp_msg(unsigned int client)
+{
+    uint8_t *opt = msg.options;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.op = DHCP_MESSAGE_OP_REQUEST;
+    msg.htype = DHCP_MESSAGE_HTYPE;
+    msg.hlen = DHCP_MESSAGE_HLEN;
+    msg.xid[3] = (uint8_t)client;
+    msg.chaddr[0] = 0x02;
+    msg.chaddr[5] = (uint8_t)client;
+
+    memcpy(opt, dhcp_magic_cookie, sizeof(dhcp_magic_cookie));
+    opt += sizeof(dhcp_magic_cookie);
+    *opt++ = DHCP_OPTION_CODE_MSG_TYPE;
+    *opt++ = 1;
+    *opt++ = DHCP_MESSAGE_TYPE_DISCOVER;
+    *opt++ = DHCP_OPTION_CODE_END;
+    return DHCPS_MIN_REPLY_LEN;
+}
+
+/* What A offers between two passes */
+static void bench_offer(unsigned int pass)
+{
+    uint8_t req[BENCH_SNTP_LEN] = { 0x23 };    /* LI 0, version 4, mode 3 (client) */
+    bench_sock_stats *s;
+    uint16_t len;
+    unsigned int i;
+
+    len = bench_window(MBOX_TCP_SOCKET);
+    if (len)
+    {
+        wizchip_setctx(&ctx_a);
+        if (sock_send(MBOX_TCP_SOCKET, stream, len) == len)
+            stats[BENCH_MBOX].rx_bytes += len;
+    }
+
+    if (bench_window(LOOPBACK_SOCKET) >= BENCH_ECHO_BLOCK)
+    {
+        wizchip_setctx(&ctx_a);
+        if (sock_send(LOOPBACK_SOCKET, stream, BENCH_ECHO_BLOCK) == BENCH_ECHO_BLOCK)
+            stats[BENCH_ECHO].rx_bytes += BENCH_ECHO_BLOCK;
+    }
+
+    if (pass % BENCH_DHCP_EVERY == 0)
+    {
+        s = &stats[BENCH_DHCP];
+        for (i = 0; i < BENCH_DHCP_BURST; i++)
+        {
+            len = bench_dhcp_msg(1 + dhcp_client++ % BENCH_DHCP_CLIENTS);
+            s->sent++;
+            if (bench_sendto(DHCP_SERVER_SOCKET, (uint8_t *)&msg, len, DHCP_SERVER_PORT))
+                s->rx_bytes += len;
+            else
+                s->lost++;
+        }
+    }
+
+    if (pass % BENCH_SNTP_EVERY == 0)
+    {
+        s = &stats[BENCH_SNTP];
+        for (i = 0; i < BENCH_SNTP_BURST; i++)
+        {
+            s->sent++;
+            if (bench_sendto(SNTP_SERVER_SOCKET, req, sizeof(req), ntp_port))
+                s->rx_bytes += sizeof(req);
+            else
+                s->lost++;
+        }
+    }
+}
+
+/* One main loop pass of B: every socket with data is served once */
+static void bench_pass(void)
+{
+    wizchip_setctx(&ctx_b);
+    if (bench_rsr(MBOX_TCP_SOCKET))
+        sock_recv(MBOX_TCP_SOCKET, mbox_buf, bench_rsr(MBOX_TCP_SOCKET));
+    if (bench_rsr(LOOPBACK_SOCKET))
+        loopback_tcps(LOOPBACK_SOCKET, echo_buf, BENCH_ECHO_PORT);
+    if (bench_rsr(DHCP_SERVER_SOCKET))
+        dhcps_run();
+    if (bench_rsr(SNTP_SERVER_SOCKET))
+        SNTPs_run();
+}
+
+/* A reads what B sent */
+static void bench_collect(void)
+{
+    uint8_t addr[4];
+    uint16_t port;
+    unsigned int b;
+    int32_t ret;
+
+    wizchip_setctx(&ctx_a);
+    for (b = 0; b < BENCH_SOCKS; b++)
+    {
+        while (getSn_RX_RSR(bench_sock[b]) > 0)
+        {
+            if (b == BENCH_MBOX || b == BENCH_ECHO)
+                ret = sock_recv(bench_sock[b], rx_buf, sizeof(rx_buf));
+            else
+                ret = sock_recvfrom(bench_sock[b], rx_buf, sizeof(rx_buf), addr, &port);
+            if (ret <= 0)
+                break;
+            stats[b].tx_bytes += ret;
+            if (b == BENCH_DHCP || b == BENCH_SNTP)
+                stats[b].answered++;
+        }
+    }
+}
+
+static void bench_chip(w5500_sim *sim, wizchip_ctx *ctx, wiz_NetInfo *netinfo)
+{
+    /* A's buffers hold what B may send back in one pass */
+    uint8_t txsize[_WIZCHIP_SOCK_NUM_] = { [MBOX_TCP_SOCKET] = 8, [LOOPBACK_SOCKET] = 4,
+                                           [DHCP_SERVER_SOCKET] = 2, [SNTP_SERVER_SOCKET] = 2 };
+    uint8_t rxsize[_WIZCHIP_SOCK_NUM_] = { [MBOX_TCP_SOCKET] = 2, [LOOPBACK_SOCKET] = 2,
+                                           [DHCP_SERVER_SOCKET] = 8, [SNTP_SERVER_SOCKET] = 4 };
+
+    w5500_sim_init(sim, &bench_net);
+    w5500_sim_attach(sim, ctx);
+    wizchip_setctx(ctx);
+    wizchip_init(txsize, rxsize);
+    wizchip_setnetinfo(netinfo);
+}
+
+static int bench_profile(unsigned int profile, unsigned int passes, uint32_t loop_us)
+{
+    uint64_t elapsed_ns = 0, second_ns = 0, bus_ns, from;
+    unsigned int pass, b;
+    uint8_t sn;
+    int failed = 0;
+
+    memset(&bench_net, 0, sizeof(bench_net));
+    memset(stats, 0, sizeof(stats));
+    dhcp_client = 0;
+
+    bench_chip(&chip_a, &ctx_a, &netinfo_a);
+    bench_chip(&chip_b, &ctx_b, &netinfo_b);
+    wizchip_setctx(&ctx_b);
+    if (sock_profile_apply(&sock_profiles[profile], tx_kb, rx_kb) != 0)
+    {
+        fprintf(stderr, "profile %s refused\n", sock_profiles[profile].name);
+        return 1;
+    }
+
+    /* B's servers open their sockets, A connects and binds */
+    wiz_socket(MBOX_TCP_SOCKET, Sn_MR_TCP, BENCH_MBOX_PORT, 0);
+    sock_listen(MBOX_TCP_SOCKET);
+    loopback_tcps(LOOPBACK_SOCKET, echo_buf, BENCH_ECHO_PORT);
+    loopback_tcps(LOOPBACK_SOCKET, echo_buf, BENCH_ECHO_PORT);
+    dhcps_init(DHCP_SERVER_SOCKET, (uint8_t *)&dhcp_buf);
+    dhcps_run();
+    dhcps_time_handler();
+    SNTPs_init(SNTP_SERVER_SOCKET, sntp_buf);
+    SNTPs_run();
+
+    wizchip_setctx(&ctx_a);
+    wiz_socket(MBOX_TCP_SOCKET, Sn_MR_TCP, 0, 0);
+    wiz_socket(LOOPBACK_SOCKET, Sn_MR_TCP, 0, 0);
+    if (sock_connect(MBOX_TCP_SOCKET, netinfo_b.ip, BENCH_MBOX_PORT) != SOCK_OK ||
+        sock_connect(LOOPBACK_SOCKET, netinfo_b.ip, BENCH_ECHO_PORT) != SOCK_OK)
+    {
+        fprintf(stderr, "profile %s: connect failed\n", sock_profiles[profile].name);
+        return 1;
+    }
+    wiz_socket(DHCP_SERVER_SOCKET, Sn_MR_UDP, DHCP_CLIENT_PORT, 0);
+    wiz_socket(SNTP_SERVER_SOCKET, Sn_MR_UDP, BENCH_SNTP_PORT, 0);
+
+    bus_ns = 0;
+    for (pass = 0; pass < passes; pass++)
+    {
+        bench_offer(pass);
+
+        from = chip_b.stats.bus_ns;
+        bench_pass();
+        bus_ns += chip_b.stats.bus_ns - from;
+        elapsed_ns += chip_b.stats.bus_ns - from + (uint64_t)loop_us * 1000;
+        second_ns += chip_b.stats.bus_ns - from + (uint64_t)loop_us * 1000;
+        if (second_ns >= 1000000000u)
+        {
+            second_ns -= 1000000000u;
+            wizchip_setctx(&ctx_b);
+            dhcps_time_handler();
+        }
+
+        bench_collect();
+    }
+
+    printf("profile \"%s\": %u passes in %.3f s, B's SPI bus busy %.0f%%\n", sock_profiles[profile].name,
+           passes, (double)elapsed_ns / 1e9, 100.0 * bus_ns / elapsed_ns);
+    printf("    socket  %-8s  TX KB  RX KB  RX kB/s  TX kB/s      sent    lost  answered\n", "");
+    for (b = 0; b < BENCH_SOCKS; b++)
+    {
+        sn = bench_sock[b];
+        printf("    %6u  %-8s  %5u  %5u  %7.1f  %7.1f", sn, bench_role[b], tx_kb[sn], rx_kb[sn],
+               stats[b].rx_bytes * 1e6 / elapsed_ns, stats[b].tx_bytes * 1e6 / elapsed_ns);
+        if (b == BENCH_DHCP || b == BENCH_SNTP)
+            printf("  %8u  %6u  %8u", stats[b].sent, stats[b].lost, stats[b].answered);
+        printf("\n");
+    }
+    printf("\n");
+
+    /* the streams are paced by B's window and must lose nothing */
+    if (stats[BENCH_ECHO].tx_bytes > stats[BENCH_ECHO].rx_bytes || chip_a.stats.rx_dropped)
+    {
+        fprintf(stderr, "profile %s: echo %llu of %llu bytes, %u lost at A\n", sock_profiles[profile].name,
+                (unsigned long long)stats[BENCH_ECHO].tx_bytes, (unsigned long long)stats[BENCH_ECHO].rx_bytes,
+                chip_a.stats.rx_dropped);
+        failed = 1;
+    }
+    return failed;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int passes = BENCH_PASSES, profile = INTERCORE_BUFFER_PROFILES, p;
+    uint32_t loop_us = BENCH_LOOP_US;
+    int opt, failed = 0;
+
+    while ((opt = getopt(argc, argv, "p:n:l:m:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            for (profile = 0; profile < INTERCORE_BUFFER_PROFILES; profile++)
+                if (strcmp(optarg, bench_profile_opt[profile]) == 0)
+                    break;
+            if (profile == INTERCORE_BUFFER_PROFILES)
+            {
+                fprintf(stderr, "%s: profile balanced, bulk or small_udp\n", argv[0]);
+                return 2;
+            }
+            break;
+        case 'n':
+            passes = (unsigned int)strtoul(optarg, NULL, 0);
+            break;
+        case 'l':
+            loop_us = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'm':
+            w5500_sim_spi.max_len = (uint16_t)strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-p profile] [-n passes] [-l loop_us] [-m max_len]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (passes == 0)
+    {
+        fprintf(stderr, "%s: passes not 0\n", argv[0]);
+        return 2;
+    }
+
+    printf("ETH1 sockets served once per main loop pass of %u us plus B's SPI time, ", loop_us);
+    if (w5500_sim_spi.max_len)
+        printf("SPI frames of at most %u data bytes\n", w5500_sim_spi.max_len);
+    else
+        printf("SPI frames of any length\n");
+    printf("offered: mailbox stream as B's window allows, echo %u B per pass, "
+           "%u DISCOVERs every %u passes, %u SNTP requests every %u passes\n\n",
+           BENCH_ECHO_BLOCK, BENCH_DHCP_BURST, BENCH_DHCP_EVERY, BENCH_SNTP_BURST, BENCH_SNTP_EVERY);
+
+    for (p = 0; p < INTERCORE_BUFFER_PROFILES; p++)
+        if (profile == INTERCORE_BUFFER_PROFILES || profile == p)
+            failed |= bench_profile(p, passes, loop_us);
+
+    return failed;
+}
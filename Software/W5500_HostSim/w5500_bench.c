@@ -0,0 +1,207 @@
+/*
+ * SPI cost of the ioLibrary socket calls, measured on the W5500 model.
+ *
+ * Two simulated chips, A and B, share one network. Each benchmark moves
+ * payload from A to B through the socket API and reports the SPI
+ * transactions and bytes each side spent per payload byte. The transfer
+ * length limit of the SPI backend may be given as the first argument
+ * (0: no limit), it defaults to the MT3620 SPIM limit.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ioLibrary_Driver/Ethernet/socket.h"
+
+#include "w5500_sim.h"
+
+#define BENCH_UDP_PORT      5000
+#define BENCH_TCP_PORT      5001
+#define BENCH_SOCK          1
+#define BENCH_ROUNDS        64
+#define BENCH_BURST         16      /* most datagrams sent before B reads */
+#define BENCH_BUF_SIZE      2048
+
+static w5500_sim_net bench_net;
+static w5500_sim chip_a, chip_b;
+static wizchip_ctx ctx_a, ctx_b;
+
+static wiz_NetInfo netinfo_a = {
+    .mac = { 0x00, 0x08, 0xDC, 0x00, 0x00, 0x0A },
+    .ip = { 192, 168, 50, 10 },
+    .sn = { 255, 255, 255, 0 },
+    .gw = { 192, 168, 50, 1 },
+    .dhcp = NETINFO_STATIC,
+};
+static wiz_NetInfo netinfo_b = {
+    .mac = { 0x00, 0x08, 0xDC, 0x00, 0x00, 0x0B },
+    .ip = { 192, 168, 50, 20 },
+    .sn = { 255, 255, 255, 0 },
+    .gw = { 192, 168, 50, 1 },
+    .dhcp = NETINFO_STATIC,
+};
+
+static uint8_t payload[BENCH_BUF_SIZE];
+static uint8_t rx_buf[BENCH_BURST * (8 + BENCH_BUF_SIZE)];
+
+typedef struct {
+    w5500_sim_stats a;
+    w5500_sim_stats b;
+} bench_mark;
+
+static void bench_start(bench_mark *m)
+{
+    m->a = chip_a.stats;
+    m->b = chip_b.stats;
+}
+
+static void bench_side(const char *side, const w5500_sim_stats *from, const w5500_sim_stats *to,
+                       uint32_t units, uint64_t payload_bytes)
+{
+    uint32_t frames = to->frames - from->frames;
+    uint64_t wire = (uint64_t)frames * 3 + (to->data_bytes - from->data_bytes);
+
+    printf("    %s %7.1f SPI transactions/op %7.3f transactions/B %6.2f SPI bytes/B\n",
+           side, (double)frames / units, (double)frames / payload_bytes, (double)wire / payload_bytes);
+}
+
+static void bench_end(const char *name, const bench_mark *m, uint32_t units, uint64_t payload_bytes)
+{
+    printf("%s (%u ops, %llu B)\n", name, units, (unsigned long long)payload_bytes);
+    bench_side("A", &m->a, &chip_a.stats, units, payload_bytes);
+    bench_side("B", &m->b, &chip_b.stats, units, payload_bytes);
+    if (chip_b.stats.rx_dropped != m->b.rx_dropped)
+        printf("    B dropped %u\n", chip_b.stats.rx_dropped - m->b.rx_dropped);
+}
+
+static void bench_chip(w5500_sim *sim, wizchip_ctx *ctx, wiz_NetInfo *netinfo)
+{
+    uint8_t size[_WIZCHIP_SOCK_NUM_] = { 2, 2, 2, 2, 2, 2, 2, 2 };
+
+    w5500_sim_init(sim, &bench_net);
+    w5500_sim_attach(sim, ctx);
+    wizchip_setctx(ctx);
+    wizchip_init(size, size);
+    wizchip_setnetinfo(netinfo);
+}
+
+/* A sends bursts of datagrams, B reads them one by one or in batches */
+static void bench_udp(uint16_t len, int batch)
+{
+    wiz_dgram dgrams[BENCH_BURST];
+    bench_mark m;
+    char name[64];
+    uint8_t addr[4];
+    uint16_t port;
+    int burst = BENCH_BUF_SIZE / (8 + len);
+    int round, i;
+    int32_t ret;
+
+    /* all of a burst fits the RX buffer of B */
+    if (burst > BENCH_BURST)
+        burst = BENCH_BURST;
+
+    wizchip_setctx(&ctx_b);
+    wiz_socket(BENCH_SOCK, Sn_MR_UDP, BENCH_UDP_PORT, 0);
+    wizchip_setctx(&ctx_a);
+    wiz_socket(BENCH_SOCK, Sn_MR_UDP, BENCH_UDP_PORT, 0);
+
+    bench_start(&m);
+    for (round = 0; round < BENCH_ROUNDS; round++)
+    {
+        wizchip_setctx(&ctx_a);
+        for (i = 0; i < burst; i++)
+            sock_sendto(BENCH_SOCK, payload, len, netinfo_b.ip, BENCH_UDP_PORT);
+
+        wizchip_setctx(&ctx_b);
+        if (batch)
+        {
+            while ((ret = sock_recvfrom_batch(BENCH_SOCK, dgrams, BENCH_BURST, rx_buf, sizeof(rx_buf))) > 0)
+                ;
+        }
+        else
+        {
+            while (getSn_RX_RSR(BENCH_SOCK) != 0)
+                sock_recvfrom(BENCH_SOCK, rx_buf, len, addr, &port);
+        }
+    }
+
+    snprintf(name, sizeof(name), "udp %4u B, B %s", len, batch ? "sock_recvfrom_batch" : "sock_recvfrom");
+    bench_end(name, &m, BENCH_ROUNDS * burst, (uint64_t)BENCH_ROUNDS * burst * len);
+
+    wizchip_setctx(&ctx_a);
+    close_socket(BENCH_SOCK);
+    wizchip_setctx(&ctx_b);
+    close_socket(BENCH_SOCK);
+}
+
+/* A streams len byte blocks to B, which reads them back in blocks of len */
+static void bench_tcp(uint16_t len)
+{
+    bench_mark m;
+    char name[64];
+    int round;
+    int32_t got;
+
+    wizchip_setctx(&ctx_b);
+    wiz_socket(BENCH_SOCK, Sn_MR_TCP, BENCH_TCP_PORT, 0);
+    sock_listen(BENCH_SOCK);
+    wizchip_setctx(&ctx_a);
+    wiz_socket(BENCH_SOCK, Sn_MR_TCP, 0, 0);
+    if (sock_connect(BENCH_SOCK, netinfo_b.ip, BENCH_TCP_PORT) != SOCK_OK)
+    {
+        printf("tcp: connect failed\n");
+        return;
+    }
+
+    bench_start(&m);
+    for (round = 0; round < BENCH_ROUNDS; round++)
+    {
+        wizchip_setctx(&ctx_a);
+        sock_send(BENCH_SOCK, payload, len);
+
+        wizchip_setctx(&ctx_b);
+        for (got = 0; got < len; )
+            got += sock_recv(BENCH_SOCK, rx_buf, len - got);
+    }
+
+    snprintf(name, sizeof(name), "tcp %4u B, sock_send/sock_recv", len);
+    bench_end(name, &m, BENCH_ROUNDS, (uint64_t)BENCH_ROUNDS * len);
+
+    wizchip_setctx(&ctx_a);
+    sock_disconnect(BENCH_SOCK);
+    wizchip_setctx(&ctx_b);
+    close_socket(BENCH_SOCK);
+}
+
+int main(int argc, char *argv[])
+{
+    static const uint16_t udp_len[] = { 16, 64, 256 };
+    static const uint16_t tcp_len[] = { 64, 512, 1460 };
+    unsigned int i;
+
+    if (argc > 1)
+        w5500_sim_spi.max_len = (uint16_t)strtoul(argv[1], NULL, 0);
+
+    for (i = 0; i < sizeof(payload); i++)
+        payload[i] = (uint8_t)i;
+
+    bench_chip(&chip_a, &ctx_a, &netinfo_a);
+    bench_chip(&chip_b, &ctx_b, &netinfo_b);
+
+    if (w5500_sim_spi.max_len)
+        printf("W5500 model, SPI frames of at most %u data bytes\n\n", w5500_sim_spi.max_len);
+    else
+        printf("W5500 model, SPI frames of any length\n\n");
+
+    for (i = 0; i < sizeof(udp_len) / sizeof(udp_len[0]); i++)
+    {
+        bench_udp(udp_len[i], 0);
+        bench_udp(udp_len[i], 1);
+    }
+    for (i = 0; i < sizeof(tcp_len) / sizeof(tcp_len[0]); i++)
+        bench_tcp(tcp_len[i]);
+
+    return 0;
+}
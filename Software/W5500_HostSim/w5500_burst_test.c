@@ -0,0 +1,321 @@
+/*
+ * Test of the burst engine of w5500.c (wizchip_burst_queue() and
+ * wizchip_burst_flush()) on the W5500 model.
+ *
+ * Buffers are written to and read from a socket's TX/RX buffer memory through
+ * WIZCHIP_WRITE_BUF, WIZCHIP_READ_BUF, wiz_send_datav() and wiz_recv_datav(),
+ * and the model's buffer memory must match them byte for byte, also where a
+ * burst crosses the end of the ring or the 16-bit offset rolls over. Every
+ * SPI frame is recorded: a burst must be split at max_len, the frames must
+ * follow each other without gap or overlap, and each carries the address of
+ * its own first byte. The backends run with and without a transaction queue;
+ * the queued one applies the frames only on flush, like the SPIM completes
+ * them after the driver queued them, and no unqueued frame may start while
+ * queued ones are outstanding. Posted register writes and
+ * wiz_send_data_queued() must reach the chip in order by the next read.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ioLibrary_Driver/Ethernet/socket.h"
+
+#include "w5500_sim.h"
+#include "host_test.h"
+
+#define TEST_SOCK       3
+#define TEST_BUF_KB     2
+#define TEST_BUF_SIZE   (TEST_BUF_KB * 1024)
+#define TEST_FRAMES_MAX (TEST_BUF_SIZE + 16)
+
+/* SPI operation mode bits of the driver's frames: variable data length
+ * (USE_VDM, _W5500_SPI_VDM_OP_ in w5500.c) */
+#define TEST_SPI_OP     0x00
+
+typedef struct {
+    uint32_t addr_sel;
+    uint8_t *rx;
+    const uint8_t *tx;
+    uint16_t len;
+} test_frame;
+
+static w5500_sim sim;
+static wizchip_ctx ctx;
+
+/* Frames of the operation under test, in the order the driver issued them */
+static test_frame frames[TEST_FRAMES_MAX];
+static unsigned int frame_count;
+/* Frames queued but not yet applied to the model */
+static unsigned int frame_applied;
+
+static void record(uint32_t AddrSel, uint8_t* rxBuf, uint8_t* txBuf, uint16_t len)
+{
+    test_frame *f;
+
+    if (frame_count == TEST_FRAMES_MAX)
+    {
+        fprintf(stderr, "too many frames\n");
+        exit(1);
+    }
+    f = &frames[frame_count++];
+    f->addr_sel = AddrSel;
+    f->rx = rxBuf;
+    f->tx = txBuf;
+    f->len = len;
+}
+
+static int test_transfer(uint32_t AddrSel, uint8_t* rxBuf, uint8_t* txBuf, uint16_t len, uint8_t use_dma)
+{
+    (void)use_dma;
+    /* the SPIM may not start a frame while queued ones are outstanding */
+    CHECKF(frame_applied == frame_count, "unqueued frame with %u queued ones outstanding",
+           frame_count - frame_applied);
+    record(AddrSel, rxBuf, txBuf, len);
+    w5500_sim_frame(&sim, AddrSel, rxBuf, txBuf, len);
+    frame_applied = frame_count;
+    return 0;
+}
+
+static int test_queue(uint32_t AddrSel, uint8_t* rxBuf, uint8_t* txBuf, uint16_t len, uint8_t use_dma)
+{
+    (void)use_dma;
+    record(AddrSel, rxBuf, txBuf, len);
+    return 0;
+}
+
+static int test_flush(void)
+{
+    test_frame *f;
+
+    for (; frame_applied < frame_count; frame_applied++)
+    {
+        f = &frames[frame_applied];
+        w5500_sim_frame(&sim, f->addr_sel, f->rx, f->tx, f->len);
+    }
+    return 0;
+}
+
+static wizchip_spi_backend backend_direct = { 0, test_transfer, NULL, NULL };
+static wizchip_spi_backend backend_queued = { 0, test_transfer, test_queue, test_flush };
+
+static uint8_t data[TEST_BUF_SIZE];
+static uint8_t back[TEST_BUF_SIZE];
+
+static void fill(uint8_t *p, uint16_t len, uint32_t seed)
+{
+    uint16_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        p[i] = (uint8_t)(seed >> 16);
+    }
+}
+
+/* The frames of one burst of len bytes starting at ptr */
+static void check_frames(const wizchip_spi_backend *spi, uint16_t ptr, uint16_t len, uint8_t ctrl,
+                         uint8_t *rx, const uint8_t *tx)
+{
+    uint16_t done = 0, expect;
+    unsigned int i;
+
+    for (i = 0; i < frame_count; i++)
+    {
+        expect = len - done;
+        if (spi->max_len && expect > spi->max_len)
+            expect = spi->max_len;
+        CHECKF(frames[i].len == expect, "max_len %u len %u frame %u: %u bytes, expected %u",
+               spi->max_len, len, i, frames[i].len, expect);
+        CHECKF((uint16_t)(frames[i].addr_sel >> 8) == (uint16_t)(ptr + done),
+               "max_len %u len %u frame %u: offset 0x%04x, expected 0x%04x", spi->max_len, len, i,
+               (unsigned)(frames[i].addr_sel >> 8), (uint16_t)(ptr + done));
+        CHECKF((uint8_t)frames[i].addr_sel == ctrl, "control 0x%02x, expected 0x%02x",
+               (uint8_t)frames[i].addr_sel, ctrl);
+        CHECK(rx == NULL || frames[i].rx == rx + done);
+        CHECK(tx == NULL || frames[i].tx == tx + done);
+        done += frames[i].len;
+        if (done >= len)
+            break;
+    }
+    CHECKF(done == len && i + 1 == frame_count, "max_len %u len %u: %u bytes in %u frames",
+           spi->max_len, len, done, frame_count);
+    CHECK(frame_applied == frame_count);
+}
+
+static void test_write(const wizchip_spi_backend *spi, uint16_t ptr, uint16_t len)
+{
+    uint32_t addr_sel = ((uint32_t)ptr << 8) + (WIZCHIP_TXBUF_BLOCK(TEST_SOCK) << 3);
+    w5500_sim_sock *s = &sim.sock[TEST_SOCK];
+    uint16_t i;
+
+    fill(data, len, ptr ^ len);
+    memset(s->tx, 0, TEST_BUF_SIZE);
+    frame_count = frame_applied = 0;
+
+    WIZCHIP_WRITE_BUF(addr_sel, data, len);
+
+    check_frames(spi, ptr, len, (uint8_t)(addr_sel | _W5500_SPI_WRITE_ | TEST_SPI_OP), NULL, data);
+    for (i = 0; i < len; i++)
+        if (s->tx[(uint16_t)(ptr + i) & (TEST_BUF_SIZE - 1)] != data[i])
+            break;
+    CHECKF(i == len, "max_len %u ptr 0x%04x len %u: TX buffer differs at byte %u",
+           spi->max_len, ptr, len, i);
+    /* nothing beside the burst was written */
+    for (i = len; i < TEST_BUF_SIZE; i++)
+        if (s->tx[(uint16_t)(ptr + i) & (TEST_BUF_SIZE - 1)] != 0)
+            break;
+    CHECKF(i == TEST_BUF_SIZE, "max_len %u ptr 0x%04x len %u: TX buffer written past the burst",
+           spi->max_len, ptr, len);
+}
+
+static void test_read(const wizchip_spi_backend *spi, uint16_t ptr, uint16_t len)
+{
+    uint32_t addr_sel = ((uint32_t)ptr << 8) + (WIZCHIP_RXBUF_BLOCK(TEST_SOCK) << 3);
+    w5500_sim_sock *s = &sim.sock[TEST_SOCK];
+    uint16_t i;
+
+    fill(s->rx, TEST_BUF_SIZE, ptr + len);
+    memset(back, 0xEE, sizeof(back));
+    frame_count = frame_applied = 0;
+
+    WIZCHIP_READ_BUF(addr_sel, back, len);
+
+    check_frames(spi, ptr, len, (uint8_t)(addr_sel | _W5500_SPI_READ_ | TEST_SPI_OP), back, NULL);
+    for (i = 0; i < len; i++)
+        if (back[i] != s->rx[(uint16_t)(ptr + i) & (TEST_BUF_SIZE - 1)])
+            break;
+    CHECKF(i == len, "max_len %u ptr 0x%04x len %u: read differs at byte %u",
+           spi->max_len, ptr, len, i);
+    for (i = len; i < sizeof(back); i++)
+        if (back[i] != 0xEE)
+            break;
+    CHECKF(i == sizeof(back), "max_len %u ptr 0x%04x len %u: read past the burst",
+           spi->max_len, ptr, len);
+}
+
+/* Scattered pieces land back to back in the ring, and come back the same way */
+static void test_iov(const wizchip_spi_backend *spi, uint16_t ptr)
+{
+    static const uint16_t sizes[] = { 1, 31, 0, 33, 64, 7, 200 };
+    wiz_iovec iov[sizeof(sizes) / sizeof(sizes[0])];
+    w5500_sim_sock *s = &sim.sock[TEST_SOCK];
+    uint16_t total = 0, i;
+    uint8_t n;
+
+    for (n = 0; n < sizeof(sizes) / sizeof(sizes[0]); n++)
+    {
+        iov[n].buf = data + total;
+        iov[n].len = sizes[n];
+        total += sizes[n];
+    }
+    fill(data, total, ptr);
+
+    /* TX_WR and RX_RD of the model start at ptr */
+    s->reg[0x24] = s->reg[0x28] = (uint8_t)(ptr >> 8);
+    s->reg[0x25] = s->reg[0x29] = (uint8_t)ptr;
+    memset(s->tx, 0, TEST_BUF_SIZE);
+    frame_count = frame_applied = 0;
+
+    wiz_send_datav(TEST_SOCK, iov, n, total);
+
+    /* the write of TX_WR may be posted, the read flushes it */
+    CHECK(getSn_TX_WR(TEST_SOCK) == (uint16_t)(ptr + total));
+    CHECK(frame_applied == frame_count);
+    for (i = 0; i < total; i++)
+        if (s->tx[(uint16_t)(ptr + i) & (TEST_BUF_SIZE - 1)] != data[i])
+            break;
+    CHECKF(i == total, "max_len %u ptr 0x%04x: wiz_send_datav differs at byte %u", spi->max_len, ptr, i);
+
+    memcpy(s->rx, s->tx, TEST_BUF_SIZE);
+    memset(back, 0, sizeof(back));
+    for (n = 0, total = 0; n < sizeof(sizes) / sizeof(sizes[0]); n++)
+    {
+        iov[n].buf = back + total;
+        total += sizes[n];
+    }
+    frame_count = frame_applied = 0;
+
+    wiz_recv_datav(TEST_SOCK, iov, n, total);
+
+    CHECK(getSn_RX_RD(TEST_SOCK) == (uint16_t)(ptr + total));
+    CHECK(frame_applied == frame_count);
+    CHECKF(memcmp(back, data, total) == 0, "max_len %u ptr 0x%04x: wiz_recv_datav differs",
+           spi->max_len, ptr);
+}
+
+/* Register writes and wiz_send_data_queued() may return with their frames
+ * queued; a read of the chip or WIZCHIP_FLUSH() applies them in order. More
+ * writes than the context keeps bytes for must not overwrite queued ones. */
+static void test_posted(const wizchip_spi_backend *spi, uint16_t ptr)
+{
+    uint32_t addr_sel = ((uint32_t)ptr << 8) + (WIZCHIP_TXBUF_BLOCK(TEST_SOCK) << 3);
+    w5500_sim_sock *s = &sim.sock[TEST_SOCK];
+    uint16_t len = 3 * WIZCHIP_SPI_POST + 5, i;
+
+    fill(data, len, ptr);
+    memset(s->tx, 0, TEST_BUF_SIZE);
+    frame_count = frame_applied = 0;
+
+    for (i = 0; i < len; i++)
+        WIZCHIP_WRITE(addr_sel + ((uint32_t)i << 8), data[i]);
+    CHECK(spi->queue == NULL || frame_applied < frame_count);
+    WIZCHIP_FLUSH();
+    CHECK(frame_applied == frame_count);
+    for (i = 0; i < len; i++)
+        if (s->tx[(uint16_t)(ptr + i) & (TEST_BUF_SIZE - 1)] != data[i])
+            break;
+    CHECKF(i == len, "max_len %u ptr 0x%04x: posted write %u differs", spi->max_len, ptr, i);
+
+    s->reg[0x24] = (uint8_t)(ptr >> 8);
+    s->reg[0x25] = (uint8_t)ptr;
+    fill(data, TEST_BUF_SIZE, ptr + 1);
+    memset(s->tx, 0, TEST_BUF_SIZE);
+    frame_count = frame_applied = 0;
+
+    wiz_send_data_queued(TEST_SOCK, data, 1000);
+    CHECK(spi->queue == NULL || frame_applied < frame_count);
+    CHECK(getSn_TX_WR(TEST_SOCK) == (uint16_t)(ptr + 1000));
+    CHECK(frame_applied == frame_count);
+    for (i = 0; i < 1000; i++)
+        if (s->tx[(uint16_t)(ptr + i) & (TEST_BUF_SIZE - 1)] != data[i])
+            break;
+    CHECKF(i == 1000, "max_len %u ptr 0x%04x: wiz_send_data_queued differs at byte %u",
+           spi->max_len, ptr, i);
+}
+
+int main(void)
+{
+    static const uint16_t max_lens[] = { 32, 0, 7, 1 };
+    static const uint16_t ptrs[] = { 0, 5, TEST_BUF_SIZE - 40, TEST_BUF_SIZE - 1, 0xFFF0, 0xFFFF };
+    static const uint16_t lens[] = { 1, 2, 31, 32, 33, 63, 64, 65, 100, 1000, TEST_BUF_SIZE };
+    wizchip_spi_backend *backends[] = { &backend_direct, &backend_queued };
+    uint8_t size[_WIZCHIP_SOCK_NUM_] = { 2, 2, 2, 2, 2, 2, 2, 2 };
+    unsigned int b, m, p, l;
+
+    w5500_sim_init(&sim, NULL);
+    w5500_sim_attach(&sim, &ctx);
+    wizchip_setctx(&ctx);
+    wizchip_init(size, size);
+
+    for (b = 0; b < sizeof(backends) / sizeof(backends[0]); b++)
+    {
+        ctx.spi = backends[b];
+        for (m = 0; m < sizeof(max_lens) / sizeof(max_lens[0]); m++)
+        {
+            backends[b]->max_len = max_lens[m];
+            for (p = 0; p < sizeof(ptrs) / sizeof(ptrs[0]); p++)
+            {
+                for (l = 0; l < sizeof(lens) / sizeof(lens[0]); l++)
+                {
+                    test_write(backends[b], ptrs[p], lens[l]);
+                    test_read(backends[b], ptrs[p], lens[l]);
+                }
+                test_iov(backends[b], ptrs[p]);
+                test_posted(backends[b], ptrs[p]);
+            }
+        }
+    }
+
+    HOST_TEST_EXIT();
+}
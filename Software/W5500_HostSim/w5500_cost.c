@@ -0,0 +1,671 @@
+/*
+ * SPI cost of the ioLibrary socket API per call, on defined workloads.
+ *
+ * Two simulated chips, A (client) and B (server), share one network and run
+ * the workloads of the RT app:
+ *
+ *  - tcp_echo: A sends a message, B echoes it through loopback_tcps();
+ *  - sntp: A sends bursts of 48 byte NTP requests, B answers them with
+ *    SNTPs_run();
+ *  - dhcp: A runs DISCOVER/OFFER and REQUEST/ACK exchanges for a set of client
+ *    MACs, B answers them with dhcps_run();
+ *  - bulk: A streams MSS sized blocks to B, which reads them with sock_recv().
+ *
+ * The calls to wiz_socket, sock_send, sock_recv, sock_sendto, sock_sendtov,
+ * sock_recvfrom, sock_recvfrom_batch, sock_peek and getSn_RX_RSR are wrapped
+ * at link time (-Wl,--wrap, see CMakeLists.txt). The SPI frames of a call are
+ * charged to it, including those of the calls it makes itself; frames spent
+ * outside of a wrapped call are charged to "other". For each call the report gives the
+ * SPI transactions, address phase bytes (3 per transaction), data phase bytes
+ * and the bus time of the W5500 model, which is what the call takes on the
+ * MT3620 apart from the M4's own cycles; the host's run time means nothing
+ * for the board and is not reported.
+ *
+ * Usage: w5500_cost [-m max_len] [-k spi_khz] [-o frame_ns] [-n rounds] [-j report.json]
+ *
+ * The report is printed as text; -j also writes it as JSON ("-" for stdout),
+ * so two runs can be compared by a script.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ioLibrary_Driver/Ethernet/socket.h"
+#include "ioLibrary_Driver/Application/loopback/loopback.h"
+#include "ioLibrary_Driver/Internet/SNTP/sntps.h"
+#include "ioLibrary_Driver/Internet/DHCP/dhcps.h"
+
+#include "w5500_sim.h"
+
+#define COST_ROUNDS         64
+
+#define COST_ECHO_SOCK      1
+#define COST_ECHO_PORT      5000
+#define COST_SNTP_SOCK      2
+#define COST_SNTP_PORT      5123    /* client side */
+#define COST_DHCP_SOCK      3
+#define COST_DHCP_CLIENTS   32
+#define COST_BULK_SOCK      4
+#define COST_BULK_PORT      5001
+#define COST_BULK_LEN       1460
+
+#define COST_BUF_SIZE       2048
+
+/* Wrapped calls, in report order */
+enum {
+    COST_WIZ_SOCKET,
+    COST_SOCK_SEND,
+    COST_SOCK_RECV,
+    COST_SOCK_SENDTO,
+    COST_SOCK_SENDTOV,
+    COST_SOCK_RECVFROM,
+    COST_SOCK_RECVFROM_BATCH,
+    COST_SOCK_PEEK,
+    COST_GETSN_RX_RSR,
+    COST_OTHER,
+    COST_API_NUM
+};
+
+static const char *const cost_api_name[COST_API_NUM] = {
+    "wiz_socket",
+    "sock_send",
+    "sock_recv",
+    "sock_sendto",
+    "sock_sendtov",
+    "sock_recvfrom",
+    "sock_recvfrom_batch",
+    "sock_peek",
+    "getSn_RX_RSR",
+    "other",
+};
+
+typedef struct {
+    uint32_t calls;
+    uint32_t frames;
+    uint64_t data_bytes;
+    uint64_t bus_ns;
+} cost_entry;
+
+#define COST_CHIPS  2
+
+typedef struct {
+    const char *name;
+    uint32_t ops;
+    uint64_t payload_bytes;
+    uint32_t rx_dropped;
+    cost_entry total[COST_CHIPS];
+    cost_entry api[COST_CHIPS][COST_API_NUM];
+} cost_result;
+
+#define COST_WORKLOADS  8
+
+static cost_result results[COST_WORKLOADS];
+static int result_num;
+static cost_result *cost_cur;       /* workload being measured, NULL between workloads */
+
+static w5500_sim_net cost_net;
+static w5500_sim chips[COST_CHIPS];
+static wizchip_ctx ctxs[COST_CHIPS];
+static const char chip_name[COST_CHIPS] = { 'A', 'B' };
+#define chip_a  (&ctxs[0])
+#define chip_b  (&ctxs[1])
+
+static wiz_NetInfo netinfo[COST_CHIPS] = {
+    {
+        .mac = { 0x00, 0x08, 0xDC, 0x00, 0x00, 0x0A },
+        .ip = { 192, 168, 50, 10 },
+        .sn = { 255, 255, 255, 0 },
+        .gw = { 192, 168, 50, 1 },
+        .dhcp = NETINFO_STATIC,
+    },
+    {
+        .mac = { 0x00, 0x08, 0xDC, 0x00, 0x00, 0x0B },
+        .ip = { 192, 168, 50, 20 },
+        .sn = { 255, 255, 255, 0 },
+        .gw = { 192, 168, 50, 1 },
+        .dhcp = NETINFO_STATIC,
+    },
+};
+
+static uint32_t rounds = COST_ROUNDS;
+static uint8_t payload[COST_BUF_SIZE];
+static uint8_t rx_buf[COST_BUF_SIZE];
+static uint8_t echo_buf[DATA_BUF_SIZE + 1];    /* loopback_tcps() terminates the data */
+static uint8_t sntp_buf[SNTPS_BUF_SIZE];
+static dhcps_msg dhcp_buf;
+
+/*
+ * Charging the wrapped calls
+ */
+
+static int cost_depth;
+static int cost_chip;
+static w5500_sim_stats cost_enter_stats;
+
+static int cost_chip_of(const wizchip_ctx *ctx)
+{
+    return ctx == chip_a ? 0 : 1;
+}
+
+static void cost_add(cost_entry *e, const w5500_sim_stats *from, const w5500_sim_stats *to)
+{
+    e->frames += to->frames - from->frames;
+    e->data_bytes += to->data_bytes - from->data_bytes;
+    e->bus_ns += to->bus_ns - from->bus_ns;
+}
+
+static void cost_enter(void)
+{
+    if (cost_depth++ == 0)
+    {
+        cost_chip = cost_chip_of(WIZCHIP_CTX);
+        cost_enter_stats = chips[cost_chip].stats;
+    }
+}
+
+static void cost_leave(int api)
+{
+    cost_entry *e;
+
+    if (--cost_depth != 0 || cost_cur == NULL)
+        return;
+
+    e = &cost_cur->api[cost_chip][api];
+    e->calls++;
+    cost_add(e, &cost_enter_stats, &chips[cost_chip].stats);
+}
+
+#define COST_WRAP(type, name, api, params, args)    \
+    type __real_##name params;                      \
+    type __wrap_##name params;                      \
+    type __wrap_##name params                       \
+    {                                               \
+        type ret;                                   \
+        cost_enter();                               \
+        ret = __real_##name args;                   \
+        cost_leave(api);                            \
+        return ret;                                 \
+    }
+
+COST_WRAP(int8_t, wiz_socket, COST_WIZ_SOCKET,
+          (uint8_t sn, uint8_t protocol, uint16_t port, uint8_t flag), (sn, protocol, port, flag))
+COST_WRAP(int32_t, sock_send, COST_SOCK_SEND,
+          (uint8_t sn, uint8_t *buf, uint16_t len), (sn, buf, len))
+COST_WRAP(int32_t, sock_recv, COST_SOCK_RECV,
+          (uint8_t sn, uint8_t *buf, uint16_t len), (sn, buf, len))
+COST_WRAP(int32_t, sock_sendto, COST_SOCK_SENDTO,
+          (uint8_t sn, uint8_t *buf, uint16_t len, uint8_t *addr, uint16_t port), (sn, buf, len, addr, port))
+COST_WRAP(int32_t, sock_sendtov, COST_SOCK_SENDTOV,
+          (uint8_t sn, const wiz_iovec *iov, uint8_t iovcnt, uint8_t *addr, uint16_t port), (sn, iov, iovcnt, addr, port))
+COST_WRAP(int32_t, sock_recvfrom, COST_SOCK_RECVFROM,
+          (uint8_t sn, uint8_t *buf, uint16_t len, uint8_t *addr, uint16_t *port), (sn, buf, len, addr, port))
+COST_WRAP(int32_t, sock_recvfrom_batch, COST_SOCK_RECVFROM_BATCH,
+          (uint8_t sn, wiz_dgram *dgrams, uint8_t count, uint8_t *buf, uint16_t size), (sn, dgrams, count, buf, size))
+COST_WRAP(int32_t, sock_peek, COST_SOCK_PEEK,
+          (uint8_t sn, uint8_t *buf, uint16_t offset, uint16_t len), (sn, buf, offset, len))
+COST_WRAP(uint16_t, getSn_RX_RSR, COST_GETSN_RX_RSR,
+          (uint8_t sn), (sn))
+
+/* The printf of the BSP used by loopback.c, sntps.c and dhcps.c; their
+ * progress messages are not part of the report. */
+void _putchar(char character)
+{
+    (void)character;
+}
+
+static w5500_sim_stats cost_start_stats[COST_CHIPS];
+
+static void cost_start(const char *name)
+{
+    int c;
+
+    cost_cur = &results[result_num++];
+    memset(cost_cur, 0, sizeof(*cost_cur));
+    cost_cur->name = name;
+    for (c = 0; c < COST_CHIPS; c++)
+        cost_start_stats[c] = chips[c].stats;
+}
+
+static void cost_end(uint32_t ops, uint64_t payload_bytes)
+{
+    cost_entry *other;
+    int c, api;
+
+    cost_cur->ops = ops;
+    cost_cur->payload_bytes = payload_bytes;
+    for (c = 0; c < COST_CHIPS; c++)
+    {
+        cost_add(&cost_cur->total[c], &cost_start_stats[c], &chips[c].stats);
+        cost_cur->rx_dropped += chips[c].stats.rx_dropped - cost_start_stats[c].rx_dropped;
+
+        other = &cost_cur->api[c][COST_OTHER];
+        *other = cost_cur->total[c];
+        for (api = 0; api < COST_OTHER; api++)
+        {
+            other->frames -= cost_cur->api[c][api].frames;
+            other->data_bytes -= cost_cur->api[c][api].data_bytes;
+            other->bus_ns -= cost_cur->api[c][api].bus_ns;
+        }
+    }
+    cost_cur = NULL;
+}
+
+/*
+ * Workloads; each one is measured from opening its sockets to closing them.
+ */
+
+static void cost_tcp_echo(const char *name, uint16_t len)
+{
+    uint32_t round;
+    int32_t got, ret;
+    int i;
+
+    cost_start(name);
+
+    wizchip_setctx(chip_b);
+    for (i = 0; i < 2 && getSn_SR(COST_ECHO_SOCK) != SOCK_LISTEN; i++)
+        loopback_tcps(COST_ECHO_SOCK, echo_buf, COST_ECHO_PORT);
+
+    wizchip_setctx(chip_a);
+    wiz_socket(COST_ECHO_SOCK, Sn_MR_TCP, 0, 0);
+    if (sock_connect(COST_ECHO_SOCK, netinfo[1].ip, COST_ECHO_PORT) != SOCK_OK)
+    {
+        fprintf(stderr, "%s: connect failed\n", name);
+        exit(1);
+    }
+
+    for (round = 0; round < rounds; round++)
+    {
+        wizchip_setctx(chip_a);
+        sock_send(COST_ECHO_SOCK, payload, len);
+
+        wizchip_setctx(chip_b);
+        loopback_tcps(COST_ECHO_SOCK, echo_buf, COST_ECHO_PORT);
+
+        wizchip_setctx(chip_a);
+        for (got = 0; got < len; got += ret)
+        {
+            if (getSn_RX_RSR(COST_ECHO_SOCK) == 0)
+                break;
+            if ((ret = sock_recv(COST_ECHO_SOCK, rx_buf, len - got)) <= 0)
+                break;
+        }
+        if (got != len)
+        {
+            fprintf(stderr, "%s: echo %d of %u bytes\n", name, got, len);
+            exit(1);
+        }
+    }
+
+    wizchip_setctx(chip_a);
+    sock_disconnect(COST_ECHO_SOCK);
+    wizchip_setctx(chip_b);
+    loopback_tcps(COST_ECHO_SOCK, echo_buf, COST_ECHO_PORT);
+    close_socket(COST_ECHO_SOCK);
+
+    cost_end(rounds, (uint64_t)rounds * len * 2);
+}
+
+static void cost_sntp(const char *name, uint8_t burst)
+{
+    uint8_t req[48];
+    uint8_t server[4] = { 192, 168, 50, 20 };
+    uint8_t addr[4];
+    uint16_t port;
+    uint32_t round, answered = 0;
+    uint8_t i;
+
+    memset(req, 0, sizeof(req));
+    req[0] = 0x23;      /* LI 0, version 4, mode 3 (client) */
+
+    cost_start(name);
+
+    wizchip_setctx(chip_b);
+    SNTPs_init(COST_SNTP_SOCK, sntp_buf);
+    SNTPs_run();        /* opens the socket */
+    wizchip_setctx(chip_a);
+    wiz_socket(COST_SNTP_SOCK, Sn_MR_UDP, COST_SNTP_PORT, 0);
+
+    for (round = 0; round < rounds; round++)
+    {
+        wizchip_setctx(chip_a);
+        for (i = 0; i < burst; i++)
+            sock_sendto(COST_SNTP_SOCK, req, sizeof(req), server, ntp_port);
+
+        wizchip_setctx(chip_b);
+        while (SNTPs_run() > 0)
+            ;
+
+        wizchip_setctx(chip_a);
+        while (getSn_RX_RSR(COST_SNTP_SOCK) != 0)
+            if (sock_recvfrom(COST_SNTP_SOCK, rx_buf, sizeof(rx_buf), addr, &port) == sizeof(req))
+                answered++;
+    }
+
+    if (answered != rounds * burst)
+    {
+        fprintf(stderr, "%s: %u of %u requests answered\n", name, answered, rounds * burst);
+        exit(1);
+    }
+
+    wizchip_setctx(chip_a);
+    close_socket(COST_SNTP_SOCK);
+    wizchip_setctx(chip_b);
+    close_socket(COST_SNTP_SOCK);
+
+    cost_end(rounds * burst, (uint64_t)rounds * burst * sizeof(req) * 2);
+}
+
+/* Builds a client message in msg, returns its length. */
+static uint16_t cost_dhcp_msg(dhcps_msg *msg, uint8_t client, uint8_t type, const uint8_t *yiaddr)
+{
+    uint8_t *opt = msg->options;
+
+    memset(msg, 0, sizeof(*msg));
+    msg->op = DHCP_MESSAGE_OP_REQUEST;
+    msg->htype = DHCP_MESSAGE_HTYPE;
+    msg->hlen = DHCP_MESSAGE_HLEN;
+    msg->xid[3] = client;
+    msg->chaddr[0] = 0x02;
+    msg->chaddr[5] = client;
+
+    memcpy(opt, dhcp_magic_cookie, sizeof(dhcp_magic_cookie));
+    opt += sizeof(dhcp_magic_cookie);
+    *opt++ = DHCP_OPTION_CODE_MSG_TYPE;
+    *opt++ = 1;
+    *opt++ = type;
+    if (yiaddr)
+    {
+        *opt++ = DHCP_OPTION_CODE_REQUEST_IP_ADDRESS;
+        *opt++ = 4;
+        memcpy(opt, yiaddr, 4);
+        opt += 4;
+        *opt++ = DHCP_OPTION_CODE_SERVER_ID;
+        *opt++ = 4;
+        memcpy(opt, netinfo[1].ip, 4);
+        opt += 4;
+    }
+    *opt++ = DHCP_OPTION_CODE_END;
+
+    /* a BOOTP message is at least 300 bytes */
+    if (opt - (uint8_t *)msg < DHCPS_MIN_REPLY_LEN)
+        return DHCPS_MIN_REPLY_LEN;
+    return (uint16_t)(opt - (uint8_t *)msg);
+}
+
+/* One message from A and the reply of B; returns the reply length. */
+static int32_t cost_dhcp_exchange(dhcps_msg *msg, uint16_t len)
+{
+    uint8_t bcast[4] = { 255, 255, 255, 255 };
+    uint8_t addr[4];
+    uint16_t port;
+
+    wizchip_setctx(chip_a);
+    sock_sendto(COST_DHCP_SOCK, (uint8_t *)msg, len, bcast, DHCP_SERVER_PORT);
+
+    wizchip_setctx(chip_b);
+    dhcps_time_handler();       /* one rate window per exchange */
+    dhcps_run();
+
+    wizchip_setctx(chip_a);
+    if (getSn_RX_RSR(COST_DHCP_SOCK) == 0)
+        return 0;
+    return sock_recvfrom(COST_DHCP_SOCK, (uint8_t *)msg, sizeof(*msg), addr, &port);
+}
+
+static void cost_dhcp(const char *name)
+{
+    dhcps_msg msg;
+    uint8_t yiaddr[4];
+    uint32_t round, acked = 0;
+    uint64_t bytes = 0;
+    uint8_t client;
+    uint16_t len;
+    int32_t ret;
+
+    cost_start(name);
+
+    wizchip_setctx(chip_b);
+    dhcps_init(COST_DHCP_SOCK, (uint8_t *)&dhcp_buf);
+    dhcps_run();        /* opens the socket */
+    wizchip_setctx(chip_a);
+    wiz_socket(COST_DHCP_SOCK, Sn_MR_UDP, DHCP_CLIENT_PORT, 0);
+
+    for (round = 0; round < rounds; round++)
+    {
+        client = (uint8_t)(1 + round % COST_DHCP_CLIENTS);
+
+        len = cost_dhcp_msg(&msg, client, DHCP_MESSAGE_TYPE_DISCOVER, NULL);
+        bytes += len;
+        if ((ret = cost_dhcp_exchange(&msg, len)) <= 0 || msg.op != DHCP_MESSAGE_OP_REPLY)
+            break;
+        bytes += ret;
+        memcpy(yiaddr, msg.yiaddr, sizeof(yiaddr));
+
+        len = cost_dhcp_msg(&msg, client, DHCP_MESSAGE_TYPE_REQUEST, yiaddr);
+        bytes += len;
+        if ((ret = cost_dhcp_exchange(&msg, len)) <= 0 || msg.op != DHCP_MESSAGE_OP_REPLY)
+            break;
+        bytes += ret;
+        acked++;
+    }
+
+    if (acked != rounds)
+    {
+        fprintf(stderr, "%s: %u of %u exchanges completed\n", name, acked, rounds);
+        exit(1);
+    }
+
+    wizchip_setctx(chip_a);
+    close_socket(COST_DHCP_SOCK);
+    wizchip_setctx(chip_b);
+    close_socket(COST_DHCP_SOCK);
+
+    cost_end(rounds, bytes);
+}
+
+static void cost_bulk(const char *name, uint16_t len)
+{
+    uint32_t round;
+    int32_t got, ret;
+
+    cost_start(name);
+
+    wizchip_setctx(chip_b);
+    wiz_socket(COST_BULK_SOCK, Sn_MR_TCP, COST_BULK_PORT, 0);
+    sock_listen(COST_BULK_SOCK);
+    wizchip_setctx(chip_a);
+    wiz_socket(COST_BULK_SOCK, Sn_MR_TCP, 0, 0);
+    if (sock_connect(COST_BULK_SOCK, netinfo[1].ip, COST_BULK_PORT) != SOCK_OK)
+    {
+        fprintf(stderr, "%s: connect failed\n", name);
+        exit(1);
+    }
+
+    for (round = 0; round < rounds; round++)
+    {
+        wizchip_setctx(chip_a);
+        sock_send(COST_BULK_SOCK, payload, len);
+
+        wizchip_setctx(chip_b);
+        for (got = 0; got < len; got += ret)
+            if ((ret = sock_recv(COST_BULK_SOCK, rx_buf, sizeof(rx_buf))) <= 0)
+                break;
+    }
+
+    wizchip_setctx(chip_a);
+    sock_disconnect(COST_BULK_SOCK);
+    wizchip_setctx(chip_b);
+    close_socket(COST_BULK_SOCK);
+
+    cost_end(rounds, (uint64_t)rounds * len);
+}
+
+/*
+ * Report
+ */
+
+static void report_text(FILE *f, uint16_t max_len)
+{
+    const cost_result *r;
+    const cost_entry *e;
+    int i, c, api;
+
+    fprintf(f, "W5500 model: SPI %u kHz, %u ns per transaction, frames of %u data bytes at most (0: any)\n",
+            chips[0].timing.spi_khz, chips[0].timing.frame_ns, max_len);
+
+    for (i = 0; i < result_num; i++)
+    {
+        r = &results[i];
+        fprintf(f, "\n%s: %u ops, %llu payload bytes", r->name, r->ops, (unsigned long long)r->payload_bytes);
+        if (r->rx_dropped)
+            fprintf(f, ", %u dropped", r->rx_dropped);
+        fprintf(f, "\n");
+        for (c = 0; c < COST_CHIPS; c++)
+        {
+            e = &r->total[c];
+            fprintf(f, "  %c total %8u frames %8.1f frames/op %10.1f us %8.2f us/op\n", chip_name[c],
+                    e->frames, (double)e->frames / r->ops, e->bus_ns / 1000.0, e->bus_ns / 1000.0 / r->ops);
+            for (api = 0; api < COST_API_NUM; api++)
+            {
+                e = &r->api[c][api];
+                if (e->frames == 0 && e->calls == 0)
+                    continue;
+                fprintf(f, "    %-20s %6u calls %8u frames %8llu addr B %8llu data B %10.1f us",
+                        cost_api_name[api], e->calls, e->frames, (unsigned long long)e->frames * 3,
+                        (unsigned long long)e->data_bytes, e->bus_ns / 1000.0);
+                if (e->calls)
+                    fprintf(f, " %6.1f frames/call %7.2f us/call", (double)e->frames / e->calls,
+                            e->bus_ns / 1000.0 / e->calls);
+                fprintf(f, "\n");
+            }
+        }
+    }
+}
+
+static void report_entry(FILE *f, const cost_entry *e, int calls)
+{
+    fprintf(f, "{");
+    if (calls)
+        fprintf(f, "\"calls\": %u, ", e->calls);
+    fprintf(f, "\"frames\": %u, \"addr_bytes\": %llu, \"data_bytes\": %llu, \"bus_us\": %.3f}",
+            e->frames, (unsigned long long)e->frames * 3, (unsigned long long)e->data_bytes, e->bus_ns / 1000.0);
+}
+
+static void report_json(FILE *f, uint16_t max_len)
+{
+    const cost_result *r;
+    int i, c, api;
+
+    fprintf(f, "{\n  \"model\": {\"spi_khz\": %u, \"frame_ns\": %u, \"max_len\": %u, \"rounds\": %u},\n",
+            chips[0].timing.spi_khz, chips[0].timing.frame_ns, max_len, rounds);
+    fprintf(f, "  \"workloads\": [\n");
+    for (i = 0; i < result_num; i++)
+    {
+        r = &results[i];
+        fprintf(f, "    {\"name\": \"%s\", \"ops\": %u, \"payload_bytes\": %llu, \"rx_dropped\": %u, \"chips\": {\n",
+                r->name, r->ops, (unsigned long long)r->payload_bytes, r->rx_dropped);
+        for (c = 0; c < COST_CHIPS; c++)
+        {
+            fprintf(f, "      \"%c\": {\"total\": ", chip_name[c]);
+            report_entry(f, &r->total[c], 0);
+            fprintf(f, ", \"api\": {\n");
+            for (api = 0; api < COST_API_NUM; api++)
+            {
+                fprintf(f, "        \"%s\": ", cost_api_name[api]);
+                report_entry(f, &r->api[c][api], api != COST_OTHER);
+                fprintf(f, "%s\n", api + 1 < COST_API_NUM ? "," : "");
+            }
+            fprintf(f, "      }}%s\n", c + 1 < COST_CHIPS ? "," : "");
+        }
+        fprintf(f, "    }}%s\n", i + 1 < result_num ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+static void cost_chip_init(int c)
+{
+    uint8_t size[_WIZCHIP_SOCK_NUM_] = { 2, 2, 2, 2, 2, 2, 2, 2 };
+
+    w5500_sim_init(&chips[c], &cost_net);
+    w5500_sim_attach(&chips[c], &ctxs[c]);
+    wizchip_setctx(&ctxs[c]);
+    wizchip_init(size, size);
+    wizchip_setnetinfo(&netinfo[c]);
+}
+
+int main(int argc, char *argv[])
+{
+    w5500_sim_timing timing = { W5500_SIM_SPI_KHZ, W5500_SIM_FRAME_NS };
+    const char *json = NULL;
+    FILE *f;
+    unsigned int i;
+    int opt, c;
+
+    while ((opt = getopt(argc, argv, "m:k:o:n:j:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'm':
+            w5500_sim_spi.max_len = (uint16_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'k':
+            timing.spi_khz = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'o':
+            timing.frame_ns = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            rounds = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'j':
+            json = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-m max_len] [-k spi_khz] [-o frame_ns] [-n rounds] [-j report.json]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    if (rounds == 0 || timing.spi_khz == 0)
+    {
+        fprintf(stderr, "%s: rounds and spi_khz must not be 0\n", argv[0]);
+        return 2;
+    }
+
+    for (i = 0; i < sizeof(payload); i++)
+        payload[i] = (uint8_t)i;
+
+    for (c = 0; c < COST_CHIPS; c++)
+    {
+        cost_chip_init(c);
+        chips[c].timing = timing;
+    }
+
+    cost_tcp_echo("tcp_echo_64", 64);
+    cost_tcp_echo("tcp_echo_1024", 1024);
+    cost_sntp("sntp_single", 1);
+    cost_sntp("sntp_burst_8", 8);
+    cost_dhcp("dhcp_discover_request");
+    cost_bulk("bulk_tcp_1460", COST_BULK_LEN);
+
+    report_text(stdout, w5500_sim_spi.max_len);
+
+    if (json)
+    {
+        f = strcmp(json, "-") == 0 ? stdout : fopen(json, "w");
+        if (f == NULL)
+        {
+            perror(json);
+            return 1;
+        }
+        report_json(f, w5500_sim_spi.max_len);
+        if (f != stdout)
+            fclose(f);
+    }
+
+    return 0;
+}
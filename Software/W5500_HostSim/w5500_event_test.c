@@ -0,0 +1,382 @@
+/*
+ * Test of the RT app's W5500 event dispatcher (w5500_event.c) on the model.
+ *
+ * Chip A is served by the dispatcher, chip B plays the network. The INTn line
+ * of A is sampled after every SPI frame of either chip, and a falling edge
+ * calls w5500_evt_signal() like the EINT handler does on the board; INTn is
+ * edge-triggered, so an event raised while the line is already low gives no
+ * new signal.
+ *
+ * A runs UDP sockets 1, 4 and 6, which read every datagram, and a TCP echo
+ * server on socket 2, which answers with the blocking sock_send() and so
+ * leaves SENDOK (masked) set in Sn_IR. Checked are: every socket gets
+ * opened, events reach the right handler, an event raised behind the
+ * dispatcher's back while INTn stays low is served on the next dispatch
+ * (the re-arm after the dispatch pass), the dispatcher goes idle when
+ * only masked Sn_IR bits are left, and a parked socket is left alone until
+ * it is unparked.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ioLibrary_Driver/Ethernet/socket.h"
+
+#include "w5500_event.h"
+#include "w5500_sim.h"
+#include "host_test.h"
+
+#define TEST_UDP_PORT       7000    /* + socket number on A */
+#define TEST_TCP_PORT       7100
+#define TEST_TCP_SOCK       2
+#define TEST_PEER_SOCK      1       /* UDP on B */
+#define TEST_PEER_TCP_SOCK  2
+#define TEST_PASSES_MAX     16      /* dispatch passes for the chip to go idle */
+
+static w5500_sim_net test_net;
+static w5500_sim chip_a, chip_b;
+static wizchip_ctx ctx_a, ctx_b;
+
+static wiz_NetInfo netinfo_a = {
+    .mac = { 0x00, 0x08, 0xDC, 0x00, 0x00, 0x0A },
+    .ip = { 192, 168, 50, 10 },
+    .sn = { 255, 255, 255, 0 },
+    .gw = { 192, 168, 50, 1 },
+    .dhcp = NETINFO_STATIC,
+};
+static wiz_NetInfo netinfo_b = {
+    .mac = { 0x00, 0x08, 0xDC, 0x00, 0x00, 0x0B },
+    .ip = { 192, 168, 50, 20 },
+    .sn = { 255, 255, 255, 0 },
+    .gw = { 192, 168, 50, 1 },
+    .dhcp = NETINFO_STATIC,
+};
+
+/* INTn of A as last sampled, and its falling edges */
+static int intn_level = 1;
+static unsigned int intn_edges;
+
+typedef struct {
+    unsigned int calls;
+    unsigned int events;        /* calls with ir != 0 */
+    uint8_t ir;                 /* every ir passed */
+    unsigned int datagrams;
+    uint32_t bytes;
+    void (*hook)(void);         /* run once at the end of the next call */
+    int full;                   /* leave RX data unread and park */
+} test_sock;
+
+static test_sock socks[_WIZCHIP_SOCK_NUM_];
+static uint8_t buf[2048];
+
+static void intn_sample(void)
+{
+    int level = w5500_sim_intn(&chip_a);
+
+    if (intn_level && !level)
+    {
+        intn_edges++;
+        w5500_evt_signal(0);
+    }
+    intn_level = level;
+}
+
+static int test_transfer(uint32_t AddrSel, uint8_t* rxBuf, uint8_t* txBuf, uint16_t len, uint8_t use_dma)
+{
+    (void)use_dma;
+    w5500_sim_frame((w5500_sim *)WIZCHIP_CTX->spi_config, AddrSel, rxBuf, txBuf, len);
+    intn_sample();
+    return 0;
+}
+
+static wizchip_spi_backend test_spi = { W5500_SIM_SPI_MAX_LEN, test_transfer, NULL, NULL };
+
+static void test_chip(w5500_sim *sim, wizchip_ctx *ctx, wiz_NetInfo *netinfo)
+{
+    uint8_t size[_WIZCHIP_SOCK_NUM_] = { 2, 2, 2, 2, 2, 2, 2, 2 };
+
+    w5500_sim_init(sim, &test_net);
+    w5500_sim_attach(sim, ctx);
+    ctx->spi = &test_spi;
+    wizchip_setctx(ctx);
+    wizchip_init(size, size);
+    wizchip_setnetinfo(netinfo);
+}
+
+static void test_called(uint8_t sn, uint8_t ir)
+{
+    socks[sn].calls++;
+    if (ir)
+        socks[sn].events++;
+    socks[sn].ir |= ir;
+}
+
+static void test_hook(uint8_t sn)
+{
+    void (*hook)(void) = socks[sn].hook;
+
+    socks[sn].hook = NULL;
+    if (hook)
+        hook();
+}
+
+static void udp_handler(uint8_t sn, uint8_t ir)
+{
+    uint8_t addr[4];
+    uint16_t port;
+    int32_t ret;
+
+    test_called(sn, ir);
+
+    if (getSn_SR(sn) == SOCK_CLOSED)
+    {
+        wiz_socket(sn, Sn_MR_UDP, TEST_UDP_PORT + sn, 0);
+        return;
+    }
+    if (socks[sn].full)
+    {
+        w5500_evt_park(sn);
+        return;
+    }
+    while (getSn_RX_RSR(sn) != 0)
+    {
+        ret = sock_recvfrom(sn, buf, sizeof(buf), addr, &port);
+        if (ret <= 0)
+            break;
+        socks[sn].datagrams++;
+        socks[sn].bytes += ret;
+    }
+    test_hook(sn);
+}
+
+static void tcp_handler(uint8_t sn, uint8_t ir)
+{
+    int32_t ret;
+
+    test_called(sn, ir);
+
+    switch (getSn_SR(sn))
+    {
+    case SOCK_CLOSED:
+        wiz_socket(sn, Sn_MR_TCP, TEST_TCP_PORT, 0);
+        break;
+    case SOCK_INIT:
+        sock_listen(sn);
+        break;
+    case SOCK_ESTABLISHED:
+        while (getSn_RX_RSR(sn) != 0)
+        {
+            ret = sock_recv(sn, buf, sizeof(buf));
+            if (ret <= 0)
+                break;
+            socks[sn].bytes += ret;
+            sock_send(sn, buf, (uint16_t)ret);
+        }
+        break;
+    case SOCK_CLOSE_WAIT:
+        sock_disconnect(sn);
+        break;
+    default:
+        break;
+    }
+}
+
+/* B sends a datagram of len bytes to UDP socket sn of A */
+static void peer_send(uint8_t sn, uint16_t len)
+{
+    wizchip_ctx *prev = wizchip_setctx(&ctx_b);
+
+    memset(buf, sn, len);
+    sock_sendto(TEST_PEER_SOCK, buf, len, netinfo_a.ip, TEST_UDP_PORT + sn);
+    wizchip_setctx(prev);
+}
+
+static void peer_send_1(void)
+{
+    peer_send(1, 10);
+}
+
+/* Dispatch until the dispatcher has nothing left to do; returns the passes */
+static unsigned int settle(void)
+{
+    unsigned int passes = 0;
+
+    while (w5500_evt_pending() && passes < TEST_PASSES_MAX)
+    {
+        w5500_evt_dispatch();
+        passes++;
+    }
+    return passes;
+}
+
+static void test_open(void)
+{
+    uint8_t sr;
+
+    wizchip_setctx(&ctx_a);
+    w5500_evt_init();
+    CHECK(w5500_evt_attach(0, &ctx_a) == 0);
+    CHECK(w5500_evt_register(W5500_EVT_SID(0, 1), udp_handler) == 0);
+    CHECK(w5500_evt_register(W5500_EVT_SID(0, 4), udp_handler) == 0);
+    CHECK(w5500_evt_register(W5500_EVT_SID(0, 6), udp_handler) == 0);
+    CHECK(w5500_evt_register(W5500_EVT_SID(0, TEST_TCP_SOCK), tcp_handler) == 0);
+    CHECK(w5500_evt_pending());
+
+    CHECK(settle() < TEST_PASSES_MAX);
+    CHECK(!w5500_evt_pending());
+
+    wizchip_setctx(&ctx_a);
+    CHECK(getSn_SR(1) == SOCK_UDP);
+    CHECK(getSn_SR(4) == SOCK_UDP);
+    CHECK(getSn_SR(6) == SOCK_UDP);
+    sr = getSn_SR(TEST_TCP_SOCK);
+    CHECKF(sr == SOCK_LISTEN, "TCP socket in state 0x%02x", sr);
+    CHECK(getSn_SR(0) == SOCK_CLOSED);
+    CHECK(socks[0].calls == 0);
+
+    wizchip_setctx(&ctx_b);
+    wiz_socket(TEST_PEER_SOCK, Sn_MR_UDP, TEST_UDP_PORT, 0);
+}
+
+/* One datagram: one edge, and the handler of its socket called with RECV.
+ * The RECV command after the datagram's header raises RECV again while the
+ * data is unread, so there may be more calls. */
+static void test_event(void)
+{
+    test_sock before = socks[4];
+    unsigned int edges = intn_edges;
+
+    peer_send(4, 100);
+    CHECK(intn_edges == edges + 1);
+    CHECK(!intn_level);
+    CHECK(w5500_evt_pending());
+
+    CHECK(settle() < TEST_PASSES_MAX);
+    CHECK(socks[4].events > before.events);
+    CHECK(socks[4].ir & Sn_IR_RECV);
+    CHECK(socks[4].datagrams == before.datagrams + 1);
+    CHECK(socks[4].bytes == before.bytes + 100);
+    CHECK(socks[1].datagrams == 0 && socks[6].datagrams == 0);
+    CHECK(intn_level);
+}
+
+/* Sockets 1, 4 and 6 are flagged together. The handler of 4 has a datagram
+ * sent to 1, whose Sn_IR was cleared already; 6 keeps INTn low meanwhile and
+ * 1 then keeps it low after 6 is cleared, so no edge tells about it. It must
+ * be served all the same. */
+static void test_rearm(void)
+{
+    unsigned int d1 = socks[1].datagrams, d4 = socks[4].datagrams, d6 = socks[6].datagrams;
+    unsigned int edges = intn_edges;
+
+    peer_send(1, 10);
+    peer_send(4, 20);
+    peer_send(6, 30);
+    CHECK(intn_edges == edges + 1);
+
+    socks[4].hook = peer_send_1;
+    edges = intn_edges;
+    w5500_evt_dispatch();
+
+    CHECK(socks[1].datagrams == d1 + 1);
+    CHECK(socks[4].datagrams == d4 + 1);
+    CHECK(socks[6].datagrams == d6 + 1);
+    CHECK(socks[4].hook == NULL);
+    CHECK(intn_edges == edges);
+    CHECK(!intn_level);
+    CHECK(w5500_evt_pending());
+
+    CHECK(settle() < TEST_PASSES_MAX);
+    CHECK(socks[1].datagrams == d1 + 2);
+    CHECK(intn_level);
+}
+
+/* The echo server's blocking sock_send() leaves SENDOK set in Sn_IR. It is
+ * masked, so INTn stays high, but SIR flags the socket: the dispatcher must
+ * not take it for an event and go idle. */
+static void test_masked(void)
+{
+    static const char ping[] = "ping";
+    uint8_t echo[sizeof(ping)];
+    unsigned int calls, round;
+    int32_t got;
+
+    wizchip_setctx(&ctx_b);
+    wiz_socket(TEST_PEER_TCP_SOCK, Sn_MR_TCP, 0, 0);
+    CHECK(sock_connect(TEST_PEER_TCP_SOCK, netinfo_a.ip, TEST_TCP_PORT) == SOCK_OK);
+    CHECK(settle() < TEST_PASSES_MAX);
+    CHECK(socks[TEST_TCP_SOCK].ir & Sn_IR_CON);
+
+    for (round = 0; round < 3; round++)
+    {
+        wizchip_setctx(&ctx_b);
+        sock_send(TEST_PEER_TCP_SOCK, (uint8_t *)ping, sizeof(ping));
+        CHECK(w5500_evt_pending());
+
+        CHECK(settle() < TEST_PASSES_MAX);
+        CHECK(!w5500_evt_pending());
+
+        wizchip_setctx(&ctx_a);
+        CHECK(getSn_IR(TEST_TCP_SOCK) & Sn_IR_SENDOK);
+        CHECK(getSIR() & (1 << TEST_TCP_SOCK));
+        CHECK(intn_level);
+
+        wizchip_setctx(&ctx_b);
+        got = sock_recv(TEST_PEER_TCP_SOCK, echo, sizeof(echo));
+        CHECK(got == sizeof(ping) && memcmp(echo, ping, sizeof(ping)) == 0);
+    }
+
+    /* a signal without an unmasked event runs no handler */
+    calls = socks[TEST_TCP_SOCK].calls;
+    w5500_evt_signal(0);
+    CHECK(settle() == 1);
+    CHECK(socks[TEST_TCP_SOCK].calls == calls);
+    CHECK(!w5500_evt_pending());
+}
+
+/* A handler with nowhere to put its RX data parks the socket: the dispatcher
+ * goes idle with the data left in the chip, and serves it on unpark. */
+static void test_park(void)
+{
+    unsigned int d6 = socks[6].datagrams, calls;
+
+    socks[6].full = 1;
+    peer_send(6, 50);
+    CHECK(settle() < TEST_PASSES_MAX);
+    CHECK(!w5500_evt_pending());
+    CHECK(socks[6].datagrams == d6);
+    wizchip_setctx(&ctx_a);
+    CHECK(getSn_RX_RSR(6) != 0);
+
+    /* unparking a socket that is not parked runs nothing */
+    w5500_evt_unpark(W5500_EVT_SID(0, 4));
+    CHECK(!w5500_evt_pending());
+
+    /* still no room: parked again */
+    calls = socks[6].calls;
+    w5500_evt_unpark(W5500_EVT_SID(0, 6));
+    CHECK(w5500_evt_pending());
+    CHECK(settle() == 1);
+    CHECK(socks[6].calls == calls + 1);
+
+    socks[6].full = 0;
+    w5500_evt_unpark(W5500_EVT_SID(0, 6));
+    CHECK(settle() < TEST_PASSES_MAX);
+    CHECK(socks[6].datagrams == d6 + 1);
+    wizchip_setctx(&ctx_a);
+    CHECK(getSn_RX_RSR(6) == 0);
+}
+
+int main(void)
+{
+    test_chip(&chip_a, &ctx_a, &netinfo_a);
+    test_chip(&chip_b, &ctx_b, &netinfo_b);
+
+    test_open();
+    test_event();
+    test_rearm();
+    test_masked();
+    test_park();
+
+    HOST_TEST_EXIT();
+}
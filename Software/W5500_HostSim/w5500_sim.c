@@ -0,0 +1,578 @@
+/*
+ * Register level W5500 model for running the ioLibrary driver on a Linux host.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "ioLibrary_Driver/Ethernet/wizchip_conf.h"
+
+#include "w5500_sim.h"
+
+/* Common register block */
+#define COM_MR          0x00
+#define COM_SIPR        0x0F
+#define COM_IR          0x15
+#define COM_IMR         0x16
+#define COM_SIR         0x17
+#define COM_SIMR        0x18
+#define COM_RTR         0x19
+#define COM_RCR         0x1B
+#define COM_PHYCFGR     0x2E
+#define COM_VERSIONR    0x39
+
+/* Socket register block */
+#define SN_MR           0x00
+#define SN_CR           0x01
+#define SN_IR           0x02
+#define SN_SR           0x03
+#define SN_PORT         0x04
+#define SN_DHAR         0x06
+#define SN_DIPR         0x0C
+#define SN_DPORT        0x10
+#define SN_TTL          0x16
+#define SN_RXBUF_SIZE   0x1E
+#define SN_TXBUF_SIZE   0x1F
+#define SN_TX_FSR       0x20
+#define SN_TX_RD        0x22
+#define SN_TX_WR        0x24
+#define SN_RX_RSR       0x26
+#define SN_RX_RD        0x28
+#define SN_RX_WR        0x2A
+#define SN_IMR          0x2C
+#define SN_FRAG         0x2D
+
+#define CTRL_WRITE      0x04
+
+#define UDP_HEADER_LEN      8
+#define MACRAW_HEADER_LEN   2
+
+static uint16_t get16(const uint8_t *reg, uint8_t off)
+{
+    return ((uint16_t)reg[off] << 8) | reg[off + 1];
+}
+
+static void set16(uint8_t *reg, uint8_t off, uint16_t val)
+{
+    reg[off] = (uint8_t)(val >> 8);
+    reg[off + 1] = (uint8_t)val;
+}
+
+static uint16_t buf_size(uint8_t kb)
+{
+    return kb > 16 ? 0 : (uint16_t)kb * 1024;
+}
+
+/* Sn_TX_FSR and Sn_RX_RSR follow the pointers */
+static void sock_update(w5500_sim_sock *s)
+{
+    uint16_t tx_size = buf_size(s->reg[SN_TXBUF_SIZE]);
+    uint16_t used = get16(s->reg, SN_TX_WR) - get16(s->reg, SN_TX_RD);
+
+    set16(s->reg, SN_TX_FSR, used > tx_size ? 0 : tx_size - used);
+    set16(s->reg, SN_RX_RSR, get16(s->reg, SN_RX_WR) - get16(s->reg, SN_RX_RD));
+}
+
+/* SIR flags every socket with a Sn_IR bit set, masked in Sn_IMR or not;
+ * Sn_IMR only keeps a bit off INTn, see w5500_sim_intn(). */
+static void intr_update(w5500_sim *sim)
+{
+    uint8_t sir = 0;
+    int sn;
+
+    for (sn = 0; sn < W5500_SIM_SOCK_NUM; sn++)
+        if (sim->sock[sn].reg[SN_IR])
+            sir |= 1 << sn;
+    sim->common[COM_SIR] = sir;
+}
+
+static void sock_reset(w5500_sim_sock *s)
+{
+    memset(s->reg, 0, sizeof(s->reg));
+    s->reg[SN_DHAR] = s->reg[SN_DHAR + 1] = s->reg[SN_DHAR + 2] = 0xFF;
+    s->reg[SN_DHAR + 3] = s->reg[SN_DHAR + 4] = s->reg[SN_DHAR + 5] = 0xFF;
+    s->reg[SN_TTL] = 0x80;
+    s->reg[SN_RXBUF_SIZE] = 2;
+    s->reg[SN_TXBUF_SIZE] = 2;
+    s->reg[SN_IMR] = 0xFF;
+    s->reg[SN_FRAG] = 0x40;
+    s->peer = NULL;
+    sock_update(s);
+}
+
+static void chip_reset(w5500_sim *sim)
+{
+    int sn;
+
+    memset(sim->common, 0, sizeof(sim->common));
+    set16(sim->common, COM_RTR, 0x07D0);
+    sim->common[COM_RCR] = 0x08;
+    sim->common[COM_PHYCFGR] = 0xBF;    /* all capable, auto-negotiation, 100M full duplex, link up */
+    sim->common[COM_VERSIONR] = 0x04;
+
+    for (sn = 0; sn < W5500_SIM_SOCK_NUM; sn++)
+        sock_reset(&sim->sock[sn]);
+}
+
+/* Append len bytes to the RX ring of s; the caller checked the room. */
+static void rx_put(w5500_sim_sock *s, const uint8_t *data, uint16_t len)
+{
+    uint16_t size = buf_size(s->reg[SN_RXBUF_SIZE]);
+    uint16_t wr = get16(s->reg, SN_RX_WR);
+    uint16_t i;
+
+    for (i = 0; i < len; i++, wr++)
+        s->rx[wr & (size - 1)] = data[i];
+    set16(s->reg, SN_RX_WR, wr);
+    sock_update(s);
+}
+
+static uint16_t rx_room(const w5500_sim_sock *s)
+{
+    uint16_t size = buf_size(s->reg[SN_RXBUF_SIZE]);
+    uint16_t used = get16(s->reg, SN_RX_WR) - get16(s->reg, SN_RX_RD);
+
+    return used > size ? 0 : size - used;
+}
+
+static void udp_deliver(w5500_sim *from, w5500_sim_sock *src, const uint8_t *data, uint16_t len)
+{
+    static const uint8_t bcast[4] = { 0xFF, 0xFF, 0xFF, 0xFF };
+    w5500_sim *chip = from->net ? from->net->chips : from;
+    const uint8_t *dip = &src->reg[SN_DIPR];
+    uint16_t dport = get16(src->reg, SN_DPORT);
+    uint8_t head[UDP_HEADER_LEN];
+    w5500_sim_sock *s;
+    int is_bcast = memcmp(dip, bcast, 4) == 0;
+    int sn;
+
+    memcpy(head, &from->common[COM_SIPR], 4);
+    head[4] = src->reg[SN_PORT];
+    head[5] = src->reg[SN_PORT + 1];
+    head[6] = (uint8_t)(len >> 8);
+    head[7] = (uint8_t)len;
+
+    for (; chip; chip = from->net ? chip->next : NULL)
+    {
+        if (!is_bcast && memcmp(&chip->common[COM_SIPR], dip, 4) != 0)
+            continue;
+        for (sn = 0; sn < W5500_SIM_SOCK_NUM; sn++)
+        {
+            s = &chip->sock[sn];
+            if (s == src || s->reg[SN_SR] != SOCK_UDP || get16(s->reg, SN_PORT) != dport)
+                continue;
+            if (rx_room(s) < UDP_HEADER_LEN + len)
+            {
+                chip->stats.rx_dropped++;
+                continue;
+            }
+            rx_put(s, head, UDP_HEADER_LEN);
+            rx_put(s, data, len);
+            s->reg[SN_IR] |= Sn_IR_RECV;
+            intr_update(chip);
+        }
+    }
+}
+
+static void macraw_deliver(w5500_sim *from, const uint8_t *data, uint16_t len)
+{
+    w5500_sim *chip;
+    w5500_sim_sock *s;
+    uint8_t head[MACRAW_HEADER_LEN];
+
+    if (from->net == NULL)
+        return;
+
+    head[0] = (uint8_t)((len + MACRAW_HEADER_LEN) >> 8);
+    head[1] = (uint8_t)(len + MACRAW_HEADER_LEN);
+
+    for (chip = from->net->chips; chip; chip = chip->next)
+    {
+        s = &chip->sock[0];
+        if (chip == from || s->reg[SN_SR] != SOCK_MACRAW)
+            continue;
+        if (rx_room(s) < MACRAW_HEADER_LEN + len)
+        {
+            chip->stats.rx_dropped++;
+            continue;
+        }
+        rx_put(s, head, MACRAW_HEADER_LEN);
+        rx_put(s, data, len);
+        s->reg[SN_IR] |= Sn_IR_RECV;
+        intr_update(chip);
+    }
+}
+
+static void tcp_deliver(w5500_sim_sock *src, const uint8_t *data, uint16_t len)
+{
+    w5500_sim *chip = src->peer;
+    w5500_sim_sock *s;
+    uint16_t room;
+
+    if (chip == NULL)
+        return;
+    s = &chip->sock[src->peer_sn];
+    if (s->reg[SN_SR] != SOCK_ESTABLISHED && s->reg[SN_SR] != SOCK_CLOSE_WAIT)
+        return;
+
+    /* no window: what does not fit is lost, and counted */
+    room = rx_room(s);
+    if (len > room)
+    {
+        chip->stats.rx_dropped += len - room;
+        len = room;
+    }
+    if (len == 0)
+        return;
+    rx_put(s, data, len);
+    s->reg[SN_IR] |= Sn_IR_RECV;
+    intr_update(chip);
+}
+
+static void cmd_send(w5500_sim *sim, w5500_sim_sock *s)
+{
+    static uint8_t data[W5500_SIM_BUF_MAX];
+    uint16_t size = buf_size(s->reg[SN_TXBUF_SIZE]);
+    uint16_t rd = get16(s->reg, SN_TX_RD);
+    uint16_t wr = get16(s->reg, SN_TX_WR);
+    uint16_t len = wr - rd;
+    uint16_t i;
+
+    if (size == 0 || len > size)
+        return;
+    for (i = 0; i < len; i++, rd++)
+        data[i] = s->tx[rd & (size - 1)];
+    set16(s->reg, SN_TX_RD, wr);
+    sock_update(s);
+
+    switch (s->reg[SN_SR])
+    {
+    case SOCK_UDP:
+        udp_deliver(sim, s, data, len);
+        break;
+    case SOCK_MACRAW:
+        macraw_deliver(sim, data, len);
+        break;
+    case SOCK_ESTABLISHED:
+    case SOCK_CLOSE_WAIT:
+        tcp_deliver(s, data, len);
+        break;
+    default:
+        return;
+    }
+    s->reg[SN_IR] |= Sn_IR_SENDOK;
+}
+
+static void cmd_connect(w5500_sim *sim, w5500_sim_sock *s, uint8_t sn)
+{
+    w5500_sim *chip = sim->net ? sim->net->chips : sim;
+    w5500_sim_sock *l;
+    int ln;
+
+    for (; chip; chip = sim->net ? chip->next : NULL)
+    {
+        if (memcmp(&chip->common[COM_SIPR], &s->reg[SN_DIPR], 4) != 0)
+            continue;
+        for (ln = 0; ln < W5500_SIM_SOCK_NUM; ln++)
+        {
+            l = &chip->sock[ln];
+            if (l->reg[SN_SR] != SOCK_LISTEN || get16(l->reg, SN_PORT) != get16(s->reg, SN_DPORT))
+                continue;
+
+            memcpy(&l->reg[SN_DIPR], &sim->common[COM_SIPR], 4);
+            memcpy(&l->reg[SN_DPORT], &s->reg[SN_PORT], 2);
+            l->reg[SN_SR] = SOCK_ESTABLISHED;
+            l->reg[SN_IR] |= Sn_IR_CON;
+            l->peer = sim;
+            l->peer_sn = sn;
+            intr_update(chip);
+
+            s->reg[SN_SR] = SOCK_ESTABLISHED;
+            s->reg[SN_IR] |= Sn_IR_CON;
+            s->peer = chip;
+            s->peer_sn = (uint8_t)ln;
+            return;
+        }
+    }
+
+    /* nobody listening: the chip gives up after its retransmissions */
+    s->reg[SN_SR] = SOCK_CLOSED;
+    s->reg[SN_IR] |= Sn_IR_TIMEOUT;
+}
+
+/* Tell the other end of a TCP connection that this end went away: after a
+ * FIN it may still send (CLOSE_WAIT), after a reset it is closed. */
+static void tcp_unlink(w5500_sim_sock *s, uint8_t peer_sr)
+{
+    w5500_sim_sock *p;
+
+    if (s->peer == NULL)
+        return;
+    p = &s->peer->sock[s->peer_sn];
+    if (p->peer != NULL)
+    {
+        p->reg[SN_SR] = (p->reg[SN_SR] == SOCK_ESTABLISHED) ? peer_sr : SOCK_CLOSED;
+        p->reg[SN_IR] |= Sn_IR_DISCON;
+        if (p->reg[SN_SR] == SOCK_CLOSED)
+            p->peer = NULL;
+        intr_update(s->peer);
+    }
+    s->peer = NULL;
+}
+
+static void sock_command(w5500_sim *sim, uint8_t sn, uint8_t cr)
+{
+    w5500_sim_sock *s = &sim->sock[sn];
+    uint8_t sr = s->reg[SN_SR];
+
+    sim->stats.commands++;
+
+    switch (cr)
+    {
+    case Sn_CR_OPEN:
+        tcp_unlink(s, SOCK_CLOSED);
+        set16(s->reg, SN_TX_RD, 0);
+        set16(s->reg, SN_TX_WR, 0);
+        set16(s->reg, SN_RX_RD, 0);
+        set16(s->reg, SN_RX_WR, 0);
+        switch (s->reg[SN_MR] & 0x0F)
+        {
+        case Sn_MR_TCP:
+            s->reg[SN_SR] = SOCK_INIT;
+            break;
+        case Sn_MR_UDP:
+            s->reg[SN_SR] = SOCK_UDP;
+            break;
+        case Sn_MR_IPRAW:
+            s->reg[SN_SR] = SOCK_IPRAW;
+            break;
+        case Sn_MR_MACRAW:
+            s->reg[SN_SR] = sn == 0 ? SOCK_MACRAW : SOCK_CLOSED;
+            break;
+        default:
+            s->reg[SN_SR] = SOCK_CLOSED;
+            break;
+        }
+        break;
+    case Sn_CR_LISTEN:
+        if (sr == SOCK_INIT)
+            s->reg[SN_SR] = SOCK_LISTEN;
+        break;
+    case Sn_CR_CONNECT:
+        if (sr == SOCK_INIT)
+            cmd_connect(sim, s, sn);
+        break;
+    case Sn_CR_DISCON:
+        if (sr == SOCK_ESTABLISHED || sr == SOCK_CLOSE_WAIT)
+        {
+            tcp_unlink(s, SOCK_CLOSE_WAIT);
+            s->reg[SN_SR] = SOCK_CLOSED;
+            s->reg[SN_IR] |= Sn_IR_DISCON;
+        }
+        break;
+    case Sn_CR_CLOSE:
+        tcp_unlink(s, SOCK_CLOSED);
+        s->reg[SN_SR] = SOCK_CLOSED;
+        break;
+    case Sn_CR_SEND:
+    case Sn_CR_SEND_MAC:
+        cmd_send(sim, s);
+        break;
+    case Sn_CR_SEND_KEEP:
+        break;
+    case Sn_CR_RECV:
+        if (get16(s->reg, SN_RX_WR) != get16(s->reg, SN_RX_RD))
+            s->reg[SN_IR] |= Sn_IR_RECV;
+        break;
+    default:
+        break;
+    }
+    s->reg[SN_CR] = 0;
+    sock_update(s);
+    intr_update(sim);
+}
+
+static uint8_t reg_read(w5500_sim *sim, uint8_t bsb, uint16_t addr)
+{
+    w5500_sim_sock *s;
+    uint16_t size;
+
+    if (bsb == 0)
+        return addr < W5500_SIM_COMMON_SIZE ? sim->common[addr] : 0;
+    if ((bsb >> 2) >= W5500_SIM_SOCK_NUM)
+        return 0;
+
+    s = &sim->sock[bsb >> 2];
+    switch (bsb & 0x03)
+    {
+    case 1:
+        return addr < W5500_SIM_SREG_SIZE ? s->reg[addr] : 0;
+    case 2:
+        size = buf_size(s->reg[SN_TXBUF_SIZE]);
+        return size ? s->tx[addr & (size - 1)] : 0;
+    case 3:
+        size = buf_size(s->reg[SN_RXBUF_SIZE]);
+        return size ? s->rx[addr & (size - 1)] : 0;
+    default:
+        return 0;
+    }
+}
+
+static void reg_write(w5500_sim *sim, uint8_t bsb, uint16_t addr, uint8_t val)
+{
+    w5500_sim_sock *s;
+    uint8_t sn;
+    uint16_t size;
+
+    if (bsb == 0)
+    {
+        if (addr >= W5500_SIM_COMMON_SIZE)
+            return;
+        switch (addr)
+        {
+        case COM_MR:
+            if (val & MR_RST)
+                chip_reset(sim);
+            else
+                sim->common[COM_MR] = val;
+            return;
+        case COM_IR:
+            sim->common[COM_IR] &= ~val;
+            return;
+        case COM_SIR:
+        case COM_VERSIONR:
+            return;
+        case COM_PHYCFGR:
+            /* the status bits are the PHY's */
+            sim->common[COM_PHYCFGR] = (val & 0xF8) | (sim->common[COM_PHYCFGR] & 0x07);
+            return;
+        default:
+            sim->common[addr] = val;
+            return;
+        }
+    }
+
+    sn = bsb >> 2;
+    if (sn >= W5500_SIM_SOCK_NUM)
+        return;
+    s = &sim->sock[sn];
+
+    switch (bsb & 0x03)
+    {
+    case 1:
+        if (addr >= W5500_SIM_SREG_SIZE)
+            return;
+        switch (addr)
+        {
+        case SN_CR:
+            if (val)
+                sock_command(sim, sn, val);
+            return;
+        case SN_IR:
+            s->reg[SN_IR] &= ~val;
+            intr_update(sim);
+            return;
+        case SN_SR:
+        case SN_TX_FSR: case SN_TX_FSR + 1:
+        case SN_TX_RD: case SN_TX_RD + 1:
+        case SN_RX_RSR: case SN_RX_RSR + 1:
+        case SN_RX_WR: case SN_RX_WR + 1:
+            return;
+        default:
+            s->reg[addr] = val;
+            if (addr == SN_IMR)
+                intr_update(sim);
+            else
+                sock_update(s);
+            return;
+        }
+    case 2:
+        size = buf_size(s->reg[SN_TXBUF_SIZE]);
+        if (size)
+            s->tx[addr & (size - 1)] = val;
+        return;
+    default:
+        /* the RX buffer is the chip's to write */
+        return;
+    }
+}
+
+void w5500_sim_frame(w5500_sim *sim, uint32_t addr_sel, uint8_t *rx, const uint8_t *tx, uint16_t len)
+{
+    uint16_t addr = (uint16_t)(addr_sel >> 8);
+    uint8_t ctrl = (uint8_t)addr_sel;
+    uint8_t bsb = ctrl >> 3;
+    uint16_t i;
+
+    sim->stats.frames++;
+    sim->stats.data_bytes += len;
+    if (sim->timing.spi_khz)
+        sim->stats.bus_ns += sim->timing.frame_ns +
+                             (uint64_t)(3 + len) * 8 * 1000000 / sim->timing.spi_khz;
+
+    if (ctrl & CTRL_WRITE)
+    {
+        sim->stats.write_frames++;
+        for (i = 0; i < len; i++)
+            reg_write(sim, bsb, (uint16_t)(addr + i), tx[i]);
+    }
+    else
+    {
+        sim->stats.read_frames++;
+        for (i = 0; i < len; i++)
+            rx[i] = reg_read(sim, bsb, (uint16_t)(addr + i));
+    }
+}
+
+int w5500_sim_intn(const w5500_sim *sim)
+{
+    int sn;
+
+    if (sim->common[COM_IR] & sim->common[COM_IMR])
+        return 0;
+    for (sn = 0; sn < W5500_SIM_SOCK_NUM; sn++)
+        if ((sim->common[COM_SIMR] & (1 << sn)) &&
+            (sim->sock[sn].reg[SN_IR] & sim->sock[sn].reg[SN_IMR]))
+            return 0;
+    return 1;
+}
+
+void w5500_sim_init(w5500_sim *sim, w5500_sim_net *net)
+{
+    memset(&sim->stats, 0, sizeof(sim->stats));
+    sim->timing.spi_khz = W5500_SIM_SPI_KHZ;
+    sim->timing.frame_ns = W5500_SIM_FRAME_NS;
+    chip_reset(sim);
+
+    sim->net = net;
+    sim->next = NULL;
+    if (net)
+    {
+        sim->next = net->chips;
+        net->chips = sim;
+    }
+}
+
+static int w5500_sim_transfer(uint32_t AddrSel, uint8_t* rxBuf, uint8_t* txBuf, uint16_t len, uint8_t use_dma)
+{
+    w5500_sim *sim = (w5500_sim *)WIZCHIP_CTX->spi_config;
+
+    (void)use_dma;
+    if (sim == NULL)
+        return -1;
+    w5500_sim_frame(sim, AddrSel, rxBuf, txBuf, len);
+    return 0;
+}
+
+wizchip_spi_backend w5500_sim_spi = {
+    W5500_SIM_SPI_MAX_LEN,
+    w5500_sim_transfer,
+    NULL,
+    NULL,
+};
+
+void w5500_sim_attach(w5500_sim *sim, wizchip_ctx *ctx)
+{
+    ctx->spi = &w5500_sim_spi;
+    ctx->spi_config = sim;
+}
@@ -0,0 +1,110 @@
+/*
+ * Register level W5500 model for running the ioLibrary driver on a Linux host.
+ *
+ * The model takes the SPI frames the driver builds (24 bit address phase and
+ * data phase, see wizchip_spi_backend) and applies them to the common and
+ * socket register blocks and to the socket TX/RX buffer memory, like the chip
+ * does. Socket commands written to Sn_CR are carried out at once:
+ *
+ *  - OPEN, CLOSE, LISTEN, CONNECT, DISCON;
+ *  - SEND/SEND_MAC move the data between TX_RD and TX_WR to the receiving
+ *    socket, SENDOK is set right away;
+ *  - RECV recomputes Sn_RX_RSR from Sn_RX_RD.
+ *
+ * Chips joined to one w5500_sim_net reach each other by SIPR: UDP datagrams
+ * go to the UDP socket bound to Sn_DPORT of the chip whose SIPR is Sn_DIPR
+ * (every chip for 255.255.255.255), CONNECT finds the LISTEN socket on
+ * Sn_DPORT, and MACRAW frames reach socket 0 of every other chip in MACRAW
+ * mode. A chip may reach its own sockets too. There is no ARP, no wire timing
+ * and no loss beyond data that does not fit the receiving buffer, which is
+ * counted.
+ *
+ * SIR flags a socket for any Sn_IR bit, also one masked in Sn_IMR; INTn goes
+ * low only for the unmasked ones of the sockets SIMR enables.
+ *
+ * Every frame is counted and timed, so a driver change can be measured in SPI
+ * transactions, bytes and bus time per payload byte, see w5500_bench.c and
+ * w5500_cost.c.
+ */
+
+#ifndef __W5500_SIM_H__
+#define __W5500_SIM_H__
+
+#include <stdint.h>
+
+#include "ioLibrary_Driver/Ethernet/wizchip_conf.h"
+
+#define W5500_SIM_SOCK_NUM      8
+#define W5500_SIM_BUF_MAX       (16 * 1024)     /* largest Sn_TXBUF_SIZE / Sn_RXBUF_SIZE */
+#define W5500_SIM_COMMON_SIZE   0x40
+#define W5500_SIM_SREG_SIZE     0x30
+
+/* Longest data phase of one frame of w5500_sim_spi by default: the MT3620
+ * SPIM limit the driver splits bursts at on the board. */
+#define W5500_SIM_SPI_MAX_LEN   32
+
+/* Default bus timing: the RT app clocks the SPIM at 20 MHz (W5500_SPI_SPEED);
+ * the fixed cost of a transaction (chip select, SPIM setup, completion) is an
+ * estimate. */
+#define W5500_SIM_SPI_KHZ       20000
+#define W5500_SIM_FRAME_NS      2000
+
+typedef struct w5500_sim w5500_sim;
+typedef struct w5500_sim_net w5500_sim_net;
+
+typedef struct {
+    uint32_t frames;            /* SPI transactions */
+    uint32_t read_frames;
+    uint32_t write_frames;
+    uint64_t data_bytes;        /* data phase bytes, the 3 address phase bytes of each frame not included */
+    uint32_t commands;          /* Sn_CR commands */
+    uint32_t rx_dropped;        /* datagrams, frames or stream bytes that did not fit an RX buffer */
+    uint64_t bus_ns;            /* modelled SPI bus time, see w5500_sim_timing */
+} w5500_sim_stats;
+
+/* A frame of len data bytes holds the bus for frame_ns plus
+ * (3 + len) * 8 periods of the spi_khz clock. */
+typedef struct {
+    uint32_t spi_khz;
+    uint32_t frame_ns;
+} w5500_sim_timing;
+
+typedef struct {
+    uint8_t reg[W5500_SIM_SREG_SIZE];
+    uint8_t tx[W5500_SIM_BUF_MAX];
+    uint8_t rx[W5500_SIM_BUF_MAX];
+    w5500_sim *peer;            /* other end of a TCP connection */
+    uint8_t peer_sn;
+} w5500_sim_sock;
+
+struct w5500_sim {
+    uint8_t common[W5500_SIM_COMMON_SIZE];
+    w5500_sim_sock sock[W5500_SIM_SOCK_NUM];
+    w5500_sim_net *net;
+    w5500_sim *next;            /* on net */
+    w5500_sim_stats stats;
+    w5500_sim_timing timing;
+};
+
+struct w5500_sim_net {
+    w5500_sim *chips;
+};
+
+/* SPI backend applying the frames to the model the selected context's
+ * spi_config points to, see w5500_sim_attach(). Not const, so a benchmark
+ * can change max_len. */
+extern wizchip_spi_backend w5500_sim_spi;
+
+/* Power-on state; the chip joins net, which may be NULL for a lone chip. */
+void w5500_sim_init(w5500_sim *sim, w5500_sim_net *net);
+
+/* Point ctx at the model: ctx->spi is w5500_sim_spi, ctx->spi_config sim. */
+void w5500_sim_attach(w5500_sim *sim, wizchip_ctx *ctx);
+
+/* Apply one SPI frame; exactly one of rx and tx is used. */
+void w5500_sim_frame(w5500_sim *sim, uint32_t addr_sel, uint8_t *rx, const uint8_t *tx, uint16_t len);
+
+/* Level of the INTn pin: 0 while an unmasked interrupt is pending. */
+int w5500_sim_intn(const w5500_sim *sim);
+
+#endif /* __W5500_SIM_H__ */
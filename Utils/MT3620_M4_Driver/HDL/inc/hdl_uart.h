@@ -106,6 +106,8 @@
 					UART_FCR_CLRR | UART_FCR_CLRT)
 #define UART_FCR_NORMAL			(UART_FCR_FIFO_INIT | \
 					UART_FCR_RXFIFO_12B_TRI)
+/* TX FIFO depth, free as a whole once LSR.THRE is set */
+#define UART_TX_FIFO_SIZE		16
 
 /* LCR */
 #define UART_LCR_BREAK			(1 << 6)
@@ -169,6 +171,8 @@ void mtk_hdl_uart_set_sw_fc(void __iomem *uart_base,
 
 /* PIO mode */
 void mtk_hdl_uart_output_char(void __iomem *uart_base, u8 c);
+u32 mtk_hdl_uart_output_nowait(void __iomem *uart_base,
+				const u8 *data, u32 len);
 u8 mtk_hdl_uart_input_char(void __iomem *uart_base);
 
 #ifdef __cplusplus
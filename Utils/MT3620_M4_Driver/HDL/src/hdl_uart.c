@@ -285,6 +285,23 @@ void mtk_hdl_uart_output_char(void __iomem *uart_base, u8 c)
 	osai_writel(c, uart_base + UART_RBR);
 }
 
+u32 mtk_hdl_uart_output_nowait(void __iomem *uart_base,
+				const u8 *data, u32 len)
+{
+	u32 i;
+
+	/* THRE bit, the TX FIFO is empty */
+	if (!(osai_readl(uart_base + UART_LSR) & UART_LSR_THRE))
+		return 0;
+
+	if (len > UART_TX_FIFO_SIZE)
+		len = UART_TX_FIFO_SIZE;
+	for (i = 0; i < len; i++)
+		osai_writel(data[i], uart_base + UART_RBR);
+
+	return len;
+}
+
 u8 mtk_hdl_uart_input_char(void __iomem *uart_base)
 {
 	u8 c = 0xFF;
@@ -465,6 +465,21 @@ int mtk_mhal_uart_set_irq(struct mtk_uart_controller *ctlr, u8 int_flag);
  */
 int mtk_mhal_uart_putc(struct mtk_uart_controller *ctlr, u8 data);
 
+/**
+ * @brief This function is used to send data in PIO mode without waiting.
+ * @brief Usage: OS-HAL driver should call it to fill the TX FIFO
+ *    while it is empty.
+ * @param [in] ctlr : UART controller used with the device.
+ * @param [in] data : Output data.
+ * @param [in] len : Output data length.
+ * @return To indicate send data successfull or not.\n
+ *    If the return value is -#UART_EPTR, it means ctlr is NULL;\n
+ *    otherwise, it means the number of bytes written to the TX FIFO,\n
+ *    0 if it is not empty yet.\n
+ */
+int mtk_mhal_uart_putc_nowait(struct mtk_uart_controller *ctlr,
+			      const u8 *data, u32 len);
+
 /**
  * @brief This function is used to get data in PIO mode.
  * @brief Usage: OS-HAL driver should call it when receiving one byte of data.
@@ -211,6 +211,15 @@ int mtk_mhal_uart_putc(struct mtk_uart_controller *ctlr, u8 data)
 	return 0;
 }
 
+int mtk_mhal_uart_putc_nowait(struct mtk_uart_controller *ctlr,
+			      const u8 *data, u32 len)
+{
+	if (!ctlr)
+		return -UART_EPTR;
+
+	return mtk_hdl_uart_output_nowait(ctlr->base, data, len);
+}
+
 int mtk_mhal_uart_getc(struct mtk_uart_controller *ctlr)
 {
 	int ch;
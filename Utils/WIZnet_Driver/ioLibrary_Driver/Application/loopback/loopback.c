@@ -4,6 +4,7 @@
 #include "../../Ethernet/socket.h"
 #include "../../Ethernet/wizchip_conf.h"
 #include "printf.h"
+#include "dlog.h"
 
 #if LOOPBACK_MODE == LOOPBACK_MAIN_NOBLCOK
 
@@ -12,26 +13,29 @@ int32_t loopback_tcps(uint8_t sn, uint8_t *buf, uint16_t port)
 {
     int32_t ret;
     uint16_t size = 0, sentsize = 0;
+    wiz_SnSnapshot snap;
 
 #ifdef _LOOPBACK_DEBUG_
     uint8_t destip[4];
     uint16_t destport;
 #endif
 
-    switch (getSn_SR(sn))
+    getSn_SNAPSHOT(sn, &snap);
+
+    switch (snap.sr)
     {
     case SOCK_ESTABLISHED:
-        if (getSn_IR(sn) & Sn_IR_CON)
+        if (snap.ir & Sn_IR_CON)
         {
 #ifdef _LOOPBACK_DEBUG_
             getSn_DIPR(sn, destip);
             destport = getSn_DPORT(sn);
 
-            printf("%d:Connected - %d.%d.%d.%d : %d\r\n", sn, destip[0], destip[1], destip[2], destip[3], destport);
+            DLOG(DLOG_LOOPBACK_CONNECTED, sn, destip[0], destip[1], destip[2], destip[3], destport);
 #endif
             setSn_IR(sn, Sn_IR_CON);
         }
-        if ((size = getSn_RX_RSR(sn)) > 0) // Don't need to check SOCKERR_BUSY because it doesn't not occur.
+        if ((size = snap.rx_rsr) > 0) // Don't need to check SOCKERR_BUSY because it doesn't not occur.
         {
             if (size > DATA_BUF_SIZE)
                 size = DATA_BUF_SIZE;
@@ -71,12 +75,12 @@ int32_t loopback_tcps(uint8_t sn, uint8_t *buf, uint16_t port)
         break;
     case SOCK_CLOSE_WAIT:
 #ifdef _LOOPBACK_DEBUG_
-        printf("%d : SOCK_CLOSE_WAIT \r\n", sn);
+        DLOG(DLOG_LOOPBACK_CLOSE_WAIT, sn);
 #endif
         if ((ret = sock_disconnect(sn)) != SOCK_OK)
             return ret;
 #ifdef _LOOPBACK_DEBUG_
-        printf("%d : Socket Closed\r\n", sn);
+        DLOG(DLOG_LOOPBACK_CLOSED, sn);
 #endif
         break;
     case SOCK_INIT:
@@ -231,7 +235,7 @@ int32_t loopback_udps(uint8_t sn, uint8_t *buf, uint16_t port)
 #if 0
                 Log_Debug("%d: recvfrom error. %ld\r\n", sn, ret);
 #else
-                printf("%d: recvfrom error. %ld\r\n", sn, ret);
+                DLOG(DLOG_LOOPBACK_RECVFROM_ERR, sn, ret);
 #endif
 #endif
                 return ret;
@@ -247,7 +251,7 @@ int32_t loopback_udps(uint8_t sn, uint8_t *buf, uint16_t port)
 #if 0
                     Log_Debug("%d: sock_sendto error. %ld\r\n", sn, ret);
 #else
-                    printf("%d: sock_sendto error. %ld\r\n", sn, ret);
+                    DLOG(DLOG_LOOPBACK_SENDTO_ERR, sn, ret);
 #endif
 #endif
                     return ret;
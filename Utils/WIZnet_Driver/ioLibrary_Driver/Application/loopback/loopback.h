@@ -7,7 +7,9 @@ extern "C" {
 
 #include <stdint.h>
 
-#if 1
+#if defined(WIZCHIP_HOST_BUILD)
+// host build, no MT3620 peripherals
+#elif 1
 // 20200527 taylor
 #include "os_hal_uart.h"
 #else
@@ -62,9 +62,19 @@
 
 #include "w5500.h"
 #include "w5500-dbg.h"
-#include "printf.h"
 
+#ifndef WIZCHIP_HOST_BUILD
+#include "printf.h"
 #include "os_hal_spim.h"
+#endif
+
+#ifdef CYC_PROBE
+//! Cycle probes of the RT app
+#include "cyc_probe.h"
+#else
+#define CYC_PROBE_BEGIN(id)
+#define CYC_PROBE_END(id)
+#endif
 
 #define _W5500_SPI_VDM_OP_ 0x00
 #define _W5500_SPI_FDM_OP_LEN1_ 0x01
@@ -77,16 +87,110 @@
 #define USE_VDM
 //#define USE_READ_DMA
 //#define USE_WRITE_DMA
+#define USE_SPI_QUEUE
+#ifndef WIZCHIP_HOST_BUILD
+#define USE_MT3620_SPIM
+#endif
 
-extern uint8_t spi_master_port_num;
-extern uint32_t spi_master_speed;
-extern struct mtk_spi_config spi_default_config;
+#ifdef USE_MT3620_SPIM
+//! SPI bus, chip select and clock of the selected chip (wizchip_setctx())
+#define WIZCHIP_SPI_PORT    ((spim_num)WIZCHIP_CTX->spi_port)
+#define WIZCHIP_SPI_CONFIG  ((struct mtk_spi_config *)WIZCHIP_CTX->spi_config)
+#define WIZCHIP_SPI_SPEED   (WIZCHIP_CTX->spi_speed_khz)
 
-uint8_t WIZCHIP_READ(uint32_t AddrSel)
+//! Longest data phase the MT3620 SPIM accepts in one half-duplex transaction
+//! (MTK_SPIM_MAX_LENGTH_ONE_TRANS_HALF, PIO and DMA alike).
+#define WIZCHIP_SPIM_MAX_LEN    32
+
+//! One frame on the SPIM of the selected chip. With queue set it goes through
+//! the SPIM transaction queue, which starts the next frame from the completion
+//! interrupt; it may still be in flight on return, see wizchip_spim_flush().
+static int wizchip_spim_xfer(uint32_t AddrSel, uint8_t* rxBuf, uint8_t* txBuf, uint16_t len, uint8_t use_dma, uint8_t queue)
 {
     struct mtk_spi_transfer xfer;
     int ret;
 
+    memset(&xfer, 0, sizeof(xfer));
+
+    xfer.tx_buf = txBuf;
+    xfer.rx_buf = rxBuf;
+    xfer.use_dma = use_dma;
+    xfer.speed_khz = WIZCHIP_SPI_SPEED;
+    xfer.len = len;
+    xfer.opcode = (u32)AddrSel & 0xffffff;
+    xfer.opcode_len = 3;
+
+    if (!queue)
+    {
+        CYC_PROBE_BEGIN(INTERCORE_PROBE_SPIM_TRANSFER);
+        ret = mtk_os_hal_spim_transfer(WIZCHIP_SPI_PORT, WIZCHIP_SPI_CONFIG, &xfer);
+        CYC_PROBE_END(INTERCORE_PROBE_SPIM_TRANSFER);
+        return ret;
+    }
+
+    while ((ret = mtk_os_hal_spim_queue_submit(WIZCHIP_SPI_PORT,
+        WIZCHIP_SPI_CONFIG, &xfer, NULL, NULL)) == -2)
+    {
+        // queue full: a descriptor frees up when the oldest frame completes
+        if (mtk_os_hal_spim_queue_wait(WIZCHIP_SPI_PORT, MTK_OS_HAL_SPIM_QUEUE_DEPTH - 2, 1000))
+            return -1;
+    }
+    return ret;
+}
+
+static int wizchip_spim_transfer(uint32_t AddrSel, uint8_t* rxBuf, uint8_t* txBuf, uint16_t len, uint8_t use_dma)
+{
+    return wizchip_spim_xfer(AddrSel, rxBuf, txBuf, len, use_dma, 0);
+}
+
+#ifdef USE_SPI_QUEUE
+static int wizchip_spim_queue(uint32_t AddrSel, uint8_t* rxBuf, uint8_t* txBuf, uint16_t len, uint8_t use_dma)
+{
+    return wizchip_spim_xfer(AddrSel, rxBuf, txBuf, len, use_dma, 1);
+}
+
+static int wizchip_spim_flush(void)
+{
+    int ret;
+
+    CYC_PROBE_BEGIN(INTERCORE_PROBE_SPIM_FLUSH);
+    ret = mtk_os_hal_spim_queue_flush(WIZCHIP_SPI_PORT, 1000);
+    CYC_PROBE_END(INTERCORE_PROBE_SPIM_FLUSH);
+    return ret;
+}
+#endif
+
+//! Backend of a context that did not set one: the MT3620 SPIM.
+static const wizchip_spi_backend wizchip_spim_backend =
+{
+    WIZCHIP_SPIM_MAX_LEN,
+    wizchip_spim_transfer,
+#ifdef USE_SPI_QUEUE
+    wizchip_spim_queue,
+    wizchip_spim_flush,
+#else
+    NULL,
+    NULL,
+#endif
+};
+#define WIZCHIP_SPI_DEFAULT     (&wizchip_spim_backend)
+#else
+//! Host builds have no SPI of their own, every context brings its backend.
+#define WIZCHIP_SPI_DEFAULT     NULL
+#endif
+
+//! SPI backend of the selected chip
+#define WIZCHIP_SPI     (WIZCHIP_CTX->spi ? WIZCHIP_CTX->spi : WIZCHIP_SPI_DEFAULT)
+
+static int wizchip_burst_flush(void);
+
+//! Before a read or an unqueued frame: the queued writes go first.
+#define WIZCHIP_SPI_DRAIN()     do { if (WIZCHIP_CTX->spi_queued) wizchip_burst_flush(); } while (0)
+
+uint8_t WIZCHIP_READ(uint32_t AddrSel)
+{
+    int ret;
+
     uint8_t rb;
 
     #ifdef USE_VDM
@@ -94,33 +198,23 @@ uint8_t WIZCHIP_READ(uint32_t AddrSel)
     #else
     AddrSel |= (_W5500_SPI_READ_ | _W5500_SPI_FDM_OP_LEN1_);
     #endif
-    
-    xfer.tx_buf = NULL;
-    xfer.rx_buf = &rb;
-    xfer.use_dma = 0;
-    xfer.speed_khz = spi_master_speed;
-    xfer.len = 1;
-    xfer.opcode = 0x5a;
-    xfer.opcode_len = 3;
-
-    uint8_t data[] = { (AddrSel & 0x00FF0000) >> 16, (AddrSel & 0x0000FF00) >> 8, (AddrSel & 0x000000FF) >> 0 };
-
-    xfer.opcode = (u32)(data[2] | data[1] << 8 | data[0] << 16) & 0xffffff;
-    xfer.opcode_len = 3;
 
-    ret = mtk_os_hal_spim_transfer((spim_num)spi_master_port_num,
-        &spi_default_config, &xfer);
+    WIZCHIP_SPI_DRAIN();
+    ret = WIZCHIP_SPI->transfer(AddrSel, &rb, NULL, 1, 0);
     if (ret) {
-        printf("mtk_os_hal_spim_transfer failed\n");
+        printf("wizchip SPI transfer failed\n");
         return ret;
     }
 
     return rb;
 }
 
+//! With a queue the write is posted: its byte is kept in the context until
+//! the flush, and the frame may still be in flight on return.
 void WIZCHIP_WRITE(uint32_t AddrSel, uint8_t wb)
 {
-    struct mtk_spi_transfer xfer;
+    const wizchip_spi_backend* spi = WIZCHIP_SPI;
+    uint8_t* post;
     int ret;
 
     #ifdef USE_VDM
@@ -129,308 +223,420 @@ void WIZCHIP_WRITE(uint32_t AddrSel, uint8_t wb)
     AddrSel |= (_W5500_SPI_WRITE_ | _W5500_SPI_FDM_OP_LEN1_);
     #endif
 
-    xfer.tx_buf = &wb;
-    xfer.rx_buf = NULL;
-    xfer.use_dma = 0;
-    xfer.speed_khz = spi_master_speed;
-    xfer.len = 1;
-    xfer.opcode = 0x5a;
-    xfer.opcode_len = 3;
+    if (spi->queue)
+    {
+        if (WIZCHIP_CTX->spi_post_len == WIZCHIP_SPI_POST)
+            wizchip_burst_flush();
+        post = &WIZCHIP_CTX->spi_post[WIZCHIP_CTX->spi_post_len++];
+        *post = wb;
+        WIZCHIP_CTX->spi_queued = 1;
+        ret = spi->queue(AddrSel, NULL, post, 1, 0);
+    }
+    else
+        ret = spi->transfer(AddrSel, NULL, &wb, 1, 0);
+    if (ret) {
+        printf("wizchip SPI transfer failed\n");
+        return;
+    }
+}
 
-    const uint8_t data[] = { (AddrSel & 0x00FF0000) >> 16, (AddrSel & 0x0000FF00) >> 8, (AddrSel & 0x000000FF) >> 0, wb };
+//! Burst engine shared by WIZCHIP_READ_BUF and WIZCHIP_WRITE_BUF.
+//! Exactly one of rxBuf / txBuf is used. Buffers longer than the backend's
+//! max_len are streamed as back-to-back frames, each one carrying its own
+//! address phase. The 16-bit offset simply rolls over;
+//! the W5500 folds it into the socket ring (Sn_RXBUF_SIZE / Sn_TXBUF_SIZE) itself,
+//! so a burst that crosses the end of the ring continues at its start.
+//! When use_dma is set, rxBuf must live in DMA-able memory (.sysram).
+//! A backend with a queue starts the next frame without returning to this
+//! loop first; the frames may still be in flight on return, see wizchip_burst_flush().
+//! The queue only overlaps the frames of the bursts queued before one flush
+//! with each other and with building them: every caller in this file flushes
+//! before it returns, so the work of the driver's callers never overlaps a
+//! transfer.
+static int wizchip_burst_queue(uint32_t AddrSel, uint8_t* rxBuf, uint8_t* txBuf, uint16_t len, uint8_t use_dma)
+{
+    const wizchip_spi_backend* spi = WIZCHIP_SPI;
+    uint16_t addr = (uint16_t)(AddrSel >> 8);
+    uint8_t  ctrl = (uint8_t)(AddrSel & 0xFF);
+    uint16_t done = 0;
+    uint16_t chunk;
+    int ret = 0;
+
+    while (done < len)
+    {
+        chunk = len - done;
+        if (spi->max_len && chunk > spi->max_len)
+            chunk = spi->max_len;
 
-    xfer.opcode = (u32)(data[2] | data[1] << 8 | data[0] << 16) & 0xffffff;
-    xfer.opcode_len = 3;
+        AddrSel = ((uint32_t)addr << 8) | ctrl;
 
-    ret = mtk_os_hal_spim_transfer((spim_num)spi_master_port_num,
-        &spi_default_config, &xfer);
-    if (ret) {
-        printf("mtk_os_hal_spim_transfer failed\n");
-        return ret;
+#if defined(DEBUG_WIZCHIP_READ_BUF) || defined(DEBUG_WIZCHIP_WRITE_BUF)
+        printf("xfer.opcode = #%x len = %d\r\n", AddrSel, chunk);
+#endif
+
+        if (spi->queue)
+            ret = spi->queue(AddrSel, rxBuf ? rxBuf + done : NULL, txBuf ? txBuf + done : NULL, chunk, use_dma);
+        else
+            ret = spi->transfer(AddrSel, rxBuf ? rxBuf + done : NULL, txBuf ? txBuf + done : NULL, chunk, use_dma);
+        if (ret) {
+            printf("wizchip SPI transfer failed\n");
+            break;
+        }
+
+        addr += chunk;
+        done += chunk;
     }
+
+    return ret;
 }
 
-#ifdef USE_READ_DMA
-void WIZCHIP_READ_BUF_DMA(uint32_t AddrSel, uint8_t* pBuf, uint16_t len)
+//! Wait for the bursts queued by wizchip_burst_queue() and the posted
+//! register writes to complete.
+static int wizchip_burst_flush(void)
+{
+    const wizchip_spi_backend* spi = WIZCHIP_SPI;
+
+    WIZCHIP_CTX->spi_queued = 0;
+    WIZCHIP_CTX->spi_post_len = 0;
+    if (spi->flush && spi->flush()) {
+        printf("wizchip SPI flush failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+void WIZCHIP_FLUSH(void)
+{
+    WIZCHIP_SPI_DRAIN();
+}
+
+//! Burst transfer that returns only after the last burst is done.
+static int wizchip_burst(uint32_t AddrSel, uint8_t* rxBuf, uint8_t* txBuf, uint16_t len, uint8_t use_dma)
 {
-    struct mtk_spi_transfer xfer;
     int ret;
-    uint8_t data[3];
-    uint8_t temp[4];
-    uint16_t addr;
-    uint32_t sent_byte = 0;
 
+    ret = wizchip_burst_queue(AddrSel, rxBuf, txBuf, len, use_dma);
+    if (wizchip_burst_flush())
+        ret = -1;
+    return ret;
+}
+
+void WIZCHIP_READ_BUF(uint32_t AddrSel, uint8_t* pBuf, uint16_t len)
+{
 #ifdef USE_VDM
     AddrSel |= (_W5500_SPI_READ_ | _W5500_SPI_VDM_OP_);
 #else
     AddrSel |= (_W5500_SPI_READ_ | _W5500_SPI_FDM_OP_LEN1_);
 #endif
 
-    memset(&xfer, 0, sizeof(xfer));
-
-    xfer.tx_buf = NULL;
-    xfer.rx_buf = pBuf;
-    xfer.use_dma = 1;
-    xfer.speed_khz = spi_master_speed;
-    xfer.len = len;
-    xfer.opcode = 0x5a;
-    xfer.opcode_len = 3;
-
-#define RBUF_SIZE_TEST 16
-
-    do
-    {
-        addr = ((AddrSel >> 8) + sent_byte) & 0xFFFF;
-        data[0] = (addr >> 8) & 0xff;
-        data[1] = (addr >> 0) & 0xff;
-        data[2] = AddrSel & 0xff;
-
-        xfer.opcode = (u32)(data[2] | data[1] << 8 | data[0] << 16) & 0xffffff;
-#ifdef DEBUG_WIZCHIP_READ_BUF
-        printf("xfer.opcode = #%x\r\n", (u32)(data[2] | data[1] << 8 | data[0] << 16) & 0xffffff);
-        printf("xfer.opcode = #%x\r\n", xfer.opcode);
+#ifdef USE_READ_DMA
+    wizchip_burst(AddrSel, pBuf, NULL, len, 1);
+#else
+    wizchip_burst(AddrSel, pBuf, NULL, len, 0);
 #endif
-        xfer.opcode_len = 3;
 
 #ifdef DEBUG_WIZCHIP_READ_BUF
-        printf("len = %d\r\n", len);
+    for (int i = 0; i < len; i++)
+    {
+        printf("%#x ", *(pBuf + i));
+    }
+    printf("\r\n");
 #endif
-        if (len >= RBUF_SIZE_TEST)
-        {
-            xfer.len = RBUF_SIZE_TEST;
-            len -= RBUF_SIZE_TEST;
-        }
-        else
-        {
-            xfer.len = len;
-            len = 0;
-        }
+}
 
-        xfer.rx_buf = pBuf + sent_byte;
+void WIZCHIP_WRITE_BUF(uint32_t AddrSel, uint8_t *pBuf, uint16_t len)
+{
+#ifdef USE_VDM
+    AddrSel |= (_W5500_SPI_WRITE_ | _W5500_SPI_VDM_OP_);
+#else
+    AddrSel |= (_W5500_SPI_WRITE_ | _W5500_SPI_FDM_OP_LEN1_);
+#endif
 
-        ret = mtk_os_hal_spim_transfer((spim_num)spi_master_port_num,
-            &spi_default_config, &xfer);
-        if (ret) {
-            printf("mtk_os_hal_spim_transfer failed\n");
-            return ret;
-        }
-        
-        sent_byte += RBUF_SIZE_TEST;
-    } while (len != 0);
+#ifdef USE_WRITE_DMA
+    wizchip_burst(AddrSel, NULL, pBuf, len, 1);
+#else
+    wizchip_burst(AddrSel, NULL, pBuf, len, 0);
+#endif
 
-#ifdef DEBUG_WIZCHIP_READ_BUF
-    for (int i = 0; i < 3; i++)
-    {
-        printf("op[%d] %#x ", i, data[i]);
-    }
+#ifdef DEBUG_WIZCHIP_WRITE_BUF
     for (int i = 0; i < len; i++)
     {
-        printf("%#x ", *(pBuf + i));
+        printf("%#x ", *(pBuf+i));
     }
     printf("\r\n");
 #endif
 }
-#endif
 
-void WIZCHIP_READ_BUF(uint32_t AddrSel, uint8_t* pBuf, uint16_t len)
-{
-    struct mtk_spi_transfer xfer;
-    int ret;
-    uint8_t data[3];
-    uint8_t temp[4];
-    uint16_t addr;
-    uint32_t sent_byte = 0;
 
+//! Register-only burst read. Always PIO: register values land on the stack,
+//! which is not DMA-able.
+static void wizchip_read_regs(uint32_t AddrSel, uint8_t* pBuf, uint16_t len)
+{
 #ifdef USE_VDM
     AddrSel |= (_W5500_SPI_READ_ | _W5500_SPI_VDM_OP_);
 #else
     AddrSel |= (_W5500_SPI_READ_ | _W5500_SPI_FDM_OP_LEN1_);
 #endif
 
-    memset(&xfer, 0, sizeof(xfer));
-
-    xfer.tx_buf = NULL;
-    xfer.rx_buf = pBuf;
-    xfer.use_dma = 0;
-    xfer.speed_khz = spi_master_speed;
-    xfer.len = len;
-    xfer.opcode = 0x5a;
-    xfer.opcode_len = 3;
+    wizchip_burst(AddrSel, pBuf, NULL, len, 0);
+}
 
-#define RBUF_SIZE_TEST 16
+//! Both bytes of a 16-bit counter come from one burst; the value is still read
+//! twice because the chip may update it between the two bytes.
+static uint16_t wizchip_read_reg16_stable(uint32_t AddrSel)
+{
+    uint8_t  buf[2];
+    uint16_t val = 0, val1 = 0;
 
     do
     {
-        addr = ((AddrSel >> 8) + sent_byte) & 0xFFFF;
-        data[0] = (addr >> 8) & 0xff;
-        data[1] = (addr >> 0) & 0xff;
-        data[2] = AddrSel & 0xff;
-
-        xfer.opcode = (u32)(data[2] | data[1] << 8 | data[0] << 16) & 0xffffff;
-#ifdef DEBUG_WIZCHIP_READ_BUF
-        printf("xfer.opcode = #%x\r\n", (u32)(data[2] | data[1] << 8 | data[0] << 16) & 0xffffff);
-        printf("xfer.opcode = #%x\r\n", xfer.opcode);
-#endif
-        xfer.opcode_len = 3;
-
-#ifdef DEBUG_WIZCHIP_READ_BUF
-        printf("len = %d\r\n", len);
-#endif
-        if (len >= RBUF_SIZE_TEST)
-        {
-            xfer.len = RBUF_SIZE_TEST;
-            len -= RBUF_SIZE_TEST;
-        }
-        else
+        wizchip_read_regs(AddrSel, buf, 2);
+        val1 = ((uint16_t)buf[0] << 8) + buf[1];
+        if (val1 != 0)
         {
-            xfer.len = len;
-            len = 0;
+            wizchip_read_regs(AddrSel, buf, 2);
+            val = ((uint16_t)buf[0] << 8) + buf[1];
         }
+    } while (val != val1);
+    return val;
+}
 
-        xfer.rx_buf = pBuf + sent_byte;
 
-        ret = mtk_os_hal_spim_transfer((spim_num)spi_master_port_num,
-            &spi_default_config, &xfer);
-        if (ret) {
-            printf("mtk_os_hal_spim_transfer failed\n");
-            return ret;
-        }
-        
-        sent_byte += RBUF_SIZE_TEST;
-    } while (len != 0);
+uint16_t getSn_TX_FSR(uint8_t sn)
+{
+    return wizchip_read_reg16_stable(Sn_TX_FSR(sn));
+}
 
-#ifdef DEBUG_WIZCHIP_READ_BUF
-    for (int i = 0; i < 3; i++)
+
+uint16_t getSn_RX_RSR(uint8_t sn)
+{
+    return wizchip_read_reg16_stable(Sn_RX_RSR(sn));
+}
+
+
+void getSn_SNAPSHOT(uint8_t sn, wiz_SnSnapshot* snap)
+{
+    uint8_t  regs[12];
+    uint16_t fsr, rsr;
+
+    // Sn_MR .. Sn_SR
+    wizchip_read_regs(Sn_MR(sn), regs, 4);
+    snap->mr = regs[0];
+    snap->cr = regs[1];
+    snap->ir = regs[2];
+    snap->sr = regs[3];
+
+    // Sn_TX_FSR .. Sn_RX_WR
+    wizchip_read_regs(Sn_TX_FSR(sn), regs, 12);
+    snap->tx_fsr = ((uint16_t)regs[0] << 8) + regs[1];
+    snap->tx_rd  = ((uint16_t)regs[2] << 8) + regs[3];
+    snap->tx_wr  = ((uint16_t)regs[4] << 8) + regs[5];
+    snap->rx_rsr = ((uint16_t)regs[6] << 8) + regs[7];
+    snap->rx_rd  = ((uint16_t)regs[8] << 8) + regs[9];
+    snap->rx_wr  = ((uint16_t)regs[10] << 8) + regs[11];
+
+    // Same double-read rule as getSn_TX_FSR()/getSn_RX_RSR(), applied to
+    // Sn_TX_FSR .. Sn_RX_RSR at once.
+    while (snap->tx_fsr != 0 || snap->rx_rsr != 0)
     {
-        printf("op[%d] %#x ", i, data[i]);
+        fsr = snap->tx_fsr;
+        rsr = snap->rx_rsr;
+
+        wizchip_read_regs(Sn_TX_FSR(sn), regs, 8);
+        snap->tx_fsr = ((uint16_t)regs[0] << 8) + regs[1];
+        snap->tx_rd  = ((uint16_t)regs[2] << 8) + regs[3];
+        snap->tx_wr  = ((uint16_t)regs[4] << 8) + regs[5];
+        snap->rx_rsr = ((uint16_t)regs[6] << 8) + regs[7];
+
+        if (snap->tx_fsr == fsr && snap->rx_rsr == rsr)
+            break;
     }
-    for (int i = 0; i < len; i++)
+}
+
+
+//! Register shadow of the selected chip (wizchip_shadow_invalidate())
+#define WIZCHIP_SHADOW      (&WIZCHIP_CTX->shadow)
+
+//! Writes a register the host owns unless it already holds pBuf, and keeps
+//! the copy. valid is the shadow bit field the copy's bit lives in.
+static void wizchip_shadow_set(uint32_t AddrSel, uint8_t* valid, uint8_t bit, uint8_t* copy, const uint8_t* pBuf, uint16_t len)
+{
+    if ((*valid & bit) && memcmp(copy, pBuf, len) == 0)
+        return;
+
+    memcpy(copy, pBuf, len);
+    WIZCHIP_WRITE_BUF(AddrSel, copy, len);
+    *valid |= bit;
+}
+
+//! Reads a register the host owns from its copy, fetching it once if unknown.
+static void wizchip_shadow_get(uint32_t AddrSel, uint8_t* valid, uint8_t bit, uint8_t* copy, uint8_t* pBuf, uint16_t len)
+{
+    if (!(*valid & bit))
     {
-        printf("%#x ", *(pBuf + i));
+        wizchip_read_regs(AddrSel, copy, len);
+        *valid |= bit;
     }
-    printf("\r\n");
-#endif
+    memcpy(pBuf, copy, len);
 }
 
-void WIZCHIP_WRITE_BUF(uint32_t AddrSel, uint8_t *pBuf, uint16_t len)
+
+void setGAR(uint8_t* gar)
 {
-    struct mtk_spi_transfer xfer;
-    int ret;
-    uint8_t data[3];
-    uint8_t temp[4];
-    uint16_t addr;
-    uint32_t sent_byte = 0;
+    wizchip_shadow* sh = WIZCHIP_SHADOW;
+    wizchip_shadow_set(GAR, &sh->valid, WIZCHIP_SHADOW_GAR, sh->gar, gar, 4);
+}
 
-#ifdef USE_VDM
-    AddrSel |= (_W5500_SPI_WRITE_ | _W5500_SPI_VDM_OP_);
-#else
-    AddrSel |= (_W5500_SPI_WRITE_ | _W5500_SPI_FDM_OP_LEN1_);
-#endif
 
-    memset(&xfer, 0, sizeof(xfer));
+void getGAR(uint8_t* gar)
+{
+    wizchip_shadow* sh = WIZCHIP_SHADOW;
+    wizchip_shadow_get(GAR, &sh->valid, WIZCHIP_SHADOW_GAR, sh->gar, gar, 4);
+}
 
-    xfer.tx_buf = pBuf;
-    xfer.rx_buf = NULL;
-#ifdef USE_WRITE_DMA
-    xfer.use_dma = 1;
-#else
-    xfer.use_dma = 0;
-#endif
-    xfer.speed_khz = spi_master_speed;
-    xfer.len = len;
-    xfer.opcode = 0x5a;
-    xfer.opcode_len = 3;
 
-#define WBUF_SIZE_TEST 16
+void setSUBR(uint8_t* subr)
+{
+    wizchip_shadow* sh = WIZCHIP_SHADOW;
+    wizchip_shadow_set(SUBR, &sh->valid, WIZCHIP_SHADOW_SUBR, sh->subr, subr, 4);
+}
 
-    do
-    {
-        addr = ((AddrSel >> 8) + sent_byte) & 0xFFFF;
-        data[0] = (addr >> 8) & 0xff;
-        data[1] = (addr >> 0) & 0xff;
-        data[2] = AddrSel & 0xff;
 
-        xfer.opcode = (u32)(data[2] | data[1] << 8 | data[0] << 16) & 0xffffff;
-#ifdef DEBUG_WIZCHIP_WRITE_BUF
-        printf("xfer.opcode = #%x\r\n", (u32)(data[2] | data[1] << 8 | data[0] << 16) & 0xffffff);
-        printf("xfer.opcode = #%x\r\n", xfer.opcode);
-#endif
-        xfer.opcode_len = 3;
+void getSUBR(uint8_t* subr)
+{
+    wizchip_shadow* sh = WIZCHIP_SHADOW;
+    wizchip_shadow_get(SUBR, &sh->valid, WIZCHIP_SHADOW_SUBR, sh->subr, subr, 4);
+}
 
-#ifdef DEBUG_WIZCHIP_WRITE_BUF
-        printf("len = %d\r\n", len);
-#endif
-        if (len >= WBUF_SIZE_TEST)
-        {
-            xfer.len = WBUF_SIZE_TEST;
-            len -= WBUF_SIZE_TEST;
-        }
-        else
-        {
-            xfer.len = len;
-            len = 0;
-        }
 
-        xfer.tx_buf = pBuf + sent_byte;
+void setSHAR(uint8_t* shar)
+{
+    wizchip_shadow* sh = WIZCHIP_SHADOW;
+    wizchip_shadow_set(SHAR, &sh->valid, WIZCHIP_SHADOW_SHAR, sh->shar, shar, 6);
+}
 
-        ret = mtk_os_hal_spim_transfer((spim_num)spi_master_port_num,
-            &spi_default_config, &xfer);
-        if (ret) {
-            printf("mtk_os_hal_spim_transfer failed\n");
-            return ret;
-        }
 
-        sent_byte += WBUF_SIZE_TEST;
+void getSHAR(uint8_t* shar)
+{
+    wizchip_shadow* sh = WIZCHIP_SHADOW;
+    wizchip_shadow_get(SHAR, &sh->valid, WIZCHIP_SHADOW_SHAR, sh->shar, shar, 6);
+}
 
-    } while (len != 0);
 
-#ifdef DEBUG_WIZCHIP_WRITE_BUF
-    for (int i = 0; i < 3; i++)
-    {
-        printf("op[%d] %#x ", i, data[i]);
-    }
-    for (int i = 0; i < len; i++)
+void setSIPR(uint8_t* sipr)
+{
+    wizchip_shadow* sh = WIZCHIP_SHADOW;
+    wizchip_shadow_set(SIPR, &sh->valid, WIZCHIP_SHADOW_SIPR, sh->sipr, sipr, 4);
+}
+
+
+void getSIPR(uint8_t* sipr)
+{
+    wizchip_shadow* sh = WIZCHIP_SHADOW;
+    wizchip_shadow_get(SIPR, &sh->valid, WIZCHIP_SHADOW_SIPR, sh->sipr, sipr, 4);
+}
+
+
+void setSn_CR(uint8_t sn, uint8_t cr)
+{
+    wizchip_shadow* sh = WIZCHIP_SHADOW;
+
+    WIZCHIP_WRITE(Sn_CR(sn), cr);
+
+    // Sn_PORT is written right before OPEN and kept; the peer starts over.
+    if (cr == Sn_CR_OPEN)
+        sh->sn_valid[sn] &= WIZCHIP_SHADOW_Sn_PORT;
+    else if (cr == Sn_CR_LISTEN)
+        sh->sn_valid[sn] = (sh->sn_valid[sn] & WIZCHIP_SHADOW_Sn_PORT) | WIZCHIP_SHADOW_Sn_PEER;
+}
+
+
+void setSn_PORT(uint8_t sn, uint16_t port)
+{
+    wizchip_shadow* sh = WIZCHIP_SHADOW;
+    uint8_t buf[2] = { (uint8_t)(port >> 8), (uint8_t)port };
+
+    if ((sh->sn_valid[sn] & WIZCHIP_SHADOW_Sn_PORT) && sh->sn_port[sn] == port)
+        return;
+
+    WIZCHIP_WRITE_BUF(Sn_PORT(sn), buf, 2);
+    sh->sn_port[sn] = port;
+    sh->sn_valid[sn] |= WIZCHIP_SHADOW_Sn_PORT;
+}
+
+
+uint16_t getSn_PORT(uint8_t sn)
+{
+    wizchip_shadow* sh = WIZCHIP_SHADOW;
+    uint8_t buf[2];
+
+    if (!(sh->sn_valid[sn] & WIZCHIP_SHADOW_Sn_PORT))
     {
-        printf("%#x ", *(pBuf+i));
+        wizchip_read_regs(Sn_PORT(sn), buf, 2);
+        sh->sn_port[sn] = ((uint16_t)buf[0] << 8) + buf[1];
+        sh->sn_valid[sn] |= WIZCHIP_SHADOW_Sn_PORT;
     }
-    printf("\r\n");
-#endif
+    return sh->sn_port[sn];
 }
 
 
-uint16_t getSn_TX_FSR(uint8_t sn)
+void setSn_DIPR(uint8_t sn, uint8_t* dipr)
 {
-    uint16_t val = 0, val1 = 0;
+    wizchip_shadow* sh = WIZCHIP_SHADOW;
 
-    do
+    if (sh->sn_valid[sn] & WIZCHIP_SHADOW_Sn_PEER)
+        WIZCHIP_WRITE_BUF(Sn_DIPR(sn), dipr, 4);
+    else
+        wizchip_shadow_set(Sn_DIPR(sn), &sh->sn_valid[sn], WIZCHIP_SHADOW_Sn_DIPR, sh->sn_dipr[sn], dipr, 4);
+}
+
+
+void getSn_DIPR(uint8_t sn, uint8_t* dipr)
+{
+    wizchip_shadow* sh = WIZCHIP_SHADOW;
+
+    if (sh->sn_valid[sn] & WIZCHIP_SHADOW_Sn_PEER)
+        wizchip_read_regs(Sn_DIPR(sn), dipr, 4);
+    else
+        wizchip_shadow_get(Sn_DIPR(sn), &sh->sn_valid[sn], WIZCHIP_SHADOW_Sn_DIPR, sh->sn_dipr[sn], dipr, 4);
+}
+
+
+void setSn_DPORT(uint8_t sn, uint16_t dport)
+{
+    wizchip_shadow* sh = WIZCHIP_SHADOW;
+    uint8_t buf[2] = { (uint8_t)(dport >> 8), (uint8_t)dport };
+
+    if ((sh->sn_valid[sn] & (WIZCHIP_SHADOW_Sn_DPORT | WIZCHIP_SHADOW_Sn_PEER)) == WIZCHIP_SHADOW_Sn_DPORT &&
+        sh->sn_dport[sn] == dport)
+        return;
+
+    WIZCHIP_WRITE_BUF(Sn_DPORT(sn), buf, 2);
+    if (!(sh->sn_valid[sn] & WIZCHIP_SHADOW_Sn_PEER))
     {
-        val1 = WIZCHIP_READ(Sn_TX_FSR(sn));
-        val1 = (val1 << 8) + WIZCHIP_READ(WIZCHIP_OFFSET_INC(Sn_TX_FSR(sn), 1));
-        if (val1 != 0)
-        {
-            val = WIZCHIP_READ(Sn_TX_FSR(sn));
-            val = (val << 8) + WIZCHIP_READ(WIZCHIP_OFFSET_INC(Sn_TX_FSR(sn), 1));
-        }
-    } while (val != val1);
-    return val;
+        sh->sn_dport[sn] = dport;
+        sh->sn_valid[sn] |= WIZCHIP_SHADOW_Sn_DPORT;
+    }
 }
 
 
-uint16_t getSn_RX_RSR(uint8_t sn)
+uint16_t getSn_DPORT(uint8_t sn)
 {
-    uint16_t val = 0, val1 = 0;
+    wizchip_shadow* sh = WIZCHIP_SHADOW;
+    uint8_t buf[2];
 
-    do
+    if (sh->sn_valid[sn] & WIZCHIP_SHADOW_Sn_PEER)
     {
-        val1 = WIZCHIP_READ(Sn_RX_RSR(sn));
-        val1 = (val1 << 8) + WIZCHIP_READ(WIZCHIP_OFFSET_INC(Sn_RX_RSR(sn), 1));
-        if (val1 != 0)
-        {
-            val = WIZCHIP_READ(Sn_RX_RSR(sn));
-            val = (val << 8) + WIZCHIP_READ(WIZCHIP_OFFSET_INC(Sn_RX_RSR(sn), 1));
-        }
-    } while (val != val1);
-    return val;
+        wizchip_read_regs(Sn_DPORT(sn), buf, 2);
+        return ((uint16_t)buf[0] << 8) + buf[1];
+    }
+    if (!(sh->sn_valid[sn] & WIZCHIP_SHADOW_Sn_DPORT))
+    {
+        wizchip_read_regs(Sn_DPORT(sn), buf, 2);
+        sh->sn_dport[sn] = ((uint16_t)buf[0] << 8) + buf[1];
+        sh->sn_valid[sn] |= WIZCHIP_SHADOW_Sn_DPORT;
+    }
+    return sh->sn_dport[sn];
 }
 
 
@@ -441,6 +647,7 @@ void wiz_send_data(uint8_t sn, uint8_t *wizdata, uint16_t len)
 
     if (len == 0)
         return;
+    CYC_PROBE_BEGIN(INTERCORE_PROBE_WIZ_SEND_DATA);
     ptr = getSn_TX_WR(sn);
 
     //M20140501 : implict type casting -> explict type casting
@@ -452,6 +659,77 @@ void wiz_send_data(uint8_t sn, uint8_t *wizdata, uint16_t len)
 
     ptr += len;
     setSn_TX_WR(sn, ptr);
+    CYC_PROBE_END(INTERCORE_PROBE_WIZ_SEND_DATA);
+}
+
+
+void wiz_send_data_queued(uint8_t sn, uint8_t *wizdata, uint16_t len)
+{
+    uint16_t ptr = 0;
+    uint32_t addrsel = 0;
+
+    if (len == 0)
+        return;
+    CYC_PROBE_BEGIN(INTERCORE_PROBE_WIZ_SEND_DATA);
+    ptr = getSn_TX_WR(sn);
+
+    addrsel = ((uint32_t)ptr << 8) + (WIZCHIP_TXBUF_BLOCK(sn) << 3);
+#ifdef USE_VDM
+    addrsel |= (_W5500_SPI_WRITE_ | _W5500_SPI_VDM_OP_);
+#else
+    addrsel |= (_W5500_SPI_WRITE_ | _W5500_SPI_FDM_OP_LEN1_);
+#endif
+#ifdef USE_WRITE_DMA
+    wizchip_burst_queue(addrsel, NULL, wizdata, len, 1);
+#else
+    wizchip_burst_queue(addrsel, NULL, wizdata, len, 0);
+#endif
+    // flushed by the next read of the chip, like a posted register write
+    if (WIZCHIP_SPI->queue)
+        WIZCHIP_CTX->spi_queued = 1;
+
+    ptr += len;
+    setSn_TX_WR(sn, ptr);
+    CYC_PROBE_END(INTERCORE_PROBE_WIZ_SEND_DATA);
+}
+
+
+void wiz_send_datav(uint8_t sn, const wiz_iovec *iov, uint8_t iovcnt, uint16_t len)
+{
+    uint16_t ptr = 0;
+    uint16_t chunk;
+    uint32_t addrsel = 0;
+    uint8_t i;
+
+    if (len == 0)
+        return;
+    CYC_PROBE_BEGIN(INTERCORE_PROBE_WIZ_SEND_DATA);
+    ptr = getSn_TX_WR(sn);
+
+    for (i = 0; i < iovcnt && len != 0; i++)
+    {
+        chunk = iov[i].len < len ? iov[i].len : len;
+        if (chunk == 0)
+            continue;
+
+        addrsel = ((uint32_t)ptr << 8) + (WIZCHIP_TXBUF_BLOCK(sn) << 3);
+#ifdef USE_VDM
+        addrsel |= (_W5500_SPI_WRITE_ | _W5500_SPI_VDM_OP_);
+#else
+        addrsel |= (_W5500_SPI_WRITE_ | _W5500_SPI_FDM_OP_LEN1_);
+#endif
+#ifdef USE_WRITE_DMA
+        wizchip_burst_queue(addrsel, NULL, iov[i].buf, chunk, 1);
+#else
+        wizchip_burst_queue(addrsel, NULL, iov[i].buf, chunk, 0);
+#endif
+        ptr += chunk;
+        len -= chunk;
+    }
+    wizchip_burst_flush();
+
+    setSn_TX_WR(sn, ptr);
+    CYC_PROBE_END(INTERCORE_PROBE_WIZ_SEND_DATA);
 }
 
 
@@ -462,23 +740,74 @@ void wiz_recv_data(uint8_t sn, uint8_t *wizdata, uint16_t len)
 
     if (len == 0)
         return;
+    CYC_PROBE_BEGIN(INTERCORE_PROBE_WIZ_RECV_DATA);
     ptr = getSn_RX_RD(sn);
     //M20140501 : implict type casting -> explict type casting
     //addrsel = ((ptr << 8) + (WIZCHIP_RXBUF_BLOCK(sn) << 3);
     addrsel = ((uint32_t)ptr << 8) + (WIZCHIP_RXBUF_BLOCK(sn) << 3);
     //
 
-    #ifdef USE_READ_DMA
-    WIZCHIP_READ_BUF_DMA(addrsel, wizdata, len);    
-    #else
     WIZCHIP_READ_BUF(addrsel, wizdata, len);
-    #endif
 
     ptr += len;
 
     setSn_RX_RD(sn, ptr);
+    CYC_PROBE_END(INTERCORE_PROBE_WIZ_RECV_DATA);
 }
 
+void wiz_recv_peek(uint8_t sn, uint16_t offset, uint8_t *wizdata, uint16_t len)
+{
+    uint16_t ptr = 0;
+    uint32_t addrsel = 0;
+
+    if (len == 0)
+        return;
+    ptr = getSn_RX_RD(sn) + offset;
+    addrsel = ((uint32_t)ptr << 8) + (WIZCHIP_RXBUF_BLOCK(sn) << 3);
+
+    WIZCHIP_READ_BUF(addrsel, wizdata, len);
+}
+
+
+void wiz_recv_datav(uint8_t sn, const wiz_iovec *iov, uint8_t iovcnt, uint16_t len)
+{
+    uint16_t ptr = 0;
+    uint16_t chunk;
+    uint32_t addrsel = 0;
+    uint8_t i;
+
+    if (len == 0)
+        return;
+    CYC_PROBE_BEGIN(INTERCORE_PROBE_WIZ_RECV_DATA);
+    ptr = getSn_RX_RD(sn);
+
+    for (i = 0; i < iovcnt && len != 0; i++)
+    {
+        chunk = iov[i].len < len ? iov[i].len : len;
+        if (chunk == 0)
+            continue;
+
+        addrsel = ((uint32_t)ptr << 8) + (WIZCHIP_RXBUF_BLOCK(sn) << 3);
+#ifdef USE_VDM
+        addrsel |= (_W5500_SPI_READ_ | _W5500_SPI_VDM_OP_);
+#else
+        addrsel |= (_W5500_SPI_READ_ | _W5500_SPI_FDM_OP_LEN1_);
+#endif
+#ifdef USE_READ_DMA
+        wizchip_burst_queue(addrsel, iov[i].buf, NULL, chunk, 1);
+#else
+        wizchip_burst_queue(addrsel, iov[i].buf, NULL, chunk, 0);
+#endif
+        ptr += chunk;
+        len -= chunk;
+    }
+    wizchip_burst_flush();
+
+    setSn_RX_RD(sn, ptr);
+    CYC_PROBE_END(INTERCORE_PROBE_WIZ_RECV_DATA);
+}
+
+
 void wiz_recv_ignore(uint8_t sn, uint16_t len)
 {
     uint16_t ptr = 0;
@@ -56,7 +56,9 @@ extern "C" {
 
 #include "../../Ethernet/wizchip_conf.h"
 
-#if 1
+#if defined(WIZCHIP_HOST_BUILD)
+    // host build, no MT3620 peripherals
+#elif 1
     // 20200527 taylor
 #include "os_hal_uart.h"
 #else
@@ -1230,12 +1232,23 @@ uint8_t  WIZCHIP_READ (uint32_t AddrSel);
 /**
  * @ingroup Basic_IO_function
  * @brief It writes 1 byte value to a register.
+ * @details With a queued SPI backend the write may still be in flight on return, see WIZCHIP_FLUSH().
  * @param AddrSel Register address
  * @param wb Write data
  * @return void
  */
 void     WIZCHIP_WRITE(uint32_t AddrSel, uint8_t wb);
 
+/**
+ * @ingroup Basic_IO_function
+ * @brief It waits for the queued writes of the selected chip.
+ * @details With a queued SPI backend, WIZCHIP_WRITE() and wiz_send_data_queued() may return
+ * with their frames still in flight. Reads of the chip wait for them on their own; call this
+ * before reusing a buffer given to wiz_send_data_queued() without such a read, or before
+ * selecting another chip on the same SPI master.
+ */
+void     WIZCHIP_FLUSH(void);
+
 
 /**
  * @ingroup Basic_IO_function
@@ -1285,8 +1298,7 @@ void     WIZCHIP_WRITE_BUF(uint32_t AddrSel, uint8_t* pBuf, uint16_t len);
  * @param (uint8_t*)gar Pointer variable to set gateway IP address. It should be allocated 4 bytes.
  * @sa getGAR()
  */
-#define setGAR(gar) \
-		WIZCHIP_WRITE_BUF(GAR,gar,4)
+void setGAR(uint8_t* gar);
 
 /**
  * @ingroup Common_register_access_function
@@ -1294,8 +1306,7 @@ void     WIZCHIP_WRITE_BUF(uint32_t AddrSel, uint8_t* pBuf, uint16_t len);
  * @param (uint8_t*)gar Pointer variable to get gateway IP address. It should be allocated 4 bytes.
  * @sa setGAR()
  */
-#define getGAR(gar) \
-		WIZCHIP_READ_BUF(GAR,gar,4)
+void getGAR(uint8_t* gar);
 
 /**
  * @ingroup Common_register_access_function
@@ -1303,8 +1314,7 @@ void     WIZCHIP_WRITE_BUF(uint32_t AddrSel, uint8_t* pBuf, uint16_t len);
  * @param (uint8_t*)subr Pointer variable to set subnet mask address. It should be allocated 4 bytes.
  * @sa getSUBR()
  */
-#define setSUBR(subr) \
-		WIZCHIP_WRITE_BUF(SUBR, subr,4)
+void setSUBR(uint8_t* subr);
 
 
 /**
@@ -1313,17 +1323,18 @@ void     WIZCHIP_WRITE_BUF(uint32_t AddrSel, uint8_t* pBuf, uint16_t len);
  * @param (uint8_t*)subr Pointer variable to get subnet mask address. It should be allocated 4 bytes.
  * @sa setSUBR()
  */
-#define getSUBR(subr) \
-		WIZCHIP_READ_BUF(SUBR, subr, 4)
+void getSUBR(uint8_t* subr);
 
 /**
  * @ingroup Common_register_access_function
  * @brief Set local MAC address
  * @param (uint8_t*)shar Pointer variable to set local MAC address. It should be allocated 6 bytes.
+ * @note SHAR, GAR, SUBR and SIPR are only written by the host. Their setters keep a copy in the
+ *       selected @ref wizchip_ctx and their getters return it without SPI traffic once it is known.
+ *       @ref wizchip_shadow_invalidate() drops the copies after a chip reset.
  * @sa getSHAR()
  */
-#define setSHAR(shar) \
-		WIZCHIP_WRITE_BUF(SHAR, shar, 6)
+void setSHAR(uint8_t* shar);
 
 /**
  * @ingroup Common_register_access_function
@@ -1331,8 +1342,7 @@ void     WIZCHIP_WRITE_BUF(uint32_t AddrSel, uint8_t* pBuf, uint16_t len);
  * @param (uint8_t*)shar Pointer variable to get local MAC address. It should be allocated 6 bytes.
  * @sa setSHAR()
  */
-#define getSHAR(shar) \
-		WIZCHIP_READ_BUF(SHAR, shar, 6)
+void getSHAR(uint8_t* shar);
 
 /**
  * @ingroup Common_register_access_function
@@ -1340,8 +1350,7 @@ void     WIZCHIP_WRITE_BUF(uint32_t AddrSel, uint8_t* pBuf, uint16_t len);
  * @param (uint8_t*)sipr Pointer variable to set local IP address. It should be allocated 4 bytes.
  * @sa getSIPR()
  */
-#define setSIPR(sipr) \
-		WIZCHIP_WRITE_BUF(SIPR, sipr, 4)
+void setSIPR(uint8_t* sipr);
 
 /**
  * @ingroup Common_register_access_function
@@ -1349,8 +1358,7 @@ void     WIZCHIP_WRITE_BUF(uint32_t AddrSel, uint8_t* pBuf, uint16_t len);
  * @param (uint8_t*)sipr Pointer variable to get local IP address. It should be allocated 4 bytes.
  * @sa setSIPR()
  */
-#define getSIPR(sipr) \
-		WIZCHIP_READ_BUF(SIPR, sipr, 4)
+void getSIPR(uint8_t* sipr);
 
 /**
  * @ingroup Common_register_access_function
@@ -1681,10 +1689,12 @@ void     WIZCHIP_WRITE_BUF(uint32_t AddrSel, uint8_t* pBuf, uint16_t len);
  * @brief Set @ref Sn_CR register
  * @param (uint8_t)sn Socket number. It should be <b>0 ~ 7</b>.
  * @param (uint8_t)cr Value to set @ref Sn_CR
+ * @note @ref Sn_CR_OPEN drops the copies of @ref Sn_DIPR and @ref Sn_DPORT kept for socket n.
+ *       After @ref Sn_CR_LISTEN the chip writes the peer into @ref Sn_DIPR and @ref Sn_DPORT itself,
+ *       so they are read from the chip until the next @ref Sn_CR_OPEN.
  * @sa getSn_CR()
  */
-#define setSn_CR(sn, cr) \
-		WIZCHIP_WRITE(Sn_CR(sn), cr)
+void setSn_CR(uint8_t sn, uint8_t cr);
 
 /**
  * @ingroup Socket_register_access_function
@@ -1752,10 +1762,7 @@ void     WIZCHIP_WRITE_BUF(uint32_t AddrSel, uint8_t* pBuf, uint16_t len);
  * @param (uint16_t)port Value to set @ref Sn_PORT.
  * @sa getSn_PORT()
  */
-#define setSn_PORT(sn, port)  { \
-		WIZCHIP_WRITE(Sn_PORT(sn),   (uint8_t)(port >> 8)); \
-		WIZCHIP_WRITE(WIZCHIP_OFFSET_INC(Sn_PORT(sn),1), (uint8_t) port); \
-	}
+void setSn_PORT(uint8_t sn, uint16_t port);
 
 /**
  * @ingroup Socket_register_access_function
@@ -1769,8 +1776,7 @@ void     WIZCHIP_WRITE_BUF(uint32_t AddrSel, uint8_t* pBuf, uint16_t len);
 #define getSn_PORT(sn) \
 		((WIZCHIP_READ(Sn_PORT(sn)) << 8) + WIZCHIP_READ(WIZCHIP_OFFSET_INC(Sn_PORT(sn),1)))
 */
-#define getSn_PORT(sn) \
-		(((uint16_t)WIZCHIP_READ(Sn_PORT(sn)) << 8) + WIZCHIP_READ(WIZCHIP_OFFSET_INC(Sn_PORT(sn),1)))		
+uint16_t getSn_PORT(uint8_t sn);
 
 /**
  * @ingroup Socket_register_access_function
@@ -1797,10 +1803,11 @@ void     WIZCHIP_WRITE_BUF(uint32_t AddrSel, uint8_t* pBuf, uint16_t len);
  * @brief Set @ref Sn_DIPR register
  * @param (uint8_t)sn Socket number. It should be <b>0 ~ 7</b>.
  * @param (uint8_t*)dipr Pointer variable to set socket n destination IP address. It should be allocated 4 bytes.
+ * @note Writing the address the register already holds costs no SPI transfer, which is the common case
+ *       of repeated sendto() to one peer. The same holds for @ref setSn_DPORT().
  * @sa getSn_DIPR()
  */
-#define setSn_DIPR(sn, dipr) \
-		WIZCHIP_WRITE_BUF(Sn_DIPR(sn), dipr, 4)
+void setSn_DIPR(uint8_t sn, uint8_t* dipr);
 
 /**
  * @ingroup Socket_register_access_function
@@ -1809,8 +1816,7 @@ void     WIZCHIP_WRITE_BUF(uint32_t AddrSel, uint8_t* pBuf, uint16_t len);
  * @param (uint8_t*)dipr Pointer variable to get socket n destination IP address. It should be allocated 4 bytes.
  * @sa setSn_DIPR()
  */
-#define getSn_DIPR(sn, dipr) \
-		WIZCHIP_READ_BUF(Sn_DIPR(sn), dipr, 4)
+void getSn_DIPR(uint8_t sn, uint8_t* dipr);
 
 /**
  * @ingroup Socket_register_access_function
@@ -1819,10 +1825,7 @@ void     WIZCHIP_WRITE_BUF(uint32_t AddrSel, uint8_t* pBuf, uint16_t len);
  * @param (uint16_t)dport Value to set @ref Sn_DPORT
  * @sa getSn_DPORT()
  */
-#define setSn_DPORT(sn, dport) { \
-		WIZCHIP_WRITE(Sn_DPORT(sn),   (uint8_t) (dport>>8)); \
-		WIZCHIP_WRITE(WIZCHIP_OFFSET_INC(Sn_DPORT(sn),1), (uint8_t)  dport); \
-	}
+void setSn_DPORT(uint8_t sn, uint16_t dport);
 
 /**
  * @ingroup Socket_register_access_function
@@ -1836,8 +1839,7 @@ void     WIZCHIP_WRITE_BUF(uint32_t AddrSel, uint8_t* pBuf, uint16_t len);
 #define getSn_DPORT(sn) \
 		((WIZCHIP_READ(Sn_DPORT(sn)) << 8) + WIZCHIP_READ(WIZCHIP_OFFSET_INC(Sn_DPORT(sn),1)))
 */
-#define getSn_DPORT(sn) \
-		(((uint16_t)WIZCHIP_READ(Sn_DPORT(sn)) << 8) + WIZCHIP_READ(WIZCHIP_OFFSET_INC(Sn_DPORT(sn),1)))		
+uint16_t getSn_DPORT(uint8_t sn);
 
 /**
  * @ingroup Socket_register_access_function
@@ -2146,6 +2148,51 @@ uint16_t getSn_RX_RSR(uint8_t sn);
  */
 void wiz_send_data(uint8_t sn, uint8_t *wizdata, uint16_t len);
 
+/**
+ * @ingroup Basic_IO_function
+ * @brief It copies data to internal TX memory without waiting for the copy
+ * @details Like wiz_send_data(), but with a queued SPI backend the frames of the data and of the
+ * Tx write pointer may still be in flight on return, so the caller can go on, e.g. with another
+ * chip, while they are sent. <i>wizdata</i> must stay unchanged until the next read of the chip or
+ * WIZCHIP_FLUSH(); a later SEND command written before then follows them on the bus.
+ * @param (uint8_t)sn Socket number. It should be <b>0 ~ 7</b>.
+ * @param wizdata Pointer buffer to write data
+ * @param len Data length
+ * @sa wiz_send_data(), WIZCHIP_FLUSH()
+ */
+void wiz_send_data_queued(uint8_t sn, uint8_t *wizdata, uint16_t len);
+
+
+/**
+ * @ingroup Socket_register_access_function
+ * @brief Socket register values captured by getSn_SNAPSHOT()
+ */
+typedef struct wiz_SnSnapshot_t
+{
+   uint8_t  mr;       ///< @ref Sn_MR
+   uint8_t  cr;       ///< @ref Sn_CR
+   uint8_t  ir;       ///< @ref Sn_IR
+   uint8_t  sr;       ///< @ref Sn_SR
+   uint16_t tx_fsr;   ///< @ref Sn_TX_FSR
+   uint16_t tx_rd;    ///< @ref Sn_TX_RD
+   uint16_t tx_wr;    ///< @ref Sn_TX_WR
+   uint16_t rx_rsr;   ///< @ref Sn_RX_RSR
+   uint16_t rx_rd;    ///< @ref Sn_RX_RD
+   uint16_t rx_wr;    ///< @ref Sn_RX_WR
+}wiz_SnSnapshot;
+
+/**
+ * @ingroup Socket_register_access_function
+ * @brief Read the socket status and pointer registers in bursts
+ * @details Reads @ref Sn_MR ~ @ref Sn_SR and @ref Sn_TX_FSR ~ @ref Sn_RX_WR with one
+ * SPI transaction each, then re-reads @ref Sn_TX_FSR ~ @ref Sn_RX_RSR until the two
+ * 16-bit counters are stable, like getSn_TX_FSR() and getSn_RX_RSR() do.
+ * A poll usually costs 3 transactions instead of about 10 for the single getters.
+ * @param (uint8_t)sn Socket number. It should be <b>0 ~ 7</b>.
+ * @param snap Pointer to store the register values
+ * @sa getSn_SR(), getSn_IR(), getSn_TX_FSR(), getSn_RX_RSR()
+ */
+void getSn_SNAPSHOT(uint8_t sn, wiz_SnSnapshot* snap);
 
 /**
  * @ingroup Basic_IO_function
@@ -2173,6 +2220,55 @@ void wiz_recv_data(uint8_t sn, uint8_t *wizdata, uint16_t len);
  */
 void wiz_recv_ignore(uint8_t sn, uint16_t len);
 
+/**
+ * @ingroup Basic_IO_function
+ * @brief It copies data from internal RX memory without consuming it
+ * @details Like wiz_recv_data() starting <i>offset</i> bytes after the Rx read pointer, which is left
+ * as it is. The data stays in RX memory until wiz_recv_data() or wiz_recv_ignore() moves past it.
+ * @param (uint8_t)sn Socket number. It should be <b>0 ~ 7</b>.
+ * @param offset Bytes to skip after the Rx read pointer
+ * @param wizdata Pointer buffer to read data
+ * @param len Data length
+ * @sa wiz_recv_data(), wiz_recv_ignore()
+ */
+void wiz_recv_peek(uint8_t sn, uint16_t offset, uint8_t *wizdata, uint16_t len);
+
+/**
+ * @ingroup Basic_IO_function
+ * @brief One piece of a scattered buffer, for wiz_send_datav() and wiz_recv_datav()
+ */
+typedef struct wiz_iovec_t
+{
+   uint8_t* buf;     ///< start of the piece
+   uint16_t len;     ///< its length in bytes
+}wiz_iovec;
+
+/**
+ * @ingroup Basic_IO_function
+ * @brief It copies scattered data to internal TX memory
+ * @details Like wiz_send_data() for the pieces of <i>iov</i> one after the other, but the Tx write
+ * pointer is read and updated once and the SPI bursts of all pieces are queued back to back.
+ * @param (uint8_t)sn Socket number. It should be <b>0 ~ 7</b>.
+ * @param iov Pieces to write
+ * @param iovcnt Number of pieces
+ * @param len Bytes to write, at most the sum of the piece lengths
+ * @sa wiz_recv_datav()
+ */
+void wiz_send_datav(uint8_t sn, const wiz_iovec *iov, uint8_t iovcnt, uint16_t len);
+
+/**
+ * @ingroup Basic_IO_function
+ * @brief It copies data from internal RX memory to scattered buffers
+ * @details Like wiz_recv_data() filling the pieces of <i>iov</i> one after the other, but the Rx read
+ * pointer is read and updated once and the SPI bursts of all pieces are queued back to back.
+ * @param (uint8_t)sn Socket number. It should be <b>0 ~ 7</b>.
+ * @param iov Pieces to fill
+ * @param iovcnt Number of pieces
+ * @param len Bytes to read, at most the sum of the piece lengths
+ * @sa wiz_send_datav()
+ */
+void wiz_recv_datav(uint8_t sn, const wiz_iovec *iov, uint8_t iovcnt, uint16_t len);
+
 /// @cond DOXY_APPLY_CODE
 #endif
 /// @endcond
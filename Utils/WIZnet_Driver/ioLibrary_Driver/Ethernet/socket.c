@@ -57,35 +57,26 @@
 
 //M20150401 : Typing Error
 //#define SOCK_ANY_PORT_NUM  0xC000;
-#define SOCK_ANY_PORT_NUM 0xC000
+//SOCK_ANY_PORT_NUM is defined in wizchip_conf.h
 
-static uint16_t sock_any_port = SOCK_ANY_PORT_NUM;
-static uint16_t sock_io_mode = 0;
-static uint16_t sock_is_sending = 0;
-
-static uint16_t sock_remained_size[_WIZCHIP_SOCK_NUM_] = {
-    0,
-    0,
-};
+// The socket state belongs to a chip, it lives in the selected wizchip_ctx.
+#define sock_any_port        (WIZCHIP_CTX->sock_any_port)
+#define sock_io_mode         (WIZCHIP_CTX->sock_io_mode)
+#define sock_is_sending      (WIZCHIP_CTX->sock_is_sending)
+#define sock_remained_size   (WIZCHIP_CTX->sock_remained_size)
 
 //M20150601 : For extern decleation
 //static uint8_t  sock_pack_info[_WIZCHIP_SOCK_NUM_] = {0,};
-uint8_t sock_pack_info[_WIZCHIP_SOCK_NUM_] = {
-    0,
-};
+#define sock_pack_info       (WIZCHIP_CTX->sock_pack_info)
 //
 
 #if _WIZCHIP_ == 5200
-static uint16_t sock_next_rd[_WIZCHIP_SOCK_NUM_] = {
-    0,
-};
+#define sock_next_rd         (WIZCHIP_CTX->sock_next_rd)
 #endif
 
 //A20150601 : For integrating with W5300
 #if _WIZCHIP_ == 5300
-uint8_t sock_remained_byte[_WIZCHIP_SOCK_NUM_] = {
-    0,
-}; // set by wiz_recv_data()
+#define sock_remained_byte   (WIZCHIP_CTX->sock_remained_byte) // set by wiz_recv_data()
 #endif
 
 #define CHECK_SOCKNUM()            \
@@ -201,12 +192,13 @@ int8_t wiz_socket(uint8_t sn, uint8_t protocol, uint16_t port, uint8_t flag)
 
    if (!port)
    {
-      port = sock_any_port++;
-      if (sock_any_port == 0xFFF0)
+      // a zeroed context starts at the bottom of the range
+      if (sock_any_port < SOCK_ANY_PORT_NUM || sock_any_port >= 0xFFF0)
          sock_any_port = SOCK_ANY_PORT_NUM;
       else
       {
       };
+      port = sock_any_port++;
    }
    else
    {
@@ -364,14 +356,14 @@ int8_t sock_disconnect(uint8_t sn)
    return SOCK_OK;
 }
 
-int32_t sock_send(uint8_t sn, uint8_t *buf, uint16_t len)
+//! Wait until the previous SEND is done and the TX buffer has room for len
+//! bytes, at most the buffer size. Returns the byte count to send, or the
+//! sock_send() error.
+static int32_t sock_send_wait(uint8_t sn, uint16_t len)
 {
    uint8_t tmp = 0;
    uint16_t freesize = 0;
 
-   CHECK_SOCKNUM();
-   CHECK_SOCKMODE(Sn_MR_TCP);
-   CHECK_SOCKDATA();
    tmp = getSn_SR(sn);
    if (tmp != SOCK_ESTABLISHED && tmp != SOCK_CLOSE_WAIT)
       return SOCKERR_SOCKSTATUS;
@@ -419,7 +411,12 @@ int32_t sock_send(uint8_t sn, uint8_t *buf, uint16_t len)
       if (len <= freesize)
          break;
    }
-   wiz_send_data(sn, buf, len);
+   return (int32_t)len;
+}
+
+//! Send the len bytes just written to the TX buffer.
+static void sock_send_start(uint8_t sn, uint16_t len)
+{
 #if _WIZCHIP_ == 5200
    sock_next_rd[sn] = getSn_TX_RD(sn) + len;
 #endif
@@ -433,15 +430,132 @@ int32_t sock_send(uint8_t sn, uint8_t *buf, uint16_t len)
    while (getSn_CR(sn))
       ;
    sock_is_sending |= (1 << sn);
+}
+
+int32_t sock_send(uint8_t sn, uint8_t *buf, uint16_t len)
+{
+   int32_t ret;
+
+   CHECK_SOCKNUM();
+   CHECK_SOCKMODE(Sn_MR_TCP);
+   CHECK_SOCKDATA();
+   ret = sock_send_wait(sn, len);
+   if (ret <= 0)
+      return ret;
+   len = (uint16_t)ret;
+
+   wiz_send_data(sn, buf, len);
+   sock_send_start(sn, len);
    //M20150409 : Explicit Type Casting
    //return len;
    return (int32_t)len;
 }
 
-int32_t sock_recv(uint8_t sn, uint8_t *buf, uint16_t len)
+#if _WIZCHIP_ == 5500
+//! Total length of the pieces, saturated at 0xFFFF.
+static uint16_t sock_iov_len(const wiz_iovec *iov, uint8_t iovcnt)
+{
+   uint32_t total = 0;
+   uint8_t i;
+
+   for (i = 0; i < iovcnt; i++)
+      total += iov[i].len;
+   return total > 0xFFFF ? 0xFFFF : (uint16_t)total;
+}
+#endif
+
+#if _WIZCHIP_ == 5500
+int32_t sock_send_async(uint8_t sn, uint8_t *buf, uint16_t len)
+{
+   wiz_SnSnapshot snap;
+   uint16_t freesize;
+
+   CHECK_SOCKNUM();
+   CHECK_SOCKMODE(Sn_MR_TCP);
+   CHECK_SOCKDATA();
+   getSn_SNAPSHOT(sn, &snap);
+   if (snap.sr != SOCK_ESTABLISHED && snap.sr != SOCK_CLOSE_WAIT)
+      return SOCKERR_SOCKSTATUS;
+
+   // Count the room from the pointers, so data queued behind a SEND in
+   // progress is taken into account whatever Sn_TX_FSR makes of it.
+   freesize = getSn_TxMAX(sn) - (uint16_t)(snap.tx_wr - snap.tx_rd);
+   if (freesize == 0)
+      return SOCK_BUSY;
+   if (len > freesize)
+      len = freesize;
+
+   wiz_send_data(sn, buf, len);
+   if (!(sock_is_sending & (1 << sn)))
+   {
+      // SENDOK tells when the command is done, no need to wait for Sn_CR
+      setSn_CR(sn, Sn_CR_SEND);
+      sock_is_sending |= (1 << sn);
+   }
+   return (int32_t)len;
+}
+
+int32_t sock_send_complete(uint8_t sn)
+{
+   wiz_SnSnapshot snap;
+
+   CHECK_SOCKNUM();
+   sock_is_sending &= ~(1 << sn);
+   getSn_SNAPSHOT(sn, &snap);
+   if (snap.sr != SOCK_ESTABLISHED && snap.sr != SOCK_CLOSE_WAIT)
+      return SOCKERR_SOCKSTATUS;
+
+   // Data queued behind the finished SEND
+   if (snap.tx_wr != snap.tx_rd)
+   {
+      setSn_CR(sn, Sn_CR_SEND);
+      sock_is_sending |= (1 << sn);
+   }
+   return (int32_t)(uint16_t)(getSn_TxMAX(sn) - (uint16_t)(snap.tx_wr - snap.tx_rd));
+}
+#endif
+
+//! Wait until the socket has received data. Returns the byte count received,
+//! or the sock_recv() error.
+static int32_t sock_recv_wait(uint8_t sn)
 {
    uint8_t tmp = 0;
    uint16_t recvsize = 0;
+
+   while (1)
+   {
+      recvsize = getSn_RX_RSR(sn);
+      tmp = getSn_SR(sn);
+      if (tmp != SOCK_ESTABLISHED)
+      {
+         if (tmp == SOCK_CLOSE_WAIT)
+         {
+            if (recvsize != 0)
+               break;
+            else if (getSn_TX_FSR(sn) == getSn_TxMAX(sn))
+            {
+               close_socket(sn);
+               return SOCKERR_SOCKSTATUS;
+            }
+         }
+         else
+         {
+            close_socket(sn);
+            return SOCKERR_SOCKSTATUS;
+         }
+      }
+      if ((sock_io_mode & (1 << sn)) && (recvsize == 0))
+         return SOCK_BUSY;
+      if (recvsize != 0)
+         break;
+   };
+   return (int32_t)recvsize;
+}
+
+int32_t sock_recv(uint8_t sn, uint8_t *buf, uint16_t len)
+{
+   int32_t ret;
+   uint16_t recvsize = 0;
 //A20150601 : For integarating with W5300
 #if _WIZCHIP_ == 5300
    uint8_t head[2];
@@ -463,33 +577,10 @@ int32_t sock_recv(uint8_t sn, uint8_t *buf, uint16_t len)
    {
 #endif
       //
-      while (1)
-      {
-         recvsize = getSn_RX_RSR(sn);
-         tmp = getSn_SR(sn);
-         if (tmp != SOCK_ESTABLISHED)
-         {
-            if (tmp == SOCK_CLOSE_WAIT)
-            {
-               if (recvsize != 0)
-                  break;
-               else if (getSn_TX_FSR(sn) == getSn_TxMAX(sn))
-               {
-                  close_socket(sn);
-                  return SOCKERR_SOCKSTATUS;
-               }
-            }
-            else
-            {
-               close_socket(sn);
-               return SOCKERR_SOCKSTATUS;
-            }
-         }
-         if ((sock_io_mode & (1 << sn)) && (recvsize == 0))
-            return SOCK_BUSY;
-         if (recvsize != 0)
-            break;
-      };
+      ret = sock_recv_wait(sn);
+      if (ret <= 0)
+         return ret;
+      recvsize = (uint16_t)ret;
 #if _WIZCHIP_ == 5300
     }
 #endif
@@ -555,13 +646,81 @@ int32_t sock_recv(uint8_t sn, uint8_t *buf, uint16_t len)
    return (int32_t)len;
 }
 
-int32_t sock_sendto(uint8_t sn, uint8_t *buf, uint16_t len, uint8_t *addr, uint16_t port)
+#if _WIZCHIP_ == 5500
+//! States in which the RX buffer holds data of the socket.
+static uint8_t sock_has_rx(uint8_t sn)
+{
+   switch (getSn_SR(sn))
+   {
+   case SOCK_ESTABLISHED:
+   case SOCK_CLOSE_WAIT:
+   case SOCK_UDP:
+   case SOCK_IPRAW:
+   case SOCK_MACRAW:
+      return 1;
+   default:
+      return 0;
+   }
+}
+
+int32_t sock_peek(uint8_t sn, uint8_t *buf, uint16_t offset, uint16_t len)
+{
+   uint16_t recvsize;
+
+   CHECK_SOCKNUM();
+   if (!sock_has_rx(sn))
+      return SOCKERR_SOCKSTATUS;
+
+   recvsize = getSn_RX_RSR(sn);
+   if (recvsize <= offset)
+      return 0;
+   if (len > recvsize - offset)
+      len = recvsize - offset;
+
+   wiz_recv_peek(sn, offset, buf, len);
+   return (int32_t)len;
+}
+
+int32_t sock_consume(uint8_t sn, uint16_t len)
+{
+   uint16_t recvsize;
+
+   CHECK_SOCKNUM();
+   if (!sock_has_rx(sn))
+      return SOCKERR_SOCKSTATUS;
+
+   recvsize = getSn_RX_RSR(sn);
+   if (len > recvsize)
+      len = recvsize;
+   if (len == 0)
+      return 0;
+
+   wiz_recv_ignore(sn, len);
+   setSn_CR(sn, Sn_CR_RECV);
+   while (getSn_CR(sn))
+      ;
+
+   // Keep sock_recvfrom() in step with a datagram it started to read
+   if (sock_remained_size[sn] > len)
+      sock_remained_size[sn] -= len;
+   else if (sock_remained_size[sn] != 0)
+   {
+      sock_remained_size[sn] = 0;
+      sock_pack_info[sn] = PACK_COMPLETED;
+   }
+   return (int32_t)len;
+}
+#endif
+
+//! Check the socket and destination, set the destination and wait until the
+//! TX buffer has room for len bytes, at most the buffer size. Returns the byte
+//! count to send, or the sock_sendto() error.
+static int32_t sock_sendto_wait(uint8_t sn, uint16_t len, uint8_t *addr, uint16_t port)
 {
    uint8_t tmp = 0;
    uint16_t freesize = 0;
    uint32_t taddr;
 
-   CHECK_SOCKNUM();
    switch (getSn_MR(sn) & 0x0F)
    {
    case Sn_MR_UDP:
@@ -574,7 +733,6 @@ int32_t sock_sendto(uint8_t sn, uint8_t *buf, uint16_t len, uint8_t *addr, uint1
    default:
       return SOCKERR_SOCKMODE;
    }
-   CHECK_SOCKDATA();
    //M20140501 : For avoiding fatal error on memory align mismatched
    //if(*((uint32_t*)addr) == 0) return SOCKERR_IPINVALID;
    //{
@@ -613,7 +771,17 @@ int32_t sock_sendto(uint8_t sn, uint8_t *buf, uint16_t len, uint8_t *addr, uint1
       if (len <= freesize)
          break;
    };
-   wiz_send_data(sn, buf, len);
+   return (int32_t)len;
+}
+
+//! Send the len bytes just written to the TX buffer and wait for SENDOK.
+//! Returns len, or the sock_sendto() error.
+static int32_t sock_sendto_start(uint8_t sn, uint16_t len)
+{
+   uint8_t tmp = 0;
+#if _WIZCHIP_ < 5500
+   uint32_t taddr;
+#endif
 
 #if _WIZCHIP_ < 5500 //M20150401 : for WIZCHIP Errata #4, #5 (ARP errata)
    getSIPR((uint8_t *)&taddr);
@@ -668,6 +836,41 @@ int32_t sock_sendto(uint8_t sn, uint8_t *buf, uint16_t len, uint8_t *addr, uint1
    return (int32_t)len;
 }
 
+int32_t sock_sendto(uint8_t sn, uint8_t *buf, uint16_t len, uint8_t *addr, uint16_t port)
+{
+   int32_t ret;
+
+   CHECK_SOCKNUM();
+   CHECK_SOCKDATA();
+   ret = sock_sendto_wait(sn, len, addr, port);
+   if (ret <= 0)
+      return ret;
+   len = (uint16_t)ret;
+
+   wiz_send_data(sn, buf, len);
+   return sock_sendto_start(sn, len);
+}
+
+#if _WIZCHIP_ == 5500
+int32_t sock_sendtov(uint8_t sn, const wiz_iovec *iov, uint8_t iovcnt, uint8_t *addr, uint16_t port)
+{
+   uint16_t len;
+   int32_t ret;
+
+   CHECK_SOCKNUM();
+   len = sock_iov_len(iov, iovcnt);
+   if (len == 0)
+      return SOCKERR_DATALEN;
+   ret = sock_sendto_wait(sn, len, addr, port);
+   if (ret <= 0)
+      return ret;
+   len = (uint16_t)ret;
+
+   wiz_send_datav(sn, iov, iovcnt, len);
+   return sock_sendto_start(sn, len);
+}
+#endif
+
 #define USE_READ_DMA
 #ifdef USE_READ_DMA
 uint8_t __attribute__((unused, section(".sysram"))) head[8];
@@ -871,6 +1074,60 @@ int32_t sock_recvfrom(uint8_t sn, uint8_t *buf, uint16_t len, uint8_t *addr, uin
    return (int32_t)pack_len;
 }
 
+#if _WIZCHIP_ == 5500
+//! Packet info the W5500 puts in front of every UDP datagram in the RX buffer
+#define SOCK_UDP_HEAD_LEN  8
+
+int32_t sock_recvfrom_batch(uint8_t sn, wiz_dgram *dgrams, uint8_t count, uint8_t *buf, uint16_t size)
+{
+   uint16_t recvsize, off = 0, len;
+   uint8_t n = 0;
+   uint8_t *head;
+
+   CHECK_SOCKNUM();
+   CHECK_SOCKMODE(Sn_MR_UDP);
+   if (count == 0)
+      return SOCKERR_ARG;
+   if (getSn_SR(sn) != SOCK_UDP || sock_remained_size[sn] != 0)
+      return SOCKERR_SOCKSTATUS;
+
+   recvsize = getSn_RX_RSR(sn);
+   if (recvsize == 0)
+      return SOCK_BUSY;
+   if (recvsize > size)
+      recvsize = size;
+   wiz_recv_peek(sn, 0, buf, recvsize);
+
+   while (n < count && recvsize - off >= SOCK_UDP_HEAD_LEN)
+   {
+      head = buf + off;
+      len = ((uint16_t)head[6] << 8) | head[7];
+      if (len > recvsize - off - SOCK_UDP_HEAD_LEN)
+         break;
+
+      dgrams[n].addr[0] = head[0];
+      dgrams[n].addr[1] = head[1];
+      dgrams[n].addr[2] = head[2];
+      dgrams[n].addr[3] = head[3];
+      dgrams[n].port = ((uint16_t)head[4] << 8) | head[5];
+      dgrams[n].len = len;
+      dgrams[n].data = head + SOCK_UDP_HEAD_LEN;
+      off += SOCK_UDP_HEAD_LEN + len;
+      n++;
+   }
+   // The chip only shows whole datagrams in Sn_RX_RSR, so the first one
+   // is always complete unless buf is too small for it.
+   if (n == 0)
+      return SOCKERR_BUFFER;
+
+   wiz_recv_ignore(sn, off);
+   setSn_CR(sn, Sn_CR_RECV);
+   while (getSn_CR(sn))
+      ;
+   return n;
+}
+#endif
+
 int8_t wiz_ctlsocket(uint8_t sn, ctlsock_type cstype, void *arg)
 {
    uint8_t tmp = 0;
@@ -250,6 +250,45 @@ int8_t  sock_disconnect(uint8_t sn);
  */
 int32_t sock_send(uint8_t sn, uint8_t * buf, uint16_t len);
 
+#if _WIZCHIP_ == 5500
+/**
+ * @ingroup WIZnet_socket_APIs
+ * @brief	Queue data for the connected peer in TCP socket without waiting.
+ * @details Copies as much of <I>buf</I> as the TX buffer has room for and returns at once.
+ *          A SEND command is issued only when none is in progress; data queued while one is
+ *          in progress goes out with the next SEND, issued by @ref sock_send_complete().
+ *          Neither @ref Sn_CR nor @ref Sn_TX_FSR is polled.
+ * @note    It is valid only in TCP server or client mode. The caller has to call
+ *          @ref sock_send_complete() on every @ref Sn_IR_SENDOK interrupt of the socket, so
+ *          it must not be mixed with @ref sock_send() on the same socket, which polls and
+ *          clears @ref Sn_IR_SENDOK itself. 
+
+ *          A return value smaller than <I>len</I> means the TX buffer is full: the rest of the
+ *          data has to be kept by the caller until @ref sock_send_complete() reports free room.
+ * @param sn Socket number. It should be <b>0 ~ @ref \_WIZCHIP_SOCK_NUM_</b>.
+ * @param buf Pointer buffer containing data to be sent.
+ * @param len The byte length of data in buf.
+ * @return	@b Success : The queued data size, @ref SOCK_BUSY when the TX buffer is full \n
+ *          @b Fail    : \n @ref SOCKERR_SOCKSTATUS - Invalid socket status for socket operation \n
+ *                          @ref SOCKERR_SOCKMODE 	- Invalid operation in the socket \n
+ *                          @ref SOCKERR_SOCKNUM    - Invalid socket number \n
+ *                          @ref SOCKERR_DATALEN    - zero data length
+ */
+int32_t sock_send_async(uint8_t sn, uint8_t * buf, uint16_t len);
+
+/**
+ * @ingroup WIZnet_socket_APIs
+ * @brief	Finish the SEND command of @ref sock_send_async().
+ * @details Call it on @ref Sn_IR_SENDOK, after clearing the interrupt. If data was queued
+ *          while the SEND was in progress, it is sent now.
+ * @param sn Socket number. It should be <b>0 ~ @ref \_WIZCHIP_SOCK_NUM_</b>.
+ * @return	@b Success : Free room in the TX buffer \n
+ *          @b Fail    : \n @ref SOCKERR_SOCKSTATUS - The connection is gone \n
+ *                          @ref SOCKERR_SOCKNUM    - Invalid socket number
+ */
+int32_t sock_send_complete(uint8_t sn);
+#endif
+
 /**
  * @ingroup WIZnet_socket_APIs
  * @brief	Receive data from the connected peer.
@@ -272,6 +311,44 @@ int32_t sock_send(uint8_t sn, uint8_t * buf, uint16_t len);
  */
 int32_t sock_recv(uint8_t sn, uint8_t * buf, uint16_t len);
 
+#if _WIZCHIP_ == 5500
+/**
+ * @ingroup WIZnet_socket_APIs
+ * @brief	Look at received data without taking it out of the socket buffer.
+ * @details Copies up to <I>len</I> bytes starting <I>offset</I> bytes into the RX buffer of the socket.
+ *          Nothing is consumed: the same data can be peeked again, until @ref sock_consume(),
+ *          @ref sock_recv() or @ref sock_recvfrom() takes it. It never waits for data. \n
+ *          The bytes are those of the buffer as they are: in UDP, IPRAW and MACRAW mode a
+ *          datagram starts with the header that @ref sock_recvfrom() strips (8 bytes in UDP:
+ *          peer IP, port and data length), unless it was already partly read.
+ * @note    It lets a protocol look at a header in a small buffer before deciding what to
+ *          do with the rest.
+ * @param sn Socket number. It should be <b>0 ~ @ref \_WIZCHIP_SOCK_NUM_</b>.
+ * @param buf Pointer buffer to copy the data to.
+ * @param offset Bytes to skip in the RX buffer.
+ * @param len Bytes to copy.
+ * @return	@b Success : The copied data size, 0 if the buffer holds no more than <I>offset</I> bytes \n
+ *          @b Fail    : \n @ref SOCKERR_SOCKSTATUS - Invalid socket status for socket operation \n
+ *                          @ref SOCKERR_SOCKNUM    - Invalid socket number
+ */
+int32_t sock_peek(uint8_t sn, uint8_t * buf, uint16_t offset, uint16_t len);
+
+/**
+ * @ingroup WIZnet_socket_APIs
+ * @brief	Drop received data from the socket buffer.
+ * @details Moves past <I>len</I> bytes of the RX buffer, at most what it holds, without copying them,
+ *          and frees the room with one RECV command. In UDP, IPRAW and MACRAW mode the data left
+ *          of a partly read datagram is accounted, so @ref sock_recvfrom() goes on with the
+ *          next datagram once it is consumed.
+ * @param sn Socket number. It should be <b>0 ~ @ref \_WIZCHIP_SOCK_NUM_</b>.
+ * @param len Bytes to drop.
+ * @return	@b Success : The dropped data size \n
+ *          @b Fail    : \n @ref SOCKERR_SOCKSTATUS - Invalid socket status for socket operation \n
+ *                          @ref SOCKERR_SOCKNUM    - Invalid socket number
+ */
+int32_t sock_consume(uint8_t sn, uint16_t len);
+#endif
+
 /**
  * @ingroup WIZnet_socket_APIs
  * @brief	Sends datagram to the peer with destination IP address and port number passed as parameter.
@@ -300,6 +377,22 @@ int32_t sock_recv(uint8_t sn, uint8_t * buf, uint16_t len);
  */
 int32_t sock_sendto(uint8_t sn, uint8_t * buf, uint16_t len, uint8_t * addr, uint16_t port);
 
+#if _WIZCHIP_ == 5500
+/**
+ * @ingroup WIZnet_socket_APIs
+ * @brief	Send one datagram made of scattered pieces.
+ * @details Like @ref sock_sendto() for the pieces of <I>iov</I> taken as one buffer, written to the
+ *          TX buffer back to back and sent as a single datagram.
+ * @param sn Socket number. It should be <b>0 ~ @ref \_WIZCHIP_SOCK_NUM_</b>.
+ * @param iov Pieces of the datagram, in order.
+ * @param iovcnt Number of pieces.
+ * @param addr Pointer variable of destination IP address. It should be allocated 4 bytes.
+ * @param port Destination port number.
+ * @return	As @ref sock_sendto().
+ */
+int32_t sock_sendtov(uint8_t sn, const wiz_iovec * iov, uint8_t iovcnt, uint8_t * addr, uint16_t port);
+#endif
+
 /**
  * @ingroup WIZnet_socket_APIs
  * @brief Receive datagram of UDP or MACRAW
@@ -330,6 +423,46 @@ int32_t sock_sendto(uint8_t sn, uint8_t * buf, uint16_t len, uint8_t * addr, uin
  */
 int32_t sock_recvfrom(uint8_t sn, uint8_t * buf, uint16_t len, uint8_t * addr, uint16_t *port);
 
+#if _WIZCHIP_ == 5500
+/**
+ * @ingroup WIZnet_socket_APIs
+ * @brief One datagram returned by @ref sock_recvfrom_batch()
+ */
+typedef struct wiz_dgram_t
+{
+   uint8_t  addr[4];   ///< peer IP address
+   uint16_t port;      ///< peer port number
+   uint16_t len;       ///< data length
+   uint8_t* data;      ///< data, in the buffer passed to @ref sock_recvfrom_batch()
+}wiz_dgram;
+
+/**
+ * @ingroup WIZnet_socket_APIs
+ * @brief	Receive several queued datagrams of a UDP socket at once.
+ * @details The RX buffer is read with one SPI burst, up to <I>size</I> bytes, headers included. Every
+ *          datagram that is complete in <I>buf</I> is described in <I>dgrams</I>, whose data points
+ *          into <I>buf</I>, and they are all taken out of the RX buffer with a single RECV command.
+ *          @ref sock_recvfrom() instead issues two commands per datagram. It never waits for data.
+ * @note    Data of the datagrams past the last complete one may be read into <I>buf</I> too; they
+ *          stay in the RX buffer for the next call. <I>size</I> should therefore not be much
+ *          larger than <I>count</I> datagrams with their 8-byte headers.
+ * @param sn    Socket number. It should be <b>0 ~ @ref \_WIZCHIP_SOCK_NUM_</b>.
+ * @param dgrams Array to describe the datagrams in.
+ * @param count Size of the dgrams array.
+ * @param buf   Pointer buffer to read the datagrams to.
+ * @param size  Size of buf.
+ * @return	@b Success : The number of datagrams received, @ref SOCK_BUSY when there is none \n
+ *          @b Fail    : \n @ref SOCKERR_SOCKMODE   - The socket is not in UDP mode \n
+ *                          @ref SOCKERR_SOCKSTATUS - The socket is not open, or @ref sock_recvfrom()
+ *                                                    has read a datagram only in part \n
+ *                          @ref SOCKERR_BUFFER     - The next datagram does not fit in buf: it is left
+ *                                                    for @ref sock_recvfrom() or @ref sock_consume() \n
+ *                          @ref SOCKERR_ARG        - count is 0 \n
+ *                          @ref SOCKERR_SOCKNUM    - Invalid socket number
+ */
+int32_t sock_recvfrom_batch(uint8_t sn, wiz_dgram * dgrams, uint8_t count, uint8_t * buf, uint16_t size);
+#endif
+
 
 /////////////////////////////
 // SOCKET CONTROL & OPTION //
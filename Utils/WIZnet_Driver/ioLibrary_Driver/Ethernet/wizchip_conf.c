@@ -50,6 +50,7 @@
 //*****************************************************************************/
 //A20140501 : for use the type - ptrdiff_t
 #include <stddef.h>
+#include <string.h>
 //
 
 #include "wizchip_conf.h"
@@ -187,8 +188,20 @@ _WIZCHIP  WIZCHIP =
 };
 
 
-static uint8_t    _DNS_[4];      // DNS server ip address
-static dhcp_mode  _DHCP_;        // DHCP mode
+static wizchip_ctx _WIZCHIP_CTX_;      // default context, used until wizchip_setctx()
+wizchip_ctx*       WIZCHIP_CTX = &_WIZCHIP_CTX_;
+
+// DNS and DHCP mode are not held by the chip, keep them per context
+#define _DNS_     (WIZCHIP_CTX->dns)      // DNS server ip address
+#define _DHCP_    (WIZCHIP_CTX->dhcp)     // DHCP mode
+
+wizchip_ctx* wizchip_setctx(wizchip_ctx* ctx)
+{
+   wizchip_ctx* prev = WIZCHIP_CTX;
+
+   WIZCHIP_CTX = ctx ? ctx : &_WIZCHIP_CTX_;
+   return prev;
+}
 
 void reg_wizchip_cris_cbfunc(void(*cris_en)(void), void(*cris_ex)(void))
 {
@@ -405,6 +418,7 @@ void wizchip_sw_reset(void)
    getGAR(gw);  getSUBR(sn);  getSIPR(sip);
    setMR(MR_RST);
    getMR(); // for delay
+   wizchip_shadow_invalidate();
 //A2015051 : For indirect bus mode 
 #if _WIZCHIP_IO_MODE_  == _WIZCHIP_IO_MODE_BUS_INDIR_
    setMR(mr | MR_IND);
@@ -416,14 +430,24 @@ void wizchip_sw_reset(void)
    setSIPR(sip);
 }
 
+void wizchip_shadow_invalidate(void)
+{
+   memset(&WIZCHIP_CTX->shadow, 0, sizeof(WIZCHIP_CTX->shadow));
+}
+
 int8_t wizchip_init(uint8_t* txsize, uint8_t* rxsize)
+{
+   wizchip_sw_reset();
+   return wizchip_setbufsize(txsize, rxsize);
+}
+
+int8_t wizchip_setbufsize(uint8_t* txsize, uint8_t* rxsize)
 {
    int8_t i;
 #if _WIZCHIP_ < W5200
    int8_t j;
 #endif
    int8_t tmp = 0;
-   wizchip_sw_reset();
    if(txsize)
    {
       tmp = 0;
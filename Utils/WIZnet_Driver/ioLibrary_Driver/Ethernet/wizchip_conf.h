@@ -451,6 +451,112 @@ typedef struct wiz_NetTimeout_t
    uint16_t time_100us;    ///< time unit 100us
 }wiz_NetTimeout;
 
+// First port of the range socket() hands out for port 0, per context
+#define SOCK_ANY_PORT_NUM  0xC000   ///< First local port given to a socket opened on port 0
+
+/**
+ * @ingroup DATA_TYPE
+ *  SPI backend of a WIZCHIP.
+ * @details Carries the SPI frames the chip driver builds to the chip selected with
+ *          @ref wizchip_setctx(). A frame is the 24 bit address phase AddrSel
+ *          (offset << 8 | control byte) followed by len data bytes, read into rxBuf
+ *          or written from txBuf; the other buffer is NULL. use_dma is a hint that the
+ *          buffer lives in DMA-able memory. The functions return 0 on success.\n
+ *          The chip driver brings a default backend for its target; a host build
+ *          has none and every context sets @ref wizchip_ctx::spi.\n
+ *          A queue lets the frames of one driver call follow each other on the bus
+ *          without a round trip through the caller. With a queue, register writes
+ *          and wiz_send_data_queued() return with their frames still in flight; every
+ *          read and every unqueued frame of the chip flushes first, so the chip sees
+ *          the accesses in program order. @ref WIZCHIP_FLUSH() waits for them
+ *          explicitly. Chips sharing one SPI master must be flushed before another
+ *          one is selected.
+ */
+typedef struct __wizchip_spi_backend
+{
+   uint16_t max_len;  ///< Longest data phase of one frame, 0 : no limit. Longer buffers take several frames.
+   int (*transfer)(uint32_t AddrSel, uint8_t* rxBuf, uint8_t* txBuf, uint16_t len, uint8_t use_dma);  ///< One frame, done on return
+   int (*queue)(uint32_t AddrSel, uint8_t* rxBuf, uint8_t* txBuf, uint16_t len, uint8_t use_dma);  ///< One frame, may still be in flight on return. NULL : use transfer
+   int (*flush)(void);  ///< Wait for the queued frames. NULL : nothing is ever queued
+}wizchip_spi_backend;
+
+//! Register writes that may be queued before the driver flushes, see @ref wizchip_ctx::spi_post
+#define WIZCHIP_SPI_POST         16
+
+//! @ref wizchip_shadow valid bits of the common registers
+#define WIZCHIP_SHADOW_SHAR      0x01
+#define WIZCHIP_SHADOW_GAR       0x02
+#define WIZCHIP_SHADOW_SUBR      0x04
+#define WIZCHIP_SHADOW_SIPR      0x08
+//! @ref wizchip_shadow state bits of each socket
+#define WIZCHIP_SHADOW_Sn_PORT   0x01
+#define WIZCHIP_SHADOW_Sn_DIPR   0x02
+#define WIZCHIP_SHADOW_Sn_DPORT  0x04
+#define WIZCHIP_SHADOW_Sn_PEER   0x80  ///< Sn_DIPR and Sn_DPORT are written by the chip (TCP server)
+
+/**
+ * @ingroup DATA_TYPE
+ *  Copies of the registers only the host writes.
+ * @details Kept by the chip driver so that reading them back, or writing the value they
+ *          already hold, costs no SPI transfer. A copy is used only while its valid bit is set.
+ *          A zeroed shadow holds nothing, see @ref wizchip_shadow_invalidate().
+ */
+typedef struct __wizchip_shadow
+{
+   uint8_t   valid;                                   ///< WIZCHIP_SHADOW_xxx
+   uint8_t   shar[6];
+   uint8_t   gar[4];
+   uint8_t   subr[4];
+   uint8_t   sipr[4];
+   uint8_t   sn_valid[_WIZCHIP_SOCK_NUM_];            ///< WIZCHIP_SHADOW_Sn_xxx
+   uint8_t   sn_dipr[_WIZCHIP_SOCK_NUM_][4];
+   uint16_t  sn_port[_WIZCHIP_SOCK_NUM_];
+   uint16_t  sn_dport[_WIZCHIP_SOCK_NUM_];
+}wizchip_shadow;
+
+/**
+ * @ingroup DATA_TYPE
+ *  Per-chip driver context.
+ * @details Holds everything that belongs to one WIZCHIP: the host SPI bus and chip select,
+ *          the socket state kept by socket.c and the part of @ref wiz_NetInfo that is not
+ *          stored in the chip registers. Every I/O and socket function acts on the context
+ *          selected with @ref wizchip_setctx(), so a board with several chips keeps one
+ *          context per chip and selects it before using the chip's sockets.\n
+ *          @ref WIZCHIP (the callback table) stays shared, the chips are of the same type.
+ *          A zeroed context is valid; until @ref wizchip_setctx() is called a built-in
+ *          default context is used, which keeps single chip applications unchanged.
+ */
+typedef struct __wizchip_ctx
+{
+   uint8_t   spi_port;                                ///< Host SPI master the chip is wired to
+   void*     spi_config;                              ///< Host SPI configuration, including the chip select
+   const wizchip_spi_backend* spi;                    ///< SPI backend, NULL : the chip driver's default
+   uint32_t  spi_speed_khz;                           ///< SPI clock in KHz
+   uint8_t   spi_queued;                              ///< Frames queued by writes and not flushed yet
+   uint8_t   spi_post_len;                            ///< Bytes of spi_post in use until the flush
+   uint8_t   spi_post[WIZCHIP_SPI_POST];              ///< Data of the queued register writes
+   uint16_t  sock_any_port;                           ///< Next local port for @ref socket() with port 0
+   uint16_t  sock_io_mode;                            ///< Bit n set : socket n is non-blocking
+   uint16_t  sock_is_sending;                         ///< Bit n set : socket n has a SEND in progress
+   uint16_t  sock_remained_size[_WIZCHIP_SOCK_NUM_];  ///< Bytes left of the packet being received
+   uint8_t   sock_pack_info[_WIZCHIP_SOCK_NUM_];      ///< PACK_xxx state of the packet being received
+#if _WIZCHIP_ == 5200
+   uint16_t  sock_next_rd[_WIZCHIP_SOCK_NUM_];
+#endif
+#if _WIZCHIP_ == 5300
+   uint8_t   sock_remained_byte[_WIZCHIP_SOCK_NUM_];  ///< set by wiz_recv_data()
+#endif
+   uint8_t   dns[4];                                  ///< DNS server IP Address
+   dhcp_mode dhcp;                                    ///< 1 - Static, 2 - DHCP
+   wizchip_shadow shadow;                             ///< Host-written registers, see @ref wizchip_shadow
+}wizchip_ctx;
+
+/**
+ * @ingroup DATA_TYPE
+ *  The context all I/O and socket functions act on. Change it with @ref wizchip_setctx().
+ */
+extern wizchip_ctx* WIZCHIP_CTX;
+
 /**
  *@brief Registers call back function for critical section of I/O functions such as
  *\ref WIZCHIP_READ, @ref WIZCHIP_WRITE, @ref WIZCHIP_READ_BUF and @ref WIZCHIP_WRITE_BUF.
@@ -538,6 +644,15 @@ int8_t ctlnetwork(ctlnetwork_type cntype, void* arg);
  */ 
 void   wizchip_sw_reset(void);
 
+/**
+ * @ingroup extra_functions
+ * @brief Forgets the register copies of the selected context.
+ * @details Call it whenever the chip lost its registers behind the driver's back,
+ *          e.g. after pulsing its RSTn pin. @ref wizchip_sw_reset() does it itself.
+ * @sa wizchip_shadow
+ */
+void   wizchip_shadow_invalidate(void);
+
 /**
  * @ingroup extra_functions
  * @brief Initializes WIZCHIP with socket buffer size
@@ -548,6 +663,18 @@ void   wizchip_sw_reset(void);
  */
 int8_t wizchip_init(uint8_t* txsize, uint8_t* rxsize);
 
+/**
+ * @ingroup extra_functions
+ * @brief Set the socket buffer sizes without resetting WIZCHIP
+ * @details Same as @ref wizchip_init() without the reset, so the network information and
+ *          the interrupt masks are kept. The sockets must be closed: their buffers move.
+ * @param txsize Socket tx buffer sizes in KB. If null, left as is.
+ * @param rxsize Socket rx buffer sizes in KB. If null, left as is.
+ * @return 0 : succcess \n
+ *        -1 : fail. Invalid buffer size
+ */
+int8_t wizchip_setbufsize(uint8_t* txsize, uint8_t* rxsize);
+
 /** 
  * @ingroup extra_functions
  * @brief Clear Interrupt of WIZCHIP.
@@ -621,6 +748,15 @@ intr_kind wizchip_getinterruptmask(void);
 void wizchip_setnetinfo_partial(wiz_NetInfo* pnetinfo);
 #endif
 
+/**
+ * @ingroup extra_functions
+ * @brief Select the chip the following I/O and socket calls act on.
+ * @param ctx : Context of the chip, or NULL for the built-in default context.
+ * @return The previously selected context, so a caller can restore it.
+ * @note Not interrupt safe: only call it from the context that uses the sockets.
+ */
+wizchip_ctx* wizchip_setctx(wizchip_ctx* ctx);
+
 /**
 * @ingroup extra_functions
  * @brief Set the network information for WIZCHIP
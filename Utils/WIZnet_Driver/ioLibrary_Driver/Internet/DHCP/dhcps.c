@@ -1,9 +1,11 @@
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include "../../Ethernet/socket.h"
 
 #include "dhcps.h"
 #include "printf.h"
+#include "dlog.h"
 
 //static struct dhcp_server_state dhcp_server_state_machine;
 static uint8_t dhcp_server_state_machine = DHCP_SERVER_STATE_IDLE;
@@ -39,14 +41,28 @@ static dhcps_msg *dhcp_message_repository;
 #endif
 static int dhcp_message_total_options_lenth;
 
-/* allocated IP range */  
-static struct table  ip_table;
+/* lease store, indexed by host number */
+static struct dhcps_lease dhcps_leases[DHCPS_LEASE_HOSTS];
+static uint8_t dhcps_lease_hash[DHCPS_LEASE_HASH_SIZE];	/* first host of each MAC chain */
+static uint8_t dhcps_free_head, dhcps_free_tail;
+static uint8_t dhcps_dirty_head;
+static volatile uint32_t dhcps_tick_1s = 0;
+static uint32_t dhcps_next_expiry;	/* earliest lease expiry, 0 = none */
+
+/* rate limit of MACs without a lease, slots shared by MACs that hash alike */
+static struct {
+	uint8_t chaddr[HW_ADDRESS_LENGTH];
+	uint8_t count;
+	uint8_t window;
+} dhcps_rate[DHCPS_RATE_SLOTS];
+
+static dhcps_counter dhcps_counters;
+
+/* from the message being handled */
 static ip_addr client_request_ip;
+static ip_addr client_server_id;
 
 static uint8_t dhcp_client_ethernet_address[16];
-static uint8_t bound_client_ethernet_address[16];
-
-extern wiz_NetInfo gWIZNETINFO;
 
 uint8_t DHCPs_CHADDR[6]; // DHCP Server MAC address.
 uint8_t DHCPs_SOCKET; // Socket number for DHCP
@@ -87,106 +103,341 @@ ntohl(uint32_t n)
   return htonl(n);
 }
 
-static void unmark_ip_in_table()
+/* lease flags */
+#define DHCPS_LEASE_HASHED	(0x01)	/* chaddr is valid and linked in the MAC hash */
+#define DHCPS_LEASE_DIRTY	(0x02)	/* on the changed list */
+
+static uint8_t lease_hash(const uint8_t *mac)
 {
-//#define DEBUG_UNMARK_IP_IN_TABLE
-  uint8_t d;
-  d = search_mac();
-  if(d != 0)
+  uint32_t h = 0;
+  uint8_t i;
+
+  for (i = 0; i < HW_ADDRESS_LENGTH; i++)
+    h = h * 31 + mac[i];
+  return (uint8_t)(h % DHCPS_LEASE_HASH_SIZE);
+}
+
+static uint8_t lease_host(const struct dhcps_lease *l)
+{
+  return (uint8_t)(l - dhcps_leases);
+}
+
+static void lease_addr(const struct dhcps_lease *l, ip_addr *ipaddr)
+{
+  IP4_ADDR(ipaddr, ip4_addr1(&dhcps_network_id), ip4_addr2(&dhcps_network_id),
+    ip4_addr3(&dhcps_network_id), lease_host(l));
+}
+
+static struct dhcps_lease *lease_by_mac(const uint8_t *mac)
+{
+  uint8_t host = dhcps_lease_hash[lease_hash(mac)];
+
+  while (host != 0)
   {
-    #ifdef DEBUG_UNMARK_IP_IN_TABLE
-    printf("unmark ip %d\r\n", d);
-    #endif
-    if (0 < d && d <= 32)
-    {
-      #ifdef DEBUG_UNMARK_IP_IN_TABLE
-  		printf("\r\n ip_table.ip_range[0] = 0x%x\r\n",ip_table.ip_range[0]);
-      #endif  
+    if (memcmp(dhcps_leases[host].chaddr, mac, HW_ADDRESS_LENGTH) == 0)
+      return &dhcps_leases[host];
+    host = dhcps_leases[host].next_hash;
+  }
+  return NULL;
+}
 
-		  ip_table.ip_range[0] = UNMARK_RANGE1_IP_BIT(ip_table, d);	
-      
-      #ifdef DEBUG_UNMARK_IP_IN_TABLE
-  		printf("\r\n ip_table.ip_range[0] = 0x%x\r\n",ip_table.ip_range[0]);
-      #endif	
-  	}
-    else if (32 < d && d <= 64)
-    {
-      #ifdef DEBUG_UNMARK_IP_IN_TABLE
-  		printf("\r\n ip_table.ip_range[1] = 0x%x\r\n",ip_table.ip_range[1]);
-      #endif	
-      
-    	ip_table.ip_range[1] = UNMARK_RANGE2_IP_BIT(ip_table, (d - 32));
-      
-      #ifdef DEBUG_UNMARK_IP_IN_TABLE
-  		printf("\r\n ip_table.ip_range[1] = 0x%x\r\n",ip_table.ip_range[1]);
-      #endif	
-  	}
-    else if (64 < d && d <= 96)
-    {
-      #ifdef DEBUG_UNMARK_IP_IN_TABLE
-  		printf("\r\n ip_table.ip_range[2] = 0x%x\r\n",ip_table.ip_range[2]);
-      #endif	
-      
-  		ip_table.ip_range[2] = UNMARK_RANGE3_IP_BIT(ip_table, (d - 64));
-      
-      #ifdef DEBUG_UNMARK_IP_IN_TABLE
-  		printf("\r\n ip_table.ip_range[2] = 0x%x\r\n",ip_table.ip_range[2]);
-      #endif	
-  	}
-    else if (96 < d && d <= 128)
-    {
-      #ifdef DEBUG_UNMARK_IP_IN_TABLE
-  		printf("\r\n ip_table.ip_range[3] = 0x%x\r\n",ip_table.ip_range[3]);
-      #endif	
-      
-  		ip_table.ip_range[3] = UNMARK_RANGE4_IP_BIT(ip_table, (d - 96));
-      
-      #ifdef DEBUG_UNMARK_IP_IN_TABLE
-  		printf("\r\n ip_table.ip_range[3] = 0x%x\r\n",ip_table.ip_range[3]);
-      #endif	
-  	}
+/* The lease of an address on our subnet, NULL for anything else. */
+static struct dhcps_lease *lease_by_addr(const ip_addr *ipaddr)
+{
+  uint8_t host;
+
+  if ((ipaddr->addr & dhcps_local_mask.addr) != dhcps_network_id.addr)
+    return NULL;
+  host = (uint8_t)ip4_addr4(ipaddr);
+  if (host == 0)
+    return NULL;
+  return &dhcps_leases[host];
+}
+
+static void lease_hash_del(struct dhcps_lease *l)
+{
+  uint8_t *link;
+
+  if (!(l->flags & DHCPS_LEASE_HASHED))
+    return;
+  link = &dhcps_lease_hash[lease_hash(l->chaddr)];
+  while (*link != lease_host(l))
+    link = &dhcps_leases[*link].next_hash;
+  *link = l->next_hash;
+  l->flags &= ~DHCPS_LEASE_HASHED;
+}
+
+static void lease_hash_add(struct dhcps_lease *l, const uint8_t *mac)
+{
+  uint8_t *head;
+
+  lease_hash_del(l);
+  memcpy(l->chaddr, mac, HW_ADDRESS_LENGTH);
+  head = &dhcps_lease_hash[lease_hash(mac)];
+  l->next_hash = *head;
+  *head = lease_host(l);
+  l->flags |= DHCPS_LEASE_HASHED;
+}
+
+/* Free addresses are handed out from the head and returned at the tail, so
+ * the address a client just gave up is the last one to be reused. */
+static void pool_append(struct dhcps_lease *l)
+{
+  uint8_t host = lease_host(l);
+
+  l->next_free = 0;
+  l->prev_free = dhcps_free_tail;
+  if (dhcps_free_tail != 0)
+    dhcps_leases[dhcps_free_tail].next_free = host;
+  else
+    dhcps_free_head = host;
+  dhcps_free_tail = host;
+}
+
+static void pool_unlink(struct dhcps_lease *l)
+{
+  if (l->prev_free != 0)
+    dhcps_leases[l->prev_free].next_free = l->next_free;
+  else
+    dhcps_free_head = l->next_free;
+  if (l->next_free != 0)
+    dhcps_leases[l->next_free].prev_free = l->prev_free;
+  else
+    dhcps_free_tail = l->prev_free;
+}
+
+static void lease_mark_dirty(struct dhcps_lease *l)
+{
+  if (l->flags & DHCPS_LEASE_DIRTY)
+    return;
+  l->flags |= DHCPS_LEASE_DIRTY;
+  l->next_dirty = dhcps_dirty_head;
+  dhcps_dirty_head = lease_host(l);
+}
+
+/* Move a lease to state for seconds (0: no expiry), keeping the free pool,
+ * the changed list and the next sweep time in step. */
+static void lease_set(struct dhcps_lease *l, uint8_t state, uint32_t seconds)
+{
+  if (l->state == DHCPS_LEASE_FREE && state != DHCPS_LEASE_FREE)
+    pool_unlink(l);
+  else if (l->state != DHCPS_LEASE_FREE && state == DHCPS_LEASE_FREE)
+    pool_append(l);
+
+  /* Only bindings are reported, an offer that times out is nobody's business. */
+  if (l->state == DHCPS_LEASE_BOUND || state == DHCPS_LEASE_BOUND)
+    lease_mark_dirty(l);
+
+  l->state = state;
+  l->expires = seconds ? dhcps_tick_1s + seconds : 0;
+  if (l->expires != 0 &&
+    (dhcps_next_expiry == 0 || (int32_t)(l->expires - dhcps_next_expiry) < 0))
+    dhcps_next_expiry = l->expires;
+}
+
+/* Hand l to mac. l is free or already belongs to mac. */
+static void lease_claim(struct dhcps_lease *l, const uint8_t *mac, uint8_t state, uint32_t seconds)
+{
+  struct dhcps_lease *old;
+
+  if (!(l->flags & DHCPS_LEASE_HASHED) || memcmp(l->chaddr, mac, HW_ADDRESS_LENGTH) != 0)
+  {
+    /* forget the address mac had before, and who had this one */
+    old = lease_by_mac(mac);
+    if (old != NULL)
+      lease_hash_del(old);
+    lease_hash_add(l, mac);
   }
+  lease_set(l, state, seconds);
 }
 
-static void mark_ip_in_table(uint8_t d)
-{
-#if (debug_dhcps)   
-  	printf("\r\n mark ip %d\r\n",d);
-#endif	
-	if (0 < d && d <= 32) {
-		ip_table.ip_range[0] = MARK_RANGE1_IP_BIT(ip_table, d);	
-#if (debug_dhcps)		
-		printf("\r\n ip_table.ip_range[0] = 0x%x\r\n",ip_table.ip_range[0]);
-#endif	
-	} else if (32 < d && d <= 64) {
-	  	ip_table.ip_range[1] = MARK_RANGE2_IP_BIT(ip_table, (d - 32));
-#if (debug_dhcps)	
-		printf("\r\n ip_table.ip_range[1] = 0x%x\r\n",ip_table.ip_range[1]);
-#endif	
-	} else if (64 < d && d <= 96) {
-		ip_table.ip_range[2] = MARK_RANGE3_IP_BIT(ip_table, (d - 64));
-#if (debug_dhcps)	
-		printf("\r\n ip_table.ip_range[2] = 0x%x\r\n",ip_table.ip_range[2]);
-#endif	
-	} else if (96 < d && d <= 128) {
-		ip_table.ip_range[3] = MARK_RANGE4_IP_BIT(ip_table, (d - 96));
-#if (debug_dhcps)	
-		printf("\r\n ip_table.ip_range[3] = 0x%x\r\n",ip_table.ip_range[3]);
-#endif	
-	} else {
-	  	printf("\r\n Request ip over the range(1-128) \r\n");
-	}
+static void lease_info(const struct dhcps_lease *l, dhcps_lease_info *info)
+{
+  ip_addr ipaddr;
+  int32_t left = (int32_t)(l->expires - dhcps_tick_1s);
+
+  memcpy(info->chaddr, l->chaddr, HW_ADDRESS_LENGTH);
+  lease_addr(l, &ipaddr);
+  memcpy(info->ip, &ipaddr, sizeof(info->ip));
+  info->bound = (l->state == DHCPS_LEASE_BOUND);
+  info->remaining = (info->bound && left > 0) ? (uint32_t)left : 0;
+}
 
-  memcpy(ip_table.chaddr[d], dhcp_client_ethernet_address, sizeof(ip_table.chaddr[d]));
-  
-#if (debug_dhcps)
-  printf("\r\nMark %d.%d.%d.%d\r\n", ip4_addr1(&dhcps_local_address), ip4_addr2(&dhcps_local_address), ip4_addr3(&dhcps_local_address), ip4_addr4(&dhcps_local_address));
-  for(int i=0; i<16; i++)
+static void dhcps_lease_init(void)
+{
+  struct dhcps_lease *l;
+  uint16_t host, start = 1, end = DHCPS_LEASE_HOSTS - 1;
+
+  memset(dhcps_leases, 0, sizeof(dhcps_leases));
+  memset(dhcps_lease_hash, 0, sizeof(dhcps_lease_hash));
+  dhcps_free_head = dhcps_free_tail = 0;
+  dhcps_dirty_head = 0;
+  dhcps_next_expiry = 0;
+
+  if (dhcps_addr_pool_set)
   {
-    printf("%x:", ip_table.chaddr[d][i]);
+    start = ip4_addr4(&dhcps_addr_pool_start);
+    end = ip4_addr4(&dhcps_addr_pool_end);
   }
-  printf("\r\n");
-#endif
+
+  for (host = 0; host < DHCPS_LEASE_HOSTS; host++)
+  {
+    l = &dhcps_leases[host];
+    l->state = DHCPS_LEASE_RESERVED;
+    if (host == 0 || host < start || host > end ||
+      host == ip4_addr4(&dhcps_local_address) ||
+      host == ip4_addr4(&dhcps_local_gateway) ||
+      host == ip4_addr4(&dhcps_subnet_broadcast))
+      continue;
+    l->state = DHCPS_LEASE_FREE;
+    pool_append(l);
+  }
+}
+
+/**
+  * @brief  pick the address to offer to the client: the one it already has
+  *         or had, the one it asks for if that is free, or the oldest free one.
+  * @retval 1 if dhcps_allocated_client_address is set, 0 if the pool is empty.
+  */
+static uint8_t dhcps_offer_lease(struct dhcps_lease *l)
+{
+  if (l == NULL)
+  {
+    l = lease_by_addr(&client_request_ip);
+    if (l == NULL || l->state != DHCPS_LEASE_FREE)
+      l = dhcps_free_head ? &dhcps_leases[dhcps_free_head] : NULL;
+  }
+
+  if (l == NULL)
+  {
+    DLOG(DLOG_DHCPS_NO_IP);
+    return 0;
+  }
+
+  /* a bound client that asks again keeps its lease until it requests */
+  if (l->state != DHCPS_LEASE_BOUND)
+    lease_claim(l, dhcp_client_ethernet_address, DHCPS_LEASE_OFFERED, DHCPS_OFFER_TIME);
+  lease_addr(l, &dhcps_allocated_client_address);
+  return 1;
+}
+
+/**
+  * @brief  bind the requested address if it is the client's or free.
+  * @retval DHCP_SERVER_STATE_ACK or DHCP_SERVER_STATE_NAK.
+  */
+static uint8_t dhcps_request_lease(struct dhcps_lease *l)
+{
+  struct dhcps_lease *r = lease_by_addr(&client_request_ip);
+
+  if (r == NULL)
+    return DHCP_SERVER_STATE_NAK;
+  /* the client holds another address, or the requested one is somebody else's */
+  if (l != NULL && l->state != DHCPS_LEASE_FREE && l != r)
+    return DHCP_SERVER_STATE_NAK;
+  if (r != l && r->state != DHCPS_LEASE_FREE)
+    return DHCP_SERVER_STATE_NAK;
+
+  lease_claim(r, dhcp_client_ethernet_address, DHCPS_LEASE_BOUND, DHCPS_LEASE_TIME);
+  lease_addr(r, &dhcps_allocated_client_address);
+  return DHCP_SERVER_STATE_ACK;
+}
+
+void dhcps_time_handler(void)
+{
+  dhcps_tick_1s++;
+}
+
+void dhcps_lease_sweep(void)
+{
+  struct dhcps_lease *l;
+  uint32_t now = dhcps_tick_1s;
+  uint32_t next = 0;
+  uint16_t host;
+
+  if (dhcps_next_expiry == 0 || (int32_t)(now - dhcps_next_expiry) < 0)
+    return;
+
+  for (host = 1; host < DHCPS_LEASE_HOSTS; host++)
+  {
+    l = &dhcps_leases[host];
+    if (l->expires == 0)
+      continue;
+    if ((int32_t)(now - l->expires) >= 0)
+      lease_set(l, DHCPS_LEASE_FREE, 0);
+    else if (next == 0 || (int32_t)(l->expires - next) < 0)
+      next = l->expires;
+  }
+  dhcps_next_expiry = next;
+}
+
+int8_t dhcps_lease_changed(dhcps_lease_info *info)
+{
+  struct dhcps_lease *l;
+
+  if (dhcps_dirty_head == 0)
+    return 0;
+
+  l = &dhcps_leases[dhcps_dirty_head];
+  dhcps_dirty_head = l->next_dirty;
+  l->flags &= ~DHCPS_LEASE_DIRTY;
+  lease_info(l, info);
+  return 1;
+}
+
+uint8_t dhcps_lease_changed_peek(dhcps_lease_info *info, uint8_t max)
+{
+  uint8_t host = dhcps_dirty_head;
+  uint8_t n;
+
+  for (n = 0; n < max && host != 0; n++)
+  {
+    lease_info(&dhcps_leases[host], &info[n]);
+    host = dhcps_leases[host].next_dirty;
+  }
+  return n;
+}
+
+void dhcps_lease_changed_take(uint8_t count)
+{
+  struct dhcps_lease *l;
+
+  while (count-- > 0 && dhcps_dirty_head != 0)
+  {
+    l = &dhcps_leases[dhcps_dirty_head];
+    dhcps_dirty_head = l->next_dirty;
+    l->flags &= ~DHCPS_LEASE_DIRTY;
+  }
+}
+
+void dhcps_lease_changed_all(void)
+{
+  uint16_t host;
+
+  for (host = 1; host < DHCPS_LEASE_HOSTS; host++)
+  {
+    if (dhcps_leases[host].state == DHCPS_LEASE_BOUND)
+      lease_mark_dirty(&dhcps_leases[host]);
+  }
+}
+
+int8_t dhcps_lease_restore(const dhcps_lease_info *info)
+{
+  struct dhcps_lease *l, *old;
+  ip_addr ipaddr;
+
+  if (!info->bound || info->remaining == 0)
+    return 0;
+
+  memcpy(&ipaddr, info->ip, sizeof(ipaddr));
+  l = lease_by_addr(&ipaddr);
+  if (l == NULL || l->state != DHCPS_LEASE_FREE)
+    return 0;
+  old = lease_by_mac(info->chaddr);
+  if (old != NULL && old->state != DHCPS_LEASE_FREE)
+    return 0;
+
+  lease_claim(l, info->chaddr, DHCPS_LEASE_BOUND, info->remaining);
+  return 1;
 }
 
 void dhcps_set_addr_pool(int addr_pool_set, ip_addr * addr_pool_start, ip_addr *addr_pool_end)
@@ -216,6 +467,8 @@ void dhcps_set_addr_pool(int addr_pool_set, ip_addr * addr_pool_start, ip_addr *
   */
 void dhcps_init(uint8_t s, uint8_t * buf)
 {	
+  wiz_NetInfo netinfo;
+
 //	printf("dhcps_init,wlan:%c\n\r",pnetif->name[1]);
 
   getSHAR(DHCPs_CHADDR);
@@ -241,11 +494,11 @@ void dhcps_init(uint8_t s, uint8_t * buf)
   dhcps_state = 0;
 
   IP4_ADDR(&dhcps_send_broadcast_address, 255, 255, 255, 255);
-	/* get net info from net interface */
-
-  memcpy(&dhcps_local_address, gWIZNETINFO.ip, sizeof(gWIZNETINFO.ip));
-	memcpy(&dhcps_local_mask, gWIZNETINFO.sn, sizeof(gWIZNETINFO.sn));
-	memcpy(&dhcps_local_gateway, gWIZNETINFO.gw, sizeof(gWIZNETINFO.gw));
+	/* get net info from net interface, the chip selected by wizchip_setctx() */
+  wizchip_getnetinfo(&netinfo);
+  memcpy(&dhcps_local_address, netinfo.ip, sizeof(netinfo.ip));
+	memcpy(&dhcps_local_mask, netinfo.sn, sizeof(netinfo.sn));
+	memcpy(&dhcps_local_gateway, netinfo.gw, sizeof(netinfo.gw));
 
 	/* calculate the usable network ip range */
 	dhcps_network_id.addr = (dhcps_local_address.addr & (dhcps_local_mask.addr));
@@ -263,69 +516,51 @@ void dhcps_init(uint8_t s, uint8_t * buf)
     ip4_addr2(&dhcps_local_address), ip4_addr3(&dhcps_local_address),
     (ip4_addr4(&dhcps_local_address)) + 1 );
 #else
-
-	//dhcps_ip_table = (struct ip_table *)(pvPortMalloc(sizeof(struct ip_table)));
-	memset(&ip_table, 0, sizeof(struct table));
 	memset(&dhcps_allocated_client_address, 0, sizeof(ip_addr));
-	memset(bound_client_ethernet_address, 0, sizeof(bound_client_ethernet_address));
-	mark_ip_in_table((uint8_t)ip4_addr4(&dhcps_local_address));
-	mark_ip_in_table((uint8_t)ip4_addr4(&dhcps_local_gateway));
-#if 0
-	for (i = 1; i < ip4_addr4(&dhcps_local_address); i++) {
-		mark_ip_in_table(i);
-	}
-#endif	
+	dhcps_lease_init();
+	memset(dhcps_rate, 0, sizeof(dhcps_rate));
 #endif
 
 }
 
 uint8_t dhcps_handle_state_machine_change(uint8_t option_message_type)
 {
+#if (!IS_USE_FIXED_IP)
+	struct dhcps_lease *lease = lease_by_mac(dhcp_client_ethernet_address);
+#endif
+
 	switch (option_message_type) {
 	case DHCP_MESSAGE_TYPE_DECLINE:
+#if (!IS_USE_FIXED_IP)
+		/* the address is in use on the wire; keep it out of the pool for a while */
+		if (lease != NULL && lease->state != DHCPS_LEASE_FREE &&
+			lease_by_addr(&client_request_ip) == lease) {
+			lease_hash_del(lease);
+			lease_set(lease, DHCPS_LEASE_RESERVED, DHCPS_DECLINE_TIME);
+		}
+#endif
 		dhcp_server_state_machine = DHCP_SERVER_STATE_IDLE;
 		break;
 	case DHCP_MESSAGE_TYPE_DISCOVER:
+#if (!IS_USE_FIXED_IP)
+		dhcp_server_state_machine = dhcps_offer_lease(lease) ?
+			DHCP_SERVER_STATE_OFFER : DHCP_SERVER_STATE_IDLE;
+#else
 		if (dhcp_server_state_machine == DHCP_SERVER_STATE_IDLE) {
 			dhcp_server_state_machine = DHCP_SERVER_STATE_OFFER;
 		}
+#endif
 		break;
 	case DHCP_MESSAGE_TYPE_REQUEST:
 
 #if (!IS_USE_FIXED_IP) 	
-		if (dhcp_server_state_machine == DHCP_SERVER_STATE_OFFER) {
-			if (ip4_addr4(&dhcps_allocated_client_address) != 0) { 
-				if (memcmp((void *)&dhcps_allocated_client_address, (void *)&client_request_ip, 4) == 0) {  	
-					dhcp_server_state_machine = DHCP_SERVER_STATE_ACK;
-			  	} else {
-				  	dhcp_server_state_machine = DHCP_SERVER_STATE_NAK;
-			  	}
-			} else {
-			  	dhcp_server_state_machine = DHCP_SERVER_STATE_NAK;
-			}
-		} else if (dhcp_server_state_machine == DHCP_SERVER_STATE_IDLE) {
-			if ((ip4_addr4(&dhcps_allocated_client_address) != 0) &&
-				(memcmp((void *)&dhcps_allocated_client_address, (void *)&client_request_ip, 4) == 0) &&
-				(memcmp((void *)&bound_client_ethernet_address, (void *)&dhcp_client_ethernet_address, 16) == 0)) {
-				dhcp_server_state_machine = DHCP_SERVER_STATE_ACK;
-			} else if ((ip4_addr1(&client_request_ip) == ip4_addr1(&dhcps_network_id)) &&
-				(ip4_addr2(&client_request_ip) == ip4_addr2(&dhcps_network_id)) &&
-				(ip4_addr3(&client_request_ip) == ip4_addr3(&dhcps_network_id))) {
-				uint8_t request_ip4 = (uint8_t) ip4_addr4(&client_request_ip);
-				if ((request_ip4 != 0) && (((request_ip4 - 1) / 32) >= 0) && (((request_ip4 - 1) / 32) <= 3) &&
-					(((ip_table.ip_range[(request_ip4 - 1) / 32] >> ((request_ip4 - 1) % 32)) & 0x01) == 0)) {
-					IP4_ADDR(&dhcps_allocated_client_address, (ip4_addr1(&dhcps_network_id)),
-						ip4_addr2(&dhcps_network_id), ip4_addr3(&dhcps_network_id), request_ip4);
-					memcpy(bound_client_ethernet_address, dhcp_client_ethernet_address, sizeof(bound_client_ethernet_address));
-					dhcp_server_state_machine = DHCP_SERVER_STATE_ACK;
-				} else {
-					dhcp_server_state_machine = DHCP_SERVER_STATE_NAK;
-				}
-			} else {
-				dhcp_server_state_machine = DHCP_SERVER_STATE_NAK;
-			}
+		if (client_server_id.addr != 0 && client_server_id.addr != dhcps_local_address.addr) {
+			/* the client took another server's offer */
+			if (lease != NULL && lease->state == DHCPS_LEASE_OFFERED)
+				lease_set(lease, DHCPS_LEASE_FREE, 0);
+			dhcp_server_state_machine = DHCP_SERVER_STATE_IDLE;
 		} else {
-			dhcp_server_state_machine = DHCP_SERVER_STATE_NAK;
+			dhcp_server_state_machine = dhcps_request_lease(lease);
 		}
 #else		
 		if (!(dhcp_server_state_machine == DHCP_SERVER_STATE_ACK ||
@@ -335,6 +570,10 @@ uint8_t dhcps_handle_state_machine_change(uint8_t option_message_type)
 #endif
 		break;
 	case DHCP_MESSAGE_TYPE_RELEASE:
+#if (!IS_USE_FIXED_IP)
+		if (lease != NULL && lease->state != DHCPS_LEASE_FREE)
+			lease_set(lease, DHCPS_LEASE_FREE, 0);
+#endif
 		dhcp_server_state_machine = DHCP_SERVER_STATE_RELEASE;
 		break;
 	}
@@ -356,9 +595,22 @@ static uint8_t dhcps_handle_msg_options(uint8_t *option_start, int16_t total_opt
   uint8_t *option_end = option_start + total_option_length;
   //dhcp_server_state_machine = DHCP_SERVER_STATE_IDLE;
 
+  client_request_ip.addr = 0;
+  client_server_id.addr = 0;
+
   /* begin process the dhcp option info */
   while (option_start < option_end)
   { 
+    if (*option_start == DHCP_OPTION_CODE_END)
+      break;
+    if (*option_start == DHCP_OPTION_CODE_PAD)
+    {
+      option_start++;
+      continue;
+    }
+    if (option_end - option_start < 2 || option_end - option_start < option_start[1] + 2)
+      break;
+
     switch ((uint8_t)*option_start)
     {
       case DHCP_OPTION_CODE_MSG_TYPE: 
@@ -376,10 +628,18 @@ static uint8_t dhcps_handle_msg_options(uint8_t *option_start, int16_t total_opt
         memcpy((char *)&client_request_ip, (char *)option_start + 2, 4);	
         #endif
       break;
+
+      case DHCP_OPTION_CODE_SERVER_ID :
+        memcpy((char *)&client_server_id, (char *)option_start + 2, 4);
+      break;
     } 
     // calculate the options offset to get next option's base addr
     option_start += option_start[1] + 2; // optptr[1]: length value + (code(1)+ Len(1))
   }
+
+  /* a renewing or rebinding client names its address in ciaddr instead */
+  if (client_request_ip.addr == 0)
+    memcpy((char *)&client_request_ip, (char *)dhcp_message_repository->ciaddr, 4);
 	return dhcps_handle_state_machine_change(option_message_type);        
 }
 
@@ -406,7 +666,7 @@ static uint8_t dhcps_check_msg_and_handle_options(uint16_t len)
   }
 #endif
 
-	dhcp_message_option_offset = ((int)dhcp_message_repository->options - (int)dhcp_message_repository);
+	dhcp_message_option_offset = (int)((uint8_t *)dhcp_message_repository->options - (uint8_t *)dhcp_message_repository);
 #ifdef DEBUG_DHCPS_CHECK_MSG_AND_HANDLE_OPTIONS
   printf("(int)dhcp_message_repository->options = %x(%d)\r\n", (int)dhcp_message_repository->options, (int)dhcp_message_repository->options);
   printf("(int)dhcp_message_repository->op = %x(%d)\r\n", (int)dhcp_message_repository->op, (int)dhcp_message_repository->op);
@@ -428,56 +688,6 @@ static uint8_t dhcps_check_msg_and_handle_options(uint16_t len)
 	return 0;
 }
 
-static uint8_t search_mac()
-{
-//#define DEBUG_SEARCH_MAC
-
-  uint8_t i;
-  for(i=0; i<128; i++)
-  {
-    if(0 == memcmp(ip_table.chaddr[i], dhcp_client_ethernet_address, sizeof(dhcp_client_ethernet_address)))
-    {
-      #ifdef DEBUG_SEARCH_MAC
-      printf("Matched %d\r\n", i);
-      #endif
-      return i;
-    }
-  }
-
-  return 0;
-}
-
-
-/**
-  * @brief  get one usable ip from the ip table of dhcp server. 
-  * @param: None 
-  * @retval the usable index which represent the ip4_addr(ip) of allocated ip addr.
-  */
-#if (!IS_USE_FIXED_IP)
-static uint8_t search_next_ip(void)
-{       
-	uint8_t range_count, offset_count;
-	uint8_t start, end;
-	if(dhcps_addr_pool_set){
-		start = (uint8_t)ip4_addr4(&dhcps_addr_pool_start);
-		end = (uint8_t)ip4_addr4(&dhcps_addr_pool_end);
-	}else{
-		start = 0;
-		end = 255;
-	}
-	for (range_count = 0; range_count < 4; range_count++) {
-		for (offset_count = 0;offset_count < 32; offset_count++) {
-			if ((((ip_table.ip_range[range_count] >> offset_count) & 0x01) == 0) 
-				&&(((range_count * 32) + (offset_count + 1)) >= start)
-				&&(((range_count * 32) + (offset_count + 1)) <= end)) {
-				return ((range_count * 32) + (offset_count + 1));
-			}
-		}
-	}
-	return 0;
-}
-#endif
-
 /**
   * @brief  fill in the option field with message type of a dhcp message. 
   * @param  msg_option_base_addr: the addr be filled start.
@@ -529,7 +739,7 @@ static uint8_t *fill_one_option_content(uint8_t *option_base_addr,
   * @param  optptr  the addr which the tail of dhcp magic field. 
   * @retval the addr represent to add the end of option.
   */
-static void add_offer_options(uint8_t *option_start_address)
+static uint8_t *add_offer_options(uint8_t *option_start_address)
 {
 	uint8_t *temp_option_addr;
 	/* add DHCP options 1. 
@@ -578,10 +788,11 @@ static void add_offer_options(uint8_t *option_start_address)
 	This option specifies whether or not the client should solicit routers */
 	temp_option_addr = fill_one_option_content(temp_option_addr,
 		DHCP_OPTION_CODE_PERFORM_ROUTER_DISCOVERY, DHCP_OPTION_LENGTH_ONE,
-								NULL);
+					(void *)&dhcp_option_router_discovery_off);
   
 	*temp_option_addr++ = DHCP_OPTION_CODE_END;
 
+	return temp_option_addr;
 }
 
 
@@ -613,162 +824,236 @@ static void dhcps_initialize_message(dhcps_msg *dhcp_message_repository, ip_addr
   	sizeof(dhcp_message_repository->giaddr));
   memcpy((char *)dhcp_message_repository->chaddr, &dhcp_client_ethernet_address,
   	sizeof(dhcp_message_repository->chaddr));
-  memset((char *)dhcp_message_repository->sname,  0,
-  	sizeof(dhcp_message_repository->sname));
-  memset((char *)dhcp_message_repository->file,   0,
-  	sizeof(dhcp_message_repository->file));
-  memset((char *)dhcp_message_repository->options, 0,
-  	dhcp_message_total_options_lenth);
+  /* sname and file are sent from dhcps_zero, see dhcps_send_reply() */
   memcpy((char *)dhcp_message_repository->options, (char *)dhcp_magic_cookie,
   	sizeof(dhcp_magic_cookie));
 }
 
 
+/* The empty sname and file fields of every reply */
+static uint8_t dhcps_zero[sizeof(((dhcps_msg *)0)->sname) + sizeof(((dhcps_msg *)0)->file)];
+
 /**
-  * @brief  init and fill in  the needed content of dhcp offer message.  
-  * @param  packet_buffer packet buffer for UDP.
-  * @retval None.
+  * @brief  broadcast the message built in dhcp_message_repository, cut after
+  *         the end option but not below DHCPS_MIN_REPLY_LEN.
+  * @details The header up to chaddr and the options are sent from the message,
+  *          sname and file from dhcps_zero, all as one datagram, so only the
+  *          padding after the end option is cleared in the message.
+  * @param  option_end: the addr following the end option.
+  * @retval 1 if it was sent, 0 otherwise.
   */
-static void dhcps_send_offer()
+static uint8_t dhcps_send_reply(uint8_t *option_end)
 {
-	uint8_t temp_ip = 0;
-  uint8_t search_ip = 0;
+  uint16_t len = (uint16_t)(option_end - (uint8_t *)dhcp_message_repository);
+  wiz_iovec iov[3];
 
-#if (!IS_USE_FIXED_IP)
-	if ((ip4_addr4(&dhcps_allocated_client_address) != 0) &&
-		(memcmp((void *)&dhcps_allocated_client_address, (void *)&client_request_ip, 4) == 0) &&
-		(memcmp((void *)&bound_client_ethernet_address, (void *)&dhcp_client_ethernet_address, 16) == 0)) {
-		temp_ip = (uint8_t) ip4_addr4(&client_request_ip);
-	} else if ((ip4_addr1(&client_request_ip) == ip4_addr1(&dhcps_network_id)) &&
-		(ip4_addr2(&client_request_ip) == ip4_addr2(&dhcps_network_id)) &&
-		(ip4_addr3(&client_request_ip) == ip4_addr3(&dhcps_network_id))) {
-		uint8_t request_ip4 = (uint8_t) ip4_addr4(&client_request_ip);
-		if ((request_ip4 != 0) && (((request_ip4 - 1) / 32) >= 0) && (((request_ip4 - 1) / 32) <= 3) &&
-			(((ip_table.ip_range[(request_ip4 - 1) / 32] >> ((request_ip4 - 1) % 32)) & 0x01) == 0)) {
-			temp_ip = request_ip4;
-		}
-	}
-
-  // Search MAC Address in a table
-  search_ip = search_mac();
-  if(search_ip != 0 && temp_ip == 0)
+  if (len < DHCPS_MIN_REPLY_LEN)
   {
-    temp_ip = search_ip;
+    memset(option_end, 0, DHCPS_MIN_REPLY_LEN - len);
+    len = DHCPS_MIN_REPLY_LEN;
   }
 
-	/* create new client ip */
-	if(temp_ip == 0) temp_ip = search_next_ip();
+  iov[0].buf = (uint8_t *)dhcp_message_repository;
+  iov[0].len = offsetof(dhcps_msg, sname);
+  iov[1].buf = dhcps_zero;
+  iov[1].len = sizeof(dhcps_zero);
+  iov[2].buf = dhcp_message_repository->options;
+  iov[2].len = len - offsetof(dhcps_msg, options);
 
-  #if (debug_dhcps)
-	printf("\r\n temp_ip = %d\r\n",temp_ip);
-  #endif
+  return sock_sendtov(DHCPs_SOCKET, iov, 3, (uint8_t *)&dhcps_send_broadcast_address.addr, DHCP_CLIENT_PORT) > 0;
+}
 
-	if (temp_ip == 0) {
-#if 0	
-	  	memset(&ip_table, 0, sizeof(struct table));
-		mark_ip_in_table((uint8_t)ip4_addr4(&dhcps_local_address));
-		printf("\r\n reset ip table!!\r\n");	
-#endif	
-		printf("\r\n No useable ip!!!!\r\n");
-	}
-	
-	IP4_ADDR(&dhcps_allocated_client_address, (ip4_addr1(&dhcps_network_id)),
-		ip4_addr2(&dhcps_network_id), ip4_addr3(&dhcps_network_id), temp_ip);
-	memcpy(bound_client_ethernet_address, dhcp_client_ethernet_address, sizeof(bound_client_ethernet_address));
-#endif   
+/**
+  * @brief  init and fill in  the needed content of dhcp offer message.  
+  * @param  None.
+  * @retval 1 if it was sent, 0 otherwise.
+  */
+static uint8_t dhcps_send_offer()
+{
   dhcps_initialize_message(dhcp_message_repository, dhcps_allocated_client_address);
-  add_offer_options(add_msg_type(&dhcp_message_repository->options[4], DHCP_MESSAGE_TYPE_OFFER));
-  
-	sock_sendto(DHCPs_SOCKET, (uint8_t *)dhcp_message_repository, sizeof(dhcps_msg), (uint8_t *)&dhcps_send_broadcast_address.addr, DHCP_CLIENT_PORT);
+  return dhcps_send_reply(add_offer_options(add_msg_type(&dhcp_message_repository->options[4], DHCP_MESSAGE_TYPE_OFFER)));
 }
 
 /**
   * @brief  init and fill in  the needed content of dhcp nak message.  
-  * @param  packet buffer packet buffer for UDP.
-  * @retval None.
+  * @param  None.
+  * @retval 1 if it was sent, 0 otherwise.
   */
-static void dhcps_send_nak()
+static uint8_t dhcps_send_nak()
 {
 	ip_addr zero_address;
 	IP4_ADDR(&zero_address, 0, 0, 0, 0);
 
   dhcps_initialize_message(dhcp_message_repository, zero_address);
-  add_msg_type(&dhcp_message_repository->options[4], DHCP_MESSAGE_TYPE_NAK);
-
-  sock_sendto(DHCPs_SOCKET, (uint8_t *)dhcp_message_repository, sizeof(dhcps_msg), (uint8_t *)&dhcps_send_broadcast_address.addr, DHCP_CLIENT_PORT);
+  return dhcps_send_reply(add_msg_type(&dhcp_message_repository->options[4], DHCP_MESSAGE_TYPE_NAK));
 }
 
 /**
   * @brief  init and fill in  the needed content of dhcp ack message.  
-  * @param  packet buffer packet buffer for UDP.
-  * @retval None.
+  * @param  None.
+  * @retval 1 if it was sent, 0 otherwise.
   */
-static void dhcps_send_ack()
+static uint8_t dhcps_send_ack()
 {
   dhcps_initialize_message(dhcp_message_repository, dhcps_allocated_client_address);
-  add_offer_options(add_msg_type(&dhcp_message_repository->options[4], DHCP_MESSAGE_TYPE_ACK));
-  
-  sock_sendto(DHCPs_SOCKET, (uint8_t *)dhcp_message_repository, sizeof(dhcps_msg), (uint8_t *)&dhcps_send_broadcast_address.addr, DHCP_CLIENT_PORT);
+  return dhcps_send_reply(add_offer_options(add_msg_type(&dhcp_message_repository->options[4], DHCP_MESSAGE_TYPE_ACK)));
 }
 
-uint8_t dhcps_run(void)
+static uint8_t dhcps_rate_take(uint8_t *count, uint8_t *window)
 {
-	uint8_t client_addr[6];
-	uint16_t client_port;
-	uint16_t len;
+  uint8_t now = (uint8_t)dhcps_tick_1s;
 
-	uint8_t * p;
-	uint8_t * e;
-	uint8_t type;
-	uint8_t opt_len;
+  if ((uint8_t)(now - *window) >= DHCPS_RATE_WINDOW)
+  {
+    *window = now;
+    *count = 0;
+  }
 
-//	printf("%s(%d)\r\n", __FILE__, __LINE__);
-	if(getSn_SR(DHCPs_SOCKET) != SOCK_UDP)
-	   wiz_socket(DHCPs_SOCKET, Sn_MR_UDP, DHCP_SERVER_PORT, 0x00);
+  if (*count >= DHCPS_RATE_LIMIT)
+    return 1;
+  (*count)++;
+  return 0;
+}
+
+/**
+  * @brief  apply the per-MAC rate limit. A MAC with a lease is counted on the
+  *         lease, any other one on a slot it may have to share.
+  * @retval 1 if the message from mac must be dropped.
+  */
+static uint8_t dhcps_rate_limited(const uint8_t *mac)
+{
+  struct dhcps_lease *l = lease_by_mac(mac);
+  uint8_t slot;
+
+  if (l != NULL)
+    return dhcps_rate_take(&l->rate_count, &l->rate_window);
 
-  if((len = getSn_RX_RSR(DHCPs_SOCKET)) > 0)
+  slot = lease_hash(mac) & (DHCPS_RATE_SLOTS - 1);
+  if (memcmp(dhcps_rate[slot].chaddr, mac, HW_ADDRESS_LENGTH) != 0)
   {
-    len = sock_recvfrom(DHCPs_SOCKET, (uint8_t *)dhcp_message_repository, len, client_addr, &client_port);
-    printf("DHCP message : %d.%d.%d.%d(%d) %d received. \r\n", client_addr[0], client_addr[1], client_addr[2], client_addr[3], client_port, len);
+    memcpy(dhcps_rate[slot].chaddr, mac, HW_ADDRESS_LENGTH);
+    dhcps_rate[slot].window = (uint8_t)dhcps_tick_1s;
+    dhcps_rate[slot].count = 0;
   }
-  else
+  return dhcps_rate_take(&dhcps_rate[slot].count, &dhcps_rate[slot].window);
+}
+
+/**
+  * @brief  handle the client message in dhcp_message_repository.
+  * @retval 1 if a reply was sent, 0 otherwise.
+  */
+static uint8_t dhcps_handle_msg(uint16_t len)
+{
+  uint8_t sent = 0;
+
+  switch (dhcps_check_msg_and_handle_options(len))
   {
-    return 0;
+    case  DHCP_SERVER_STATE_OFFER:
+#if (debug_dhcps)
+      DLOG(DLOG_DHCPS_OFFER);
+#endif
+      sent = dhcps_send_offer();
+      break;
+    case DHCP_SERVER_STATE_ACK:
+#if (debug_dhcps)
+      DLOG(DLOG_DHCPS_ACK);
+#endif
+      sent = dhcps_send_ack();
+      dhcp_server_state_machine = DHCP_SERVER_STATE_IDLE;
+      break;
+    case DHCP_SERVER_STATE_NAK:
+#if (debug_dhcps)
+      DLOG(DLOG_DHCPS_NAK);
+#endif
+      sent = dhcps_send_nak();
+      dhcp_server_state_machine = DHCP_SERVER_STATE_IDLE;
+      break;
+    case DHCP_SERVER_STATE_RELEASE:
+      dhcp_server_state_machine = DHCP_SERVER_STATE_IDLE;
+      break;
   }
 
-  if(client_port == DHCP_CLIENT_PORT)
+  return sent;
+}
+
+/* UDP packet info the W5500 puts in front of every datagram in the RX buffer */
+#define DHCPS_UDP_HEAD_LEN	8
+
+/*
+ * The socket stays open; every call answers the datagrams queued in Sn_RX_RSR,
+ * at most DHCPS_MAX_BURST of them so the other sockets get a turn.
+ * Each datagram is first judged on its head, read in place from the RX buffer:
+ * one that is dropped anyway is skipped without being copied.
+ * Returns the number of datagrams handled.
+ */
+uint8_t dhcps_run(void)
+{
+	uint8_t client_addr[4];
+	uint16_t client_port;
+	uint16_t remain;
+	uint8_t head[DHCPS_UDP_HEAD_LEN + offsetof(dhcps_msg, chaddr) + HW_ADDRESS_LENGTH];
+	const uint8_t *msg = head + DHCPS_UDP_HEAD_LEN;
+	uint16_t dgram_len;
+	int32_t len;
+	uint8_t handled = 0;
+
+	if(getSn_SR(DHCPs_SOCKET) != SOCK_UDP)
+	   wiz_socket(DHCPs_SOCKET, Sn_MR_UDP, DHCP_SERVER_PORT, 0x00);
+
+  while (handled < DHCPS_MAX_BURST && getSn_RX_RSR(DHCPs_SOCKET) > 0)
   {
-    switch (dhcps_check_msg_and_handle_options(len))
+    handled++;
+    if (sock_peek(DHCPs_SOCKET, head, 0, sizeof(head)) < DHCPS_UDP_HEAD_LEN)
     {
-  		case  DHCP_SERVER_STATE_OFFER:
-        printf("DHCP_SERVER_STATE_OFFER\r\n");
-  			dhcps_send_offer();
-  			break;
-  		case DHCP_SERVER_STATE_ACK:
-        printf("DHCP_SERVER_STATE_ACK\r\n");
-  			dhcps_send_ack();
-#if (!IS_USE_FIXED_IP)
-  			mark_ip_in_table((uint8_t)ip4_addr4(&dhcps_allocated_client_address)); 			
+      dhcps_counters.dropped++;
+      break;
+    }
+    dhcps_counters.received++;
+
+    client_port = ((uint16_t)head[4] << 8) | head[5];
+    dgram_len = ((uint16_t)head[6] << 8) | head[7];
+    if (client_port != DHCP_CLIENT_PORT ||
+      dgram_len < offsetof(dhcps_msg, options) + sizeof(dhcp_magic_cookie) ||
+      msg[offsetof(dhcps_msg, op)] != DHCP_MESSAGE_OP_REQUEST)
+    {
+      dhcps_counters.dropped++;
+      sock_consume(DHCPs_SOCKET, DHCPS_UDP_HEAD_LEN + dgram_len);
+      continue;
+    }
+
+    if (dhcps_rate_limited(msg + offsetof(dhcps_msg, chaddr)))
+    {
+      dhcps_counters.rate_limited++;
+      sock_consume(DHCPs_SOCKET, DHCPS_UDP_HEAD_LEN + dgram_len);
+      continue;
+    }
+
+    len = sock_recvfrom(DHCPs_SOCKET, (uint8_t *)dhcp_message_repository, sizeof(dhcps_msg), client_addr, &client_port);
+    if (len <= 0)
+    {
+      dhcps_counters.dropped++;
+      break;
+    }
+
+    // Options past sizeof(dhcps_msg) are not parsed.
+    if (wiz_getsockopt(DHCPs_SOCKET, SO_REMAINSIZE, &remain) == SOCK_OK && remain > 0)
+      sock_consume(DHCPs_SOCKET, remain);
+
+#if (debug_dhcps)
+    DLOG(DLOG_DHCPS_MSG, client_addr[0], client_addr[1], client_addr[2], client_addr[3], client_port, len);
 #endif
-  			dhcp_server_state_machine = DHCP_SERVER_STATE_IDLE;
-  			break;
-  		case DHCP_SERVER_STATE_NAK:
-        printf("DHCP_SERVER_STATE_NAK\r\n");
-  			dhcps_send_nak();
-  			dhcp_server_state_machine = DHCP_SERVER_STATE_IDLE;
-  			break;
-  		case DHCP_OPTION_CODE_END:
-        printf("DHCP_OPTION_CODE_END\r\n");
-  			break;
-      case DHCP_SERVER_STATE_RELEASE:
-        unmark_ip_in_table();
-        dhcp_server_state_machine = DHCP_SERVER_STATE_IDLE;
-        break;
-		}
+
+    if (dhcps_handle_msg((uint16_t)len))
+      dhcps_counters.replied++;
   }
 
-  return 0;
+  if (handled > dhcps_counters.max_burst)
+    dhcps_counters.max_burst = handled;
 
+  return handled;
 }
 
-
+void dhcps_get_counters(dhcps_counter *counters)
+{
+  *counters = dhcps_counters;
+}
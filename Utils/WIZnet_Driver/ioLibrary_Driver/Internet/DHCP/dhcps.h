@@ -44,6 +44,7 @@
 #define DHCP_OPTION_LENGTH_THREE			(3)
 #define DHCP_OPTION_LENGTH_FOUR				(4)
 
+#define DHCP_OPTION_CODE_PAD           			(0)
 #define DHCP_OPTION_CODE_SUBNET_MASK   			(1)
 #define DHCP_OPTION_CODE_ROUTER        			(3)
 #define DHCP_OPTION_CODE_DNS_SERVER    			(6)
@@ -62,6 +63,17 @@
 
 #define HW_ADDRESS_LENGTH				(6)
 
+/* Datagrams handled per dhcps_run() call at most. */
+#define DHCPS_MAX_BURST					(16)
+
+/* Messages answered per client MAC in one rate window; the rest are dropped. */
+#define DHCPS_RATE_LIMIT				(4)
+#define DHCPS_RATE_WINDOW				(1)	/* seconds */
+#define DHCPS_RATE_SLOTS				(32)	/* MACs without a lease, power of two */
+
+/* Replies are sent up to the end option, but not shorter than a BOOTP message. */
+#define DHCPS_MIN_REPLY_LEN				(300)
+
 typedef struct ip_addr_t
 {
   uint32_t addr;
@@ -98,10 +110,36 @@ typedef struct dhcps_msg_t
 static const uint8_t dhcp_magic_cookie[4] = {99, 130, 83, 99};
 static const uint8_t dhcp_option_lease_time_one_day[] = {0x00, 0x01, 0x51, 0x80}; 
 static const uint8_t dhcp_option_interface_mtu_576[] = {0x02, 0x40};
-
-struct table {
-	uint32_t ip_range[4];
-  uint8_t chaddr[128][16];	/* Client hardware address */
+static const uint8_t dhcp_option_router_discovery_off[] = {0x00};
+
+/* Lease store. Leases are indexed by the host part (last octet) of the
+ * address, MACs are found through a hash of chained leases and free addresses
+ * are kept in a FIFO, so lookup and allocation do not scan the table.
+ * A released or expired lease remembers its MAC until the address is handed
+ * to someone else, so a returning client gets its old address back. */
+#define DHCPS_LEASE_HOSTS				(256)
+#define DHCPS_LEASE_HASH_SIZE				(64)
+
+#define DHCPS_LEASE_TIME				(86400)	/* seconds, matches dhcp_option_lease_time_one_day */
+#define DHCPS_OFFER_TIME				(60)	/* hold an offered address */
+#define DHCPS_DECLINE_TIME				(600)	/* quarantine a declined address */
+
+#define DHCPS_LEASE_FREE				(0)
+#define DHCPS_LEASE_OFFERED				(1)
+#define DHCPS_LEASE_BOUND				(2)
+#define DHCPS_LEASE_RESERVED				(3)	/* server, gateway, declined or outside the pool */
+
+struct dhcps_lease {
+	uint8_t chaddr[HW_ADDRESS_LENGTH];
+	uint8_t state;		/* DHCPS_LEASE_xxx */
+	uint8_t flags;
+	uint8_t next_hash;	/* host of the next lease in the hash chain, 0 = end */
+	uint8_t prev_free;	/* free FIFO links, 0 = end */
+	uint8_t next_free;
+	uint8_t next_dirty;	/* changed leases not yet reported, 0 = end */
+	uint8_t rate_count;	/* messages from chaddr in the current rate window */
+	uint8_t rate_window;	/* low byte of the dhcps tick the window started */
+	uint32_t expires;	/* dhcps tick, 0 = never */
 };
 
 struct address_pool{
@@ -109,28 +147,47 @@ struct address_pool{
 	uint32_t end;
 };
 
-/* 01~32 */
-#define MARK_RANGE1_IP_BIT(table, ip)	((table.ip_range[0]) | (1 << ((ip) - 1)))	 
-#define UNMARK_RANGE1_IP_BIT(table, ip)	((table.ip_range[0]) ^ (1 << ((ip) - 1)))	 
-
-/* 33~64 */
-#define MARK_RANGE2_IP_BIT(table, ip)	((table.ip_range[1]) | (1 << ((ip) - 1)))
-#define UNMARK_RANGE2_IP_BIT(table, ip)	((table.ip_range[1]) ^ (1 << ((ip) - 1)))
-
-/* 65~96 */
-#define MARK_RANGE3_IP_BIT(table, ip)	((table.ip_range[2]) | (1 << ((ip) - 1)))
-#define UNMARK_RANGE3_IP_BIT(table, ip)	((table.ip_range[2]) ^ (1 << ((ip) - 1)))
-
-/* 97~128 */
-#define MARK_RANGE4_IP_BIT(table, ip)	((table.ip_range[3]) | (1 << ((ip) - 1)))
-#define UNMARK_RANGE4_IP_BIT(table, ip)	((table.ip_range[3]) ^ (1 << ((ip) - 1)))
-
+/* A lease as seen by the application, e.g. to mirror it outside the RT core. */
+typedef struct dhcps_lease_info_t {
+	uint8_t chaddr[HW_ADDRESS_LENGTH];
+	uint8_t ip[4];
+	uint8_t bound;		/* 0: released, expired or declined */
+	uint32_t remaining;	/* seconds left on a bound lease */
+} dhcps_lease_info;
+
+typedef struct dhcps_counter_t {
+	uint32_t received;	/* datagrams read from the socket */
+	uint32_t replied;	/* OFFER, ACK and NAK sent */
+	uint32_t rate_limited;	/* dropped by the per-MAC rate limit */
+	uint32_t dropped;	/* not a client request, or the reply failed */
+	uint8_t  max_burst;	/* most datagrams handled in one dhcps_run() call */
+} dhcps_counter;
 
 /* expose API */
 void dhcps_set_addr_pool(int addr_pool_set, ip_addr * addr_pool_start, ip_addr *addr_pool_end);
+/* Serves the chip selected when it is called, dhcps_run() must run with that chip selected */
 void dhcps_init(uint8_t s, uint8_t * buf);
-static uint8_t search_mac();
 uint8_t dhcps_run(void);
+void dhcps_get_counters(dhcps_counter *counters);
+
+/* Call once a second, e.g. from a timer interrupt. */
+void dhcps_time_handler(void);
+/* Expire leases that ran out; call from the main loop. */
+void dhcps_lease_sweep(void);
+/* Take one lease whose binding changed since it was last taken.
+ * Returns 1 and fills info, 0 if nothing changed. */
+int8_t dhcps_lease_changed(dhcps_lease_info *info);
+/* Copy up to max changed leases, in the order dhcps_lease_changed takes them,
+ * without taking them. Returns how many were copied. */
+uint8_t dhcps_lease_changed_peek(dhcps_lease_info *info, uint8_t max);
+/* Take the first count changed leases, once a peek of them was delivered.
+ * No other dhcps call may run between the peek and the take. */
+void dhcps_lease_changed_take(uint8_t count);
+/* Report every bound lease again through dhcps_lease_changed. */
+void dhcps_lease_changed_all(void);
+/* Re-install a bound lease saved elsewhere, e.g. after an RT core restart.
+ * Returns 1 if installed, 0 if it conflicts with the current table. */
+int8_t dhcps_lease_restore(const dhcps_lease_info *info);
 
 #endif
 
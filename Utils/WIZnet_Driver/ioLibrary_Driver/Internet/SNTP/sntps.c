@@ -8,10 +8,18 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <time.h>
+#if defined(WIZCHIP_HOST_BUILD)
+// <arpa/inet.h> would clash with the socket API's names
+#include <endian.h>
+#define htonl(x)  htobe32(x)
+#define ntohl(x)  be32toh(x)
+#endif
 
 #include "sntps.h"
 #include "../../Ethernet/socket.h"
+#include "printf.h"
 
 ntpsformat NTPsformat;
 datetime Nowdatetime;
@@ -76,6 +84,24 @@ uint16_t ntp_retry_cnt=0; //counting the ntp retry number
 
 uint32_t timestamp = 0;
 
+static void (*sntps_clock_now)(ntp_timestamp *ts) = NULL;
+static int (*sntps_clock_rx_stamp)(ntp_timestamp *ts) = NULL;
+static void (*sntps_clock_sync)(uint32_t sec, uint32_t frac) = NULL;
+static int8_t sntps_precision = 0;
+static ntp_timestamp sntps_reference;   // last time sync from the HL app
+static sntps_counter sntps_counters;
+
+void reg_sntps_clock_cbfunc(void (*now)(ntp_timestamp *ts),
+                            int (*rx_stamp)(ntp_timestamp *ts),
+                            void (*sync)(uint32_t sec, uint32_t frac),
+                            int8_t precision)
+{
+  sntps_clock_now = now;
+  sntps_clock_rx_stamp = rx_stamp;
+  sntps_clock_sync = sync;
+  sntps_precision = precision;
+}
+
 
 void SNTPs_init(uint8_t s, uint8_t *buf)
 {
@@ -114,12 +140,18 @@ void SNTPs_init(uint8_t s, uint8_t *buf)
   timestamp = numberOfSecondsSince1900Epoch();
 }
 
+/*
+ * buf is "%Y-%m-%d %H:%M:%S", optionally followed by ".uuuuuu" microseconds.
+ */
 void SNTPs_sync_time(uint8_t *buf)
 {
   struct tm tm;
+  char *rest;
+  uint32_t us = 0;
+  uint32_t scale = 100000;
 
   // printf("SNTPs_sync_time: %s\r\n", buf);
-  if (strptime(buf, "%Y-%m-%d %H:%M:%S", &tm) == NULL) {
+  if ((rest = strptime((char *)buf, "%Y-%m-%d %H:%M:%S", &tm)) == NULL) {
     printf("time sync failed.\r\n");
   } else {
     Nowdatetime.yy = tm.tm_year+1900;
@@ -129,7 +161,18 @@ void SNTPs_sync_time(uint8_t *buf)
     Nowdatetime.mm = tm.tm_min;
     Nowdatetime.ss = tm.tm_sec;
 
-    timestamp = numberOfSecondsSince1900Epoch();
+    if (*rest == '.') {
+      for (rest++; *rest >= '0' && *rest <= '9' && scale > 0; rest++, scale /= 10)
+        us += (*rest - '0') * scale;
+    }
+
+    sntps_reference.second = numberOfSecondsSince1900Epoch();
+    sntps_reference.fraction = (uint32_t)(((uint64_t)us << 32) / 1000000);
+
+    if (sntps_clock_sync)
+      sntps_clock_sync(sntps_reference.second, sntps_reference.fraction);
+    else
+      timestamp = sntps_reference.second;
   }
 }
 
@@ -228,7 +271,25 @@ bool isLeapYear(uint32_t year)
     return (multipleOfFour && !(multipleOfOneHundred && !multipleOfFourHundred));
 }
 
-static int numDaysInMonths[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+// Date of the last numberOfSecondsSince1900Epoch() call and its day count.
+static uint16_t epoch_cache_yy;
+static uint8_t epoch_cache_mo, epoch_cache_dd;
+static uint32_t epoch_cache_days;
+
+/*
+ * Days from 1900-01-01 to yy-mo-dd, in closed form: years are counted from
+ * March so the leap day falls at the end of the year.
+ */
+static uint32_t daysSince1900(uint32_t yy, uint32_t mo, uint32_t dd)
+{
+  uint32_t y = yy - (mo <= 2);
+  uint32_t m = (mo + 9) % 12;                 // March = 0
+  uint32_t doy = (153 * m + 2) / 5 + dd - 1;  // day of the March-based year
+  uint32_t days = 365 * y + y / 4 - y / 100 + y / 400 + doy;
+
+  // The same formula gives 693901 for 1900-01-01.
+  return days - 693901;
+}
 
 uint32_t numberOfSecondsSince1900Epoch()
 {
@@ -247,31 +308,30 @@ uint32_t numberOfSecondsSince1900Epoch()
         (Nowdatetime.mm * SECONDS_IN_MINUTE) + 
         (Nowdatetime.hh * SECONDS_IN_MINUTE * MINUTES_IN_HOUR);
 
-  uint32_t numDays = 0;
-  for (uint32_t currentYear = EPOCH_YEAR; currentYear < Nowdatetime.yy; currentYear++)
+  if (Nowdatetime.yy != epoch_cache_yy || Nowdatetime.mo != epoch_cache_mo ||
+      Nowdatetime.dd != epoch_cache_dd)
   {
-      if (isLeapYear(currentYear))
-      {
-          numDays++;
-      }
+    epoch_cache_days = daysSince1900(Nowdatetime.yy, Nowdatetime.mo, Nowdatetime.dd);
+    epoch_cache_yy = Nowdatetime.yy;
+    epoch_cache_mo = Nowdatetime.mo;
+    epoch_cache_dd = Nowdatetime.dd;
   }
-  numDays += DAYS_IN_YEAR * (Nowdatetime.yy - EPOCH_YEAR);
-  for (uint32_t currentMonth = 0; currentMonth < Nowdatetime.mo - 1; currentMonth++)
-  {
-      numDays += numDaysInMonths[currentMonth];
-  }
-  numDays += Nowdatetime.dd - 1;
-  if (isLeapYear(Nowdatetime.yy) && Nowdatetime.mo > 2)
-  {
-      numDays++;
-  }
-  returnValue += numDays * SECONDS_IN_MINUTE * MINUTES_IN_HOUR * HOURS_IN_DAY;
+  returnValue += epoch_cache_days * SECONDS_IN_MINUTE * MINUTES_IN_HOUR * HOURS_IN_DAY;
 
   return returnValue;
 }
 
 void set_timestamp(uint32_t* sec, uint32_t* frac)
 {
+  ntp_timestamp now;
+
+  if (sntps_clock_now) {
+    sntps_clock_now(&now);
+    *sec = now.second;
+    *frac = now.fraction;
+    return;
+  }
+
   *sec = timestamp;
   *frac = 0;
   
@@ -291,34 +351,21 @@ void set_timestamp(uint32_t* sec, uint32_t* frac)
   #endif
 }
 
-int8_t SNTPs_run()
+/*
+ * Answer the request msg of len bytes. Returns 1 if a reply was sent.
+ */
+static int8_t SNTPs_reply(const uint8_t *msg, uint16_t len, uint8_t *destip, uint16_t destport,
+                          uint32_t recv_sec, uint32_t recv_frac)
 {
-
 //#define DEBUG_SNTPS_RUN
 
-	uint16_t RSR_len;
-	uint8_t destip[6];
-	uint16_t destport;
-  uint32_t recv_sec;
-  uint32_t recv_frac;
-
-	if(getSn_SR(NTPs_SOCKET) != SOCK_UDP)
-        wiz_socket(NTPs_SOCKET, Sn_MR_UDP, ntp_port, 0x00);
-
-	switch(getSn_SR(NTPs_SOCKET))
-	{
-  	case SOCK_UDP:
-  		if ((RSR_len = getSn_RX_RSR(NTPs_SOCKET)) > 0)
-  		{
-  		  set_timestamp(&recv_sec, &recv_frac);
-        
-  			if (RSR_len > MAX_SNTP_BUF_SIZE) RSR_len = MAX_SNTP_BUF_SIZE;	// if Rx data size is lager than TX_RX_MAX_BUF_SIZE
-            sock_recvfrom(NTPs_SOCKET, data_buf, RSR_len, (uint8_t *)&destip, &destport);
-#if 0
-        printf("NTP message : %d.%d.%d.%d(%d) %d received. \r\n", destip[0], destip[1], destip[2], destip[3], destport, RSR_len);
-#endif
+        if (len < sizeof(NTPsformat))
+          return 0;
+
+        memcpy(&NTPsformat, msg, sizeof(NTPsformat));
+        if (getmode() != 3) // only answer clients
+          return 0;
 
-        memcpy(&NTPsformat, &data_buf[8], sizeof(NTPsformat));
         #ifdef DEBUG_SNTPS_RUN
         printf("NTPformat.leap %#x\r\n", NTPformat.leapVersionMode);
         printf("NTPformat.version %#x\r\n", NTPformat.leapVersionMode);
@@ -342,7 +389,7 @@ int8_t SNTPs_run()
         NTPsformat.stratum = 2; // secondary reference
         #if 1
         NTPsformat.poll = 6;
-        NTPsformat.precision = 0;
+        NTPsformat.precision = sntps_precision;
         NTPsformat.rootDelay= 0;
         NTPsformat.rootDispersion= 0;
         #endif
@@ -351,10 +398,8 @@ int8_t SNTPs_run()
         NTPsformat.referenceId[2] = 0;
         NTPsformat.referenceId[3] = 1;
 
-        #if 0
-        //NTPsformat.referenceTimestampSeconds = 0;
-        //NTPsformat.referenceTimestampFraction = 0;
-        #endif
+        NTPsformat.referenceTimestampSeconds = sntps_reference.second;
+        NTPsformat.referenceTimestampFraction = sntps_reference.fraction;
 
         NTPsformat.originTimestampSeconds = NTPsformat.transmitTimestampSeconds;
         NTPsformat.originTimestampFraction = NTPsformat.transmitTimestampFraction;
@@ -366,19 +411,79 @@ int8_t SNTPs_run()
  
         swapEndian();
         
-        sock_sendto(NTPs_SOCKET, (uint8_t*)&NTPsformat, sizeof(NTPsformat), destip, destport);
-
-        close_socket(NTPs_SOCKET);
-
-  			return 1;
-  		}
-  		break;
-  	case SOCK_CLOSED:
-        wiz_socket(NTPs_SOCKET,Sn_MR_UDP,ntp_port,0);
-  		break;
-	}
-	// Return value
-	// 0 - failed / 1 - success
-	return 0;
+        if (sock_sendto(NTPs_SOCKET, (uint8_t*)&NTPsformat, sizeof(NTPsformat), destip, destport) <= 0)
+          return 0;
+
+        return 1;
 }
 
+/*
+ * The socket stays open; every call answers the datagrams queued in Sn_RX_RSR,
+ * at most SNTPS_MAX_BURST of them so the other sockets get a turn. They are
+ * read from the chip together, with a single RECV command.
+ * Returns the number of datagrams handled.
+ */
+int8_t SNTPs_run()
+{
+  wiz_dgram dgrams[SNTPS_MAX_BURST];
+  int32_t count;
+  uint8_t head[8];
+  uint8_t i;
+  ntp_timestamp rx, later;
+
+  switch(getSn_SR(NTPs_SOCKET))
+  {
+    case SOCK_UDP:
+      break;
+    case SOCK_CLOSED:
+      wiz_socket(NTPs_SOCKET, Sn_MR_UDP, ntp_port, 0);
+      return 0;
+    default:
+      return 0;
+  }
+
+  if (getSn_RX_RSR(NTPs_SOCKET) == 0)
+    return 0;
+
+  // The INTn capture belongs to the first datagram of the burst; the
+  // others arrived after it, but before they are read.
+  if (!sntps_clock_rx_stamp || sntps_clock_rx_stamp(&rx) != 0)
+    set_timestamp(&rx.second, &rx.fraction);
+  set_timestamp(&later.second, &later.fraction);
+
+  count = sock_recvfrom_batch(NTPs_SOCKET, dgrams, SNTPS_MAX_BURST, data_buf, SNTPS_BUF_SIZE);
+  if (count == SOCKERR_BUFFER)
+  {
+    // Far longer than a request, skip it
+    if (sock_peek(NTPs_SOCKET, head, 0, sizeof(head)) == sizeof(head))
+      sock_consume(NTPs_SOCKET, sizeof(head) + (((uint16_t)head[6] << 8) | head[7]));
+    sntps_counters.dropped++;
+    return 1;
+  }
+  if (count <= 0)
+    return 0;
+
+  for (i = 0; i < (uint8_t)count; i++)
+  {
+#if 0
+    printf("NTP message : %d.%d.%d.%d(%d) %d received. \r\n", dgrams[i].addr[0], dgrams[i].addr[1], dgrams[i].addr[2], dgrams[i].addr[3], dgrams[i].port, dgrams[i].len);
+#endif
+
+    // Extension fields and anything else past the 48-byte header are ignored.
+    if (SNTPs_reply(dgrams[i].data, dgrams[i].len, dgrams[i].addr, dgrams[i].port,
+                    i ? later.second : rx.second, i ? later.fraction : rx.fraction))
+      sntps_counters.served++;
+    else
+      sntps_counters.dropped++;
+  }
+
+  if (count > sntps_counters.max_burst)
+    sntps_counters.max_burst = (uint8_t)count;
+
+  return (int8_t)count;
+}
+
+void SNTPs_get_counters(sntps_counter *counters)
+{
+	*counters = sntps_counters;
+}
@@ -80,11 +80,41 @@ typedef struct _datetime
 #define EPOCH_YEAR 1900
 #define LEAP_SECOND_YEAR 1972
 
+/* Datagrams answered per SNTPs_run() call at most. */
+#define SNTPS_MAX_BURST 16
+
+/* The buffer passed to SNTPs_init() must hold SNTPS_BUF_SIZE bytes: a burst
+ * of requests is read into it at once, each with its 8-byte UDP header. */
+#define SNTPS_BUF_SIZE  (SNTPS_MAX_BURST * (8 + MAX_SNTP_BUF_SIZE))
+
+typedef struct
+{
+  uint32_t served;      ///< replies sent
+  uint32_t dropped;     ///< datagrams not answered: short, not a client request, or send failed
+  uint8_t  max_burst;   ///< most datagrams handled in one SNTPs_run() call
+} sntps_counter;
+
 void SNTPs_init(uint8_t s, uint8_t *buf);
 int8_t SNTPs_run();
+void SNTPs_get_counters(sntps_counter *counters);
 uint32_t numberOfSecondsSince1900Epoch();
 void SNTPs_sync_time(uint8_t *buf);
 
+/*
+ * @brief Register a high-resolution clock for the SNTP server.
+ * @param now       : returns the current time. Without it the server answers
+ *                    from the 1 s @ref timestamp counter with fraction 0.
+ * @param rx_stamp  : returns the time the last request was received and 0, or
+ *                    -1 if it has none; now is used then. May be NULL.
+ * @param sync      : steers the clock to the time given by the HL app. May be
+ *                    NULL, in which case @ref timestamp is set.
+ * @param precision : clock precision reported to clients, log2 seconds.
+ */
+void reg_sntps_clock_cbfunc(void (*now)(ntp_timestamp *ts),
+                            int (*rx_stamp)(ntp_timestamp *ts),
+                            void (*sync)(uint32_t sec, uint32_t frac),
+                            int8_t precision);
+
 #ifdef __cplusplus
 }
 #endif